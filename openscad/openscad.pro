@@ -156,6 +156,9 @@ CONFIG += opencsg
 CONFIG += boost
 CONFIG += eigen
 
+# zlib compresses the geometry disk cache
+LIBS += -lz
+
 #Uncomment the following line to enable QCodeEdit
 #CONFIG += qcodeedit
 
@@ -195,6 +198,7 @@ HEADERS += src/typedefs.h \
            src/renderer.h \
            src/rendersettings.h \
            src/ThrownTogetherRenderer.h \
+           src/GLMeshCache.h \
            src/CGAL_renderer.h \
            src/OGL_helper.h \
            src/QGLView.h \
@@ -218,7 +222,10 @@ HEADERS += src/typedefs.h \
            src/grid.h \
            src/highlighter.h \
            src/localscope.h \
+           src/instantiationcache.h \
+           src/hash.h \
            src/module.h \
+           src/recursioncount.h \
            src/node.h \
            src/csgnode.h \
            src/linearextrudenode.h \
@@ -232,6 +239,12 @@ HEADERS += src/typedefs.h \
            src/openscad.h \
            src/handle_dep.h \
            src/polyset.h \
+           src/voxelizer.h \
+           src/polygonindex.h \
+           src/screwplacer.h \
+           src/meshslicer.h \
+           src/marchingcubes.h \
+           src/indexedmesh.h \
            src/printutils.h \
            src/fileutils.h \
            src/value.h \
@@ -244,6 +257,7 @@ HEADERS += src/typedefs.h \
            src/nodedumper.h \
            src/ModuleCache.h \
            src/PolySetCache.h \
+           src/DiskCache.h \
            src/PolySetEvaluator.h \
            src/CSGTermEvaluator.h \
            src/Tree.h \
@@ -276,6 +290,8 @@ SOURCES += src/version_check.cc \
            src/expr.cc \
            src/func.cc \
            src/localscope.cc \
+           src/instantiationcache.cc \
+           src/hash.cc \
            src/module.cc \
            src/node.cc \
            src/context.cc \
@@ -310,6 +326,7 @@ SOURCES += src/version_check.cc \
            src/PolySetEvaluator.cc \
            src/ModuleCache.cc \
            src/PolySetCache.cc \
+           src/DiskCache.cc \
            src/Tree.cc \
            \
            src/rendersettings.cc \
@@ -325,8 +342,15 @@ SOURCES += src/version_check.cc \
            src/export.cc \
            src/export_png.cc \
            src/import.cc \
+           src/voxelizer.cc \
+           src/polygonindex.cc \
+           src/screwplacer.cc \
+           src/meshslicer.cc \
+           src/marchingcubes.cc \
+           src/indexedmesh.cc \
            src/renderer.cc \
            src/ThrownTogetherRenderer.cc \
+           src/GLMeshCache.cc \
            src/dxftess.cc \
            src/dxftess-glu.cc \
            src/dxftess-cgal.cc \
@@ -368,7 +392,8 @@ HEADERS += src/cgal.h \
            src/PolySetCGALEvaluator.h \
            src/CGALRenderer.h \
            src/CGAL_Nef_polyhedron.h \
-           src/cgalworker.h
+           src/cgalworker.h \
+           src/enclosure.h
 
 SOURCES += src/cgalutils.cc \
            src/CGALEvaluator.cc \
@@ -378,7 +403,8 @@ SOURCES += src/cgalutils.cc \
            src/CGAL_Nef_polyhedron.cc \
            src/CGAL_Nef_polyhedron_DxfData.cc \
            src/cgaladv_minkowski2.cc \
-           src/cgalworker.cc
+           src/cgalworker.cc \
+           src/enclosure.cc
 }
 
 macx {
@@ -2,8 +2,11 @@
 #define CGALCACHE_H_
 
 #include "cache.h"
+#include <boost/thread/mutex.hpp>
 
 /*!
+	All methods are thread-safe, so subtrees can be evaluated concurrently.
+	Misses fall back to the DiskCache, if it's enabled.
 */
 class CGALCache
 {
@@ -12,8 +15,8 @@ public:
 
 	static CGALCache *instance() { if (!inst) inst = new CGALCache; return inst; }
 
-	bool contains(const std::string &id) const { return this->cache.contains(id); }
-	const class CGAL_Nef_polyhedron &get(const std::string &id) const;
+	bool contains(const std::string &id) const;
+	bool get(const std::string &id, class CGAL_Nef_polyhedron &N);
 	bool insert(const std::string &id, const CGAL_Nef_polyhedron &N);
 	size_t maxSize() const;
 	void setMaxSize(size_t limit);
@@ -24,6 +27,7 @@ private:
 	static CGALCache *inst;
 
 	Cache<std::string, CGAL_Nef_polyhedron> cache;
+	mutable boost::mutex mutex;
 };
 
 #endif
@@ -12,6 +12,7 @@
 #include "dxfdata.h"
 #include "dxftess.h"
 #include "Tree.h"
+#include "progress.h"
 
 #include "CGALCache.h"
 #include "cgal.h"
@@ -35,7 +36,118 @@
 
 #include <boost/foreach.hpp>
 #include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+#include <boost/exception_ptr.hpp>
 #include <map>
+#include <vector>
+#include <algorithm>
+
+int cgal_threads = 1;
+
+namespace {
+	struct SubtreeJob {
+		SubtreeJob(const AbstractNode *node) : node(node), threads(1), done(false), cancelled(false) {}
+		const AbstractNode *node;
+		int threads;
+		CGAL_Nef_polyhedron N;
+		bool done, cancelled;
+	};
+
+	/*!
+		Returns the number of threads to use for threads, which is 0 for one
+		per core. Returns 1 if CGAL wasn't built with thread support.
+
+		CGAL_HAS_THREADS doesn't make the reference counts of Nef polyhedra
+		and their exact coordinates atomic. Polyhedra must therefore never be
+		shared between threads: workers only see deep copies of their
+		operands, and evaluate subtrees without CGALCache.
+	*/
+	int usable_threads(int threads)
+	{
+#ifdef CGAL_HAS_THREADS
+		if (threads <= 0) threads = boost::thread::hardware_concurrency();
+		return std::max(1, threads);
+#else
+		(void)threads;
+		return 1;
+#endif
+	}
+
+	/*!
+		Holds CGAL's error behaviour at THROW_EXCEPTION while in scope. The
+		behaviour is process-wide, so the save/restore pairs around single Nef
+		operations (e.g. in process()) would otherwise race between workers:
+		one thread could restore ABORT while another is still inside an
+		operation. Set once around the parallel section, all those pairs just
+		swap THROW_EXCEPTION for itself.
+	*/
+	void run_task(const boost::function<void()> &task, boost::exception_ptr *error)
+	{
+		try {
+			task();
+		}
+		catch (...) {
+			*error = boost::current_exception();
+		}
+	}
+
+	/*!
+		Runs the tasks on up to threads threads at a time. An exception thrown
+		by a task is rethrown here once the running tasks have finished; the
+		remaining tasks are skipped.
+	*/
+	void run_concurrently(const std::vector<boost::function<void()> > &tasks, int threads)
+	{
+		threads = usable_threads(threads);
+		if (threads < 2 || tasks.size() < 2) {
+			BOOST_FOREACH(const boost::function<void()> &task, tasks) task();
+			return;
+		}
+#if BOOST_VERSION >= 105000
+		boost::thread::attributes attrs;
+		attrs.set_stack_size(1024*1024); // Same as CGALWorker
+#endif
+		HoldCGALErrorBehaviour throw_on_error;
+		std::vector<boost::exception_ptr> errors(tasks.size());
+		for (size_t first = 0; first < tasks.size(); first += threads) {
+			size_t last = std::min(tasks.size(), first + threads);
+			boost::thread_group workers;
+			for (size_t i = first; i < last; i++) {
+				boost::function<void()> task = boost::bind(run_task, boost::cref(tasks[i]), &errors[i]);
+#if BOOST_VERSION >= 105000
+				workers.add_thread(new boost::thread(attrs, task));
+#else
+				workers.create_thread(task);
+#endif
+			}
+			workers.join_all();
+			for (size_t i = first; i < last; i++) {
+				if (errors[i]) boost::rethrow_exception(errors[i]);
+			}
+		}
+	}
+
+	bool lighter(const std::pair<const AbstractNode *, CGAL_Nef_polyhedron> &a,
+							 const std::pair<const AbstractNode *, CGAL_Nef_polyhedron> &b)
+	{
+		return a.second.weight() < b.second.weight();
+	}
+
+	void evaluate_subtree(const Tree &tree, SubtreeJob *job)
+	{
+		try {
+			CGALEvaluator evaluator(tree);
+			evaluator.threads = job->threads;
+			evaluator.isolated = true;
+			job->N = evaluator.evaluateCGALMesh(*job->node);
+			job->done = true;
+		}
+		catch (const ProgressCancelException &e) {
+			job->cancelled = true;
+		}
+	}
+}
 
 CGAL_Nef_polyhedron CGALEvaluator::evaluateCGALMesh(const AbstractNode &node)
 {
@@ -44,12 +156,71 @@ CGAL_Nef_polyhedron CGALEvaluator::evaluateCGALMesh(const AbstractNode &node)
 		evaluate.execute();
 		return this->root;
 	}
-	return CGALCache::instance()->get(this->tree.getIdString(node));
+	return takeCached(node);
 }
 
-bool CGALEvaluator::isCached(const AbstractNode &node) const
+/*!
+	Returns true if the result of node is known, either from a worker thread
+	or from CGALCache. The result is held on to until takeCached() is called,
+	so other threads can't evict it from CGALCache in the meantime.
+*/
+bool CGALEvaluator::isCached(const AbstractNode &node)
+{
+	if (this->cached.find(node.index()) != this->cached.end()) return true;
+	if (this->isolated) return false;
+	CGAL_Nef_polyhedron N;
+	if (!CGALCache::instance()->get(this->tree.getIdString(node), N)) return false;
+	this->cached[node.index()] = N;
+	return true;
+}
+
+CGAL_Nef_polyhedron CGALEvaluator::takeCached(const AbstractNode &node)
 {
-	return CGALCache::instance()->contains(this->tree.getIdString(node));
+	std::map<int, CGAL_Nef_polyhedron>::iterator it = this->cached.find(node.index());
+	assert(it != this->cached.end());
+	CGAL_Nef_polyhedron N = it->second;
+	this->cached.erase(it);
+	return N;
+}
+
+/*!
+	Evaluates the uncached children of node concurrently, each on its own
+	thread with its own evaluator. The traversal then finds the results through
+	isCached(), so applyToChildren() still combines them in child order.
+	The workers don't use CGALCache, so only whole subtrees get cached.
+*/
+void CGALEvaluator::evaluateChildren(const AbstractNode &node)
+{
+	int threads = usable_threads(this->threads);
+	if (threads < 2) return;
+
+	std::vector<SubtreeJob> jobs;
+	BOOST_FOREACH(const AbstractNode *chnode, node.getChildren()) {
+		// FIXME: Don't use deep access to modinst members
+		if (chnode->modinst->isBackground() || isCached(*chnode)) continue;
+		jobs.push_back(SubtreeJob(chnode));
+	}
+	if (jobs.size() < 2) return;
+
+	// Tree fills its caches lazily, which the workers mustn't do concurrently.
+	// Computing the ID of a node computes the IDs of its whole subtree.
+	BOOST_FOREACH(const SubtreeJob &job, jobs) this->tree.getIdString(*job.node);
+
+	// Share the threads among the subtrees running at the same time
+	int share = std::max(1, threads / int(std::min(jobs.size(), size_t(threads))));
+	std::vector<boost::function<void()> > tasks;
+	BOOST_FOREACH(SubtreeJob &job, jobs) {
+		job.threads = share;
+		tasks.push_back(boost::bind(evaluate_subtree, boost::cref(this->tree), &job));
+	}
+	run_concurrently(tasks, threads);
+
+	bool cancelled = false;
+	BOOST_FOREACH(const SubtreeJob &job, jobs) {
+		if (job.done) this->cached[job.node->index()] = job.N;
+		cancelled |= job.cancelled;
+	}
+	if (cancelled) throw ProgressCancelException();
 }
 
 /*!
@@ -65,7 +236,7 @@ void CGALEvaluator::process(CGAL_Nef_polyhedron &target, const CGAL_Nef_polyhedr
 	if (target.isEmpty() && op != CGE_UNION) return; // empty op <something> => empty
 	if (target.dim != src.dim) return; // If someone tries to e.g. union 2d and 3d objects
 
-	CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
+	CGAL::Failure_behaviour old_behaviour = set_cgal_error_behaviour(CGAL::THROW_EXCEPTION);
 	try {
 		switch (op) {
 		case CGE_UNION:
@@ -91,13 +262,15 @@ void CGALEvaluator::process(CGAL_Nef_polyhedron &target, const CGAL_Nef_polyhedr
 		// Errors can result in corrupt polyhedrons, so put back the old one
 		target = src;
 	}
-	CGAL::set_error_behaviour(old_behaviour);
+	set_cgal_error_behaviour(old_behaviour);
 }
 
 /*!
 */
 CGAL_Nef_polyhedron CGALEvaluator::applyToChildren(const AbstractNode &node, CGALEvaluator::CsgOp op)
 {
+	if (op == CGE_UNION || op == CGE_DIFFERENCE) return applyReduction(node, op);
+
 	CGAL_Nef_polyhedron N;
 	BOOST_FOREACH(const ChildItem &item, this->visitedchildren[node.index()]) {
 		const AbstractNode *chnode = item.first;
@@ -105,13 +278,7 @@ CGAL_Nef_polyhedron CGALEvaluator::applyToChildren(const AbstractNode &node, CGA
 		// FIXME: Don't use deep access to modinst members
 		if (chnode->modinst->isBackground()) continue;
 
-    // NB! We insert into the cache here to ensure that all children of
-    // a node is a valid object. If we inserted as we created them, the 
-    // cache could have been modified before we reach this point due to a large
-    // sibling object. 
-		if (!isCached(*chnode)) {
-			CGALCache::instance()->insert(this->tree.getIdString(*chnode), chN);
-		}
+		cacheChild(*chnode, chN);
 		// Initialize N on first iteration with first expected geometric object
 		if (N.isNull() && !N.isEmpty()) N = chN.copy();
 		else process(N, chN, op);
@@ -121,6 +288,104 @@ CGAL_Nef_polyhedron CGALEvaluator::applyToChildren(const AbstractNode &node, CGA
 	return N;
 }
 
+void CGALEvaluator::cacheChild(const AbstractNode &node, const CGAL_Nef_polyhedron &N)
+{
+	// NB! We insert into the cache here to ensure that all children of
+	// a node is a valid object. If we inserted as we created them, the 
+	// cache could have been modified before we reach this point due to a large
+	// sibling object. 
+	if (this->isolated) return;
+	const std::string &id = this->tree.getIdString(node);
+	if (!CGALCache::instance()->contains(id)) {
+		CGALCache::instance()->insert(id, N);
+	}
+}
+
+/*!
+	Applies union or difference to the children as a balanced reduction
+	rather than a left fold, which would merge an ever growing result with
+	one child at a time. A difference unions all its subtrahends first and
+	subtracts them from the first child once. The result is the same as the
+	left fold in applyToChildren().
+*/
+CGAL_Nef_polyhedron CGALEvaluator::applyReduction(const AbstractNode &node, CGALEvaluator::CsgOp op)
+{
+	ChildItem first(NULL, CGAL_Nef_polyhedron());
+	ChildList operands;
+	BOOST_FOREACH(const ChildItem &item, this->visitedchildren[node.index()]) {
+		const AbstractNode *chnode = item.first;
+		const CGAL_Nef_polyhedron &chN = item.second;
+		// FIXME: Don't use deep access to modinst members
+		if (chnode->modinst->isBackground()) continue;
+
+		cacheChild(*chnode, chN);
+		// The first expected geometric object decides the dimension
+		if (first.second.isNull() && !first.second.isEmpty()) {
+			if (first.first) first.first->progress_report();
+			first = item;
+		}
+		else if (chN.dim == first.second.dim && !chN.isNull()) {
+			operands.push_back(item);
+		}
+		else {
+			chnode->progress_report();
+		}
+	}
+	if (!first.first) return CGAL_Nef_polyhedron();
+
+	if (op == CGE_UNION) {
+		if (!first.second.isNull()) operands.push_front(first);
+		else first.first->progress_report();
+		if (operands.empty()) return first.second.copy();
+		return unionAll(operands);
+	}
+
+	CGAL_Nef_polyhedron N = first.second.copy();
+	first.first->progress_report();
+	if (!operands.empty()) process(N, unionAll(operands), CGE_DIFFERENCE);
+	return N;
+}
+
+/*!
+	Unions the items pairwise, lightest with next lightest, until one is
+	left. Items which still refer to a child node hold that child's result,
+	which mustn't be modified and may be shared with the CGALCache. With
+	more than one thread, the merges of each round run concurrently, on
+	detached copies of such items, so no two threads share any handles.
+*/
+CGAL_Nef_polyhedron CGALEvaluator::unionAll(ChildList &items)
+{
+	int threads = usable_threads(this->threads);
+	std::vector<ChildItem> round(items.begin(), items.end());
+	while (round.size() > 1) {
+		std::stable_sort(round.begin(), round.end(), lighter);
+		bool parallel = threads > 1 && round.size() > 3;
+		std::vector<boost::function<void()> > tasks;
+		for (size_t i = 0; i + 1 < round.size(); i += 2) {
+			if (parallel) {
+				if (round[i].first) round[i].second = round[i].second.detachedCopy();
+				if (round[i+1].first) round[i+1].second = round[i+1].second.detachedCopy();
+			}
+			else if (round[i].first) round[i].second = round[i].second.copy();
+			tasks.push_back(boost::bind(&CGALEvaluator::process, this,
+																	boost::ref(round[i].second), boost::cref(round[i+1].second), CGE_UNION));
+		}
+		run_concurrently(tasks, parallel ? threads : 1);
+
+		std::vector<ChildItem> next;
+		for (size_t i = 0; i + 1 < round.size(); i += 2) {
+			if (round[i].first) round[i].first->progress_report();
+			if (round[i+1].first) round[i+1].first->progress_report();
+			next.push_back(ChildItem(NULL, round[i].second));
+		}
+		if (round.size() % 2) next.push_back(round.back());
+		round.swap(next);
+	}
+	if (!round[0].first) return round[0].second;
+	round[0].first->progress_report();
+	return round[0].second.copy();
+}
+
 CGAL_Nef_polyhedron CGALEvaluator::applyHull(const CgaladvNode &node)
 {
 	CGAL_Nef_polyhedron N;
@@ -241,6 +506,35 @@ CGAL_Nef_polyhedron CGALEvaluator::applyResize(const CgaladvNode &node)
 	return N;
 }
 
+/*!
+	The volume swept by the children when moved along the node's direction
+	vector, i.e. their Minkowski sum with the line segment [0, length*direction].
+	This is exact: CGAL decomposes the object into convex parts and hulls each
+	part with its translated copy, so no tessellation or voxelization is
+	involved.
+*/
+CGAL_Nef_polyhedron CGALEvaluator::applySweep(const CgaladvNode &node)
+{
+	CGAL_Nef_polyhedron N;
+	N = applyToChildren(node, CGE_UNION);
+
+	if ( N.isNull() || N.isEmpty() ) return N;
+
+	if (N.dim != 3) {
+		PRINT("WARNING: sweep() currently only supports 3D objects.");
+		return N;
+	}
+	if (node.direction.norm() == 0 || node.length == 0) return N;
+
+	Vector3d v = node.direction.normalized() * node.length;
+	CGAL_Point_3 segment[2] = { CGAL_Point_3(0, 0, 0), CGAL_Point_3(v[0], v[1], v[2]) };
+	std::pair<CGAL_Point_3 *, CGAL_Point_3 *> polyline(segment, segment + 2);
+	CGAL_Nef_polyhedron path(new CGAL_Nef_polyhedron3(&polyline, &polyline + 1,
+																										CGAL_Nef_polyhedron3::Polylines_tag()));
+	process(N, path, CGE_MINKOWSKI);
+	return N;
+}
+
 
 
 /*
@@ -253,10 +547,11 @@ CGAL_Nef_polyhedron CGALEvaluator::applyResize(const CgaladvNode &node)
 Response CGALEvaluator::visit(State &state, const AbstractNode &node)
 {
 	if (state.isPrefix() && isCached(node)) return PruneTraversal;
+	if (state.isPrefix()) evaluateChildren(node);
 	if (state.isPostfix()) {
 		CGAL_Nef_polyhedron N;
 		if (!isCached(node)) N = applyToChildren(node, CGE_UNION);
-		else N = CGALCache::instance()->get(this->tree.getIdString(node));
+		else N = takeCached(node);
 		addToParent(state, node, N);
 	}
 	return ContinueTraversal;
@@ -265,10 +560,11 @@ Response CGALEvaluator::visit(State &state, const AbstractNode &node)
 Response CGALEvaluator::visit(State &state, const AbstractIntersectionNode &node)
 {
 	if (state.isPrefix() && isCached(node)) return PruneTraversal;
+	if (state.isPrefix()) evaluateChildren(node);
 	if (state.isPostfix()) {
 		CGAL_Nef_polyhedron N;
 		if (!isCached(node)) N = applyToChildren(node, CGE_INTERSECTION);
-		else N = CGALCache::instance()->get(this->tree.getIdString(node));
+		else N = takeCached(node);
 		addToParent(state, node, N);
 	}
 	return ContinueTraversal;
@@ -277,6 +573,7 @@ Response CGALEvaluator::visit(State &state, const AbstractIntersectionNode &node
 Response CGALEvaluator::visit(State &state, const CsgNode &node)
 {
 	if (state.isPrefix() && isCached(node)) return PruneTraversal;
+	if (state.isPrefix()) evaluateChildren(node);
 	if (state.isPostfix()) {
 		CGAL_Nef_polyhedron N;
 		if (!isCached(node)) {
@@ -297,7 +594,7 @@ Response CGALEvaluator::visit(State &state, const CsgNode &node)
 			N = applyToChildren(node, op);
 		}
 		else {
-			N = CGALCache::instance()->get(this->tree.getIdString(node));
+			N = takeCached(node);
 		}
 		addToParent(state, node, N);
 	}
@@ -307,6 +604,7 @@ Response CGALEvaluator::visit(State &state, const CsgNode &node)
 Response CGALEvaluator::visit(State &state, const TransformNode &node)
 {
 	if (state.isPrefix() && isCached(node)) return PruneTraversal;
+	if (state.isPrefix()) evaluateChildren(node);
 	if (state.isPostfix()) {
 		CGAL_Nef_polyhedron N;
 		if (!isCached(node)) {
@@ -320,7 +618,7 @@ Response CGALEvaluator::visit(State &state, const TransformNode &node)
 			N.transform( node.matrix );
 		}
 		else {
-			N = CGALCache::instance()->get(this->tree.getIdString(node));
+			N = takeCached(node);
 		}
 		addToParent(state, node, N);
 	}
@@ -342,7 +640,7 @@ Response CGALEvaluator::visit(State &state, const AbstractPolyNode &node)
 			}
 		}
 		else {
-			N = CGALCache::instance()->get(this->tree.getIdString(node));
+			N = takeCached(node);
 		}
 		addToParent(state, node, N);
 	}
@@ -352,6 +650,7 @@ Response CGALEvaluator::visit(State &state, const AbstractPolyNode &node)
 Response CGALEvaluator::visit(State &state, const CgaladvNode &node)
 {
 	if (state.isPrefix() && isCached(node)) return PruneTraversal;
+	if (state.isPrefix()) evaluateChildren(node);
 	if (state.isPostfix()) {
 		CGAL_Nef_polyhedron N;
 		if (!isCached(node)) {
@@ -375,10 +674,13 @@ Response CGALEvaluator::visit(State &state, const CgaladvNode &node)
 			case RESIZE:
 				N = applyResize(node);
 				break;
+			case SWEEP:
+				N = applySweep(node);
+				break;
 			}
 		}
 		else {
-			N = CGALCache::instance()->get(this->tree.getIdString(node));
+			N = takeCached(node);
 		}
 		addToParent(state, node, N);
 	}
@@ -398,8 +700,9 @@ void CGALEvaluator::addToParent(const State &state, const AbstractNode &node, co
 	}
 	else {
 		// Root node, insert into cache
-		if (!isCached(node)) {
-			if (!CGALCache::instance()->insert(this->tree.getIdString(node), N)) {
+		const std::string &id = this->tree.getIdString(node);
+		if (!this->isolated && !CGALCache::instance()->contains(id)) {
+			if (!CGALCache::instance()->insert(id, N)) {
 				PRINT("WARNING: CGAL Evaluator: Root node didn't fit into cache");
 			}
 		}
@@ -661,7 +964,7 @@ CGAL_Nef_polyhedron CGALEvaluator::evaluateCGALMesh(const PolySet &ps)
 	else // not (this->is2d)
 	{
 		CGAL_Nef_polyhedron3 *N = NULL;
-		CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
+		CGAL::Failure_behaviour old_behaviour = set_cgal_error_behaviour(CGAL::THROW_EXCEPTION);
 		try {
 			// FIXME: Are we leaking memory for the CGAL_Polyhedron object?
 			CGAL_Polyhedron *P = createPolyhedronFromPolySet(ps);
@@ -672,7 +975,7 @@ CGAL_Nef_polyhedron CGALEvaluator::evaluateCGALMesh(const PolySet &ps)
 		catch (const CGAL::Assertion_exception &e) {
 			PRINTB("CGAL error in CGAL_Nef_polyhedron3(): %s", e.what());
 		}
-		CGAL::set_error_behaviour(old_behaviour);
+		set_cgal_error_behaviour(old_behaviour);
 		return CGAL_Nef_polyhedron(N);
 	}
 	return CGAL_Nef_polyhedron();
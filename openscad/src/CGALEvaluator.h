@@ -9,11 +9,14 @@
 #include <map>
 #include <list>
 
+// Default number of threads of a CGALEvaluator, 0 for one per core
+extern int cgal_threads;
+
 class CGALEvaluator : public Visitor
 {
 public:
 	enum CsgOp {CGE_UNION, CGE_INTERSECTION, CGE_DIFFERENCE, CGE_MINKOWSKI};
-	CGALEvaluator(const class Tree &tree) : tree(tree), psevaluator(*this) {}
+	CGALEvaluator(const class Tree &tree) : tree(tree), psevaluator(*this), threads(cgal_threads), isolated(false) {}
   virtual ~CGALEvaluator() {}
 
   virtual Response visit(State &state, const AbstractNode &node);
@@ -30,16 +33,24 @@ public:
 
 private:
   void addToParent(const State &state, const AbstractNode &node, const CGAL_Nef_polyhedron &N);
-  bool isCached(const AbstractNode &node) const;
+  bool isCached(const AbstractNode &node);
+	CGAL_Nef_polyhedron takeCached(const AbstractNode &node);
+	void evaluateChildren(const AbstractNode &node);
 	void process(CGAL_Nef_polyhedron &target, const CGAL_Nef_polyhedron &src, CGALEvaluator::CsgOp op);
 	CGAL_Nef_polyhedron applyToChildren(const AbstractNode &node, CGALEvaluator::CsgOp op);
+	CGAL_Nef_polyhedron applyReduction(const AbstractNode &node, CGALEvaluator::CsgOp op);
+	void cacheChild(const AbstractNode &node, const CGAL_Nef_polyhedron &N);
 	CGAL_Nef_polyhedron applyHull(const CgaladvNode &node);
 	CGAL_Nef_polyhedron applyResize(const CgaladvNode &node);
+	CGAL_Nef_polyhedron applySweep(const CgaladvNode &node);
 
 	std::string currindent;
   typedef std::pair<const AbstractNode *, CGAL_Nef_polyhedron> ChildItem;
   typedef std::list<ChildItem> ChildList;
+	CGAL_Nef_polyhedron unionAll(ChildList &items);
 	std::map<int, ChildList> visitedchildren;
+	// Results looked up in CGALCache or evaluated by worker threads, keyed by node index
+	std::map<int, CGAL_Nef_polyhedron> cached;
 
 	const Tree &tree;
 	CGAL_Nef_polyhedron root;
@@ -47,6 +58,13 @@ public:
 	// FIXME: Do we need to make this visible? Used for cache management
  // Note: psevaluator constructor needs this->tree to be initialized first
 	PolySetCGALEvaluator psevaluator;
+
+	// Number of threads for independent subtrees and merges. 1 = sequential,
+	// 0 = one per core
+	int threads;
+	// Set for the evaluators of worker threads, which must not share
+	// polyhedra with other threads and so don't use CGALCache
+	bool isolated;
 };
 
 #endif
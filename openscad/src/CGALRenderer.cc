@@ -32,6 +32,7 @@
 // dxfdata.h must come first for Eigen SIMD alignment issues
 #include "dxfdata.h"
 #include "polyset.h"
+#include "GLMeshCache.h"
 
 #include "CGALRenderer.h"
 #include "CGAL_renderer.h"
@@ -45,18 +46,16 @@ CGALRenderer::CGALRenderer(const CGAL_Nef_polyhedron &root) : root(root)
 {
 	if (this->root.isNull()) {
 		this->polyhedron = NULL;
-		this->polyset = NULL;
 	}
 	else if (root.dim == 2) {
 		DxfData *dd = root.convertToDxfData();
 		this->polyhedron = NULL;
-		this->polyset = new PolySet();
+		this->polyset.reset(new PolySet());
 		this->polyset->is2d = true;
-		dxf_tesselate(this->polyset, *dd, 0, Vector2d(1,1), true, false, 0);
+		dxf_tesselate(this->polyset.get(), *dd, 0, Vector2d(1,1), true, false, 0);
 		delete dd;
 	}
 	else if (root.dim == 3) {
-		this->polyset = NULL;
 		this->polyhedron = new Polyhedron();
     // FIXME: Make independent of Preferences
 		// this->polyhedron->setColor(Polyhedron::CGAL_NEF3_MARKED_FACET_COLOR,
@@ -75,7 +74,6 @@ CGALRenderer::CGALRenderer(const CGAL_Nef_polyhedron &root) : root(root)
 
 CGALRenderer::~CGALRenderer()
 {
-	delete this->polyset;
 	delete this->polyhedron;
 }
 
@@ -88,13 +86,23 @@ void CGALRenderer::draw(bool showfaces, bool showedges) const
 // FIXME:		const QColor &col = Preferences::inst()->color(Preferences::CGAL_FACE_2D_COLOR);
 		glColor3f(0.0f, 0.75f, 0.60f);
 		
-		for (size_t i=0; i < this->polyset->polygons.size(); i++) {
-			glBegin(GL_POLYGON);
-			for (size_t j=0; j < this->polyset->polygons[i].size(); j++) {
-				const Vector3d &p = this->polyset->polygons[i][j];
-				glVertex3d(p[0], p[1], -0.1);
+		GLMeshCache *cache = GLMeshCache::current();
+		const GLMesh *mesh = cache ? cache->get(this->polyset) : NULL;
+		if (mesh) {
+			glPushMatrix();
+			glTranslated(0, 0, -0.1);
+			mesh->drawSurface(false);
+			glPopMatrix();
+		}
+		else {
+			for (size_t i=0; i < this->polyset->polygons.size(); i++) {
+				glBegin(GL_POLYGON);
+				for (size_t j=0; j < this->polyset->polygons[i].size(); j++) {
+					const Vector3d &p = this->polyset->polygons[i][j];
+					glVertex3d(p[0], p[1], -0.1);
+				}
+				glEnd();
 			}
-			glEnd();
 		}
 		
 		typedef CGAL_Nef_polyhedron2::Explorer Explorer;
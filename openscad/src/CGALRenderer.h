@@ -2,6 +2,7 @@
 #define CGALRENDERER_H_
 
 #include "renderer.h"
+#include "memory.h"
 
 class CGALRenderer : public Renderer
 {
@@ -13,7 +14,7 @@ public:
 public:
 	const CGAL_Nef_polyhedron &root;
 	class Polyhedron *polyhedron;
-	class PolySet *polyset;
+	shared_ptr<class PolySet> polyset;
 };
 
 #endif
@@ -6,6 +6,8 @@
 #include "dxfdata.h"
 #include "dxftess.h"
 
+#include <sstream>
+
 CGAL_Nef_polyhedron::CGAL_Nef_polyhedron(CGAL_Nef_polyhedron2 *p)
 {
 	if (p) {
@@ -95,7 +97,7 @@ PolySet *CGAL_Nef_polyhedron::convertToPolyset()
 		delete dd;
 	}
 	else if (this->dim == 3) {
-		CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
+		CGAL::Failure_behaviour old_behaviour = set_cgal_error_behaviour(CGAL::THROW_EXCEPTION);
 		try {
 			CGAL_Polyhedron P;
 			this->p3->convert_to_Polyhedron(P);
@@ -104,7 +106,7 @@ PolySet *CGAL_Nef_polyhedron::convertToPolyset()
 		catch (const CGAL::Precondition_exception &e) {
 			PRINTB("CGAL error in CGAL_Nef_polyhedron::convertToPolyset(): %s", e.what());
 		}
-		CGAL::set_error_behaviour(old_behaviour);
+		set_cgal_error_behaviour(old_behaviour);
 	}
 	return ps;
 }
@@ -119,3 +121,26 @@ CGAL_Nef_polyhedron CGAL_Nef_polyhedron::copy() const
 	else if (copy.p3) copy.p3.reset(new CGAL_Nef_polyhedron3(*copy.p3));
 	return copy;
 }
+
+/*!
+	Copy which shares nothing with this one, not even the reference counted
+	exact coordinates, which copy() and the boolean operations share. Such a
+	copy may be used on another thread while this one is in use. It goes
+	through CGAL's text format, so it is much slower than copy().
+*/
+CGAL_Nef_polyhedron CGAL_Nef_polyhedron::detachedCopy() const
+{
+	CGAL_Nef_polyhedron copy(this->dim);
+	std::stringstream stream;
+	if (this->p2) {
+		stream << *this->p2;
+		copy.p2.reset(new CGAL_Nef_polyhedron2);
+		stream >> *copy.p2;
+	}
+	else if (this->p3) {
+		stream << *this->p3;
+		copy.p3.reset(new CGAL_Nef_polyhedron3);
+		stream >> *copy.p3;
+	}
+	return copy;
+}
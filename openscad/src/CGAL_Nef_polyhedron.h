@@ -24,6 +24,7 @@ public:
 	CGAL_Nef_polyhedron &operator-=(const CGAL_Nef_polyhedron &other);
 	CGAL_Nef_polyhedron &minkowski(const CGAL_Nef_polyhedron &other);
 	CGAL_Nef_polyhedron copy() const;
+	CGAL_Nef_polyhedron detachedCopy() const;
 	std::string dump() const;
 	int weight() const;
 	class PolySet *convertToPolyset();
@@ -0,0 +1,318 @@
+#include "DiskCache.h"
+#include "printutils.h"
+#include "boosty.h"
+#ifdef WIN32
+typedef unsigned __int64 uint64_t;
+#else
+#include <stdint.h>
+#endif
+
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <ctime>
+#include <string.h>
+#include <zlib.h>
+#include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+DiskCache *DiskCache::inst = NULL;
+
+static const char MAGIC[4] = {'O', 'S', 'D', 'C'};
+static const char *EXTENSION = ".cache";
+
+// write() waits for the writer thread while more data than this is queued
+static const size_t MAX_QUEUED = 256*1024*1024;
+
+DiskCache::~DiskCache()
+{
+	{
+		boost::mutex::scoped_lock lock(this->mutex);
+		this->stopping = true;
+	}
+	this->queuechanged.notify_all();
+	if (this->writer) {
+		this->writer->join();
+		delete this->writer;
+	}
+}
+
+/*!
+	Returns true if id is a node ID, i.e. a content address. Other keys,
+	e.g. the textual keys of meshes cached by the enclosure code, aren't
+	persisted.
+*/
+bool DiskCache::isCacheableId(const std::string &id)
+{
+	if (id.size() != 32) return false;
+	BOOST_FOREACH(char c, id) {
+		if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return false;
+	}
+	return true;
+}
+
+std::string DiskCache::path(const std::string &key) const
+{
+	return boosty::stringy(fs::path(this->dir) / (key + EXTENSION));
+}
+
+/*!
+	Adds an entry of size bytes as the most recently used one. Must be
+	called with the mutex held.
+*/
+void DiskCache::add(const std::string &key, size_t size)
+{
+	Entry &e = this->entries[key];
+	e.size = size;
+	e.use = this->uses.insert(this->uses.end(), key);
+	this->total += size;
+}
+
+/*!
+	Uses dir as cache directory, creating it if necessary, and indexes the
+	entries already in there. An empty dir disables the cache. The last use
+	of an entry is kept in the modification time of its file, so the order
+	of eviction survives restarts.
+*/
+bool DiskCache::setDirectory(const std::string &dir)
+{
+	flush();
+	boost::mutex::scoped_lock lock(this->mutex);
+	this->dir.clear();
+	this->entries.clear();
+	this->uses.clear();
+	this->total = 0;
+	if (dir.empty()) return true;
+
+	std::vector<std::pair<std::time_t, std::pair<std::string, size_t> > > found;
+	try {
+		fs::path p(dir);
+		if (!fs::exists(p)) fs::create_directories(p);
+		for (fs::directory_iterator it(p); it != fs::directory_iterator(); ++it) {
+			if (!fs::is_regular_file(it->status())) continue;
+			std::string name = boosty::stringy(it->path().filename());
+			if (!boost::algorithm::ends_with(name, EXTENSION)) continue;
+			found.push_back(std::make_pair(fs::last_write_time(it->path()),
+																		 std::make_pair(name.substr(0, name.size() - strlen(EXTENSION)),
+																										size_t(fs::file_size(it->path())))));
+		}
+	}
+	catch (const fs::filesystem_error &e) {
+		PRINTB("WARNING: Can't use disk cache directory %s: %s", dir % e.what());
+		return false;
+	}
+	std::sort(found.begin(), found.end());
+	for (size_t i = 0; i < found.size(); i++) add(found[i].second.first, found[i].second.second);
+	this->dir = dir;
+	trim(this->limit);
+	return true;
+}
+
+bool DiskCache::contains(const std::string &key) const
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	return this->entries.find(key) != this->entries.end();
+}
+
+/*!
+	Reads and decompresses the entry for key into data. Reading an entry
+	marks it as most recently used.
+*/
+bool DiskCache::read(const std::string &key, std::string &data)
+{
+	std::string filename;
+	{
+		boost::mutex::scoped_lock lock(this->mutex);
+		EntryMap::iterator it = this->entries.find(key);
+		if (it == this->entries.end()) return false;
+		this->uses.splice(this->uses.end(), this->uses, it->second.use);
+		filename = path(key);
+	}
+
+	std::ifstream f(filename.c_str(), std::ios::in | std::ios::binary);
+	std::string blob((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+	bool ok = f.good() || f.eof();
+	uLongf length = 0;
+	if (ok && blob.size() >= 12 && std::equal(MAGIC, MAGIC + 4, blob.begin())) {
+		uint64_t size = 0;
+		for (int i = 11; i >= 4; i--) size = (size << 8) | (unsigned char)blob[i];
+		// zlib can't compress better than about 1:1032
+		ok = size / 1032 <= blob.size();
+		length = uLongf(size);
+		if (ok) data.resize(length);
+		ok = ok && uncompress((Bytef *)&data[0], &length, (const Bytef *)&blob[12], blob.size() - 12) == Z_OK &&
+			length == data.size();
+	}
+	else {
+		ok = false;
+	}
+	if (!ok) {
+		PRINTB("WARNING: Removing corrupt disk cache entry %s", key);
+		remove(key);
+		return false;
+	}
+
+	try {
+		fs::last_write_time(fs::path(filename), time(NULL));
+	}
+	catch (const fs::filesystem_error &) {
+	}
+	return true;
+}
+
+/*!
+	Queues data to be stored under key, unless key is already cached. The
+	writer thread compresses it and evicts the least recently used entries
+	if the cache gets too large.
+*/
+void DiskCache::write(const std::string &key, const std::string &data)
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	if (!enabled() || data.size() > this->limit ||
+			this->entries.find(key) != this->entries.end() ||
+			this->pending.find(key) != this->pending.end()) return;
+	while (this->queued > 0 && this->queued + data.size() > MAX_QUEUED) this->queuechanged.wait(lock);
+	if (this->entries.find(key) != this->entries.end() || !this->pending.insert(key).second) return;
+
+	// Copies data only once
+	this->queue.push_back(std::make_pair(key, std::string()));
+	this->queue.back().second = data;
+	this->queued += data.size();
+	if (!this->writer) this->writer = new boost::thread(boost::bind(&DiskCache::writeQueued, this));
+	this->queuechanged.notify_all();
+}
+
+/*!
+	Waits until all queued entries are written.
+*/
+void DiskCache::flush()
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	while (!this->pending.empty()) this->queuechanged.wait(lock);
+}
+
+/*!
+	Compresses data into a file named filename. Returns the size of the
+	file, or 0 on failure.
+*/
+static size_t store(const std::string &filename, const std::string &data)
+{
+	uLongf length = compressBound(data.size());
+	std::vector<char> blob(12 + length);
+	std::copy(MAGIC, MAGIC + 4, blob.begin());
+	uint64_t size = data.size();
+	for (int i = 4; i < 12; i++, size >>= 8) blob[i] = char(size & 0xff);
+	bool ok = compress2((Bytef *)&blob[12], &length, (const Bytef *)data.data(), data.size(), Z_BEST_SPEED) == Z_OK;
+
+	// Write to a temporary file first, so readers never see partial entries
+	std::string tmpname = filename + ".tmp";
+	if (ok) {
+		std::ofstream f(tmpname.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		f.write(&blob[0], 12 + length);
+		f.close();
+		ok = !f.fail();
+	}
+	try {
+		if (ok) fs::rename(fs::path(tmpname), fs::path(filename));
+		else if (fs::exists(fs::path(tmpname))) fs::remove(fs::path(tmpname));
+	}
+	catch (const fs::filesystem_error &e) {
+		ok = false;
+	}
+	return ok ? 12 + length : 0;
+}
+
+/*!
+	Body of the writer thread. Writes the queued entries until the cache is
+	destroyed.
+*/
+void DiskCache::writeQueued()
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	for (;;) {
+		while (this->queue.empty() && !this->stopping) this->queuechanged.wait(lock);
+		if (this->queue.empty()) return;
+
+		std::pair<std::string, std::string> item;
+		item.swap(this->queue.front());
+		this->queue.pop_front();
+		std::string filename = path(item.first);
+		lock.unlock();
+		size_t size = store(filename, item.second);
+		lock.lock();
+
+		this->queued -= item.second.size();
+		this->pending.erase(item.first);
+		if (size == 0) {
+			PRINTB("WARNING: Unable to write disk cache entry %s", filename);
+		}
+		else {
+			add(item.first, size);
+			trim(this->limit);
+		}
+		this->queuechanged.notify_all();
+	}
+}
+
+void DiskCache::remove(const std::string &key)
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	EntryMap::iterator it = this->entries.find(key);
+	if (it == this->entries.end()) return;
+	this->total -= it->second.size;
+	this->uses.erase(it->second.use);
+	this->entries.erase(it);
+	try {
+		fs::remove(fs::path(path(key)));
+	}
+	catch (const fs::filesystem_error &) {
+	}
+}
+
+/*!
+	Evicts the least recently used entries until the total size is at most
+	limit. Must be called with the mutex held.
+*/
+void DiskCache::trim(size_t limit)
+{
+	while (this->total > limit && !this->uses.empty()) {
+		EntryMap::iterator oldest = this->entries.find(this->uses.front());
+		try {
+			fs::remove(fs::path(path(oldest->first)));
+		}
+		catch (const fs::filesystem_error &) {
+		}
+		this->total -= oldest->second.size;
+		this->entries.erase(oldest);
+		this->uses.pop_front();
+	}
+}
+
+size_t DiskCache::maxSize() const
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	return this->limit;
+}
+
+void DiskCache::setMaxSize(size_t limit)
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	this->limit = limit;
+	trim(limit);
+}
+
+void DiskCache::clear()
+{
+	flush();
+	boost::mutex::scoped_lock lock(this->mutex);
+	trim(0);
+}
+
+void DiskCache::print()
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	if (!enabled()) return;
+	PRINTB("Disk cache entries: %d", this->entries.size());
+	PRINTB("Disk cache size in bytes: %d", this->total);
+}
@@ -0,0 +1,86 @@
+#ifndef DISKCACHE_H_
+#define DISKCACHE_H_
+
+#include <string>
+#include <map>
+#include <set>
+#include <list>
+#include <deque>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace boost { class thread; }
+
+/*!
+	Persistent, content-addressed cache of serialized geometry and parsed
+	library modules.
+
+	Each entry is a zlib compressed file in a cache directory, named by its
+	key. Keys are node IDs (see Tree::getIdString()) with a prefix for the
+	kind of object, so an entry stays valid for as long as the subtree it
+	was computed from is unchanged. Import nodes include the timestamp of
+	their file in their ID, and nodes holding a mesh from memory a hash of
+	it (see MeshNode). Modules are keyed by a hash of their
+	source (see ModuleCache).
+
+	The total size of the directory is capped; the least recently used
+	entries are evicted first. Entries are compressed and written by a
+	background thread, so write() only waits if a lot of data is queued.
+	flush() waits for the queue to be written. The cache is disabled until
+	a directory is set. All methods are thread-safe.
+*/
+class DiskCache
+{
+public:
+	DiskCache(size_t limit = 1024*1024*1024) : limit(limit), total(0), queued(0), stopping(false), writer(NULL) {}
+	~DiskCache();
+
+	static DiskCache *instance() { if (!inst) inst = new DiskCache; return inst; }
+
+	static bool isCacheableId(const std::string &id);
+
+	bool setDirectory(const std::string &dir);
+	const std::string &directory() const { return this->dir; }
+	bool enabled() const { return !this->dir.empty(); }
+
+	bool contains(const std::string &key) const;
+	bool read(const std::string &key, std::string &data);
+	void write(const std::string &key, const std::string &data);
+	void remove(const std::string &key);
+	void flush();
+
+	size_t maxSize() const;
+	void setMaxSize(size_t limit);
+	void clear();
+	void print();
+
+private:
+	static DiskCache *inst;
+
+	typedef std::list<std::string> UseList;
+	struct Entry {
+		size_t size;
+		UseList::iterator use;
+	};
+	typedef std::map<std::string, Entry> EntryMap;
+
+	std::string path(const std::string &key) const;
+	void add(const std::string &key, size_t size);
+	void trim(size_t limit);
+	void writeQueued();
+
+	std::string dir;
+	size_t limit;
+	size_t total;
+	EntryMap entries;
+	UseList uses; // Keys of the entries, least recently used first
+	std::set<std::string> pending; // Keys queued or being written
+	std::deque<std::pair<std::string, std::string> > queue;
+	size_t queued; // Bytes of data in the queue
+	bool stopping;
+	boost::thread *writer;
+	boost::condition_variable queuechanged;
+	mutable boost::mutex mutex;
+};
+
+#endif
@@ -0,0 +1,266 @@
+#include "GLMeshCache.h"
+
+#include <boost/foreach.hpp>
+
+GLMeshCache *GLMeshCache::curr = NULL;
+
+namespace {
+	// Vertex layout: all positions and normals first, so plain drawing
+	// only reads that block, followed by the shader attributes
+	const int SURFACE_FLOATS = 6;
+	const int SHADER_FLOATS = 12;
+
+	class GLMeshBuilder
+	{
+	public:
+		std::vector<GLfloat> surface, shader;
+		std::vector<GLuint> triangles, mirrored, edges;
+
+		/*!
+			Adds the triangle p0,p1,p2 with the given edge flags, as
+			gl_draw_triangle() in polyset.cc draws it. Returns the index of
+			the vertex of p0; p1 and p2 follow.
+		*/
+		GLuint addTriangle(const Vector3d &p0, const Vector3d &p1, const Vector3d &p2, bool e0, bool e1, bool e2) {
+			double ax = p1[0] - p0[0], bx = p1[0] - p2[0];
+			double ay = p1[1] - p0[1], by = p1[1] - p2[1];
+			double az = p1[2] - p0[2], bz = p1[2] - p2[2];
+			double nx = ay*bz - az*by;
+			double ny = az*bx - ax*bz;
+			double nz = ax*by - ay*bx;
+			double nl = sqrt(nx*nx + ny*ny + nz*nz);
+			if (nl > 0) nx /= nl, ny /= nl, nz /= nl;
+
+			GLuint base = this->surface.size() / SURFACE_FLOATS;
+			const Vector3d *p[3] = { &p0, &p1, &p2 };
+			for (int i = 0; i < 3; i++) {
+				const Vector3d &b = *p[i == 0 ? 1 : 0], &c = *p[i == 2 ? 1 : 2];
+				GLfloat s[SURFACE_FLOATS] = { GLfloat((*p[i])[0]), GLfloat((*p[i])[1]), GLfloat((*p[i])[2]),
+																			 GLfloat(nx), GLfloat(ny), GLfloat(nz) };
+				GLfloat a[SHADER_FLOATS] = { e0 ? 2.0f : -1.0f, e1 ? 2.0f : -1.0f, e2 ? 2.0f : -1.0f,
+																		 GLfloat(b[0]), GLfloat(b[1]), GLfloat(b[2]),
+																		 GLfloat(c[0]), GLfloat(c[1]), GLfloat(c[2]),
+																		 i == 2 ? 1.0f : 0.0f, i == 0 ? 1.0f : 0.0f, i == 1 ? 1.0f : 0.0f };
+				this->surface.insert(this->surface.end(), s, s + SURFACE_FLOATS);
+				this->shader.insert(this->shader.end(), a, a + SHADER_FLOATS);
+			}
+			GLuint t[3] = { base, base + 1, base + 2 };
+			GLuint m[3] = { base, base + 2, base + 1 };
+			this->triangles.insert(this->triangles.end(), t, t + 3);
+			this->mirrored.insert(this->mirrored.end(), m, m + 3);
+			return base;
+		}
+
+		void addPolygon(const PolySet::Polygon &poly) {
+			size_t n = poly.size();
+			if (n < 3) return;
+			std::vector<GLuint> corners(n);
+			if (n == 3) {
+				GLuint b = addTriangle(poly[0], poly[1], poly[2], true, true, true);
+				for (int i = 0; i < 3; i++) corners[i] = b + i;
+			}
+			else if (n == 4) {
+				GLuint b = addTriangle(poly[0], poly[1], poly[3], true, false, true);
+				corners[0] = b, corners[1] = b + 1, corners[3] = b + 2;
+				corners[2] = addTriangle(poly[2], poly[3], poly[1], true, false, true);
+			}
+			else {
+				Vector3d center = Vector3d::Zero();
+				for (size_t j = 0; j < n; j++) center += poly[j];
+				center /= n;
+				for (size_t j = 1; j <= n; j++) {
+					corners[j - 1] = addTriangle(center, poly[j - 1], poly[j % n], false, true, false) + 1;
+				}
+			}
+			for (size_t j = 0; j < n; j++) {
+				this->edges.push_back(corners[j]);
+				this->edges.push_back(corners[(j + 1) % n]);
+			}
+		}
+	};
+
+	const GLvoid *buffer_offset(size_t bytes) { return reinterpret_cast<const GLvoid *>(bytes); }
+}
+
+GLMesh::GLMesh(const PolySet &ps)
+{
+	GLMeshBuilder builder;
+	BOOST_FOREACH(const PolySet::Polygon &poly, ps.polygons) {
+		builder.addPolygon(poly);
+	}
+	this->vertices = builder.surface.size() / SURFACE_FLOATS;
+	this->triangleIndices = builder.triangles.size();
+	this->edgeIndices = builder.edges.size();
+
+	size_t surfaceBytes = builder.surface.size() * sizeof(GLfloat);
+	size_t shaderBytes = builder.shader.size() * sizeof(GLfloat);
+	glGenBuffers(1, &this->vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+	glBufferData(GL_ARRAY_BUFFER, surfaceBytes + shaderBytes, NULL, GL_STATIC_DRAW);
+	if (surfaceBytes > 0) {
+		glBufferSubData(GL_ARRAY_BUFFER, 0, surfaceBytes, &builder.surface[0]);
+		glBufferSubData(GL_ARRAY_BUFFER, surfaceBytes, shaderBytes, &builder.shader[0]);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	const std::vector<GLuint> *indices[3] = { &builder.triangles, &builder.mirrored, &builder.edges };
+	glGenBuffers(3, this->ibo);
+	for (int i = 0; i < 3; i++) {
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ibo[i]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices[i]->size() * sizeof(GLuint),
+								 indices[i]->empty() ? NULL : &(*indices[i])[0], GL_STATIC_DRAW);
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+GLMesh::~GLMesh()
+{
+	glDeleteBuffers(3, this->ibo);
+	glDeleteBuffers(1, &this->vbo);
+}
+
+size_t GLMesh::memsize() const
+{
+	return this->vertices * (SURFACE_FLOATS + SHADER_FLOATS) * sizeof(GLfloat) +
+		(2 * this->triangleIndices + this->edgeIndices) * sizeof(GLuint);
+}
+
+/*!
+	Draws the triangles with the current material. A transform with a
+	negative determinant flips the winding of the triangles, which is
+	compensated as in PolySet::render_surface(). With shaderinfo, the edge
+	shader attributes are fed as well.
+*/
+void GLMesh::drawSurface(bool mirrored, GLint *shaderinfo) const
+{
+	glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glVertexPointer(3, GL_FLOAT, SURFACE_FLOATS * sizeof(GLfloat), buffer_offset(0));
+	glNormalPointer(GL_FLOAT, SURFACE_FLOATS * sizeof(GLfloat), buffer_offset(3 * sizeof(GLfloat)));
+#ifdef ENABLE_OPENCSG
+	size_t shaderOffset = this->vertices * SURFACE_FLOATS * sizeof(GLfloat);
+	if (shaderinfo) {
+		for (int i = 0; i < 4; i++) {
+			glEnableVertexAttribArray(shaderinfo[3 + i]);
+			glVertexAttribPointer(shaderinfo[3 + i], 3, GL_FLOAT, GL_FALSE, SHADER_FLOATS * sizeof(GLfloat),
+														buffer_offset(shaderOffset + 3 * i * sizeof(GLfloat)));
+		}
+	}
+#endif
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ibo[mirrored ? 1 : 0]);
+	glDrawElements(GL_TRIANGLES, this->triangleIndices, GL_UNSIGNED_INT, buffer_offset(0));
+
+#ifdef ENABLE_OPENCSG
+	if (shaderinfo) {
+		for (int i = 0; i < 4; i++) glDisableVertexAttribArray(shaderinfo[3 + i]);
+	}
+#endif
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/*!
+	Draws the outline of every polygon as lines.
+*/
+void GLMesh::drawEdges() const
+{
+	glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3, GL_FLOAT, SURFACE_FLOATS * sizeof(GLfloat), buffer_offset(0));
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ibo[2]);
+	glDrawElements(GL_LINES, this->edgeIndices, GL_UNSIGNED_INT, buffer_offset(0));
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+const GLMesh *GLMeshCache::get(const shared_ptr<PolySet> &ps)
+{
+	if (!ps || !GLEW_VERSION_1_5) return NULL;
+
+	boost::unordered_map<const PolySet *, cache_entry>::iterator it = this->meshes.find(ps.get());
+	if (it != this->meshes.end()) {
+		if (it->second.ps.lock() == ps) return it->second.mesh;
+		delete it->second.mesh;
+		this->meshes.erase(it);
+	}
+
+	if (this->meshes.size() >= this->purgeAt) {
+		purge();
+		this->purgeAt = std::max(size_t(64), 2 * this->meshes.size());
+	}
+	cache_entry entry;
+	entry.ps = ps;
+	entry.mesh = new GLMesh(*ps);
+	this->meshes[ps.get()] = entry;
+	return entry.mesh;
+}
+
+/*!
+	Releases all meshes. Must be called with the context of the view owning
+	the cache current.
+*/
+void GLMeshCache::clear()
+{
+	typedef std::pair<const PolySet * const, cache_entry> entry_t;
+	BOOST_FOREACH(entry_t &e, this->meshes) delete e.second.mesh;
+	this->meshes.clear();
+	this->purgeAt = 64;
+}
+
+/*!
+	Releases the meshes of PolySets which have been freed.
+*/
+void GLMeshCache::purge()
+{
+	boost::unordered_map<const PolySet *, cache_entry>::iterator it = this->meshes.begin();
+	while (it != this->meshes.end()) {
+		if (it->second.ps.expired()) {
+			delete it->second.mesh;
+			it = this->meshes.erase(it);
+		}
+		else ++it;
+	}
+}
+
+/*!
+	Draws ps like PolySet::render_surface(), from the current GLMeshCache for 3D
+	PolySets when buffer objects are available.
+*/
+void render_polyset_surface(const shared_ptr<PolySet> &ps, PolySet::csgmode_e csgmode, const Transform3d &m, GLint *shaderinfo)
+{
+	GLMeshCache *cache = GLMeshCache::current();
+	const GLMesh *mesh = ps->is2d || !cache ? NULL : cache->get(ps);
+	if (!mesh) {
+		ps->render_surface(csgmode, m, shaderinfo);
+		return;
+	}
+#ifdef ENABLE_OPENCSG
+	if (shaderinfo) {
+		glUniform1f(shaderinfo[7], shaderinfo[9]);
+		glUniform1f(shaderinfo[8], shaderinfo[10]);
+	}
+#endif
+	mesh->drawSurface(m.matrix().determinant() < 0, shaderinfo);
+}
+
+/*!
+	Draws ps like PolySet::render_edges(), from the current GLMeshCache for 3D
+	PolySets when buffer objects are available.
+*/
+void render_polyset_edges(const shared_ptr<PolySet> &ps, PolySet::csgmode_e csgmode)
+{
+	GLMeshCache *cache = GLMeshCache::current();
+	const GLMesh *mesh = ps->is2d || !cache ? NULL : cache->get(ps);
+	if (!mesh) {
+		ps->render_edges(csgmode);
+		return;
+	}
+	glDisable(GL_LIGHTING);
+	mesh->drawEdges();
+	glEnable(GL_LIGHTING);
+}
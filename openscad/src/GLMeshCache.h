@@ -0,0 +1,76 @@
+#ifndef GLMESHCACHE_H_
+#define GLMESHCACHE_H_
+
+#include "system-gl.h"
+#include "polyset.h"
+#include "memory.h"
+#include <boost/weak_ptr.hpp>
+#include <boost/unordered_map.hpp>
+
+/*!
+	GPU copy of the polygons of a PolySet, in vertex and index buffer
+	objects. Polygons are triangulated as in PolySet::render_surface(), with
+	one vertex per triangle corner carrying the face normal and the
+	attributes of the OpenCSG edge shader, so a frame only issues a few
+	draw calls instead of streaming the mesh through immediate mode.
+*/
+class GLMesh
+{
+public:
+	GLMesh(const PolySet &ps);
+	// Deletes the buffers, which needs the context they were created in
+	~GLMesh();
+
+	void drawSurface(bool mirrored, GLint *shaderinfo = NULL) const;
+	void drawEdges() const;
+	size_t memsize() const;
+
+private:
+	GLuint vbo;
+	GLuint ibo[3]; // triangles, triangles of a mirrored transform, edges
+	GLsizei vertices, triangleIndices, edgeIndices;
+};
+
+/*!
+	GLMesh per PolySet, built on the first draw of the PolySet. Entries
+	hold a weak pointer to their PolySet, so a PolySet allocated where a
+	freed one used to be isn't served its mesh, and meshes of freed
+	PolySets are released on later inserts.
+
+	Buffer objects aren't shared between the GL contexts of different
+	views, so every GLView owns a cache and makes it current() while its
+	renderer draws. All buffers of a cache belong to the context of its
+	view: get() must only be called while drawing that view, and the view
+	calls clear() with its context current before the context goes away.
+	Without a current cache, or if the context has no buffer objects,
+	get() returns NULL and PolySets are drawn in immediate mode.
+*/
+class GLMeshCache
+{
+public:
+	GLMeshCache() : purgeAt(64) {}
+
+	static GLMeshCache *current() { return curr; }
+	static void setCurrent(GLMeshCache *cache) { curr = cache; }
+
+	const GLMesh *get(const shared_ptr<PolySet> &ps);
+	void clear();
+
+private:
+	static GLMeshCache *curr;
+
+	struct cache_entry {
+		boost::weak_ptr<PolySet> ps;
+		GLMesh *mesh;
+	};
+
+	void purge();
+
+	boost::unordered_map<const PolySet *, cache_entry> meshes;
+	size_t purgeAt;
+};
+
+void render_polyset_surface(const shared_ptr<PolySet> &ps, PolySet::csgmode_e csgmode, const Transform3d &m, GLint *shaderinfo = NULL);
+void render_polyset_edges(const shared_ptr<PolySet> &ps, PolySet::csgmode_e csgmode);
+
+#endif
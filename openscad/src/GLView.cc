@@ -314,7 +314,9 @@ void GLView::vectorCamPaintGL()
   //if (showaxes) GLView::showSmallaxes();
 
   if (this->renderer) {
+    GLMeshCache::setCurrent(&this->meshcache);
     this->renderer->draw(showfaces, showedges);
+    GLMeshCache::setCurrent(NULL);
   }
 }
 
@@ -355,7 +357,9 @@ void GLView::gimbalCamPaintGL()
     // FIXME: This belongs in the OpenCSG renderer, but it doesn't know about this ID yet
     OpenCSG::setContext(this->opencsg_id);
 #endif
+    GLMeshCache::setCurrent(&this->meshcache);
     this->renderer->draw(showfaces, showedges);
+    GLMeshCache::setCurrent(NULL);
 	}
   // Small axis cross in the lower left corner
   if (showaxes) GLView::showSmallaxes();
@@ -26,6 +26,7 @@ Some actions (showCrossHairs) only work properly on Gimbal Camera.
 #include "system-gl.h"
 #include <iostream>
 #include "renderer.h"
+#include "GLMeshCache.h"
 #include "Camera.h"
 #include <QVector>
 #include <QPoint>
@@ -59,6 +60,7 @@ public:
 	virtual std::string getRendererInfo() const = 0;
 
 	Renderer *renderer;
+	GLMeshCache meshcache;
 	Camera cam;
 	double far_far_away;
 	size_t width;
@@ -7,21 +7,14 @@
 #include "modcontext.h"
 #include "module.h"
 #include "Tree.h"
+#include "instantiationcache.h"
 #include "memory.h"
 #include <vector>
 #include <QMutex>
+#include <QPair>
 #include "dxfdata.h"
 typedef std::pair<double, double> Point2D;
 
-typedef struct
-{
-    double xLoc, yLoc;
-    bool insidePoly;
-    bool nearEdge;
-    double currentEnergy;
-    double possibleEnergy[12];
-} gridCell;
-
 class MainWindow : public QMainWindow, public Ui::MainWindow
 {
 	Q_OBJECT
@@ -46,17 +39,12 @@ public:
     double handleX, handleY, handleZ;
     double screw1X, screw1Y, screw1Z, screw2X, screw2Y, screw2Z, screw3X, screw3Y, screw3Z;
     double xRot, yRot, zRot;
-    double binvoxTransX, binvoxTransY, binvoxTransZ, binvoxScale;
+    int voxelResolution = 256;
+    shared_ptr<class PolySet> insertedMesh; // swept target, added to the tree by subtractInsertedMesh()
     QVector <double> cuttingPlaneMatrix;
     Transform3d cuttingPlaneMatrixRot;
-    bool crossSectionMode = false;
-    int crossSectionModelNumber = 0;
-    class CGAL_Nef_polyhedron * crossSectionTarget;
-    class CGAL_Nef_polyhedron * crossSectionEnclosure;
-    class CGAL_Nef_polyhedron * crossSectionTargetInserted;
-    class CGAL_Nef_polyhedron * crossSectionEncMinTarget;
-    QVector<Point2D> cavityPointsTarget;
     QVector<Point2D> cavityPointsInserted;
+    QVector<QPair<Point2D, Point2D> > cavitySegmentsInserted;
     Transform3d transMatrixInverse;
     
     
@@ -76,6 +64,7 @@ public:
 	ModuleInstantiation root_inst;    // Top level instance
 	AbstractNode *absolute_root_node; // Result of tree evaluation
 	AbstractNode *root_node;          // Root if the root modifier (!) is used
+	InstantiationCache instantiations; // Subtrees the next compile may reuse
 	Tree tree;
 
 	shared_ptr<class CSGTerm> root_raw_term;           // Result of CSG term rendering
@@ -121,6 +110,8 @@ private:
 	void compileTopLevelDocument();
 	void compile(bool reload, bool forcedone = false);
 	void compileCSG(bool procevents);
+	void nodeModified(const AbstractNode &node);
+	void subtractInsertedMesh();
 	bool maybeSave();
 	bool checkEditorModified();
 	QString dumpCSGTree(AbstractNode *root);
@@ -234,21 +225,11 @@ public slots:
 	// Procrustes end
 	void loadOriginalFiles();
 	void loadInsertedFiles();
-	void readBinvoxScaleTranslate(std::string filespec);
 	void addCuttingPlaneAfter();
 	void crossSection();
 	void computeScrewPositionsAction();
-	void crossSectionOutLines();
-	void crossSectionModel(std::string modelFileName);
-	void crossSectionModelBinvox();
-	QVector<Point2D> findCloseCavityPoints(class CGAL_Nef_polyhedron *target,class CGAL_Nef_polyhedron *enclosure);
-	int pnpoly( DxfData *dd, double testx, double testy);
+	QVector<Point2D> findCloseCavityPoints(class CGAL_Nef_polyhedron *target,class CGAL_Nef_polyhedron *enclosure, QVector<QPair<Point2D, Point2D> > *segments = NULL);
 	void findScrewPositions(DxfData *dd);
-	Vector2d picRandomPointInPolygon(DxfData *dd, int minX, int minY, int yDist, int xDist);
-	double distanceToPoint(double x1, double y1, double x2, double y2 );
-	double distToLineSegment(double x1, double y1, double x2, double y2, double x3, double y3);
-	bool testIfCloseToPolygonEdge(DxfData *dd, double testx, double testy, double minDist);
-	int pickRandomGoodGridCell(gridCell* grid, int gridSize);
 	void addScrewHole(double xPos, double yPos);
 	void loadInsertedFilesNoRender();
 	void addCuttingPlaneAfterNoRender();
@@ -1,7 +1,14 @@
 #include "ModuleCache.h"
 #include "module.h"
+#include "expression.h"
+#include "function.h"
 #include "printutils.h"
 #include "openscad.h"
+#include "parsersettings.h"
+#include "handle_dep.h"
+#include "DiskCache.h"
+#include "instantiationcache.h"
+#include "hash.h"
 
 #include "boosty.h"
 #include <boost/format.hpp>
@@ -9,18 +16,454 @@
 #include <boost/foreach.hpp>
 
 #include <stdio.h>
+#include <string.h>
+#include <assert.h>
 #include <fstream>
 #include <sstream>
 #include <time.h>
 #include <sys/stat.h>
-
-//#include "parsersettings.h"
 /*!
 	FIXME: Implement an LRU scheme to avoid having an ever-growing module cache
 */
 
 ModuleCache *ModuleCache::inst = NULL;
 
+// Part of the keys of parsed modules in the DiskCache. Bump whenever the
+// grammar or the serialized layout below changes.
+static const int PARSER_VERSION = 2;
+
+template <typename T> static void put(std::string &data, const T &value)
+{
+	data.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T> static bool take(const std::string &data, size_t &pos, T &value)
+{
+	if (pos + sizeof(T) > data.size()) return false;
+	memcpy(&value, &data[pos], sizeof(T));
+	pos += sizeof(T);
+	return true;
+}
+
+static void put_string(std::string &data, const std::string &str)
+{
+	put(data, uint32_t(str.size()));
+	data.append(str);
+}
+
+static bool take_string(const std::string &data, size_t &pos, std::string &str)
+{
+	uint32_t n;
+	if (!take(data, pos, n) || pos + n > data.size()) return false;
+	str.assign(data, pos, n);
+	pos += n;
+	return true;
+}
+
+static void put_value(std::string &data, const Value &value)
+{
+	put(data, int32_t(value.type()));
+	switch (value.type()) {
+	case Value::BOOL:
+		put(data, int32_t(value.toBool()));
+		break;
+	case Value::NUMBER:
+		put(data, value.toDouble());
+		break;
+	case Value::STRING:
+		put_string(data, value.toString());
+		break;
+	case Value::VECTOR:
+		put(data, uint32_t(value.toVector().size()));
+		BOOST_FOREACH(const Value &v, value.toVector()) put_value(data, v);
+		break;
+	case Value::RANGE: {
+		Value::RangeType range = value.toRange();
+		put(data, range.begin); put(data, range.step); put(data, range.end);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+static bool take_value(const std::string &data, size_t &pos, Value &value)
+{
+	int32_t type;
+	if (!take(data, pos, type)) return false;
+	switch (type) {
+	case Value::UNDEFINED:
+		value = Value();
+		return true;
+	case Value::BOOL: {
+		int32_t b;
+		if (!take(data, pos, b)) return false;
+		value = Value(bool(b));
+		return true;
+	}
+	case Value::NUMBER: {
+		double d;
+		if (!take(data, pos, d)) return false;
+		value = Value(d);
+		return true;
+	}
+	case Value::STRING: {
+		std::string str;
+		if (!take_string(data, pos, str)) return false;
+		value = Value(str);
+		return true;
+	}
+	case Value::VECTOR: {
+		uint32_t n;
+		if (!take(data, pos, n) || n > data.size()) return false;
+		Value::VectorType vec(n);
+		for (uint32_t i = 0; i < n; i++) {
+			if (!take_value(data, pos, vec[i])) return false;
+		}
+		value = Value(vec);
+		return true;
+	}
+	case Value::RANGE: {
+		double begin, step, end;
+		if (!take(data, pos, begin) || !take(data, pos, step) || !take(data, pos, end)) return false;
+		value = Value(begin, step, end);
+		return true;
+	}
+	}
+	return false;
+}
+
+static void put_expression(std::string &data, const Expression *expr);
+
+static void put_assignments(std::string &data, const AssignmentList &assignments)
+{
+	put(data, uint32_t(assignments.size()));
+	BOOST_FOREACH(const Assignment &a, assignments) {
+		put_string(data, a.first);
+		put_expression(data, a.second);
+	}
+}
+
+static void put_expression(std::string &data, const Expression *expr)
+{
+	if (!expr) {
+		put(data, int32_t(-1));
+		return;
+	}
+	put(data, int32_t(expr->type));
+	switch (expr->type) {
+	case Expression::CONSTANT:
+		put_value(data, expr->const_value);
+		break;
+	case Expression::LOOKUP:
+	case Expression::MEMBER:
+		put_string(data, expr->var_name);
+		break;
+	case Expression::CALL:
+		put_string(data, expr->call_funcname);
+		put_assignments(data, expr->call_arguments);
+		break;
+	default:
+		break;
+	}
+	put(data, uint32_t(expr->children.size()));
+	BOOST_FOREACH(const Expression *e, expr->children) put_expression(data, e);
+}
+
+static bool take_expression(const std::string &data, size_t &pos, Expression *&expr);
+
+static bool take_assignments(const std::string &data, size_t &pos, AssignmentList &assignments)
+{
+	uint32_t n;
+	if (!take(data, pos, n) || n > data.size()) return false;
+	for (uint32_t i = 0; i < n; i++) {
+		std::string name;
+		Expression *expr;
+		if (!take_string(data, pos, name) || !take_expression(data, pos, expr)) return false;
+		assignments.push_back(Assignment(name, expr));
+	}
+	return true;
+}
+
+/*!
+	Reads an expression the way the parser builds it. On failure, what was
+	read is deleted.
+*/
+static bool take_expression(const std::string &data, size_t &pos, Expression *&expr)
+{
+	expr = NULL;
+	int32_t type;
+	if (!take(data, pos, type) || type > Expression::CALL) return false;
+	if (type < 0) return true;
+
+	std::string name;
+	switch (type) {
+	case Expression::CONSTANT: {
+		Value value;
+		if (!take_value(data, pos, value)) return false;
+		expr = new Expression(value);
+		break;
+	}
+	case Expression::LOOKUP:
+	case Expression::MEMBER: {
+		if (!take_string(data, pos, name)) return false;
+		expr = new Expression(Expression::Type(type), name, NULL);
+		break;
+	}
+	case Expression::CALL: {
+		expr = new Expression(Expression::CALL);
+		bool ok = take_string(data, pos, expr->call_funcname) &&
+			take_assignments(data, pos, expr->call_arguments);
+		if (!ok) {
+			BOOST_FOREACH(const Assignment &a, expr->call_arguments) delete a.second;
+			delete expr;
+			expr = NULL;
+			return false;
+		}
+		break;
+	}
+	default:
+		expr = new Expression(Expression::Type(type));
+	}
+
+	uint32_t n;
+	bool ok = take(data, pos, n) && n <= data.size();
+	for (uint32_t i = 0; ok && i < n; i++) {
+		Expression *child;
+		ok = take_expression(data, pos, child);
+		if (ok) expr->children.push_back(child);
+	}
+	if (!ok) {
+		delete expr;
+		expr = NULL;
+	}
+	return ok;
+}
+
+static void put_scope(std::string &data, const LocalScope &scope);
+
+static void put_instantiation(std::string &data, const ModuleInstantiation &inst)
+{
+	const IfElseModuleInstantiation *ifelse = dynamic_cast<const IfElseModuleInstantiation*>(&inst);
+	put(data, int32_t(ifelse != NULL));
+	put_string(data, inst.name());
+	put_string(data, inst.path());
+	put(data, int32_t(inst.tag_root | inst.tag_highlight << 1 | inst.tag_background << 2));
+	put_assignments(data, inst.arguments);
+	put_scope(data, inst.scope);
+	if (ifelse) put_scope(data, ifelse->else_scope);
+}
+
+static void put_scope(std::string &data, const LocalScope &scope)
+{
+	put_assignments(data, scope.assignments);
+	put(data, uint32_t(scope.children.size()));
+	BOOST_FOREACH(const ModuleInstantiation *inst, scope.children) put_instantiation(data, *inst);
+	put(data, uint32_t(scope.functions.size()));
+	BOOST_FOREACH(const LocalScope::FunctionContainer::value_type &f, scope.functions) {
+		const Function *func = dynamic_cast<const Function*>(f.second);
+		put_string(data, f.first);
+		put_assignments(data, func->definition_arguments);
+		put_expression(data, func->expr);
+	}
+	put(data, uint32_t(scope.modules.size()));
+	BOOST_FOREACH(const LocalScope::AbstractModuleContainer::value_type &m, scope.modules) {
+		const Module *module = dynamic_cast<const Module*>(m.second);
+		put_string(data, m.first);
+		put_assignments(data, module->definition_arguments);
+		put_scope(data, module->scope);
+	}
+}
+
+/*!
+	Reads a scope into the given one, which owns whatever was read even on
+	failure.
+*/
+static bool take_scope(const std::string &data, size_t &pos, LocalScope &scope)
+{
+	uint32_t n;
+	if (!take_assignments(data, pos, scope.assignments)) return false;
+
+	if (!take(data, pos, n) || n > data.size()) return false;
+	for (uint32_t i = 0; i < n; i++) {
+		int32_t ifelse, tags;
+		std::string name, path;
+		if (!take(data, pos, ifelse) || !take_string(data, pos, name) ||
+				!take_string(data, pos, path) || !take(data, pos, tags)) return false;
+		ModuleInstantiation *inst = ifelse ? new IfElseModuleInstantiation() : new ModuleInstantiation(name);
+		scope.addChild(inst);
+		inst->setPath(path);
+		inst->tag_root = tags & 1;
+		inst->tag_highlight = tags & 2;
+		inst->tag_background = tags & 4;
+		if (!take_assignments(data, pos, inst->arguments) || !take_scope(data, pos, inst->scope)) return false;
+		if (ifelse && !take_scope(data, pos, static_cast<IfElseModuleInstantiation*>(inst)->else_scope)) return false;
+	}
+
+	if (!take(data, pos, n) || n > data.size()) return false;
+	for (uint32_t i = 0; i < n; i++) {
+		std::string name;
+		if (!take_string(data, pos, name)) return false;
+		Function *func = new Function();
+		func->expr = NULL;
+		delete scope.functions[name];
+		scope.functions[name] = func;
+		if (!take_assignments(data, pos, func->definition_arguments) ||
+				!take_expression(data, pos, func->expr) || !func->expr) return false;
+	}
+
+	if (!take(data, pos, n) || n > data.size()) return false;
+	for (uint32_t i = 0; i < n; i++) {
+		std::string name;
+		if (!take_string(data, pos, name)) return false;
+		Module *module = new Module();
+		delete scope.modules[name];
+		scope.modules[name] = module;
+		if (!take_assignments(data, pos, module->definition_arguments) ||
+				!take_scope(data, pos, module->scope)) return false;
+	}
+	return true;
+}
+
+/*!
+	Identifies the current contents of the file at fullpath, or is empty if
+	fullpath is.
+*/
+static std::string include_id(const fs::path &fullpath)
+{
+	if (fullpath.empty()) return std::string();
+	std::ifstream ifs(boosty::stringy(fullpath).c_str(), std::ios::in | std::ios::binary);
+	std::string text((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+	return hash128(text);
+}
+
+/*!
+	Serializes a parsed module with the messages printed while parsing it,
+	in native byte order like the other DiskCache entries. The contents of
+	the included files are identified too, since they are part of the
+	module but not of its key.
+*/
+static std::string serialize(const FileModule &module, const std::string &messages)
+{
+	std::string data;
+	put_string(data, messages);
+	put_string(data, module.modulePath());
+	put(data, uint32_t(module.usedlibs.size()));
+	BOOST_FOREACH(const std::string &lib, module.usedlibs) put_string(data, lib);
+	FileModule::IncludePaths includes = module.includePaths();
+	put(data, uint32_t(includes.size()));
+	BOOST_FOREACH(const FileModule::IncludePaths::value_type &inc, includes) {
+		put_string(data, inc.first);
+		put_string(data, inc.second.sourcepath);
+		put_string(data, inc.second.fullpath);
+		put_string(data, include_id(find_valid_path(inc.second.sourcepath, inc.first)));
+	}
+	put_scope(data, module.scope);
+	return data;
+}
+
+/*!
+	Reads a module written by serialize(). Sets stale and returns NULL if
+	the parser would now find different files for its use and include
+	statements, or an included file has changed since.
+*/
+static FileModule *deserialize(const std::string &data, std::string &messages, bool &stale)
+{
+	size_t pos = 0;
+	std::string path;
+	uint32_t n;
+	stale = false;
+	if (!take_string(data, pos, messages) || !take_string(data, pos, path)) return NULL;
+
+	FileModule *module = new FileModule();
+	module->setModulePath(path);
+	std::vector<std::string> libs;
+	bool ok = take(data, pos, n) && n <= data.size();
+	for (uint32_t i = 0; ok && i < n; i++) {
+		std::string lib;
+		ok = take_string(data, pos, lib);
+		if (ok) libs.push_back(lib);
+	}
+
+	// Use statements in included files are resolved from their directories
+	std::vector<fs::path> sourcepaths(1, fs::path(path));
+	ok = ok && take(data, pos, n) && n <= data.size();
+	for (uint32_t i = 0; ok && i < n; i++) {
+		std::string localpath, sourcepath, fullpath, id;
+		ok = take_string(data, pos, localpath) && take_string(data, pos, sourcepath) &&
+			take_string(data, pos, fullpath) && take_string(data, pos, id);
+		if (!ok) break;
+		// Missing includes are registered by their local path
+		fs::path found = find_valid_path(sourcepath, localpath);
+		std::string resolved = found.empty() ? localpath : boosty::stringy(found);
+		if (resolved != fullpath || include_id(found) != id) stale = true;
+		if (!found.empty()) sourcepaths.push_back(found.parent_path());
+		module->registerInclude(localpath, fullpath, sourcepath);
+	}
+
+	// The lexer keeps the full path of libraries it found and the relative
+	// name of those it didn't
+	BOOST_FOREACH(const std::string &lib, libs) {
+		if (boosty::is_absolute(fs::path(lib))) {
+			if (boosty::stringy(find_valid_path(path, lib)) != lib) stale = true;
+		}
+		else {
+			BOOST_FOREACH(const fs::path &sourcepath, sourcepaths) {
+				if (!find_valid_path(sourcepath, lib).empty()) stale = true;
+			}
+		}
+		module->usedlibs.insert(lib);
+	}
+	ok = ok && !stale && take_scope(data, pos, module->scope) && pos == data.size();
+	if (!ok) {
+		delete module;
+		return NULL;
+	}
+	return module;
+}
+
+/*!
+	Returns the DiskCache key of the module parsed from text. The result of
+	the parser also depends on where the file is and where libraries are
+	searched for.
+*/
+static std::string module_key(const std::string &pathname, const std::string &text)
+{
+	std::stringstream key;
+	key << PARSER_VERSION << "\n" << pathname << "\n";
+	BOOST_FOREACH(const std::string &dir, librarypath) key << dir << "\n";
+	key << text;
+	return "ast-" + hash128(key.str());
+}
+
+/*!
+	Loads the module stored under key from the DiskCache, if it's there and
+	the files it used and included are unchanged. Prints the messages the
+	parser printed and notes the dependencies, like parse() would.
+*/
+static FileModule *load_module(const std::string &key)
+{
+	DiskCache *disk = DiskCache::instance();
+	std::string data, messages;
+	if (!disk->enabled() || !disk->read(key, data)) return NULL;
+
+	bool stale;
+	FileModule *module = deserialize(data, messages, stale);
+	if (!module) {
+		if (!stale) PRINTB("WARNING: Unable to read cached library %s", key);
+		disk->remove(key);
+		return NULL;
+	}
+	if (!messages.empty()) PRINT(messages);
+	BOOST_FOREACH(const std::string &lib, module->usedlibs) {
+		if (boosty::is_absolute(fs::path(lib))) handle_dep(lib);
+	}
+	BOOST_FOREACH(const FileModule::IncludePaths::value_type &inc, module->includePaths()) {
+		if (fs::exists(fs::path(inc.second.fullpath))) handle_dep(inc.second.fullpath);
+	}
+	return module;
+}
+
 /*!
 	Reevaluate the given file and recompile if necessary.
 	Returns NULL on any error (e.g. compile error or file not found)
@@ -82,6 +525,7 @@ FileModule *ModuleCache::evaluate(const std::string &filename)
 		std::stringstream textbuf;
 		textbuf << ifs.rdbuf();
 		textbuf << "\n" << commandline_commands;
+		std::string text = textbuf.str();
 
 		print_messages_push();
 
@@ -93,13 +537,22 @@ FileModule *ModuleCache::evaluate(const std::string &filename)
 		this->entries[filename] = e;
 		
 		std::string pathname = boosty::stringy(fs::path(filename).parent_path());
-		lib_mod = dynamic_cast<FileModule*>(parse(textbuf.str().c_str(), pathname.c_str(), false));
+		std::string key = module_key(pathname, text);
+		lib_mod = load_module(key);
+		if (!lib_mod) {
+			lib_mod = dynamic_cast<FileModule*>(parse(text.c_str(), pathname.c_str(), false));
+			if (lib_mod && DiskCache::instance()->enabled()) {
+				DiskCache::instance()->write(key, serialize(*lib_mod, print_messages_stack.back()));
+			}
+		}
 		PRINTB_NOCACHE("  compiled module: %p", lib_mod);
 		
 		if (lib_mod) {
-			// We defer deletion so we can ensure that the new module won't
-			// have the same address as the old
-			delete oldmodule;
+			// Nodes reused by the GUI across compiles may still refer to the
+			// instantiations of the old module, so it is retired rather than
+			// deleted. This also ensures that the new module won't have the same
+			// address as the old
+			if (oldmodule) retire(oldmodule);
 			this->entries[filename].module = lib_mod;
 		} else {
 			this->entries.erase(filename);
@@ -115,11 +568,43 @@ FileModule *ModuleCache::evaluate(const std::string &filename)
 	return lib_mod;
 }
 
+/*!
+	Forgets all modules. They are retired, as nodes may still refer to
+	them.
+*/
 void ModuleCache::clear()
 {
+	typedef boost::unordered_map<std::string, cache_entry>::value_type Entry;
+	BOOST_FOREACH(const Entry &e, this->entries) retire(e.second.module);
 	this->entries.clear();
 }
 
+/*!
+	Hands a replaced module to the InstantiationCaches, which release it
+	once none of their nodes refer to it anymore. Without any, no nodes are
+	kept across compiles and the module is deleted right away.
+*/
+void ModuleCache::retire(FileModule *module)
+{
+	int holders = InstantiationCache::retireLibrary(module);
+	if (holders > 0) this->retired[module] = holders;
+	else delete module;
+}
+
+/*!
+	Called by an InstantiationCache when its nodes no longer refer to the
+	retired module. Deletes the module when no cache does.
+*/
+void ModuleCache::release(FileModule *module)
+{
+	boost::unordered_map<FileModule*, int>::iterator it = this->retired.find(module);
+	assert(it != this->retired.end());
+	if (--it->second == 0) {
+		this->retired.erase(it);
+		delete module;
+	}
+}
+
 FileModule *ModuleCache::lookup(const std::string &filename)
 {
 	return (this->entries.find(filename) != this->entries.end()) ?
@@ -1,8 +1,11 @@
 #include <string>
+#include <vector>
 #include <boost/unordered_map.hpp>
 
 /*!
-	Caches FileModules based on their filenames
+	Caches FileModules based on their filenames. When the DiskCache is
+	enabled, parsed modules are also kept there across sessions, so
+	libraries shared by many designs aren't parsed again by every run.
 */
 class ModuleCache
 {
@@ -12,6 +15,7 @@ public:
 	class FileModule *lookup(const std::string &filename);
 	size_t size() { return this->entries.size(); }
 	void clear();
+	void release(class FileModule *module);
 
 private:
 	ModuleCache() {}
@@ -19,9 +23,14 @@ private:
 
 	static ModuleCache *inst;
 
+	void retire(class FileModule *module);
+
 	struct cache_entry {
 		class FileModule *module;
 		std::string cache_id;
 	};
 	boost::unordered_map<std::string, cache_entry> entries;
+	// Replaced modules, with the number of InstantiationCaches whose nodes
+	// may still refer to them
+	boost::unordered_map<class FileModule*, int> retired;
 };
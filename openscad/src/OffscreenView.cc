@@ -18,6 +18,8 @@ OffscreenView::OffscreenView(size_t width, size_t height)
 
 OffscreenView::~OffscreenView()
 {
+  // Release the mesh buffers while their context still exists
+  this->meshcache.clear();
   teardown_offscreen_context(this->ctx);
 }
 
@@ -27,6 +27,7 @@
 #include "system-gl.h"
 #include "OpenCSGRenderer.h"
 #include "polyset.h"
+#include "GLMeshCache.h"
 #include "csgterm.h"
 #include "stl-utils.h"
 #ifdef ENABLE_OPENCSG
@@ -44,7 +45,7 @@ public:
 	virtual void render() {
 		glPushMatrix();
 		glMultMatrixd(m.data());
-		ps->render_surface(csgmode, m);
+		render_polyset_surface(ps, csgmode, m);
 		glPopMatrix();
 	}
 };
@@ -120,7 +121,7 @@ void OpenCSGRenderer::renderCSGChain(CSGChain *chain, GLint *shaderinfo,
 
 				setColor(colormode, c.data(), shaderinfo);
 
-				j_obj.polyset->render_surface(csgmode, j_obj.matrix, shaderinfo);
+				render_polyset_surface(j_obj.polyset, csgmode, j_obj.matrix, shaderinfo);
 				glPopMatrix();
 			}
 			if (shaderinfo) glUseProgram(0);
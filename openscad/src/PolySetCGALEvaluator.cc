@@ -54,7 +54,7 @@ PolySet *PolySetCGALEvaluator::evaluatePolySet(const ProjectionNode &node)
 	CGAL_Nef_polyhedron nef_poly(2);
 
 	if (node.cut_mode) {
-		CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
+		CGAL::Failure_behaviour old_behaviour = set_cgal_error_behaviour(CGAL::THROW_EXCEPTION);
 		try {
 			CGAL_Nef_polyhedron3::Plane_3 xy_plane = CGAL_Nef_polyhedron3::Plane_3( 0,0,1,0 );
 			*sum.p3 = sum.p3->intersection( xy_plane, CGAL_Nef_polyhedron3::PLANE_ONLY);
@@ -83,7 +83,7 @@ PolySet *PolySetCGALEvaluator::evaluatePolySet(const ProjectionNode &node)
 		}
 
 		if (sum.p3->is_empty()) {
-			CGAL::set_error_behaviour(old_behaviour);
+			set_cgal_error_behaviour(old_behaviour);
 			PRINT("WARNING: projection() failed.");
 			return NULL;
 		}
@@ -110,7 +110,7 @@ PolySet *PolySetCGALEvaluator::evaluatePolySet(const ProjectionNode &node)
 		}
 		log << "</svg>\n";
 
-		CGAL::set_error_behaviour(old_behaviour);
+		set_cgal_error_behaviour(old_behaviour);
 
 		// Extract polygons in the XY plane, ignoring all other polygons
 		// FIXME: If the polyhedron is really thin, there might be unwanted polygons
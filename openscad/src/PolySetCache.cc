@@ -1,26 +1,154 @@
 #include "PolySetCache.h"
 #include "printutils.h"
 #include "polyset.h"
+#include "DiskCache.h"
+
+#include <string.h>
+#include <boost/foreach.hpp>
 
 PolySetCache *PolySetCache::inst = NULL;
 
+template <typename T> static void put(std::string &data, const T &value)
+{
+	data.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T> static bool take(const std::string &data, size_t &pos, T &value)
+{
+	if (pos + sizeof(T) > data.size()) return false;
+	memcpy(&value, &data[pos], sizeof(T));
+	pos += sizeof(T);
+	return true;
+}
+
+static void put_polygons(std::string &data, const std::vector<PolySet::Polygon> &polygons)
+{
+	put(data, uint32_t(polygons.size()));
+	BOOST_FOREACH(const PolySet::Polygon &p, polygons) {
+		put(data, uint32_t(p.size()));
+		BOOST_FOREACH(const Vector3d &v, p) {
+			put(data, v[0]); put(data, v[1]); put(data, v[2]);
+		}
+	}
+}
+
+static bool take_polygons(const std::string &data, size_t &pos, std::vector<PolySet::Polygon> &polygons)
+{
+	uint32_t n, m;
+	if (!take(data, pos, n) || n > data.size()) return false;
+	polygons.resize(n);
+	for (uint32_t i = 0; i < n; i++) {
+		if (!take(data, pos, m) || pos + m * 3 * sizeof(double) > data.size()) return false;
+		polygons[i].resize(m);
+		for (uint32_t j = 0; j < m; j++) {
+			double *v = polygons[i][j].data();
+			take(data, pos, v[0]); take(data, pos, v[1]); take(data, pos, v[2]);
+		}
+	}
+	return true;
+}
+
+/*!
+	Serializes the polygons and borders of ps as raw doubles in native byte
+	order. The disk cache is local to the machine, so that's fine.
+*/
+static std::string serialize(const PolySet &ps)
+{
+	std::string data;
+	put(data, int32_t(ps.is2d));
+	put(data, int32_t(ps.convexity));
+	put_polygons(data, ps.polygons);
+	put_polygons(data, ps.borders);
+	return data;
+}
+
+static PolySet *deserialize(const std::string &data)
+{
+	size_t pos = 0;
+	int32_t is2d, convexity;
+	PolySet *ps = new PolySet();
+	if (!take(data, pos, is2d) || !take(data, pos, convexity) ||
+			!take_polygons(data, pos, ps->polygons) || !take_polygons(data, pos, ps->borders) ||
+			pos != data.size()) {
+		delete ps;
+		return NULL;
+	}
+	ps->is2d = is2d;
+	ps->convexity = convexity;
+	return ps;
+}
+
+bool PolySetCache::contains(const std::string &id) const
+{
+	{
+		boost::mutex::scoped_lock lock(this->mutex);
+		if (this->cache.contains(id)) return true;
+	}
+	return DiskCache::isCacheableId(id) && DiskCache::instance()->contains("ps-" + id);
+}
+
+/*!
+	PolySets which are only in the DiskCache are loaded into memory.
+*/
+shared_ptr<PolySet> PolySetCache::get(const std::string &id)
+{
+	{
+		boost::mutex::scoped_lock lock(this->mutex);
+		const cache_entry *entry = this->cache[id];
+		if (entry) return entry->ps;
+	}
+
+	std::string data;
+	if (!DiskCache::isCacheableId(id) || !DiskCache::instance()->read("ps-" + id, data)) {
+		return shared_ptr<PolySet>();
+	}
+	shared_ptr<PolySet> ps(deserialize(data));
+	if (!ps) {
+		PRINTB("WARNING: Unable to read cached PolySet %s", id);
+		DiskCache::instance()->remove("ps-" + id);
+		return ps;
+	}
+	boost::mutex::scoped_lock lock(this->mutex);
+	this->cache.insert(id, new cache_entry(ps), ps->memsize());
+	return ps;
+}
+
+/*!
+	Inserts ps into the memory cache and, if enabled, the DiskCache.
+*/
 void PolySetCache::insert(const std::string &id, const shared_ptr<PolySet> &ps)
 {
-	this->cache.insert(id, new cache_entry(ps), ps ? ps->memsize() : 0);
+	{
+		boost::mutex::scoped_lock lock(this->mutex);
+		this->cache.insert(id, new cache_entry(ps), ps ? ps->memsize() : 0);
+	}
+	DiskCache *disk = DiskCache::instance();
+	if (ps && disk->enabled() && DiskCache::isCacheableId(id) && !disk->contains("ps-" + id)) {
+		disk->write("ps-" + id, serialize(*ps));
+	}
 }
 
 size_t PolySetCache::maxSize() const
 {
+	boost::mutex::scoped_lock lock(this->mutex);
 	return this->cache.maxCost();
 }
 
 void PolySetCache::setMaxSize(size_t limit)
 {
+	boost::mutex::scoped_lock lock(this->mutex);
 	this->cache.setMaxCost(limit);
 }
 
+void PolySetCache::clear()
+{
+	boost::mutex::scoped_lock lock(this->mutex);
+	this->cache.clear();
+}
+
 void PolySetCache::print()
 {
+	boost::mutex::scoped_lock lock(this->mutex);
 	PRINTB("PolySets in cache: %d", this->cache.size());
 	PRINTB("PolySet cache size in bytes: %d", this->cache.totalCost());
 }
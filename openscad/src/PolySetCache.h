@@ -3,7 +3,12 @@
 
 #include "cache.h"
 #include "memory.h"
+#include <boost/thread/mutex.hpp>
 
+/*!
+	All methods are thread-safe. get() returns an empty pointer if id isn't cached.
+	Misses fall back to the DiskCache, if it's enabled.
+*/
 class PolySetCache
 {
 public:	
@@ -11,12 +16,12 @@ public:
 
 	static PolySetCache *instance() { if (!inst) inst = new PolySetCache; return inst; }
 
-	bool contains(const std::string &id) const { return this->cache.contains(id); }
-	shared_ptr<class PolySet> get(const std::string &id) const { return this->cache[id]->ps; }
+	bool contains(const std::string &id) const;
+	shared_ptr<class PolySet> get(const std::string &id);
 	void insert(const std::string &id, const shared_ptr<PolySet> &ps);
 	size_t maxSize() const;
 	void setMaxSize(size_t limit);
-	void clear() { cache.clear(); }
+	void clear();
 	void print();
 
 private:
@@ -30,6 +35,7 @@ private:
 	};
 
 	Cache<std::string, cache_entry> cache;
+	mutable boost::mutex mutex;
 };
 
 #endif
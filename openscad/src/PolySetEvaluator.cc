@@ -26,7 +26,9 @@ shared_ptr<PolySet> PolySetEvaluator::getPolySet(const AbstractNode &node, bool
     // For cache debugging
 		PRINTB("PolySetCache hit: %s", cacheid.substr(0, 40));
 #endif
-		return PolySetCache::instance()->get(cacheid);
+		// May have been evicted by another thread in the meantime
+		shared_ptr<PolySet> ps = PolySetCache::instance()->get(cacheid);
+		if (ps) return ps;
 	}
 
 	shared_ptr<PolySet> ps(node.evaluate_polyset(this));
@@ -32,6 +32,7 @@
 #include <QSettings>
 #include <QStatusBar>
 #include "PolySetCache.h"
+#include "DiskCache.h"
 #include "AutoUpdater.h"
 #ifdef ENABLE_CGAL
 #include "CGALCache.h"
@@ -83,6 +84,9 @@ Preferences::Preferences(QWidget *parent) : QMainWindow(parent)
 #ifdef ENABLE_CGAL
 	this->defaultmap["advanced/cgalCacheSize"] = uint(CGALCache::instance()->maxSize());
 #endif
+	// The disk cache is off unless a directory is set
+	this->defaultmap["advanced/diskCacheDir"] = QString();
+	this->defaultmap["advanced/diskCacheSize"] = uint(DiskCache::instance()->maxSize());
 	this->defaultmap["advanced/openCSGLimit"] = RenderSettings::inst()->openCSGTermLimit;
 	this->defaultmap["advanced/forceGoldfeather"] = false;
 
@@ -59,6 +59,13 @@ QGLView::QGLView(const QGLFormat & format, QWidget *parent) : QGLWidget(format,
   init();
 }
 
+QGLView::~QGLView()
+{
+  // The mesh buffers belong to our context, which needn't be current
+  makeCurrent();
+  this->meshcache.clear();
+}
+
 static bool running_under_wine = false;
 
 void QGLView::init()
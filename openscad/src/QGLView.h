@@ -24,6 +24,7 @@ class QGLView : public QGLWidget, public GLView
 public:
 	QGLView(QWidget *parent = NULL);
 	QGLView(const QGLFormat & format, QWidget *parent = NULL);
+	~QGLView();
 #ifdef ENABLE_OPENCSG
 	bool hasOpenCSGSupport() { return this->opencsg_support; }
 #endif
@@ -26,6 +26,7 @@
 
 #include "ThrownTogetherRenderer.h"
 #include "polyset.h"
+#include "GLMeshCache.h"
 #include "csgterm.h"
 
 #include "system-gl.h"
@@ -113,11 +114,11 @@ void ThrownTogetherRenderer::renderCSGChain(CSGChain *chain, bool highlight,
 		}
 		
 		setColor(colormode, c.data());
-		obj.polyset->render_surface(csgmode, m);
+		render_polyset_surface(obj.polyset, csgmode, m);
 		if (showedges) {
 			// FIXME? glColor4f((c[0]+1)/2, (c[1]+1)/2, (c[2]+1)/2, 1.0);
 			setColor(edge_colormode);
-			obj.polyset->render_edges(csgmode);
+			render_polyset_edges(obj.polyset, csgmode);
 		}
 
 		glPopMatrix();
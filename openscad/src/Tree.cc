@@ -1,8 +1,12 @@
 #include "Tree.h"
 #include "nodedumper.h"
+#include "printutils.h"
+#include "hash.h"
 
 #include <assert.h>
 #include <algorithm>
+#include <sstream>
+#include <boost/foreach.hpp>
 
 Tree::~Tree()
 {
@@ -12,14 +16,13 @@ Tree::~Tree()
 
 /*!
 	Returns the cached string representation of the subtree rooted by \a node.
-	If node is not cached, the cache will be rebuilt.
+	If node is not cached, the tree is dumped again, skipping the subtrees
+	which are still cached.
 */
 const std::string &Tree::getString(const AbstractNode &node) const
 {
 	assert(this->root_node);
 	if (!this->nodecache.contains(node)) {
-		this->nodecache.clear();
-		this->nodeidcache.clear();
 		NodeDumper dumper(this->nodecache, false);
 		Traverser trav(dumper, *this->root_node, Traverser::PRE_AND_POSTFIX);
 		trav.execute();
@@ -35,20 +38,42 @@ static bool filter(char c)
 }
 
 /*!
-	Returns the cached ID string representation of the subtree rooted by \a node.
-	If node is not cached, the cache will be rebuilt.
+	Returns the cached ID of the subtree rooted by \a node, which is used as
+	key into the geometry caches. If node is not cached, the IDs of the
+	subtree will be computed.
 
-	The difference between this method and getString() is that the ID string
-	is stripped for whitespace. Especially indentation whitespace is important to
-	strip to enable cache hits for equivalent nodes from different scopes.
+	The ID is a 128-bit structural hash of the node's own description and
+	the IDs of its children, so it is computed bottom-up without dumping the
+	whole subtree for every node. Whitespace is stripped from the description
+	to enable cache hits for equivalent nodes from different scopes.
+
+	Define DEBUG_CACHE_KEYS to keep the whitespace-stripped dump of each
+	subtree as well and report hash collisions.
 */
 const std::string &Tree::getIdString(const AbstractNode &node) const
 {
 	assert(this->root_node);
 	if (!this->nodeidcache.contains(node)) {
-		std::string str = getString(node);
-		str.erase(std::remove_if(str.begin(), str.end(), filter), str.end());
-		return this->nodeidcache.insert(node, str);
+#ifdef DEBUG_CACHE_KEYS
+		std::string text = getString(node);
+		text.erase(std::remove_if(text.begin(), text.end(), filter), text.end());
+#endif
+		std::stringstream stream;
+		stream << node;
+		std::string desc = stream.str();
+		desc.erase(std::remove_if(desc.begin(), desc.end(), filter), desc.end());
+		desc += "{";
+		BOOST_FOREACH(const AbstractNode *chnode, node.getChildren()) {
+			desc += getIdString(*chnode);
+		}
+		desc += "}";
+		std::string id = hash128(desc);
+#ifdef DEBUG_CACHE_KEYS
+		std::map<std::string, std::string>::const_iterator it = this->idtexts.find(id);
+		if (it == this->idtexts.end()) this->idtexts[id] = text;
+		else if (it->second != text) PRINTB("WARNING: Cache key collision for %s:\n%s\n%s", id % it->second % text);
+#endif
+		return this->nodeidcache.insert(node, id);
 	}
 	return this->nodeidcache[node];
 }
@@ -60,4 +85,50 @@ void Tree::setRoot(const AbstractNode *root)
 {
 	this->root_node = root; 
 	this->nodecache.clear();
+	this->nodeidcache.clear();
+}
+
+static void mark_reachable(const AbstractNode &node, std::vector<bool> &reachable)
+{
+	if (reachable.size() <= node.index()) reachable.resize(node.index() + 1);
+	reachable[node.index()] = true;
+	BOOST_FOREACH(const AbstractNode *chnode, node.getChildren()) {
+		mark_reachable(*chnode, reachable);
+	}
+}
+
+/*!
+	Sets a new root which may share subtrees with the old one. Only what is
+	cached for nodes of the new tree is kept.
+ */
+void Tree::updateRoot(const AbstractNode *root)
+{
+	this->root_node = root;
+	std::vector<bool> reachable;
+	if (root) mark_reachable(*root, reachable);
+	this->nodecache.retain(reachable);
+	this->nodeidcache.retain(reachable);
+}
+
+/*!
+	Forgets what is cached for \a node and its ancestors, after \a node was
+	modified in place.
+ */
+void Tree::invalidate(const AbstractNode &node)
+{
+	if (this->root_node) invalidatePath(*this->root_node, node);
+}
+
+bool Tree::invalidatePath(const AbstractNode &node, const AbstractNode &target)
+{
+	bool found = (&node == &target);
+	BOOST_FOREACH(const AbstractNode *chnode, node.getChildren()) {
+		if (found) break;
+		found = invalidatePath(*chnode, target);
+	}
+	if (found) {
+		this->nodecache.remove(node);
+		this->nodeidcache.remove(node);
+	}
+	return found;
 }
@@ -2,12 +2,17 @@
 #define TREE_H_
 
 #include "nodecache.h"
+#ifdef DEBUG_CACHE_KEYS
+#include <map>
+#endif
 
 /*!  
 	For now, just an abstraction of the node tree which keeps a dump
 	cache based on node indices around.
 
-	Note that since node trees don't survive a recompilation, the tree cannot either.
+	Node trees don't survive a recompilation, except for the subtrees the GUI
+	reuses (see InstantiationCache), which keep their indices. updateRoot()
+	keeps what is cached for those.
  */
 class Tree
 {
@@ -16,15 +21,23 @@ public:
 	~Tree();
 
 	void setRoot(const AbstractNode *root);
+	void updateRoot(const AbstractNode *root);
+	void invalidate(const AbstractNode &node);
 	const AbstractNode *root() const { return this->root_node; }
 
 	const std::string &getString(const AbstractNode &node) const;
 	const std::string &getIdString(const AbstractNode &node) const;
 
 private:
+	bool invalidatePath(const AbstractNode &node, const AbstractNode &target);
+
 	const AbstractNode *root_node;
   mutable NodeCache nodecache;
   mutable NodeCache nodeidcache;
+#ifdef DEBUG_CACHE_KEYS
+	// Subtree dump per ID, for detecting hash collisions
+	mutable std::map<std::string, std::string> idtexts;
+#endif
 };
 
 #endif
@@ -60,6 +60,9 @@ AbstractNode *CgaladvModule::instantiate(const Context *ctx, const ModuleInstant
 	if (type == RESIZE)
 		args += Assignment("newsize", NULL), Assignment("auto", NULL);
 
+	if (type == SWEEP)
+		args += Assignment("direction", NULL), Assignment("length", NULL), Assignment("convexity", NULL);
+
 	Context c(ctx);
 	c.setVariables(args, evalctx);
 
@@ -102,6 +105,19 @@ AbstractNode *CgaladvModule::instantiate(const Context *ctx, const ModuleInstant
 		}
 	}
 
+	if (type == SWEEP) {
+		convexity = c.lookup_variable("convexity", true);
+		Value direction = c.lookup_variable("direction");
+		node->direction << 0,0,1;
+		if ( direction.type() == Value::VECTOR ) {
+			Value::VectorType vd = direction.toVector();
+			for (size_t i = 0; i < 3; i++) node->direction[i] = i < vd.size() ? vd[i].toDouble() : 0;
+		}
+		// Without a length, the object is swept by the direction vector itself
+		Value length = c.lookup_variable("length", true);
+		node->length = length.type() == Value::NUMBER ? length.toDouble() : node->direction.norm();
+	}
+
 	node->convexity = (int)convexity.toDouble();
 	node->path = path;
 	node->subdiv_type = subdiv_type.toString();
@@ -139,6 +155,9 @@ std::string CgaladvNode::name() const
 	case RESIZE:
 		return "resize";
 		break;
+	case SWEEP:
+		return "sweep";
+		break;
 	default:
 		assert(false);
 	}
@@ -170,6 +189,12 @@ std::string CgaladvNode::toString() const
 		  << this->autosize[0] << "," << this->autosize[1] << "," << this->autosize[2] << "]"
 		  << ")";
 		break;
+	case SWEEP:
+		stream << "(direction = ["
+		  << this->direction[0] << "," << this->direction[1] << "," << this->direction[2] << "]"
+		  << ", length = " << this->length
+		  << ", convexity = " << this->convexity << ")";
+		break;
 	default:
 		assert(false);
 	}
@@ -184,4 +209,5 @@ void register_builtin_cgaladv()
 	Builtins::init("subdiv", new CgaladvModule(SUBDIV));
 	Builtins::init("hull", new CgaladvModule(HULL));
 	Builtins::init("resize", new CgaladvModule(RESIZE));
+	Builtins::init("sweep", new CgaladvModule(SWEEP));
 }
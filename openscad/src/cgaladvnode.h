@@ -11,7 +11,8 @@ enum cgaladv_type_e {
 	GLIDE,
 	SUBDIV,
 	HULL,
-	RESIZE
+	RESIZE,
+	SWEEP
 };
 
 class CgaladvNode : public AbstractNode
@@ -19,6 +20,7 @@ class CgaladvNode : public AbstractNode
 public:
 	CgaladvNode(const ModuleInstantiation *mi, cgaladv_type_e type) : AbstractNode(mi), type(type) {
 		convexity = 1;
+		length = 0;
 	}
 	virtual ~CgaladvNode() { }
   virtual Response accept(class State &state, Visitor &visitor) const {
@@ -33,6 +35,8 @@ public:
 	int convexity, level;
 	Vector3d newsize;
 	Eigen::Matrix<bool,3,1> autosize;
+	Vector3d direction;
+	double length;
 	cgaladv_type_e type;
 };
 
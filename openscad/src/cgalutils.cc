@@ -7,6 +7,35 @@
 #include "cgal.h"
 
 #include <map>
+#include <boost/thread/mutex.hpp>
+
+namespace {
+	boost::mutex error_behaviour_mutex;
+	bool error_behaviour_held = false;
+}
+
+CGAL::Failure_behaviour set_cgal_error_behaviour(CGAL::Failure_behaviour eb)
+{
+	boost::mutex::scoped_lock lock(error_behaviour_mutex);
+	if (error_behaviour_held) return CGAL::THROW_EXCEPTION;
+	return set_cgal_error_behaviour(eb);
+}
+
+HoldCGALErrorBehaviour::HoldCGALErrorBehaviour() : outermost(false)
+{
+	boost::mutex::scoped_lock lock(error_behaviour_mutex);
+	if (error_behaviour_held) return;
+	this->old_behaviour = set_cgal_error_behaviour(CGAL::THROW_EXCEPTION);
+	this->outermost = error_behaviour_held = true;
+}
+
+HoldCGALErrorBehaviour::~HoldCGALErrorBehaviour()
+{
+	if (!this->outermost) return;
+	boost::mutex::scoped_lock lock(error_behaviour_mutex);
+	set_cgal_error_behaviour(this->old_behaviour);
+	error_behaviour_held = false;
+}
 
 PolySet *createPolySetFromPolyhedron(const CGAL_Polyhedron &p)
 {
@@ -130,7 +159,7 @@ public:
 CGAL_Polyhedron *createPolyhedronFromPolySet(const PolySet &ps)
 {
 	CGAL_Polyhedron *P = NULL;
-	CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
+	CGAL::Failure_behaviour old_behaviour = set_cgal_error_behaviour(CGAL::THROW_EXCEPTION);
 	try {
 		P = new CGAL_Polyhedron;
 		CGAL_Build_PolySet builder(ps);
@@ -141,7 +170,7 @@ CGAL_Polyhedron *createPolyhedronFromPolySet(const PolySet &ps)
 		delete P;
 		P = NULL;
 	}
-	CGAL::set_error_behaviour(old_behaviour);
+	set_cgal_error_behaviour(old_behaviour);
 	return P;
 }
 
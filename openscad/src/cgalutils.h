@@ -7,6 +7,29 @@ CGAL_Polyhedron *createPolyhedronFromPolySet(const class PolySet &ps);
 CGAL_Iso_cuboid_3 bounding_box( const CGAL_Nef_polyhedron3 &N );
 CGAL_Iso_rectangle_2e bounding_box( const CGAL_Nef_polyhedron2 &N );
 
+/*!
+	Use instead of CGAL::set_error_behaviour(), which sets a process-wide
+	value. While a HoldCGALErrorBehaviour exists, the behaviour stays at
+	THROW_EXCEPTION and this does nothing but return it.
+*/
+CGAL::Failure_behaviour set_cgal_error_behaviour(CGAL::Failure_behaviour eb);
+
+/*!
+	Keeps CGAL's error behaviour at THROW_EXCEPTION while in scope, so that
+	threads evaluating in parallel don't set and restore it under each
+	other. Create it on the thread which starts the workers; one created
+	while another exists does nothing.
+*/
+class HoldCGALErrorBehaviour
+{
+public:
+	HoldCGALErrorBehaviour();
+	~HoldCGALErrorBehaviour();
+private:
+	bool outermost;
+	CGAL::Failure_behaviour old_behaviour;
+};
+
 #include "svg.h"
 #include "printutils.h"
 
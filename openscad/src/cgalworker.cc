@@ -35,6 +35,9 @@ void CGALWorker::work()
 	catch (const ProgressCancelException &e) {
 		PRINT("Rendering cancelled.");
 	}
+	catch (const std::exception &e) {
+		PRINTB("ERROR: Rendering failed: %s", e.what());
+	}
 
 	emit done(root_N);
 	thread->quit();
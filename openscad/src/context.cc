@@ -31,26 +31,39 @@
 #include "module.h"
 #include "builtin.h"
 #include "printutils.h"
+#include "instantiationcache.h"
 #include <boost/foreach.hpp>
+#include <boost/thread/tss.hpp>
 #include <boost/filesystem.hpp>
 namespace fs = boost::filesystem;
 #include "boosty.h"
 
-std::vector<const Context*> Context::ctx_stack;
+bool Context::threaded = false;
+unsigned long Context::next_serial = 1;
+
+static std::vector<const Context*> main_ctx_stack;
+static boost::thread_specific_ptr<std::vector<const Context*> > thread_ctx_stack;
+
+std::vector<const Context*> &Context::ctx_stack()
+{
+	if (!threaded) return main_ctx_stack;
+	if (!thread_ctx_stack.get()) thread_ctx_stack.reset(new std::vector<const Context*>);
+	return *thread_ctx_stack;
+}
 
 /*!
 	Initializes this context. Optionally initializes a context for an external library
 */
 Context::Context(const Context *parent)
-	: parent(parent)
+	: parent(parent), serial(threaded ? 0 : next_serial++)
 {
-	ctx_stack.push_back(this);
+	ctx_stack().push_back(this);
 	if (parent) document_path = parent->document_path;
 }
 
 Context::~Context()
 {
-	ctx_stack.pop_back();
+	ctx_stack().pop_back();
 }
 
 /*!
@@ -98,25 +111,74 @@ void Context::set_constant(const std::string &name, const Value &value)
 
 Value Context::lookup_variable(const std::string &name, bool silent) const
 {
-	if (name[0] == '$') {
-		for (int i = ctx_stack.size()-1; i >= 0; i--) {
-			const ValueMap &confvars = ctx_stack[i]->config_variables;
-			if (confvars.find(name) != confvars.end())
-				return confvars.find(name)->second;
-		}
-		return Value();
+	return lookup_variable(name, boost::hash<std::string>()(name), silent);
+}
+
+namespace {
+	// Hashes every key to the hash of the name being looked up, so a lookup
+	// doesn't rehash the name once per context
+	struct PrecomputedHash {
+		size_t hash;
+		PrecomputedHash(size_t hash) : hash(hash) {}
+		size_t operator()(const std::string &) const { return this->hash; }
+	};
+}
+
+/*!
+	Looks up a variable given the boost::hash of its name, which expressions
+	compute once when they are parsed.
+*/
+Value Context::lookup_variable(const std::string &name, size_t hash, bool silent) const
+{
+	const Context *found;
+	const Value *value = find_variable(name, hash, found);
+	if (InstantiationCache *cache = InstantiationCache::active()) {
+		cache->readVariable(this, found, name, value ? *value : Value());
 	}
-	if (!this->parent && this->constants.find(name) != this->constants.end())
-		return this->constants.find(name)->second;
-	if (this->variables.find(name) != this->variables.end())
-		return this->variables.find(name)->second;
-	if (this->parent)
-		return this->parent->lookup_variable(name, silent);
+	if (value) return *value;
 	if (!silent)
 		PRINTB("WARNING: Ignoring unknown variable '%s'.", name);
 	return Value();
 }
 
+/*!
+	Returns the variable lookup_variable() would return and sets found to
+	the context defining it, or returns NULL and sets found to NULL.
+*/
+const Value *Context::find_variable(const std::string &name, size_t hash, const Context *&found) const
+{
+	PrecomputedHash hasher(hash);
+	std::equal_to<std::string> eq;
+	if (name[0] == '$') {
+		const std::vector<const Context*> &stack = ctx_stack();
+		for (int i = stack.size()-1; i >= 0; i--) {
+			const ValueMap &confvars = stack[i]->config_variables;
+			ValueMap::const_iterator it = confvars.find(name, hasher, eq);
+			if (it != confvars.end()) {
+				found = stack[i];
+				return &it->second;
+			}
+		}
+		found = NULL;
+		return NULL;
+	}
+	const Context *ctx = this;
+	for (; ctx->parent; ctx = ctx->parent) {
+		ValueMap::const_iterator it = ctx->variables.find(name, hasher, eq);
+		if (it != ctx->variables.end()) {
+			found = ctx;
+			return &it->second;
+		}
+	}
+	found = ctx;
+	ValueMap::const_iterator it = ctx->constants.find(name, hasher, eq);
+	if (it != ctx->constants.end()) return &it->second;
+	it = ctx->variables.find(name, hasher, eq);
+	if (it != ctx->variables.end()) return &it->second;
+	found = NULL;
+	return NULL;
+}
+
 Value Context::evaluate_function(const std::string &name, const EvalContext *evalctx) const
 {
 	if (this->parent) return this->parent->evaluate_function(name, evalctx);
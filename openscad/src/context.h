@@ -23,6 +23,8 @@ public:
 	void set_constant(const std::string &name, const Value &value);
 
 	Value lookup_variable(const std::string &name, bool silent = false) const;
+	Value lookup_variable(const std::string &name, size_t hash, bool silent = false) const;
+	const Value *find_variable(const std::string &name, size_t hash, const Context *&found) const;
 
 	void setDocumentPath(const std::string &path) { this->document_path = path; }
 	const std::string &documentPath() const { return this->document_path; }
@@ -31,9 +33,23 @@ public:
 public:
 	const Context *parent;
 
-	static std::vector<const Context*> ctx_stack;
+	// Creation order of the contexts of the main thread. A context's parents
+	// have smaller serials.
+	unsigned long serial;
+	static unsigned long nextSerial() { return next_serial; }
+
+	// The contexts alive on the calling thread, innermost last
+	static std::vector<const Context*> &ctx_stack();
+
+	// Set while the iterations of a for loop are instantiated on several
+	// threads. Each keeps its own context stack, starting from a copy of
+	// the stack of the thread which started it, its own recursion counts
+	// and its own messages, and leaves its nodes to be numbered afterwards.
+	static bool threaded;
 
 protected:
+	static unsigned long next_serial;
+
 	typedef boost::unordered_map<std::string, Value> ValueMap;
 	ValueMap constants;
 	ValueMap variables;
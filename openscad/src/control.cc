@@ -30,7 +30,11 @@
 #include "modcontext.h"
 #include "builtin.h"
 #include "printutils.h"
+#include "instantiationcache.h"
 #include <sstream>
+#include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 
 enum control_type_e {
 	CHILD,
@@ -49,13 +53,50 @@ public:
 	virtual AbstractNode *instantiate(const Context *ctx, const ModuleInstantiation *inst, const EvalContext *evalctx) const;
 };
 
-void for_eval(AbstractNode &node, const ModuleInstantiation &inst, size_t l, 
-							const Context *ctx, const EvalContext *evalctx)
+int instantiation_threads = 1;
+
+// Loops with fewer iterations are instantiated in sequence, as starting
+// the threads would cost more than it saves
+static const size_t PARALLEL_ITERATIONS = 64;
+
+struct ForIteration
+{
+	Value value;
+	std::vector<AbstractNode *> nodes;
+	std::vector<std::string> messages;
+};
+
+static void for_eval(std::vector<AbstractNode *> &children, const ModuleInstantiation &inst, size_t l, 
+										 const Context *ctx, const EvalContext *evalctx);
+
+/*!
+	Instantiates the iterations first, first + step, ... of loop level l
+	on a thread of its own, starting from a copy of the context stack of
+	the thread which started it. The nodes and messages of each iteration
+	are kept for that thread to collect in order.
+*/
+static void for_eval_thread(const ModuleInstantiation &inst, size_t l, const Context *ctx, const EvalContext *evalctx,
+														const std::string &it_name, const std::vector<const Context*> &ctx_stack,
+														size_t first, size_t step, std::vector<ForIteration> &iterations)
+{
+	Context::ctx_stack() = ctx_stack;
+
+	Context c(ctx);
+	for (size_t i = first; i < iterations.size(); i += step) {
+		c.set_variable(it_name, iterations[i].value);
+		print_capture_begin();
+		for_eval(iterations[i].nodes, inst, l+1, &c, evalctx);
+		iterations[i].messages = print_capture_end();
+	}
+}
+
+static void for_eval(std::vector<AbstractNode *> &children, const ModuleInstantiation &inst, size_t l, 
+										 const Context *ctx, const EvalContext *evalctx)
 {
 	if (evalctx->numArgs() > l) {
 		const std::string &it_name = evalctx->getArgName(l);
 		const Value &it_values = evalctx->getArgValue(l, ctx);
-		Context c(ctx);
+		std::vector<Value> values;
 		if (it_values.type() == Value::RANGE) {
 			Value::RangeType range = it_values.toRange();
 			if (range.end < range.begin) {
@@ -65,24 +106,55 @@ void for_eval(AbstractNode &node, const ModuleInstantiation &inst, size_t l,
 			}
 			if (range.step > 0 && (range.begin-range.end)/range.step < 10000) {
 				for (double i = range.begin; i <= range.end; i += range.step) {
-					c.set_variable(it_name, Value(i));
-					for_eval(node, inst, l+1, &c, evalctx);
+					values.push_back(Value(i));
 				}
 			}
 		}
 		else if (it_values.type() == Value::VECTOR) {
-			for (size_t i = 0; i < it_values.toVector().size(); i++) {
-				c.set_variable(it_name, it_values.toVector()[i]);
-				for_eval(node, inst, l+1, &c, evalctx);
-			}
+			values = it_values.toVector();
 		}
 		else if (it_values.type() != Value::UNDEFINED) {
-			c.set_variable(it_name, it_values);
-			for_eval(node, inst, l+1, &c, evalctx);
+			values.push_back(it_values);
+		}
+
+		size_t threads = instantiation_threads > 0 ? instantiation_threads : boost::thread::hardware_concurrency();
+		// Loops nested in the iterations of a parallel loop run in sequence
+		if (threads > 1 && values.size() >= PARALLEL_ITERATIONS && !Context::threaded) {
+			std::vector<ForIteration> iterations(values.size());
+			for (size_t i = 0; i < values.size(); i++) iterations[i].value = values[i];
+			// Give the threads as much stack as the main thread usually has,
+			// for deeply nested module calls
+			boost::thread::attributes attrs;
+			attrs.set_stack_size(8 * 1024 * 1024);
+			const std::vector<const Context*> &ctx_stack = Context::ctx_stack();
+			// The threads don't record what they read
+			if (InstantiationCache *cache = InstantiationCache::active()) cache->uncacheable();
+			Context::threaded = true;
+			boost::thread_group group;
+			for (size_t i = 0; i < threads; i++) {
+				group.add_thread(new boost::thread(attrs, boost::bind(&for_eval_thread, boost::cref(inst), l, ctx, evalctx,
+																															boost::cref(it_name), boost::cref(ctx_stack),
+																															i, threads, boost::ref(iterations))));
+			}
+			group.join_all();
+			Context::threaded = false;
+
+			BOOST_FOREACH(ForIteration &iteration, iterations) {
+				BOOST_FOREACH(const std::string &msg, iteration.messages) PRINT(msg);
+				BOOST_FOREACH(AbstractNode *node, iteration.nodes) AbstractNode::renumber(node);
+				children.insert(children.end(), iteration.nodes.begin(), iteration.nodes.end());
+			}
+		}
+		else {
+			Context c(ctx);
+			BOOST_FOREACH(const Value &value, values) {
+				c.set_variable(it_name, value);
+				for_eval(children, inst, l+1, &c, evalctx);
+			}
 		}
 	} else if (l > 0) {
 		std::vector<AbstractNode *> instantiatednodes = inst.instantiateChildren(ctx);
-		node.children.insert(node.children.end(), instantiatednodes.begin(), instantiatednodes.end());
+		children.insert(children.end(), instantiatednodes.begin(), instantiatednodes.end());
 	}
 }
 
@@ -113,6 +185,9 @@ AbstractNode *ControlModule::instantiate(const Context *ctx, const ModuleInstant
         // This will trigger if trying to invoke child from the root of any file
         // assert(filectx->evalctx);
 
+				// The children belong to the caller of the module, so what
+				// instantiates them can't be reused on its own
+				if (InstantiationCache *cache = InstantiationCache::active()) cache->readChildren(filectx);
 				if (filectx->evalctx) {
 					if (n < (int)filectx->evalctx->numChildren()) {
 						node = filectx->evalctx->getChild(n)->evaluate(filectx->evalctx);
@@ -161,7 +236,7 @@ AbstractNode *ControlModule::instantiate(const Context *ctx, const ModuleInstant
 
 	if (type == FOR || type == INT_FOR)
 	{
-		for_eval(*node, *inst, 0, evalctx, evalctx);
+		for_eval(node->children, *inst, 0, evalctx, evalctx);
 	}
 
 	if (type == IF)
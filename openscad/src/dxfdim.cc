@@ -32,6 +32,7 @@
 #include "printutils.h"
 #include "fileutils.h"
 #include "evalcontext.h"
+#include "instantiationcache.h"
 
 #include "mathc99.h"
 #include <sstream>
@@ -39,8 +40,11 @@
 #include <stdint.h>
 
 #include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
 boost::unordered_map<std::string,Value> dxf_dim_cache;
 boost::unordered_map<std::string,Value> dxf_cross_cache;
+// The iterations of a for loop may be instantiated on several threads
+static boost::mutex dxf_cache_mutex;
 namespace fs = boost::filesystem;
 
 Value builtin_dxf_dim(const Context *ctx, const EvalContext *evalctx)
@@ -68,6 +72,7 @@ Value builtin_dxf_dim(const Context *ctx, const EvalContext *evalctx)
 		if (evalctx->getArgName(i) == "name")
 			name = evalctx->getArgValue(i).toString();
 	}
+	if (InstantiationCache *cache = InstantiationCache::active()) cache->readFile(filename);
 
 	std::stringstream keystream;
 	fs::path filepath(filename);
@@ -81,6 +86,7 @@ Value builtin_dxf_dim(const Context *ctx, const EvalContext *evalctx)
 						<< "|" << yorigin <<"|" << scale << "|" << lastwritetime
 						<< "|" << filesize;
 	std::string key = keystream.str();
+	boost::mutex::scoped_lock lock(dxf_cache_mutex);
 	if (dxf_dim_cache.find(key) != dxf_dim_cache.end())
 		return dxf_dim_cache.find(key)->second;
 
@@ -160,6 +166,7 @@ Value builtin_dxf_cross(const Context *ctx, const EvalContext *evalctx)
 		if (evalctx->getArgName(i) == "scale")
 			evalctx->getArgValue(i).getDouble(scale);
 	}
+	if (InstantiationCache *cache = InstantiationCache::active()) cache->readFile(filename);
 
 	std::stringstream keystream;
 	fs::path filepath(filename);
@@ -174,6 +181,7 @@ Value builtin_dxf_cross(const Context *ctx, const EvalContext *evalctx)
 						<< "|" << filesize;
 	std::string key = keystream.str();
 
+	boost::mutex::scoped_lock lock(dxf_cache_mutex);
 	if (dxf_cross_cache.find(key) != dxf_cross_cache.end())
 		return dxf_cross_cache.find(key)->second;
 
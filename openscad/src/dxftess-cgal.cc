@@ -4,6 +4,7 @@
 #include "polyset.h"
 #include "grid.h"
 #include "cgal.h"
+#include "cgalutils.h"
 
 #ifdef NDEBUG
 #define PREV_NDEBUG NDEBUG
@@ -111,7 +112,7 @@ void dxf_tesselate(PolySet *ps, DxfData &dxf, double rot, Vector2d scale, bool u
 	boost::unordered_map<edge_t,int> edge_to_path;
 	int duplicate_vertices = 0;
 
-	CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
+	CGAL::Failure_behaviour old_behaviour = set_cgal_error_behaviour(CGAL::THROW_EXCEPTION);
 	try {
 
 	// read path data and copy all relevant infos
@@ -174,10 +175,10 @@ void dxf_tesselate(PolySet *ps, DxfData &dxf, double rot, Vector2d scale, bool u
 	}
 	catch (const CGAL::Assertion_exception &e) {
 		PRINTB("CGAL error in dxf_tesselate(): %s", e.what());
-		CGAL::set_error_behaviour(old_behaviour);
+		set_cgal_error_behaviour(old_behaviour);
 		return;
 	}
-	CGAL::set_error_behaviour(old_behaviour);
+	set_cgal_error_behaviour(old_behaviour);
 
 	// run delaunay triangulation
 	std::list<CDTPoint> list_of_seeds;
@@ -0,0 +1,415 @@
+#include "enclosure.h"
+#include "voxelizer.h"
+#include "marchingcubes.h"
+#include "polyset.h"
+#include "dxfdata.h"
+#include "polygonindex.h"
+#include "screwplacer.h"
+#include "meshslicer.h"
+#include "dxftess.h"
+#include "importnode.h"
+#include "csgnode.h"
+#include "module.h"
+#include "modcontext.h"
+#include "openscad.h"
+#include "printutils.h"
+#include "export.h"
+#include "Tree.h"
+#include "PolySetCache.h"
+#include "CGALEvaluator.h"
+#include "CGAL_Nef_polyhedron.h"
+#include "boosty.h"
+
+#include <QTime>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
+
+/*!
+	Loads an STL file through the same code path as import().
+	The mesh is kept in the PolySetCache under the import node's string,
+	which includes the file timestamp, so repeated loads of an unchanged
+	file don't parse it again. Returns an empty pointer if the file can't
+	be read.
+*/
+shared_ptr<PolySet> import_stl(const std::string &filename)
+{
+	ModuleInstantiation inst("import");
+	ImportNode node(&inst, TYPE_STL);
+	node.filename = filename;
+	node.convexity = 1;
+	node.fn = node.fs = node.fa = 0;
+	node.origin_x = node.origin_y = 0;
+	node.scale = 1;
+
+	std::string key = node.toString();
+	if (PolySetCache::instance()->contains(key)) return PolySetCache::instance()->get(key);
+	shared_ptr<PolySet> ps(node.evaluate_polyset(NULL));
+	if (ps) PolySetCache::instance()->insert(key, ps);
+	return ps;
+}
+
+/*!
+	Returns the target swept along the insertion direction, i.e. the cavity
+	which has to be cut out of the enclosure for the target to slide in.
+	Returns NULL if the target is empty.
+*/
+PolySet *sweep_insertion(const PolySet &target, const Vector3d &direction, int resolution)
+{
+	VoxelGrid *grid = voxelize(target, resolution);
+	if (!grid) return NULL;
+	sweep_voxels(*grid, direction);
+	PolySet *ps = marching_cubes(*grid);
+	delete grid;
+	ps->convexity = 2;
+	return ps;
+}
+
+/*!
+	Builds the cut plane frame used by the GUI from a plane equation
+	normal.p = offset. As with the plane drawn in the GUI, the local y axis
+	is the plane normal and the origin lies on the plane.
+*/
+Transform3d cut_plane_transform(const Vector3d &normal, double offset)
+{
+	Vector3d y = normal.normalized();
+	Vector3d ref = fabs(y[2]) < 0.9 ? Vector3d(0, 0, 1) : Vector3d(1, 0, 0);
+	Vector3d x = y.cross(ref).normalized();
+	Vector3d z = x.cross(y);
+
+	Transform3d m = Transform3d::Identity();
+	for (int i = 0; i < 3; i++) {
+		m(i, 0) = x[i];
+		m(i, 1) = y[i];
+		m(i, 2) = z[i];
+		m(i, 3) = offset * y[i];
+	}
+	return m;
+}
+
+/*!
+	Returns the transform which moves the cut plane onto z=0, where
+	projection(cut = true) slices.
+*/
+Transform3d cross_section_transform(const Transform3d &cutplane)
+{
+	Transform3d rot90 = Transform3d::Identity();
+	rot90(1,1) = cos(90*3.14159/180.0);
+	rot90(1,2) = -1*sin(90*3.14159/180.0);
+	rot90(2,1) = sin(90*3.14159/180.0);
+	rot90(2,2) = cos(90*3.14159/180.0);
+	return rot90 * Transform3d(cutplane.inverse());
+}
+
+static std::string multmatrix_scad(const Transform3d &m)
+{
+	std::stringstream out;
+	out << "multmatrix(m = [ [" << m(0,0) << " , " << m(0,1) << " , " << m(0,2) << " , " << m(0,3) << " ], ";
+	out << "[ " << m(1,0) << " , " << m(1,1) << " , " << m(1,2) << " , " << m(1,3) << " ], ";
+	out << "[ " << m(2,0) << " , " << m(2,1) << " , " << m(2,2) << " , " << m(2,3) << " ], ";
+	out << "[ " << m(3,0) << " , " << m(3,1) << " , " << m(3,2) << " , " << m(3,3) << " ] ] ) ";
+	return out.str();
+}
+
+/*!
+	Returns the cross section of ps at z=0 after applying section (see
+	cross_section_transform()), as projection(cut = true) would, but
+	sliced directly from the mesh instead of through a Nef polyhedron.
+*/
+CGAL_Nef_polyhedron cross_section(const PolySet &ps, const Transform3d &section)
+{
+	DxfData *dd = slice_mesh(ps, section);
+	PolySet tess;
+	tess.is2d = true;
+	if (!dd->paths.empty()) dxf_tesselate(&tess, *dd, 0, Vector2d(1,1), true, false, 0);
+	delete dd;
+
+	Tree nulltree;
+	CGALEvaluator tmpeval(nulltree);
+	return tmpeval.evaluateCGALMesh(tess);
+}
+
+/*!
+	SCAD code for the final enclosure: the enclosure minus a nut and screw
+	assembly at each screw position on the cut plane. The swept target is
+	subtracted too once subtract_inserted_mesh() has added it to the tree.
+	unsection maps the cross section frame back to the model, i.e. it's the
+	inverse of cross_section_transform().
+*/
+std::string screw_assembly_scad(const std::string &enclosure, const Transform3d &unsection,
+																const Vector2d screws[3])
+{
+	std::stringstream out;
+	out << "module nutAssembly(){ cylinder(r= 6.5/2, h=100, $fn = 6, center=[0,0]); translate([0, 0, 1]) rotate(a=-180, v=[0,1,0]) cylinder(r= 3.8/2, h=100, $fn = 100, center=[0,0]); translate([0, 0, -5]) rotate(a=-180, v=[0,1,0]) cylinder(r= 3.5, h=100, $fn = 100, center=[0,0]);} ";
+	out << "difference(){ {import(\"" << enclosure << "\", convexity=2);} ";
+	for (int i = 0; i < 3; i++) {
+		Transform3d pos = Transform3d::Identity();
+		pos(0,3) = screws[i][0];
+		pos(1,3) = screws[i][1];
+		out << multmatrix_scad(pos * unsection);
+		out << "nutAssembly();";
+	}
+	out << "} ";
+	return out.str();
+}
+
+/*!
+	Appends a node holding inserted to the top level difference() of a tree
+	compiled from generated SCAD code, so the swept target is cut out of the
+	enclosure. Returns the modified difference() node, or NULL if there's
+	none.
+*/
+AbstractNode *subtract_inserted_mesh(AbstractNode *root, const shared_ptr<PolySet> &inserted)
+{
+	static ModuleInstantiation inst("mesh");
+	BOOST_FOREACH(AbstractNode *child, root->children) {
+		CsgNode *csg = dynamic_cast<CsgNode *>(child);
+		if (csg && csg->type == CSG_TYPE_DIFFERENCE) {
+			csg->children.push_back(new MeshNode(&inst, inserted, 2));
+			return csg;
+		}
+	}
+	return NULL;
+}
+
+/*!
+	Finds where the cavity section touches the target section.
+
+	points receives the indices of the cavity outline points lying within
+	tolerance of a point of the target outlines. Target points are hashed
+	into square cells of size tolerance, so each cavity point only looks
+	at the 3 x 3 cells around it. A tolerance of 0 matches exactly equal
+	points only.
+
+	segments receives the cavity outline edges, as pairs of point indices,
+	whose end points and midpoint all lie within tolerance of the target
+	outlines; this also finds contacts along target edges which the cavity
+	outline splits. Needs a positive tolerance, as the midpoint of a
+	shared edge is rounded.
+*/
+void find_cavity_contacts(const DxfData &cavity, const DxfData &target, double tolerance,
+													std::vector<int> &points, std::vector<std::pair<int,int> > &segments)
+{
+	points.clear();
+	segments.clear();
+	double cell = tolerance > 0 ? tolerance : GRID_FINE;
+
+	typedef std::pair<int64_t,int64_t> CellKey;
+	boost::unordered_multimap<CellKey, int> cells;
+	BOOST_FOREACH(const DxfData::Path &path, target.paths) {
+		BOOST_FOREACH(int i, path.indices) {
+			const Vector2d &p = target.points[i];
+			cells.insert(std::make_pair(CellKey(int64_t(floor(p[0] / cell)), int64_t(floor(p[1] / cell))), i));
+		}
+	}
+
+	std::vector<bool> seen(cavity.points.size(), false);
+	BOOST_FOREACH(const DxfData::Path &path, cavity.paths) {
+		BOOST_FOREACH(int i, path.indices) {
+			if (seen[i]) continue;
+			seen[i] = true;
+			const Vector2d &p = cavity.points[i];
+			int64_t cx = int64_t(floor(p[0] / cell)), cy = int64_t(floor(p[1] / cell));
+			bool found = false;
+			for (int64_t x = cx - 1; x <= cx + 1 && !found; x++) {
+				for (int64_t y = cy - 1; y <= cy + 1 && !found; y++) {
+					typedef boost::unordered_multimap<CellKey, int>::const_iterator iter_t;
+					std::pair<iter_t, iter_t> range = cells.equal_range(CellKey(x, y));
+					for (iter_t it = range.first; it != range.second && !found; ++it) {
+						found = (target.points[it->second] - p).norm() <= tolerance;
+					}
+				}
+			}
+			if (found) points.push_back(i);
+		}
+	}
+
+	if (tolerance <= 0) return;
+	PolygonIndex index(target);
+	if (index.isEmpty()) return;
+	BOOST_FOREACH(const DxfData::Path &path, cavity.paths) {
+		for (size_t k = 1; k < path.indices.size(); k++) {
+			const Vector2d &p = cavity.points[path.indices[k - 1]], &q = cavity.points[path.indices[k]];
+			Vector2d m = (p + q) / 2;
+			if (index.distance(p[0], p[1], 2 * tolerance) <= tolerance &&
+					index.distance(q[0], q[1], 2 * tolerance) <= tolerance &&
+					index.distance(m[0], m[1], 2 * tolerance) <= tolerance) {
+				segments.push_back(std::make_pair(path.indices[k - 1], path.indices[k]));
+			}
+		}
+	}
+}
+
+/*!
+	Places three screws inside the cross section of the enclosure cavity,
+	at least 5 mm away from its outline, on a 1/5 mm grid. See ScrewPlacer
+	for the optimization; one run is made per core.
+
+	Only sections consisting of a single outline are supported. Returns
+	SCREWS_NOT_SINGLE_OUTLINE for anything else, and SCREWS_NO_ROOM if no
+	cell is far enough from the outline.
+*/
+screw_placement_e find_screw_positions(const DxfData &dd, Vector2d screws[3])
+{
+	if (dd.paths.size() != 1) return SCREWS_NOT_SINGLE_OUTLINE;
+
+	PolygonIndex index(dd);
+	double minX = index.minX(), minY = index.minY();
+	int xDist = int(index.maxX()-minX) + 1;
+	int yDist = int(index.maxY()-minY) + 1;
+	int gridSpacing = 5;
+	const double minEdgeDist = 5; // mm
+	int threads = std::max(1, int(boost::thread::hardware_concurrency()));
+
+	DistanceField *field = index.signedDistanceField(minX, minY, 1.0 / gridSpacing, gridSpacing*xDist, gridSpacing*yDist,
+																									 minEdgeDist, threads);
+	ScrewPlacer placer(*field, minEdgeDist);
+	int gridSize = field->width * field->height;
+	delete field;
+
+	std::vector<Vector2d> positions;
+	double energy = 0;
+	bool found = placer.place(3, positions, energy, threads, threads, (unsigned int)std::time(NULL));
+
+	PRINTB("num pixels inside poly %d", placer.insideCount());
+	PRINTB("num edge cells %d", placer.insideCount() - placer.allowedCount());
+	PRINTB("num pixels %d", gridSize);
+	if (!found) return SCREWS_NO_ROOM;
+	PRINTB("current energy %f", energy);
+
+	for (int i = 0; i < 3; i++) screws[i] = positions[i];
+	return SCREWS_PLACED;
+}
+
+/*!
+	Why find_screw_positions() failed, for the user.
+*/
+const char *screw_placement_error(screw_placement_e result)
+{
+	switch (result) {
+	case SCREWS_NOT_SINGLE_OUTLINE:
+		return "The cavity section must consist of a single outline to place screws";
+	case SCREWS_NO_ROOM:
+		return "The cavity section has no room for screws 5 mm away from its outline";
+	default:
+		return "";
+	}
+}
+
+/*!
+	Parses and evaluates a piece of generated SCAD code like the GUI does,
+	with inserted subtracted (see subtract_inserted_mesh()).
+*/
+static CGAL_Nef_polyhedron evaluate_scad(const std::string &scad, const shared_ptr<PolySet> &inserted)
+{
+	CGAL_Nef_polyhedron N;
+	FileModule *module = parse(scad.c_str(), "", false);
+	if (!module) return N;
+
+	ModuleContext top_ctx;
+	top_ctx.registerBuiltin();
+	ModuleInstantiation root_inst("group");
+	AbstractNode::resetIndexCounter();
+	AbstractNode *root_node = module->instantiate(&top_ctx, &root_inst, NULL);
+	if (root_node) {
+		subtract_inserted_mesh(root_node, inserted);
+		Tree tree(root_node);
+		tree.getString(*root_node);
+		CGALEvaluator evaluator(tree);
+		N = evaluator.evaluateCGALMesh(*root_node);
+	}
+	delete root_node;
+	delete module;
+	return N;
+}
+
+static void print_stage(const char *stage, QTime &t)
+{
+	printf("%-16s %8d ms\n", stage, t.elapsed());
+	fflush(stdout);
+	t.start();
+}
+
+/*!
+	Runs the whole enclosure pipeline without the GUI: sweeps the target
+	along direction, places the screws on the cross section of the cavity
+	with the plane normal.p = offset and writes the final enclosure to
+	output as STL. Per-stage timings go to stdout.
+	Returns a process exit code.
+*/
+int enclosure_batch(const std::string &target, const std::string &enclosure,
+										const Vector3d &direction, const Vector3d &normal, double offset,
+										const std::string &output, export_format_e format, int resolution)
+{
+	std::string targetPath = boosty::stringy(boosty::absolute(target));
+	std::string enclosurePath = boosty::stringy(boosty::absolute(enclosure));
+	QTime total, t;
+	total.start();
+	t.start();
+
+	shared_ptr<PolySet> targetMesh = import_stl(targetPath);
+	if (!targetMesh) {
+		fprintf(stderr, "Can't read target '%s'\n", target.c_str());
+		return 1;
+	}
+	print_stage("import", t);
+
+	shared_ptr<PolySet> inserted(sweep_insertion(*targetMesh, direction, resolution));
+	if (!inserted) {
+		fprintf(stderr, "Target '%s' is empty\n", target.c_str());
+		return 1;
+	}
+	print_stage("sweep", t);
+
+	shared_ptr<PolySet> enclosureMesh = import_stl(enclosurePath);
+	if (!enclosureMesh) {
+		fprintf(stderr, "Can't read enclosure '%s'\n", enclosure.c_str());
+		return 1;
+	}
+	Transform3d section = cross_section_transform(cut_plane_transform(normal, offset));
+	CGAL_Nef_polyhedron cavity = cross_section(*enclosureMesh, section);
+	if (cavity.isNull() || cavity.isEmpty()) {
+		fprintf(stderr, "The cut plane doesn't intersect the enclosure\n");
+		return 1;
+	}
+	CGAL_Nef_polyhedron insertedSection = cross_section(*inserted, section);
+	if (!insertedSection.isNull()) cavity -= insertedSection;
+	print_stage("cross sections", t);
+
+	DxfData *dd = cavity.convertToDxfData();
+	Vector2d screws[3];
+	screw_placement_e placement = dd ? find_screw_positions(*dd, screws) : SCREWS_NOT_SINGLE_OUTLINE;
+	delete dd;
+	if (placement != SCREWS_PLACED) {
+		fprintf(stderr, "%s\n", screw_placement_error(placement));
+		return 1;
+	}
+	print_stage("screw positions", t);
+
+	CGAL_Nef_polyhedron result = evaluate_scad(screw_assembly_scad(enclosurePath, Transform3d(section.inverse()), screws), inserted);
+	print_stage("assembly", t);
+
+	if (result.isNull() || result.dim != 3) {
+		fprintf(stderr, "Current top level object is not a 3D object.\n");
+		return 1;
+	}
+	if (!result.p3->is_simple()) {
+		fprintf(stderr, "Object isn't a valid 2-manifold! Modify your design.\n");
+		return 1;
+	}
+	std::ofstream fstream(output.c_str(), export_format_is_binary(format) ? std::ios::out|std::ios::binary : std::ios::out);
+	if (!fstream.is_open()) {
+		fprintf(stderr, "Can't open file \"%s\" for export\n", output.c_str());
+		return 1;
+	}
+	export_mesh(&result, format, fstream);
+	fstream.close();
+	print_stage("export", t);
+	printf("%-16s %8d ms\n", "total", total.elapsed());
+	return 0;
+}
@@ -0,0 +1,46 @@
+#ifndef ENCLOSURE_H_
+#define ENCLOSURE_H_
+
+#include "linalg.h"
+#include "memory.h"
+#include "export.h"
+#include <string>
+#include <vector>
+
+class PolySet;
+class DxfData;
+class CGAL_Nef_polyhedron;
+class AbstractNode;
+
+/*!
+	The stages of the Procrustes enclosure pipeline which don't need the GUI,
+	shared by the MainWindow buttons and the --enclosure command line mode.
+*/
+
+shared_ptr<PolySet> import_stl(const std::string &filename);
+PolySet *sweep_insertion(const PolySet &target, const Vector3d &direction, int resolution);
+
+Transform3d cut_plane_transform(const Vector3d &normal, double offset);
+Transform3d cross_section_transform(const Transform3d &cutplane);
+CGAL_Nef_polyhedron cross_section(const PolySet &ps, const Transform3d &section);
+
+void find_cavity_contacts(const DxfData &cavity, const DxfData &target, double tolerance,
+													std::vector<int> &points, std::vector<std::pair<int,int> > &segments);
+
+enum screw_placement_e {
+	SCREWS_PLACED,
+	SCREWS_NOT_SINGLE_OUTLINE,
+	SCREWS_NO_ROOM
+};
+
+screw_placement_e find_screw_positions(const DxfData &dd, Vector2d screws[3]);
+const char *screw_placement_error(screw_placement_e result);
+std::string screw_assembly_scad(const std::string &enclosure, const Transform3d &unsection,
+																const Vector2d screws[3]);
+AbstractNode *subtract_inserted_mesh(AbstractNode *root, const shared_ptr<PolySet> &inserted);
+
+int enclosure_batch(const std::string &target, const std::string &enclosure,
+										const Vector3d &direction, const Vector3d &normal, double offset,
+										const std::string &output, export_format_e format, int resolution);
+
+#endif
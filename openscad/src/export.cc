@@ -29,106 +29,440 @@
 #include "polyset.h"
 #include "dxfdata.h"
 
-#ifdef ENABLE_CGAL
-#include "CGAL_Nef_polyhedron.h"
-#include "cgal.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <boost/cstdint.hpp>
+
+#ifdef _MSC_VER
+#define snprintf _snprintf
+#endif
 
 /*!
-	Saves the current 3D CGAL Nef polyhedron as STL to the given file.
-	The file must be open.
- */
-void export_stl(CGAL_Nef_polyhedron *root_N, std::ostream &output)
+	Returns the export format with the given name, e.g. from the command
+	line, or EXPORT_UNKNOWN.
+*/
+export_format_e export_format(const std::string &name)
 {
-	CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
-	try {
-	CGAL_Polyhedron P;
-	root_N->p3->convert_to_Polyhedron(P);
+	if (name == "stl" || name == "asciistl") return EXPORT_STL_ASCII;
+	if (name == "binstl") return EXPORT_STL_BINARY;
+	if (name == "off") return EXPORT_OFF;
+	if (name == "ply") return EXPORT_PLY;
+	return EXPORT_UNKNOWN;
+}
+
+const char *export_format_suffix(export_format_e format)
+{
+	switch (format) {
+	case EXPORT_STL_ASCII:
+	case EXPORT_STL_BINARY:
+		return "stl";
+	case EXPORT_OFF:
+		return "off";
+	case EXPORT_PLY:
+		return "ply";
+	default:
+		return "";
+	}
+}
+
+/*!
+	Returns true if files in the format must be opened in binary mode.
+*/
+bool export_format_is_binary(export_format_e format)
+{
+	return format == EXPORT_STL_BINARY || format == EXPORT_PLY;
+}
+
+namespace {
+	/*!
+		Collects output in large blocks, so meshes can be written number by
+		number without going through the stream or allocating each time.
+		Numbers are written in the C locale, binary data as little endian.
+	*/
+	class ExportBuffer
+	{
+	public:
+		ExportBuffer(std::ostream &output) : output(output), used(0), precision(output.precision()) {}
+		~ExportBuffer() { flush(); }
+
+		void write(const char *data, size_t len) {
+			if (this->used + len > sizeof(this->buffer)) flush();
+			if (len > sizeof(this->buffer)) this->output.write(data, len);
+			else {
+				memcpy(this->buffer + this->used, data, len);
+				this->used += len;
+			}
+		}
+		void write(const char *str) { write(str, strlen(str)); }
+		// Formats like an ostream with the precision of the output stream
+		void number(double x) {
+			reserve(32);
+			this->used += snprintf(this->buffer + this->used, 32, "%.*g", this->precision, x);
+		}
+		void number(size_t x) {
+			reserve(32);
+			this->used += snprintf(this->buffer + this->used, 32, "%lu", (unsigned long)x);
+		}
+		void uint8(uint8_t x) { write((const char *)&x, 1); }
+		void uint16(uint16_t x) {
+			char bytes[2] = { char(x & 0xff), char(x >> 8) };
+			write(bytes, 2);
+		}
+		void uint32(uint32_t x) {
+			char bytes[4] = { char(x & 0xff), char((x >> 8) & 0xff), char((x >> 16) & 0xff), char(x >> 24) };
+			write(bytes, 4);
+		}
+		void float32(float x) {
+			uint32_t u;
+			memcpy(&u, &x, 4);
+			uint32(u);
+		}
+		void flush() {
+			this->output.write(this->buffer, this->used);
+			this->used = 0;
+		}
+		int textPrecision() const { return this->precision; }
+
+	private:
+		void reserve(size_t len) { if (this->used + len > sizeof(this->buffer)) flush(); }
+
+		std::ostream &output;
+		char buffer[64 * 1024];
+		size_t used;
+		int precision;
+	};
+}
 
-	typedef CGAL_Polyhedron::Vertex                                 Vertex;
+#ifdef ENABLE_CGAL
+#include "CGAL_Nef_polyhedron.h"
+#include "cgal.h"
+#include "cgalutils.h"
+#include <CGAL/Inverse_index.h>
+
+namespace {
+	typedef CGAL_Polyhedron::Vertex_const_handle                    VCH;
 	typedef CGAL_Polyhedron::Vertex_const_iterator                  VCI;
 	typedef CGAL_Polyhedron::Facet_const_iterator                   FCI;
 	typedef CGAL_Polyhedron::Halfedge_around_facet_const_circulator HFCC;
+	typedef CGAL_Polyhedron::Traits::Point_3                        Point_3;
 
-	setlocale(LC_NUMERIC, "C"); // Ensure radix is . (not ,) in output
+	/*!
+		The vertices of a polyhedron, numbered in iteration order, with
+		their coordinates converted to double once.
+	*/
+	class ExportVertices
+	{
+	public:
+		ExportVertices(const CGAL_Polyhedron &P) : index(P.vertices_begin(), P.vertices_end()) {
+			this->coords.reserve(3 * P.size_of_vertices());
+			for (VCI vi = P.vertices_begin(); vi != P.vertices_end(); ++vi) {
+				this->coords.push_back(CGAL::to_double(vi->point().x()));
+				this->coords.push_back(CGAL::to_double(vi->point().y()));
+				this->coords.push_back(CGAL::to_double(vi->point().z()));
+			}
+		}
+		size_t size() const { return this->coords.size() / 3; }
+		size_t operator[](VCH v) const { return this->index[VCI(v)]; }
+		const double *coordinates(size_t i) const { return &this->coords[3 * i]; }
 
-	output << "solid OpenSCAD_Model\n";
-
-	for (FCI fi = P.facets_begin(); fi != P.facets_end(); ++fi) {
-		HFCC hc = fi->facet_begin();
-		HFCC hc_end = hc;
-		Vertex v1, v2, v3;
-		v1 = *VCI((hc++)->vertex());
-		v3 = *VCI((hc++)->vertex());
-		do {
-			v2 = v3;
-			v3 = *VCI((hc++)->vertex());
-			double x1 = CGAL::to_double(v1.point().x());
-			double y1 = CGAL::to_double(v1.point().y());
-			double z1 = CGAL::to_double(v1.point().z());
-			double x2 = CGAL::to_double(v2.point().x());
-			double y2 = CGAL::to_double(v2.point().y());
-			double z2 = CGAL::to_double(v2.point().z());
-			double x3 = CGAL::to_double(v3.point().x());
-			double y3 = CGAL::to_double(v3.point().y());
-			double z3 = CGAL::to_double(v3.point().z());
-			std::stringstream stream;
-			stream << x1 << " " << y1 << " " << z1;
-			std::string vs1 = stream.str();
-			stream.str("");
-			stream << x2 << " " << y2 << " " << z2;
-			std::string vs2 = stream.str();
-			stream.str("");
-			stream << x3 << " " << y3 << " " << z3;
-			std::string vs3 = stream.str();
-			if (vs1 != vs2 && vs1 != vs3 && vs2 != vs3) {
-				// The above condition ensures that there are 3 distinct vertices, but
-				// they may be collinear. If they are, the unit normal is meaningless
-				// so the default value of "1 0 0" can be used. If the vertices are not
-				// collinear then the unit normal must be calculated from the
-				// components.
-				if (!CGAL::collinear(v1.point(),v2.point(),v3.point())) {
-					CGAL_Polyhedron::Traits::Vector_3 normal = CGAL::normal(v1.point(),v2.point(),v3.point());
-					output << "  facet normal "
-								 << CGAL::sign(normal.x()) * sqrt(CGAL::to_double(normal.x()*normal.x()/normal.squared_length()))
-								 << " "
-								 << CGAL::sign(normal.y()) * sqrt(CGAL::to_double(normal.y()*normal.y()/normal.squared_length()))
-								 << " "
-								 << CGAL::sign(normal.z()) * sqrt(CGAL::to_double(normal.z()*normal.z()/normal.squared_length()))
-								 << "\n";
-				}
-				else output << "  facet normal 1 0 0\n";
-				output << "    outer loop\n";
-				output << "      vertex " << vs1 << "\n";
-				output << "      vertex " << vs2 << "\n";
-				output << "      vertex " << vs3 << "\n";
-				output << "    endloop\n";
-				output << "  endfacet\n";
+	private:
+		CGAL::Inverse_index<VCI> index;
+		std::vector<double> coords;
+	};
+
+	/*!
+		Appends the facets of P, split into triangle fans, to triangles.
+	*/
+	void triangulate_facets(const CGAL_Polyhedron &P, const ExportVertices &vertices, std::vector<size_t> &triangles)
+	{
+		triangles.reserve(3 * (P.size_of_halfedges() - 2 * P.size_of_facets()));
+		for (FCI fi = P.facets_begin(); fi != P.facets_end(); ++fi) {
+			HFCC hc = fi->facet_begin();
+			HFCC hc_end = hc;
+			size_t v1 = vertices[(hc++)->vertex()];
+			size_t v3 = vertices[(hc++)->vertex()];
+			do {
+				size_t v2 = v3;
+				v3 = vertices[(hc++)->vertex()];
+				triangles.push_back(v1);
+				triangles.push_back(v2);
+				triangles.push_back(v3);
+			} while (hc != hc_end);
+		}
+	}
+
+	/*!
+		Computes the unit normal of a triangle from the exact points. If the
+		points are collinear, the normal is meaningless and 1 0 0 is used.
+	*/
+	void facet_normal(const Point_3 &p1, const Point_3 &p2, const Point_3 &p3, double normal[3])
+	{
+		if (CGAL::collinear(p1, p2, p3)) {
+			normal[0] = 1;
+			normal[1] = normal[2] = 0;
+			return;
+		}
+		CGAL_Polyhedron::Traits::Vector_3 n = CGAL::normal(p1, p2, p3);
+		CGAL_Polyhedron::Traits::FT length = n.squared_length();
+		normal[0] = CGAL::sign(n.x()) * sqrt(CGAL::to_double(n.x()*n.x()/length));
+		normal[1] = CGAL::sign(n.y()) * sqrt(CGAL::to_double(n.y()*n.y()/length));
+		normal[2] = CGAL::sign(n.z()) * sqrt(CGAL::to_double(n.z()*n.z()/length));
+	}
+
+	/*!
+		Triangles whose vertices coincide in the output are skipped, as
+		they would be degenerate in the file. For ASCII output, this means
+		their text is the same.
+	*/
+	void write_ascii_stl(const CGAL_Polyhedron &P, ExportBuffer &out)
+	{
+		ExportVertices vertices(P);
+		std::vector<VCH> handles;
+		handles.reserve(vertices.size());
+		for (VCI vi = P.vertices_begin(); vi != P.vertices_end(); ++vi) handles.push_back(vi);
+
+		// The text of every vertex, formatted once
+		size_t stride = 3 * (out.textPrecision() + 8) + 4;
+		std::vector<char> text(vertices.size() * stride);
+		for (size_t i = 0; i < vertices.size(); i++) {
+			const double *v = vertices.coordinates(i);
+			int p = out.textPrecision();
+			snprintf(&text[i * stride], stride, "%.*g %.*g %.*g", p, v[0], p, v[1], p, v[2]);
+		}
+
+		std::vector<size_t> triangles;
+		triangulate_facets(P, vertices, triangles);
+
+		out.write("solid OpenSCAD_Model\n");
+		for (size_t t = 0; t < triangles.size(); t += 3) {
+			const char *vs1 = &text[triangles[t] * stride];
+			const char *vs2 = &text[triangles[t + 1] * stride];
+			const char *vs3 = &text[triangles[t + 2] * stride];
+			if (!strcmp(vs1, vs2) || !strcmp(vs1, vs3) || !strcmp(vs2, vs3)) continue;
+
+			double normal[3];
+			facet_normal(handles[triangles[t]]->point(), handles[triangles[t + 1]]->point(),
+									 handles[triangles[t + 2]]->point(), normal);
+			out.write("  facet normal ");
+			out.number(normal[0]);
+			out.write(" ");
+			out.number(normal[1]);
+			out.write(" ");
+			out.number(normal[2]);
+			out.write("\n    outer loop\n      vertex ");
+			out.write(vs1);
+			out.write("\n      vertex ");
+			out.write(vs2);
+			out.write("\n      vertex ");
+			out.write(vs3);
+			out.write("\n    endloop\n  endfacet\n");
+		}
+		out.write("endsolid OpenSCAD_Model\n");
+	}
+
+	bool same_float_vertex(const double *a, const double *b)
+	{
+		return float(a[0]) == float(b[0]) && float(a[1]) == float(b[1]) && float(a[2]) == float(b[2]);
+	}
+
+	void write_binary_stl(const CGAL_Polyhedron &P, ExportBuffer &out)
+	{
+		ExportVertices vertices(P);
+		std::vector<VCH> handles;
+		handles.reserve(vertices.size());
+		for (VCI vi = P.vertices_begin(); vi != P.vertices_end(); ++vi) handles.push_back(vi);
+
+		// Drop the triangles which are degenerate in single precision first,
+		// as the header holds the number of triangles
+		std::vector<size_t> triangles;
+		triangulate_facets(P, vertices, triangles);
+		size_t kept = 0;
+		for (size_t t = 0; t < triangles.size(); t += 3) {
+			const double *v1 = vertices.coordinates(triangles[t]);
+			const double *v2 = vertices.coordinates(triangles[t + 1]);
+			const double *v3 = vertices.coordinates(triangles[t + 2]);
+			if (same_float_vertex(v1, v2) || same_float_vertex(v1, v3) || same_float_vertex(v2, v3)) continue;
+			std::copy(&triangles[t], &triangles[t] + 3, &triangles[kept]);
+			kept += 3;
+		}
+		triangles.resize(kept);
+
+		char header[80] = "OpenSCAD_Model";
+		out.write(header, sizeof(header));
+		out.uint32(triangles.size() / 3);
+		for (size_t t = 0; t < triangles.size(); t += 3) {
+			double normal[3];
+			facet_normal(handles[triangles[t]]->point(), handles[triangles[t + 1]]->point(),
+									 handles[triangles[t + 2]]->point(), normal);
+			for (int i = 0; i < 3; i++) out.float32(normal[i]);
+			for (int j = 0; j < 3; j++) {
+				const double *v = vertices.coordinates(triangles[t + j]);
+				for (int i = 0; i < 3; i++) out.float32(v[i]);
 			}
-		} while (hc != hc_end);
+			out.uint16(0);
+		}
 	}
 
-	output << "endsolid OpenSCAD_Model\n";
-	setlocale(LC_NUMERIC, "");      // Set default locale
+	void write_off(const CGAL_Polyhedron &P, ExportBuffer &out)
+	{
+		ExportVertices vertices(P);
+		out.write("OFF\n");
+		out.number(vertices.size());
+		out.write(" ");
+		out.number(P.size_of_facets());
+		out.write(" 0\n");
+		for (size_t i = 0; i < vertices.size(); i++) {
+			const double *v = vertices.coordinates(i);
+			out.number(v[0]);
+			out.write(" ");
+			out.number(v[1]);
+			out.write(" ");
+			out.number(v[2]);
+			out.write("\n");
+		}
+		for (FCI fi = P.facets_begin(); fi != P.facets_end(); ++fi) {
+			out.number(size_t(fi->facet_degree()));
+			HFCC hc = fi->facet_begin();
+			HFCC hc_end = hc;
+			do {
+				out.write(" ");
+				out.number(vertices[(hc++)->vertex()]);
+			} while (hc != hc_end);
+			out.write("\n");
+		}
+	}
+
+	/*!
+		Writes binary little endian PLY. Facets with more vertices than the
+		face lists can hold are split into triangle fans.
+	*/
+	void write_ply(const CGAL_Polyhedron &P, ExportBuffer &out)
+	{
+		ExportVertices vertices(P);
+		size_t faces = 0;
+		for (FCI fi = P.facets_begin(); fi != P.facets_end(); ++fi) {
+			size_t degree = fi->facet_degree();
+			faces += degree <= 255 ? 1 : degree - 2;
+		}
+
+		out.write("ply\nformat binary_little_endian 1.0\ncomment OpenSCAD_Model\nelement vertex ");
+		out.number(vertices.size());
+		out.write("\nproperty float x\nproperty float y\nproperty float z\nelement face ");
+		out.number(faces);
+		out.write("\nproperty list uchar int vertex_indices\nend_header\n");
+
+		for (size_t i = 0; i < vertices.size(); i++) {
+			const double *v = vertices.coordinates(i);
+			for (int j = 0; j < 3; j++) out.float32(v[j]);
+		}
+		for (FCI fi = P.facets_begin(); fi != P.facets_end(); ++fi) {
+			size_t degree = fi->facet_degree();
+			HFCC hc = fi->facet_begin();
+			HFCC hc_end = hc;
+			if (degree <= 255) {
+				out.uint8(degree);
+				do {
+					out.uint32(vertices[(hc++)->vertex()]);
+				} while (hc != hc_end);
+			}
+			else {
+				uint32_t v1 = vertices[(hc++)->vertex()];
+				uint32_t v3 = vertices[(hc++)->vertex()];
+				do {
+					uint32_t v2 = v3;
+					v3 = vertices[(hc++)->vertex()];
+					out.uint8(3);
+					out.uint32(v1);
+					out.uint32(v2);
+					out.uint32(v3);
+				} while (hc != hc_end);
+			}
+		}
+	}
+}
 
+/*!
+	Saves the current 3D CGAL Nef polyhedron as ASCII or binary STL to the
+	given stream. The stream must be open, in binary mode for binary STL.
+ */
+void export_stl(CGAL_Nef_polyhedron *root_N, std::ostream &output, bool binary)
+{
+	CGAL::Failure_behaviour old_behaviour = set_cgal_error_behaviour(CGAL::THROW_EXCEPTION);
+	try {
+		CGAL_Polyhedron P;
+		root_N->p3->convert_to_Polyhedron(P);
+		setlocale(LC_NUMERIC, "C"); // Ensure radix is . (not ,) in output
+		{
+			ExportBuffer out(output);
+			if (binary) write_binary_stl(P, out);
+			else write_ascii_stl(P, out);
+		}
+		setlocale(LC_NUMERIC, "");      // Set default locale
 	}
 	catch (const CGAL::Assertion_exception &e) {
 		PRINTB("CGAL error in CGAL_Nef_polyhedron3::convert_to_Polyhedron(): %s", e.what());
 	}
-	CGAL::set_error_behaviour(old_behaviour);
+	set_cgal_error_behaviour(old_behaviour);
 }
 
 void export_off(CGAL_Nef_polyhedron *root_N, std::ostream &output)
 {
-	CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
+	CGAL::Failure_behaviour old_behaviour = set_cgal_error_behaviour(CGAL::THROW_EXCEPTION);
+	try {
+		CGAL_Polyhedron P;
+		root_N->p3->convert_to_Polyhedron(P);
+		setlocale(LC_NUMERIC, "C"); // Ensure radix is . (not ,) in output
+		{
+			ExportBuffer out(output);
+			write_off(P, out);
+		}
+		setlocale(LC_NUMERIC, "");      // Set default locale
+	}
+	catch (const CGAL::Assertion_exception &e) {
+		PRINTB("CGAL error in CGAL_Nef_polyhedron3::convert_to_Polyhedron(): %s", e.what());
+	}
+	set_cgal_error_behaviour(old_behaviour);
+}
+
+/*!
+	Saves the current 3D CGAL Nef polyhedron as binary PLY to the given
+	stream, which must be open in binary mode.
+ */
+void export_ply(CGAL_Nef_polyhedron *root_N, std::ostream &output)
+{
+	CGAL::Failure_behaviour old_behaviour = set_cgal_error_behaviour(CGAL::THROW_EXCEPTION);
 	try {
 		CGAL_Polyhedron P;
 		root_N->p3->convert_to_Polyhedron(P);
-		output << P;
+		ExportBuffer out(output);
+		write_ply(P, out);
 	}
 	catch (const CGAL::Assertion_exception &e) {
 		PRINTB("CGAL error in CGAL_Nef_polyhedron3::convert_to_Polyhedron(): %s", e.what());
 	}
-	CGAL::set_error_behaviour(old_behaviour);
+	set_cgal_error_behaviour(old_behaviour);
+}
+
+/*!
+	Saves the current 3D CGAL Nef polyhedron in the given format.
+ */
+void export_mesh(CGAL_Nef_polyhedron *root_N, export_format_e format, std::ostream &output)
+{
+	switch (format) {
+	case EXPORT_STL_ASCII:
+	case EXPORT_STL_BINARY:
+		export_stl(root_N, output, format == EXPORT_STL_BINARY);
+		break;
+	case EXPORT_OFF:
+		export_off(root_N, output);
+		break;
+	case EXPORT_PLY:
+		export_ply(root_N, output);
+		break;
+	default:
+		PRINT("ERROR: Unknown export format");
+	}
 }
 
 /*!
@@ -197,20 +531,59 @@ void export_dxf(CGAL_Nef_polyhedron *root_N, std::ostream &output)
 
 #endif // ENABLE_CGAL
 
-#ifdef DEBUG
 #include <boost/foreach.hpp>
-void export_stl(const PolySet &ps, std::ostream &output)
+
+/*!
+	Saves the given PolySet as ASCII or binary STL. Polygons are written as
+	triangle fans.
+*/
+void export_stl(const PolySet &ps, std::ostream &output, bool binary)
 {
-	output << "solid OpenSCAD_PolySet\n";
-	BOOST_FOREACH(const PolySet::Polygon &p, ps.polygons) {
-		output << "facet\n";
-		output << "outer loop\n";
-		BOOST_FOREACH(const Vector3d &v, p) {
-			output << "vertex " << v[0] << " " << v[1] << " " << v[2] << "\n";
+	setlocale(LC_NUMERIC, "C"); // Ensure radix is . (not ,) in output
+	{
+		ExportBuffer out(output);
+		if (binary) {
+			size_t triangles = 0;
+			BOOST_FOREACH(const PolySet::Polygon &p, ps.polygons) {
+				if (p.size() > 2) triangles += p.size() - 2;
+			}
+			char header[80] = "OpenSCAD_PolySet";
+			out.write(header, sizeof(header));
+			out.uint32(triangles);
 		}
-		output << "endloop\n";
-		output << "endfacet\n";
+		else out.write("solid OpenSCAD_PolySet\n");
+
+		BOOST_FOREACH(const PolySet::Polygon &p, ps.polygons) {
+			for (size_t i = 2; i < p.size(); i++) {
+				const Vector3d *v[3] = { &p[0], &p[i-1], &p[i] };
+				Vector3d normal = (*v[1] - *v[0]).cross(*v[2] - *v[0]);
+				if (normal.norm() > 0) normal.normalize();
+				if (binary) {
+					for (int j = 0; j < 3; j++) out.float32(normal[j]);
+					for (int k = 0; k < 3; k++) {
+						for (int j = 0; j < 3; j++) out.float32((*v[k])[j]);
+					}
+					out.uint16(0);
+					continue;
+				}
+				out.write("  facet normal ");
+				for (int j = 0; j < 3; j++) {
+					if (j) out.write(" ");
+					out.number(normal[j]);
+				}
+				out.write("\n    outer loop\n");
+				for (int k = 0; k < 3; k++) {
+					out.write("      vertex ");
+					for (int j = 0; j < 3; j++) {
+						if (j) out.write(" ");
+						out.number((*v[k])[j]);
+					}
+					out.write("\n");
+				}
+				out.write("    endloop\n  endfacet\n");
+			}
+		}
+		if (!binary) out.write("endsolid OpenSCAD_PolySet\n");
 	}
-	output << "endsolid OpenSCAD_PolySet\n";
+	setlocale(LC_NUMERIC, "");      // Set default locale
 }
-#endif
@@ -2,21 +2,34 @@
 #define EXPORT_H_
 
 #include <iostream>
+#include <string>
 #include "Tree.h"
 #include "Camera.h"
 
+enum export_format_e {
+	EXPORT_STL_ASCII,
+	EXPORT_STL_BINARY,
+	EXPORT_OFF,
+	EXPORT_PLY,
+	EXPORT_UNKNOWN
+};
+
+export_format_e export_format(const std::string &name);
+const char *export_format_suffix(export_format_e format);
+bool export_format_is_binary(export_format_e format);
+
 #ifdef ENABLE_CGAL
 
-void export_stl(class CGAL_Nef_polyhedron *root_N, std::ostream &output);
+void export_stl(class CGAL_Nef_polyhedron *root_N, std::ostream &output, bool binary = false);
 void export_off(CGAL_Nef_polyhedron *root_N, std::ostream &output);
+void export_ply(CGAL_Nef_polyhedron *root_N, std::ostream &output);
+void export_mesh(CGAL_Nef_polyhedron *root_N, export_format_e format, std::ostream &output);
 void export_dxf(CGAL_Nef_polyhedron *root_N, std::ostream &output);
 void export_png_with_cgal(CGAL_Nef_polyhedron *root_N, Camera &c, std::ostream &output);
 void export_png_with_opencsg(Tree &tree, Camera &c, std::ostream &output);
 
 #endif
 
-#ifdef DEBUG
-void export_stl(const class PolySet &ps, std::ostream &output);
-#endif
+void export_stl(const class PolySet &ps, std::ostream &output, bool binary = false);
 
 #endif
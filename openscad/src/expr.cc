@@ -32,28 +32,42 @@
 #include <algorithm>
 #include "stl-utils.h"
 #include "printutils.h"
+#include "instantiationcache.h"
 #include <boost/bind.hpp>
 #include <boost/foreach.hpp>
+#include <boost/functional/hash.hpp>
 
-Expression::Expression() : recursioncount(0)
+Expression::Expression(Type type) : type(type), var_hash(0), member(-1)
 {
 }
 
-Expression::Expression(const std::string &type, 
-											 Expression *left, Expression *right)
-	: type(type), recursioncount(0)
+Expression::Expression(Type type, Expression *left, Expression *right)
+	: type(type), var_hash(0), member(-1)
 {
 	this->children.push_back(left);
 	this->children.push_back(right);
 }
 
-Expression::Expression(const std::string &type, Expression *expr)
-	: type(type), recursioncount(0)
+Expression::Expression(Type type, Expression *expr)
+	: type(type), var_hash(0), member(-1)
 {
 	this->children.push_back(expr);
 }
 
-Expression::Expression(const Value &val) : const_value(val), type("C"), recursioncount(0)
+/*!
+	Builds a variable lookup, or with expr, a member lookup of expr.
+*/
+Expression::Expression(Type type, const std::string &name, Expression *expr)
+	: var_name(name), type(type), var_hash(boost::hash<std::string>()(name)), member(-1)
+{
+	if (expr) this->children.push_back(expr);
+	static const char *members[] = { "x", "y", "z", "begin", "step", "end" };
+	for (int i = 0; i < 6; i++) {
+		if (name == members[i]) this->member = i;
+	}
+}
+
+Expression::Expression(const Value &val) : const_value(val), type(CONSTANT), var_hash(0), member(-1)
 {
 }
 
@@ -65,57 +79,57 @@ Expression::~Expression()
 class FuncRecursionGuard
 {
 public:
-	FuncRecursionGuard(const Expression &e) : expr(e) { 
-		expr.recursioncount++; 
+	FuncRecursionGuard(const Expression &e) : count(e.recursioncount.get()) { 
+		count++; 
 	}
-	~FuncRecursionGuard() { expr.recursioncount--; }
-	bool recursion_detected() const { return (expr.recursioncount > 1000); }
+	~FuncRecursionGuard() { count--; }
+	bool recursion_detected() const { return (count > 1000); }
 private:
-	const Expression &expr;
+	int &count;
 };
 
 Value Expression::evaluate(const Context *context) const
 {
-	if (this->type == "!")
+	switch (this->type) {
+	case NOT:
 		return ! this->children[0]->evaluate(context);
-	if (this->type == "&&")
+	case AND:
 		return this->children[0]->evaluate(context) && this->children[1]->evaluate(context);
-	if (this->type == "||")
+	case OR:
 		return this->children[0]->evaluate(context) || this->children[1]->evaluate(context);
-	if (this->type == "*")
+	case MULTIPLY:
 		return this->children[0]->evaluate(context) * this->children[1]->evaluate(context);
-	if (this->type == "/")
+	case DIVIDE:
 		return this->children[0]->evaluate(context) / this->children[1]->evaluate(context);
-	if (this->type == "%")
+	case MODULO:
 		return this->children[0]->evaluate(context) % this->children[1]->evaluate(context);
-	if (this->type == "+")
+	case PLUS:
 		return this->children[0]->evaluate(context) + this->children[1]->evaluate(context);
-	if (this->type == "-")
+	case MINUS:
 		return this->children[0]->evaluate(context) - this->children[1]->evaluate(context);
-	if (this->type == "<")
+	case LESS:
 		return this->children[0]->evaluate(context) < this->children[1]->evaluate(context);
-	if (this->type == "<=")
+	case LESS_EQUAL:
 		return this->children[0]->evaluate(context) <= this->children[1]->evaluate(context);
-	if (this->type == "==")
+	case EQUAL:
 		return this->children[0]->evaluate(context) == this->children[1]->evaluate(context);
-	if (this->type == "!=")
+	case NOT_EQUAL:
 		return this->children[0]->evaluate(context) != this->children[1]->evaluate(context);
-	if (this->type == ">=")
+	case GREATER_EQUAL:
 		return this->children[0]->evaluate(context) >= this->children[1]->evaluate(context);
-	if (this->type == ">")
+	case GREATER:
 		return this->children[0]->evaluate(context) > this->children[1]->evaluate(context);
-	if (this->type == "?:") {
+	case CONDITION: {
 		Value v = this->children[0]->evaluate(context);
 		return this->children[v.toBool() ? 1 : 2]->evaluate(context);
 	}
-	if (this->type == "[]") {
+	case INDEX:
 		return this->children[0]->evaluate(context)[this->children[1]->evaluate(context)];
-	}
-	if (this->type == "I")
+	case INVERT:
 		return -this->children[0]->evaluate(context);
-	if (this->type == "C")
+	case CONSTANT:
 		return this->const_value;
-	if (this->type == "R") {
+	case RANGE: {
 		Value v1 = this->children[0]->evaluate(context);
 		Value v2 = this->children[1]->evaluate(context);
 		Value v3 = this->children[2]->evaluate(context);
@@ -124,36 +138,25 @@ Value Expression::evaluate(const Context *context) const
 		}
 		return Value();
 	}
-	if (this->type == "V") {
+	case VECTOR: {
 		Value::VectorType vec;
+		vec.reserve(this->children.size());
 		BOOST_FOREACH(const Expression *e, this->children) {
 			vec.push_back(e->evaluate(context));
 		}
 		return Value(vec);
 	}
-	if (this->type == "L")
-		return context->lookup_variable(this->var_name);
-	if (this->type == "N")
-	{
+	case LOOKUP:
+		return context->lookup_variable(this->var_name, this->var_hash);
+	case MEMBER: {
 		Value v = this->children[0]->evaluate(context);
-
-		if (v.type() == Value::VECTOR && this->var_name == "x")
-			return v[0];
-		if (v.type() == Value::VECTOR && this->var_name == "y")
-			return v[1];
-		if (v.type() == Value::VECTOR && this->var_name == "z")
-			return v[2];
-
-		if (v.type() == Value::RANGE && this->var_name == "begin")
-			return Value(v[0]);
-		if (v.type() == Value::RANGE && this->var_name == "step")
-			return Value(v[1]);
-		if (v.type() == Value::RANGE && this->var_name == "end")
-			return Value(v[2]);
-
+		if (v.type() == Value::VECTOR && this->member >= 0 && this->member < 3)
+			return v[this->member];
+		if (v.type() == Value::RANGE && this->member >= 3)
+			return Value(v[this->member - 3]);
 		return Value();
 	}
-	if (this->type == "F") {
+	case CALL: {
 		FuncRecursionGuard g(*this);
 		if (g.recursion_detected()) { 
 			PRINTB("ERROR: Recursion detected calling function '%s'", this->call_funcname);
@@ -161,54 +164,71 @@ Value Expression::evaluate(const Context *context) const
 		}
 
 		EvalContext c(context, this->call_arguments);
+		if (InstantiationCache *cache = InstantiationCache::active()) cache->readFunction(context, this->call_funcname);
 		return context->evaluate_function(this->call_funcname, &c);
 	}
+	}
 	abort();
 }
 
+static const char *operator_name(Expression::Type type)
+{
+	switch (type) {
+	case Expression::AND: return "&&";
+	case Expression::OR: return "||";
+	case Expression::MULTIPLY: return "*";
+	case Expression::DIVIDE: return "/";
+	case Expression::MODULO: return "%";
+	case Expression::PLUS: return "+";
+	case Expression::MINUS: return "-";
+	case Expression::LESS: return "<";
+	case Expression::LESS_EQUAL: return "<=";
+	case Expression::EQUAL: return "==";
+	case Expression::NOT_EQUAL: return "!=";
+	case Expression::GREATER_EQUAL: return ">=";
+	case Expression::GREATER: return ">";
+	default: return NULL;
+	}
+}
+
 std::string Expression::toString() const
 {
 	std::stringstream stream;
 
-	if (this->type == "*" || this->type == "/" || this->type == "%" || this->type == "+" ||
-			this->type == "-" || this->type == "<" || this->type == "<=" || this->type == "==" || 
-			this->type == "!=" || this->type == ">=" || this->type == ">" ||
-			this->type == "&&" || this->type == "||") {
-		stream << "(" << *this->children[0] << " " << this->type << " " << *this->children[1] << ")";
-	}
-	else if (this->type == "?:") {
+	switch (this->type) {
+	case CONDITION:
 		stream << "(" << *this->children[0] << " ? " << *this->children[1] << " : " << *this->children[2] << ")";
-	}
-	else if (this->type == "[]") {
+		break;
+	case INDEX:
 		stream << *this->children[0] << "[" << *this->children[1] << "]";
-	}
-	else if (this->type == "I") {
+		break;
+	case INVERT:
 		stream << "-" << *this->children[0];
-	}
-	else if (this->type == "!") {
+		break;
+	case NOT:
 		stream << "!" << *this->children[0];
-	}
-	else if (this->type == "C") {
+		break;
+	case CONSTANT:
 		stream << this->const_value;
-	}
-	else if (this->type == "R") {
+		break;
+	case RANGE:
 		stream << "[" << *this->children[0] << " : " << *this->children[1] << " : " << *this->children[2] << "]";
-	}
-	else if (this->type == "V") {
+		break;
+	case VECTOR:
 		stream << "[";
 		for (size_t i=0; i < this->children.size(); i++) {
 			if (i > 0) stream << ", ";
 			stream << *this->children[i];
 		}
 		stream << "]";
-	}
-	else if (this->type == "L") {
+		break;
+	case LOOKUP:
 		stream << this->var_name;
-	}
-	else if (this->type == "N") {
+		break;
+	case MEMBER:
 		stream << *this->children[0] << "." << this->var_name;
-	}
-	else if (this->type == "F") {
+		break;
+	case CALL:
 		stream << this->call_funcname << "(";
 		for (size_t i=0; i < this->call_arguments.size(); i++) {
 			const Assignment &arg = this->call_arguments[i];
@@ -217,9 +237,10 @@ std::string Expression::toString() const
 			stream << *arg.second;
 		}
 		stream << ")";
-	}
-	else {
-		assert(false && "Illegal expression type");
+		break;
+	default:
+		assert(operator_name(this->type) && "Illegal expression type");
+		stream << "(" << *this->children[0] << " " << operator_name(this->type) << " " << *this->children[1] << ")";
 	}
 
 	return stream.str();
@@ -5,10 +5,37 @@
 #include <vector>
 #include "value.h"
 #include "typedefs.h"
+#include "recursioncount.h"
 
 class Expression
 {
 public:
+	enum Type {
+		NOT,           // !
+		AND,           // &&
+		OR,            // ||
+		MULTIPLY,      // *
+		DIVIDE,        // /
+		MODULO,        // %
+		PLUS,          // +
+		MINUS,         // -
+		LESS,          // <
+		LESS_EQUAL,    // <=
+		EQUAL,         // ==
+		NOT_EQUAL,     // !=
+		GREATER_EQUAL, // >=
+		GREATER,       // >
+		INDEX,         // Vector element: []
+		CONDITION,     // Condition operator: ?:
+		INVERT,        // Invert (prefix '-')
+		CONSTANT,      // Constant value
+		RANGE,         // Create Range
+		VECTOR,        // Create Vector
+		LOOKUP,        // Lookup Variable
+		MEMBER,        // Lookup member per name
+		CALL           // Function call
+	};
+
 	std::vector<Expression*> children;
 
 	const Value const_value;
@@ -17,31 +44,26 @@ public:
 	std::string call_funcname;
 	AssignmentList call_arguments;
 
-	// Boolean: ! && ||
-	// Operators: * / % + -
-	// Relations: < <= == != >= >
-	// Vector element: []
-	// Condition operator: ?:
-	// Invert (prefix '-'): I
-	// Constant value: C
-	// Create Range: R
-	// Create Vector: V
-	// Create Matrix: M
-	// Lookup Variable: L
-	// Lookup member per name: N
-	// Function call: F
-  std::string type;
-
-	Expression();
+	Type type;
+
+	Expression(Type type);
 	Expression(const Value &val);
-	Expression(const std::string &type, Expression *left, Expression *right);
-	Expression(const std::string &type, Expression *expr);
+	Expression(Type type, Expression *left, Expression *right);
+	Expression(Type type, Expression *expr);
+	Expression(Type type, const std::string &name, Expression *expr = NULL);
 	~Expression();
 
 	Value evaluate(const class Context *context) const;
 	std::string toString() const;
 
-	mutable int recursioncount;
+	RecursionCount recursioncount;
+
+private:
+	// Resolved when the expression is built, so evaluation doesn't hash or
+	// compare names: the hash of var_name for LOOKUP, and the element
+	// index of x/y/z or begin/step/end for MEMBER, or -1
+	size_t var_hash;
+	int member;
 };
 
 std::ostream &operator<<(std::ostream &stream, const Expression &expr);
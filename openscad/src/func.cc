@@ -34,6 +34,7 @@
 #include <algorithm>
 #include "stl-utils.h"
 #include "printutils.h"
+#include "instantiationcache.h"
 #include <boost/foreach.hpp>
 
 /*
@@ -45,6 +46,7 @@
 
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_real.hpp>
+#include <boost/thread/mutex.hpp>
 
 #ifdef __WIN32__
 #include <process.h>
@@ -55,8 +57,9 @@ int process_id = _getpid();
 int process_id = getpid();
 #endif
 
-boost::mt19937 deterministic_rng;
 boost::mt19937 lessdeterministic_rng( std::time(0) + process_id );
+// rands() may be called from several threads instantiating for loop iterations
+static boost::mutex rng_mutex;
 
 AbstractFunction::~AbstractFunction()
 {
@@ -145,6 +148,7 @@ Value builtin_sign(const Context *, const EvalContext *evalctx)
 Value builtin_rands(const Context *, const EvalContext *evalctx)
 {
 	bool deterministic = false;
+	boost::mt19937 deterministic_rng;
 	if (evalctx->numArgs() == 3 &&
 			evalctx->getArgValue(0).type() == Value::NUMBER && 
 			evalctx->getArgValue(1).type() == Value::NUMBER && 
@@ -168,9 +172,16 @@ Value builtin_rands(const Context *, const EvalContext *evalctx)
 	
 	double min = std::min( evalctx->getArgValue(0).toDouble(), evalctx->getArgValue(1).toDouble() );
 	double max = std::max( evalctx->getArgValue(0).toDouble(), evalctx->getArgValue(1).toDouble() );
+	double count = evalctx->getArgValue(2).toDouble();
 	boost::uniform_real<> distributor( min, max );
 	Value::VectorType vec;
-	for (int i=0; i<evalctx->getArgValue(2).toDouble(); i++) {
+	boost::mutex::scoped_lock lock(rng_mutex, boost::defer_lock);
+	if (!deterministic) {
+		lock.lock();
+		// A new compile must draw new numbers
+		if (InstantiationCache *cache = InstantiationCache::active()) cache->uncacheable();
+	}
+	for (int i=0; i<count; i++) {
 		if ( deterministic ) {
 			vec.push_back( Value( distributor( deterministic_rng ) ) );
 		} else {
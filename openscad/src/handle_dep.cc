@@ -6,14 +6,18 @@
 #include <boost/foreach.hpp>
 #include <boost/regex.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
 namespace fs = boost::filesystem;
 #include "boosty.h"
 
 boost::unordered_set<std::string> dependencies;
 const char *make_command = NULL;
+// Files may be read while for loop iterations are instantiated in parallel
+static boost::mutex dep_mutex;
 
 void handle_dep(const std::string &filename)
 {
+	boost::mutex::scoped_lock lock(dep_mutex);
 	fs::path filepath(filename);
 	if ( boosty::is_absolute( filepath )) {
 		dependencies.insert(filename);
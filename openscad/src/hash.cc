@@ -0,0 +1,64 @@
+#include "hash.h"
+
+#include <algorithm>
+#include <stdio.h>
+#ifdef WIN32
+typedef unsigned __int64 uint64_t;
+#else
+#include <stdint.h>
+#endif
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+/*!
+	MurmurHash3 (x64, 128 bit) of str, as 32 hex digits.
+*/
+std::string hash128(const std::string &str)
+{
+	const unsigned char *data = reinterpret_cast<const unsigned char *>(str.data());
+	const size_t len = str.size();
+	const uint64_t c1 = 0x87c37b91114253d5ULL;
+	const uint64_t c2 = 0x4cf5ad432745937fULL;
+	uint64_t h1 = 0, h2 = 0;
+
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		uint64_t k1 = 0, k2 = 0;
+		for (int b = 7; b >= 0; b--) {
+			k1 = (k1 << 8) | data[i + b];
+			k2 = (k2 << 8) | data[i + 8 + b];
+		}
+		k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+		h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+		k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	uint64_t k1 = 0, k2 = 0;
+	for (size_t b = len - i; b > 8; b--) k2 = (k2 << 8) | data[i + b - 1];
+	for (size_t b = std::min(len - i, size_t(8)); b > 0; b--) k1 = (k1 << 8) | data[i + b - 1];
+	if (len - i > 8) { k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2; }
+	if (len - i > 0) { k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1; }
+
+	h1 ^= len; h2 ^= len;
+	h1 += h2; h2 += h1;
+	h1 = fmix64(h1); h2 = fmix64(h2);
+	h1 += h2; h2 += h1;
+
+	char buf[33];
+	sprintf(buf, "%08x%08x%08x%08x", unsigned(h1 >> 32), unsigned(h1), unsigned(h2 >> 32), unsigned(h2));
+	return std::string(buf, 32);
+}
@@ -0,0 +1,8 @@
+#ifndef HASH_H_
+#define HASH_H_
+
+#include <string>
+
+std::string hash128(const std::string &str);
+
+#endif
@@ -35,18 +35,26 @@
 #include "printutils.h"
 #include "fileutils.h"
 #include "handle_dep.h" // handle_dep()
+#include "indexedmesh.h"
+#include "grid.h"
+#include "instantiationcache.h"
+#include "hash.h"
 
 #ifdef ENABLE_CGAL
 #include "cgalutils.h"
 #endif
 
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 #include <fstream>
 #include <sstream>
 #include <assert.h>
 #include <boost/algorithm/string.hpp>
-#include <boost/regex.hpp>
-#include <boost/lexical_cast.hpp>
 #include <boost/filesystem.hpp>
 namespace fs = boost::filesystem;
 #include <boost/assign/std/vector.hpp>
@@ -55,6 +63,10 @@ using namespace boost::assign; // bring 'operator+=()' into scope
 
 #include <boost/detail/endian.hpp>
 #include <boost/cstdint.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/math/special_functions/fpclassify.hpp>
 
 class ImportModule : public AbstractModule
 {
@@ -115,6 +127,7 @@ AbstractNode *ImportModule::instantiate(const Context *ctx, const ModuleInstanti
 	node->fa = c.lookup_variable("$fa").toDouble();
 
 	node->filename = filename;
+	if (InstantiationCache *cache = InstantiationCache::active()) cache->readFile(filename);
 	Value layerval = c.lookup_variable("layer", true);
 	if (layerval.isUndefined()) {
 		layerval = c.lookup_variable("layername");
@@ -140,19 +153,6 @@ AbstractNode *ImportModule::instantiate(const Context *ctx, const ModuleInstanti
 }
 
 #define STL_FACET_NUMBYTES 4*3*4+2
-// as there is no 'float32_t' standard, we assume the systems 'float'
-// is a 'binary32' aka 'single' standard IEEE 32-bit floating point type
-union stl_facet {
-	uint8_t data8[ STL_FACET_NUMBYTES ];
-	uint32_t data32[4*3];
-	struct facet_data {
-	  float i, j, k;
-	  float x1, y1, z1;
-	  float x2, y2, z2;
-	  float x3, y3, z3;
-	  uint16_t attribute_byte_count;
-	} data;
-};
 
 void uint32_byte_swap( uint32_t &x )
 {
@@ -171,103 +171,480 @@ void uint32_byte_swap( uint32_t &x )
 #endif
 }
 
-void read_stl_facet( std::ifstream &f, stl_facet &facet )
-{
-	f.read( (char*)facet.data8, STL_FACET_NUMBYTES );
+namespace {
+	/*!
+		Read-only view of a whole file. The file is memory mapped where
+		possible and read into memory otherwise.
+	*/
+	class MappedFile
+	{
+	public:
+		MappedFile(const std::string &filename) : ptr(NULL), len(0), ok(false) {
+#ifdef _WIN32
+			std::ifstream f(filename.c_str(), std::ios::in | std::ios::binary);
+			if (!f.good()) return;
+			this->buffer.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+			this->ptr = this->buffer.empty() ? NULL : (const unsigned char *)&this->buffer[0];
+			this->len = this->buffer.size();
+			this->ok = true;
+#else
+			int fd = open(filename.c_str(), O_RDONLY);
+			if (fd < 0) return;
+			struct stat st;
+			if (fstat(fd, &st) == 0) {
+				if (st.st_size == 0) this->ok = true;
+				else {
+					void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+					if (map != MAP_FAILED) {
+						this->ptr = (const unsigned char *)map;
+						this->len = st.st_size;
+						this->ok = true;
+					}
+				}
+			}
+			close(fd);
+#endif
+		}
+		~MappedFile() {
+#ifndef _WIN32
+			if (this->ptr) munmap((void *)this->ptr, this->len);
+#endif
+		}
+		bool good() const { return this->ok; }
+		const unsigned char *data() const { return this->ptr; }
+		size_t size() const { return this->len; }
+
+	private:
+		const unsigned char *ptr;
+		size_t len;
+		bool ok;
+#ifdef _WIN32
+		std::vector<char> buffer;
+#endif
+	};
+
+	const int STL_WELD_SHARDS = 16;
+	// Hash of vertices with invalid coordinates, which aren't welded
+	const uint64_t STL_INVALID_HASH = ~uint64_t(0);
+
+	/*!
+		An STL vertex on the PolySet grid. Coordinates which aren't finite
+		or are too large for the grid make the vertex invalid.
+	*/
+	struct StlVertex
+	{
+		template <typename T> StlVertex(const T *xyz) {
+			this->valid = true;
+			for (int i = 0; i < 3; i++) {
+				this->valid = this->valid && boost::math::isfinite(xyz[i]) && fabs(xyz[i]) < 1e12;
+				this->k[i] = this->valid ? int64_t(round(xyz[i] / GRID_FINE)) : 0;
+			}
+		}
+		bool operator==(const StlVertex &o) const { return k[0] == o.k[0] && k[1] == o.k[1] && k[2] == o.k[2]; }
+		uint64_t hash() const {
+			if (!this->valid) return STL_INVALID_HASH;
+			uint64_t h = uint64_t(k[0]) * 0x9e3779b97f4a7c15ULL ^ uint64_t(k[1]) * 0xc2b2ae3d27d4eb4fULL ^ uint64_t(k[2]) * 0x165667b19e3779f9ULL;
+			h ^= h >> 33;
+			h *= 0xff51afd7ed558ccdULL;
+			h ^= h >> 33;
+			return h == STL_INVALID_HASH ? h - 1 : h;
+		}
+		int64_t k[3];
+		bool valid;
+	};
+
+	/*!
+		The vertices of the facets of a binary STL file, decoded on access.
+	*/
+	struct BinaryStlVertices
+	{
+		BinaryStlVertices(const unsigned char *facets) : facets(facets) {}
+		StlVertex operator[](size_t v) const {
+			const unsigned char *p = this->facets + (v / 3) * (STL_FACET_NUMBYTES) + 12 * (v % 3 + 1);
+			float xyz[3];
+			for (int i = 0; i < 3; i++) {
+				uint32_t u;
+				memcpy(&u, p + 4 * i, 4);
 #ifdef BOOST_BIG_ENDIAN
-	for ( int i = 0; i < 12; i++ ) {
-		uint32_byte_swap( facet.data32[ i ] );
-	}
-	// we ignore attribute byte count
+				uint32_byte_swap(u);
 #endif
-}
+				memcpy(&xyz[i], &u, 4);
+			}
+			return StlVertex(xyz);
+		}
+		const unsigned char *facets;
+	};
 
-PolySet *ImportNode::evaluate_polyset(class PolySetEvaluator *) const
-{
-	PolySet *p = NULL;
+	/*!
+		The vertices parsed from an ASCII STL file, three coordinates each.
+	*/
+	struct AsciiStlVertices
+	{
+		AsciiStlVertices(const std::vector<double> &coords) : coords(coords.empty() ? NULL : &coords[0]) {}
+		StlVertex operator[](size_t v) const { return StlVertex(this->coords + 3 * v); }
+		const double *coords;
+	};
+
+	struct StlWeldSlot {
+		uint64_t hash;
+		uint32_t index; // into unique + 1, 0 = free
+	};
+
+	template <class Vertices>
+	void hash_stl_vertices(const Vertices &vertices, size_t v0, size_t v1, std::vector<uint64_t> &hashes)
+	{
+		for (size_t v = v0; v < v1; v++) hashes[v] = vertices[v].hash();
+	}
 
-	if (this->type == TYPE_STL)
+	/*!
+		Welds the vertices in [begin, end), which all belong to the same
+		shard, using an open addressing table. local[v] is set to the index of
+		v among the distinct vertices of the shard, whose first occurences are
+		appended to unique.
+	*/
+	template <class Vertices>
+	void weld_stl_shard(const Vertices &vertices, const std::vector<uint64_t> &hashes,
+											const uint32_t *begin, const uint32_t *end,
+											std::vector<uint32_t> &local, std::vector<uint32_t> &unique)
 	{
-		handle_dep((std::string)this->filename);
-		// Open file and position at the end
-		std::ifstream f(this->filename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
-		if (!f.good()) {
-			PRINTB("WARNING: Can't open import file '%s'.", this->filename);
-			return p;
+		size_t mask = 1;
+		while (mask < 2 * size_t(end - begin)) mask <<= 1;
+		std::vector<StlWeldSlot> table(mask);
+		mask--;
+		std::vector<StlVertex> keys; // of unique, to keep the comparisons local
+
+		for (const uint32_t *it = begin; it != end; it++) {
+			uint32_t v = *it;
+			uint64_t hash = hashes[v];
+			StlVertex vertex = vertices[v];
+			size_t slot = hash & mask;
+			while (true) {
+				StlWeldSlot &entry = table[slot];
+				if (!entry.index) {
+					unique.push_back(v);
+					keys.push_back(vertex);
+					entry.hash = hash;
+					entry.index = unique.size();
+					local[v] = unique.size() - 1;
+					break;
+				}
+				if (entry.hash == hash && keys[entry.index - 1] == vertex) {
+					local[v] = entry.index - 1;
+					break;
+				}
+				slot = (slot + 1) & mask;
+			}
 		}
+	}
 
-		p = new PolySet();
+	template <class Vertices>
+	void weld_stl_shards(const Vertices &vertices, const std::vector<uint64_t> &hashes,
+											 const std::vector<uint32_t> &order, const size_t *bounds, int first, int step,
+											 std::vector<uint32_t> &local, std::vector<std::vector<uint32_t> > &unique)
+	{
+		for (int shard = first; shard < STL_WELD_SHARDS; shard += step) {
+			if (bounds[shard] == bounds[shard + 1]) continue;
+			weld_stl_shard(vertices, hashes, &order[bounds[shard]], &order[0] + bounds[shard + 1], local, unique[shard]);
+		}
+	}
 
-		boost::regex ex_sfe("solid|facet|endloop");
-		boost::regex ex_outer("outer loop");
-		boost::regex ex_vertex("vertex");
-		boost::regex ex_vertices("\\s*vertex\\s+([^\\s]+)\\s+([^\\s]+)\\s+([^\\s]+)");
-
-		bool binary = false;
-		std::streampos file_size = f.tellg();
-		f.seekg(80);
-		if (!f.eof()) {
-			uint32_t facenum = 0;
-			f.read((char *)&facenum, sizeof(uint32_t));
-#ifdef BOOST_BIG_ENDIAN
-			uint32_byte_swap( facenum );
-#endif
-			if (file_size == 80 + 4 + 50*facenum) binary = true;
+	/*!
+		Builds an indexed mesh from triangle soup, welding vertices which
+		coincide on the PolySet grid. Triangles which collapse when welding
+		are dropped, as are those with invalid vertices; the number of the
+		latter is returned in invalid.
+	*/
+	template <class Vertices>
+	IndexedMesh *weld_stl_vertices(const Vertices &vertices, size_t numvertices, int threads, size_t &invalid)
+	{
+		std::vector<uint64_t> hashes(numvertices);
+		{
+			boost::thread_group group;
+			for (int i = 0; i < threads; i++) {
+				size_t v0 = numvertices * i / threads / 3 * 3;
+				size_t v1 = numvertices * (i + 1) / threads / 3 * 3;
+				group.create_thread(boost::bind(&hash_stl_vertices<Vertices>, boost::cref(vertices), v0, v1, boost::ref(hashes)));
+			}
+			group.join_all();
+		}
+
+		// Group the valid vertices by shard, keeping their order within each shard
+		size_t bounds[STL_WELD_SHARDS + 1] = { 0 };
+		for (size_t v = 0; v < numvertices; v++) {
+			if (hashes[v] != STL_INVALID_HASH) bounds[(hashes[v] >> 60) + 1]++;
+		}
+		for (int shard = 0; shard < STL_WELD_SHARDS; shard++) bounds[shard + 1] += bounds[shard];
+		std::vector<uint32_t> order(bounds[STL_WELD_SHARDS]);
+		{
+			size_t next[STL_WELD_SHARDS];
+			std::copy(bounds, bounds + STL_WELD_SHARDS, next);
+			for (size_t v = 0; v < numvertices; v++) {
+				if (hashes[v] != STL_INVALID_HASH) order[next[hashes[v] >> 60]++] = v;
+			}
+		}
+
+		std::vector<uint32_t> local(numvertices);
+		std::vector<std::vector<uint32_t> > unique(STL_WELD_SHARDS);
+		{
+			boost::thread_group group;
+			int workers = std::min(threads, STL_WELD_SHARDS);
+			for (int i = 0; i < workers; i++) {
+				group.create_thread(boost::bind(&weld_stl_shards<Vertices>, boost::cref(vertices), boost::cref(hashes), boost::cref(order),
+																				bounds, i, workers, boost::ref(local), boost::ref(unique)));
+			}
+			group.join_all();
+		}
+
+		IndexedMesh *mesh = new IndexedMesh;
+		uint32_t offset[STL_WELD_SHARDS];
+		for (int shard = 0; shard < STL_WELD_SHARDS; shard++) {
+			offset[shard] = mesh->vertices.size();
+			BOOST_FOREACH(uint32_t v, unique[shard]) {
+				StlVertex vertex = vertices[v];
+				mesh->vertices.push_back(Vector3d(vertex.k[0] * GRID_FINE, vertex.k[1] * GRID_FINE, vertex.k[2] * GRID_FINE));
+			}
+		}
+		invalid = 0;
+		mesh->triangles.reserve(numvertices);
+		for (size_t v = 0; v < numvertices; v += 3) {
+			if (hashes[v] == STL_INVALID_HASH || hashes[v + 1] == STL_INVALID_HASH || hashes[v + 2] == STL_INVALID_HASH) {
+				invalid++;
+				continue;
+			}
+			int a = offset[hashes[v] >> 60] + local[v];
+			int b = offset[hashes[v + 1] >> 60] + local[v + 1];
+			int c = offset[hashes[v + 2] >> 60] + local[v + 2];
+			if (a == b || b == c || c == a) continue;
+			mesh->triangles.push_back(a);
+			mesh->triangles.push_back(b);
+			mesh->triangles.push_back(c);
+		}
+		return mesh;
+	}
+
+	inline bool stl_space(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+	}
+
+	/*!
+		Locale independent parser for the decimal numbers in ASCII STL files.
+		Parses the number at p, which must be followed by whitespace or end,
+		and advances p past it. Returns false if there is no such number.
+	*/
+	bool parse_stl_double(const char *&p, const char *end, double &result)
+	{
+		static const double exact[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+		const char *s = p;
+		bool negative = s < end && *s == '-';
+		if (s < end && (*s == '-' || *s == '+')) s++;
+
+		// Keep up to 19 significant digits, which fit into the mantissa
+		uint64_t mantissa = 0;
+		int digits = 0, exponent = 0;
+		bool any = false;
+		for (; s < end && *s >= '0' && *s <= '9'; s++, any = true) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*s - '0');
+				if (mantissa) digits++;
+			}
+			else exponent++;
 		}
-		f.seekg(0);
-
-		char data[5];
-		f.read(data, 5);
-		if (!binary && !f.eof() && !memcmp(data, "solid", 5)) {
-			int i = 0;
-			double vdata[3][3];
-			std::string line;
-			std::getline(f, line);
-			while (!f.eof()) {
-				
-				std::getline(f, line);
-				boost::trim(line);
-				if (boost::regex_search(line, ex_sfe)) {
-					continue;
+		if (s < end && *s == '.') {
+			for (s++; s < end && *s >= '0' && *s <= '9'; s++, any = true) {
+				if (digits < 19) {
+					mantissa = mantissa * 10 + (*s - '0');
+					if (mantissa) digits++;
+					exponent--;
 				}
-				if (boost::regex_search(line, ex_outer)) {
-					i = 0;
-					continue;
+			}
+		}
+		if (!any) return false;
+		if (s < end && (*s == 'e' || *s == 'E')) {
+			s++;
+			bool negexp = s < end && *s == '-';
+			if (s < end && (*s == '-' || *s == '+')) s++;
+			if (s == end || *s < '0' || *s > '9') return false;
+			int e = 0;
+			for (; s < end && *s >= '0' && *s <= '9'; s++) {
+				if (e < 10000) e = e * 10 + (*s - '0');
+			}
+			exponent += negexp ? -e : e;
+		}
+		if (s < end && !stl_space(*s)) return false;
+
+		// Exact, correctly rounded in the common case of few digits
+		double value = double(mantissa);
+		if (mantissa < (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+			value = exponent < 0 ? value / exact[-exponent] : value * exact[exponent];
+		}
+		else if (mantissa) {
+			value = exponent < 0 ? value / pow(10.0, -exponent) : value * pow(10.0, exponent);
+		}
+		result = negative ? -value : value;
+		p = s;
+		return true;
+	}
+
+	/*!
+		Parses the facets in [begin, end) of an ASCII STL file, which must
+		start at the beginning of a line, and appends the coordinates of
+		the three vertices of each facet to coords. Vertex lines which can't
+		be parsed are appended to errors, and their facet is skipped.
+	*/
+	void parse_ascii_stl(const char *begin, const char *end, std::vector<double> &coords,
+											 std::vector<std::string> &errors)
+	{
+		int i = 0;
+		double vdata[3][3];
+		const char *p = begin;
+		while (p < end) {
+			const char *line = p;
+			while (p < end && stl_space(*p)) p++;
+			const char *word = p;
+			while (p < end && !stl_space(*p)) p++;
+			size_t len = p - word;
+			if (len == 5 && !memcmp(word, "outer", 5)) {
+				i = 0;
+			}
+			else if (len == 6 && !memcmp(word, "vertex", 6) && i < 3) {
+				bool ok = true;
+				for (int v = 0; v < 3 && ok; v++) {
+					while (p < end && (*p == ' ' || *p == '\t')) p++;
+					ok = parse_stl_double(p, end, vdata[i][v]);
 				}
-				boost::smatch results;
-				if (boost::regex_search(line, results, ex_vertices)) {
-					try {
-						for (int v=0;v<3;v++) {
-							vdata[i][v] = boost::lexical_cast<double>(results[v+1]);
-						}
-					}
-					catch (const boost::bad_lexical_cast &blc) {
-						PRINTB("WARNING: Can't parse vertex line '%s'.", line);
-						i = 10;
-						continue;
-					}
-					if (++i == 3) {
-						p->append_poly();
-						p->append_vertex(vdata[0][0], vdata[0][1], vdata[0][2]);
-						p->append_vertex(vdata[1][0], vdata[1][1], vdata[1][2]);
-						p->append_vertex(vdata[2][0], vdata[2][1], vdata[2][2]);
-					}
+				if (!ok) {
+					const char *eol = std::find(p, end, '\n');
+					std::string text(line, eol);
+					boost::trim(text);
+					errors.push_back(text);
+					i = 10;
+				}
+				else if (++i == 3) {
+					coords.insert(coords.end(), &vdata[0][0], &vdata[0][0] + 9);
 				}
 			}
+			p = std::find(p, end, '\n');
+		}
+	}
+
+	/*!
+		Returns the first line start after the next endfacet at or after p.
+	*/
+	const char *next_stl_facet(const char *p, const char *end)
+	{
+		static const char endfacet[] = "endfacet";
+		p = std::search(p, end, endfacet, endfacet + 8);
+		p = std::find(p, end, '\n');
+		return p == end ? end : p + 1;
+	}
+
+	/*!
+		Parses an ASCII STL file, split at facet boundaries into chunks of at
+		least a megabyte which are parsed in parallel.
+	*/
+	IndexedMesh *import_ascii_stl(const std::string &filename, const char *begin, const char *end,
+																int threads)
+	{
+		size_t size = end - begin;
+		int chunks = int(std::min(size_t(threads), size / (1024*1024) + 1));
+		std::vector<const char *> bounds(chunks + 1, end);
+		bounds[0] = begin;
+		for (int i = 1; i < chunks; i++) {
+			bounds[i] = next_stl_facet(std::max(bounds[i - 1], begin + size * i / chunks), end);
 		}
-		else
+
+		std::vector<std::vector<double> > coords(chunks);
+		std::vector<std::vector<std::string> > errors(chunks);
 		{
-			f.ignore(80-5+4);
-			while (1) {
-				stl_facet facet;
-				read_stl_facet( f, facet );
-				if (f.eof()) break;
-				p->append_poly();
-				p->append_vertex(facet.data.x1, facet.data.y1, facet.data.z1);
-				p->append_vertex(facet.data.x2, facet.data.y2, facet.data.z2);
-				p->append_vertex(facet.data.x3, facet.data.y3, facet.data.z3);
+			boost::thread_group group;
+			for (int i = 0; i < chunks; i++) {
+				group.create_thread(boost::bind(&parse_ascii_stl, bounds[i], bounds[i + 1],
+																				boost::ref(coords[i]), boost::ref(errors[i])));
 			}
+			group.join_all();
 		}
+		for (int i = 0; i < chunks; i++) {
+			BOOST_FOREACH(const std::string &line, errors[i]) {
+				PRINTB("WARNING: Can't parse vertex line '%s'.", line);
+			}
+			if (i > 0) {
+				coords[0].insert(coords[0].end(), coords[i].begin(), coords[i].end());
+				std::vector<double>().swap(coords[i]);
+			}
+		}
+
+		size_t numvertices = coords[0].size() / 3;
+		if (numvertices > 0x7fffffff) {
+			PRINTB("WARNING: Too many facets in STL file '%s'.", filename);
+			return NULL;
+		}
+		size_t invalid;
+		IndexedMesh *mesh = weld_stl_vertices(AsciiStlVertices(coords[0]), numvertices, threads, invalid);
+		if (invalid) PRINTB("WARNING: Skipped %d facets with invalid coordinates in '%s'.", invalid % filename);
+		return mesh;
+	}
+}
+
+/*!
+	Reads an ASCII or binary STL file into an indexed mesh, welding
+	vertices which coincide on the PolySet grid. The file is memory mapped,
+	and parsed and welded on up to threads threads (0 = one per core).
+	Facets which collapse when welding, or have invalid coordinates, are
+	dropped.
+
+	Returns NULL if the file can't be read.
+*/
+IndexedMesh *import_stl_mesh(const std::string &filename, int threads)
+{
+	MappedFile file(filename);
+	if (!file.good()) {
+		PRINTB("WARNING: Can't open import file '%s'.", filename);
+		return NULL;
+	}
+	if (threads <= 0) threads = boost::thread::hardware_concurrency();
+	threads = std::max(1, threads);
+
+	const unsigned char *data = file.data();
+	size_t size = file.size();
+	uint32_t facenum = 0;
+	if (size >= 84) {
+		memcpy(&facenum, data + 80, 4);
+#ifdef BOOST_BIG_ENDIAN
+		uint32_byte_swap(facenum);
+#endif
+	}
+	bool binary = size >= 84 && size == 84 + size_t(STL_FACET_NUMBYTES) * facenum;
+	if (!binary && size >= 5 && !memcmp(data, "solid", 5)) {
+		return import_ascii_stl(filename, (const char *)data, (const char *)data + size, threads);
+	}
+
+	// Read as many whole facets as there are, even if the count is wrong
+	size_t numfacets = size >= 84 ? (size - 84) / (STL_FACET_NUMBYTES) : 0;
+	if (numfacets > 0x7fffffff / 3) {
+		PRINTB("WARNING: Too many facets in STL file '%s'.", filename);
+		return NULL;
+	}
+	size_t invalid;
+	IndexedMesh *mesh = weld_stl_vertices(BinaryStlVertices(data + 84), 3 * numfacets, threads, invalid);
+	if (invalid) PRINTB("WARNING: Skipped %d facets with invalid coordinates in '%s'.", invalid % filename);
+	return mesh;
+}
+
+PolySet *ImportNode::evaluate_polyset(class PolySetEvaluator *) const
+{
+	PolySet *p = NULL;
+
+	if (this->type == TYPE_STL)
+	{
+		handle_dep((std::string)this->filename);
+		IndexedMesh *mesh = import_stl_mesh(this->filename);
+		if (!mesh) return p;
+		p = mesh->toPolySet();
+		delete mesh;
 	}
 
 	else if (this->type == TYPE_OFF)
@@ -333,6 +710,43 @@ std::string ImportNode::name() const
 	return "import";
 }
 
+MeshNode::MeshNode(const ModuleInstantiation *mi, const shared_ptr<PolySet> &ps, int convexity)
+	: AbstractPolyNode(mi), ps(ps), convexity(convexity)
+{
+	std::string data;
+	BOOST_FOREACH(const PolySet::Polygon &poly, ps->polygons) {
+		size_t n = poly.size();
+		data.append(reinterpret_cast<const char *>(&n), sizeof(n));
+		BOOST_FOREACH(const Vector3d &v, poly) {
+			data.append(reinterpret_cast<const char *>(v.data()), 3 * sizeof(double));
+		}
+	}
+	this->id = hash128(data);
+}
+
+PolySet *MeshNode::evaluate_polyset(class PolySetEvaluator *) const
+{
+	PolySet *p = new PolySet();
+	p->polygons = this->ps->polygons;
+	p->borders = this->ps->borders;
+	p->is2d = this->ps->is2d;
+	p->convexity = this->convexity;
+	return p;
+}
+
+std::string MeshNode::toString() const
+{
+	std::stringstream stream;
+	stream << this->name() << "(content = " << QuotedString(this->id) << ", "
+				 "convexity = " << this->convexity << ")";
+	return stream.str();
+}
+
+std::string MeshNode::name() const
+{
+	return "mesh";
+}
+
 void register_builtin_import()
 {
 	Builtins::init("import_stl", new ImportModule(TYPE_STL));
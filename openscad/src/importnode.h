@@ -4,6 +4,7 @@
 #include "node.h"
 #include "visitor.h"
 #include "value.h"
+#include "memory.h"
 
 enum import_type_e {
 	TYPE_UNKNOWN,
@@ -31,4 +32,25 @@ public:
 	virtual PolySet *evaluate_polyset(class PolySetEvaluator *) const;
 };
 
+/*!
+	Holds a mesh made in memory, like the swept target of the enclosure
+	pipeline, in the tree in place of an import() of it. The node string
+	identifies the mesh by a hash of its content, so cached results follow
+	the mesh.
+*/
+class MeshNode : public AbstractPolyNode
+{
+public:
+	MeshNode(const ModuleInstantiation *mi, const shared_ptr<class PolySet> &ps, int convexity = 1);
+	virtual std::string toString() const;
+	virtual std::string name() const;
+	virtual PolySet *evaluate_polyset(class PolySetEvaluator *) const;
+
+	shared_ptr<class PolySet> ps;
+	std::string id;
+	int convexity;
+};
+
+class IndexedMesh *import_stl_mesh(const std::string &filename, int threads = 0);
+
 #endif
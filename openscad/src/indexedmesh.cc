@@ -0,0 +1,18 @@
+#include "indexedmesh.h"
+#include "polyset.h"
+
+/*!
+	Returns a new PolySet with the triangles of this mesh.
+	The vertices are used as-is, they aren't snapped to the PolySet grid.
+*/
+PolySet *IndexedMesh::toPolySet() const
+{
+	PolySet *ps = new PolySet();
+	ps->polygons.resize(numTriangles());
+	for (size_t i = 0; i < ps->polygons.size(); i++) {
+		PolySet::Polygon &p = ps->polygons[i];
+		p.reserve(3);
+		for (int c = 0; c < 3; c++) p.push_back(this->vertices[this->triangles[3 * i + c]]);
+	}
+	return ps;
+}
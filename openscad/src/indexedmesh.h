@@ -0,0 +1,24 @@
+#ifndef INDEXEDMESH_H_
+#define INDEXEDMESH_H_
+
+#include "linalg.h"
+#include <vector>
+
+/*!
+	Triangle mesh with shared vertices. Every three consecutive entries
+	of triangles index one triangle, counter-clockwise seen from the outside.
+*/
+class IndexedMesh
+{
+public:
+	std::vector<Vector3d> vertices;
+	std::vector<int> triangles;
+
+	size_t numTriangles() const { return this->triangles.size() / 3; }
+	size_t memsize() const {
+		return this->vertices.size() * sizeof(Vector3d) + this->triangles.size() * sizeof(int);
+	}
+	class PolySet *toPolySet() const;
+};
+
+#endif
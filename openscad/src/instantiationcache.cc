@@ -0,0 +1,525 @@
+#include "instantiationcache.h"
+#include "module.h"
+#include "modcontext.h"
+#include "function.h"
+#include "node.h"
+#include "ModuleCache.h"
+#include "hash.h"
+#include "printutils.h"
+
+#include <algorithm>
+#include <sstream>
+#include <fstream>
+#include <boost/foreach.hpp>
+#include <boost/format.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_set.hpp>
+
+InstantiationCache *InstantiationCache::current = NULL;
+std::vector<InstantiationCache*> InstantiationCache::instances;
+
+// Candidates tried per lookup. The entries of a key are usually reused in
+// the order they were made, like the iterations of a loop.
+static const size_t MAX_CANDIDATES = 16;
+
+size_t hash_value(const InstantiationCache::ReadKey &key)
+{
+	size_t seed = boost::hash<std::string>()(key.name);
+	boost::hash_combine(seed, key.type);
+	boost::hash_combine(seed, key.scope);
+	return seed;
+}
+
+// File modification times have a resolution of a second, so the contents
+// identify the file
+static std::string file_id(const std::string &filename)
+{
+	std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!ifs.is_open()) return std::string();
+	std::string text((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+	return hash128(text);
+}
+
+// Parents from ctx up to ancestor, or -1 if it isn't one
+static int distance(const Context *ctx, const Context *ancestor)
+{
+	int hops = 0;
+	for (; ctx; ctx = ctx->parent, hops++) {
+		if (ctx == ancestor) return hops;
+		if (ctx->serial < ancestor->serial) break;
+	}
+	return -1;
+}
+
+static const Context *ancestor(const Context *ctx, int hops)
+{
+	for (; ctx && hops > 0; hops--) ctx = ctx->parent;
+	return ctx;
+}
+
+static void delete_except(AbstractNode *node, const boost::unordered_set<const AbstractNode*> &keep)
+{
+	if (!node || keep.find(node) != keep.end()) return;
+	BOOST_FOREACH(AbstractNode *child, node->children) delete_except(child, keep);
+	node->children.clear();
+	delete node;
+}
+
+static size_t count_nodes(const AbstractNode *node)
+{
+	size_t count = 1;
+	BOOST_FOREACH(const AbstractNode *child, node->getChildren()) count += count_nodes(child);
+	return count;
+}
+
+// Appends the nodes from root down to node, if it's in the subtree
+static bool find_path(const AbstractNode *root, const AbstractNode *node,
+											boost::unordered_set<const AbstractNode*> &path)
+{
+	bool found = (root == node);
+	for (size_t i = 0; !found && i < root->getChildren().size(); i++) {
+		found = find_path(root->getChildren()[i], node, path);
+	}
+	if (found) path.insert(root);
+	return found;
+}
+
+InstantiationCache::InstantiationCache() : generation(0), livenodes(0), nextindex(0)
+{
+	instances.push_back(this);
+}
+
+InstantiationCache::~InstantiationCache()
+{
+	clear();
+	typedef std::pair<int, FileModule*> RetiredModule;
+	BOOST_FOREACH(const RetiredModule &module, this->retired) delete module.second;
+	BOOST_FOREACH(const RetiredModule &module, this->libraries) ModuleCache::instance()->release(module.second);
+	instances.erase(std::find(instances.begin(), instances.end(), this));
+}
+
+/*!
+	Starts recording a compile. Returns false if there was nothing to reuse,
+	in which case the node indices were reset and the Tree should be
+	cleared too.
+*/
+bool InstantiationCache::beginCompile()
+{
+	// Node indices aren't reused, so the tree caches indexed by them would
+	// grow with every compile. Start over once most belong to deleted nodes.
+	if (AbstractNode::indexCounter() > 4 * this->livenodes + 100000) clear();
+	// New nodes mustn't get the indices of reused ones. Other trees built
+	// in between may have reset the counter.
+	if (AbstractNode::indexCounter() < this->nextindex) clear();
+
+	this->generation++;
+	this->stale.swap(this->entries);
+	BOOST_FOREACH(Entry *e, this->stale) {
+		if (e->valid) this->previous[e->key].push_back(e);
+	}
+	current = this;
+
+	if (this->previous.empty()) {
+		AbstractNode::resetIndexCounter();
+		return false;
+	}
+	return true;
+}
+
+/*!
+	Ends the compile which built the tree rooted by \a root. Deletes the old
+	tree except for the subtrees which were moved to the new one, and the
+	root modules no node refers to anymore.
+*/
+void InstantiationCache::endCompile(AbstractNode *oldroot, const AbstractNode *root)
+{
+	assert(this->recordings.empty());
+	current = NULL;
+
+	boost::unordered_set<const AbstractNode*> keep;
+	BOOST_FOREACH(const Entry *e, this->taken) keep.insert(e->node);
+	delete_except(oldroot, keep);
+
+	BOOST_FOREACH(Entry *e, this->stale) {
+		if (e->generation != this->generation) delete e;
+	}
+	this->stale.clear();
+	this->previous.clear();
+	this->taken.clear();
+	this->keys.clear();
+	this->definitions.clear();
+
+	int oldest = this->generation;
+	BOOST_FOREACH(const Entry *e, this->entries) oldest = std::min(oldest, e->oldest);
+	std::vector<std::pair<int, FileModule*> >::iterator it = this->retired.begin();
+	while (it != this->retired.end()) {
+		if (it->first < oldest) {
+			delete it->second;
+			it = this->retired.erase(it);
+		}
+		else it++;
+	}
+	it = this->libraries.begin();
+	while (it != this->libraries.end()) {
+		if (it->first < oldest) {
+			ModuleCache::instance()->release(it->second);
+			it = this->libraries.erase(it);
+		}
+		else it++;
+	}
+
+	this->livenodes = root ? count_nodes(root) : 0;
+	this->nextindex = AbstractNode::indexCounter();
+}
+
+/*!
+	Takes over a root module which has been replaced, as the nodes of the
+	compiles made from it may be reused.
+*/
+void InstantiationCache::retire(FileModule *module)
+{
+	if (module) this->retired.push_back(std::make_pair(this->generation, module));
+}
+
+/*!
+	Retires a library module replaced in the ModuleCache to every cache.
+	Returns the number of caches, each of which releases the module to the
+	ModuleCache once its nodes no longer refer to it.
+*/
+int InstantiationCache::retireLibrary(FileModule *module)
+{
+	BOOST_FOREACH(InstantiationCache *cache, instances) {
+		cache->libraries.push_back(std::make_pair(cache->generation, module));
+	}
+	return instances.size();
+}
+
+/*!
+	Forgets the instantiations which produced \a node of the tree rooted by
+	\a root, after the node was modified in place.
+*/
+void InstantiationCache::invalidate(const AbstractNode &root, const AbstractNode &node)
+{
+	boost::unordered_set<const AbstractNode*> path;
+	if (!find_path(&root, &node, path)) return;
+	BOOST_FOREACH(Entry *e, this->entries) {
+		if (path.find(e->node) != path.end()) e->valid = false;
+	}
+}
+
+/*!
+	Forgets all instantiations, so the next compile builds a new tree.
+	Needed when something changes which the instantiations don't record,
+	like the document path.
+*/
+void InstantiationCache::clear()
+{
+	BOOST_FOREACH(Entry *e, this->entries) delete e;
+	this->entries.clear();
+}
+
+/*!
+	Returns the subtree of an earlier instantiation of an equal \a inst in
+	an equal \a ctx, or NULL if there's none.
+*/
+AbstractNode *InstantiationCache::reuse(const ModuleInstantiation &inst, const Context *ctx)
+{
+	boost::unordered_map<std::string, std::deque<Entry*> >::iterator found = this->previous.find(key(inst));
+	if (found == this->previous.end()) return NULL;
+	std::deque<Entry*> &candidates = found->second;
+	while (!candidates.empty() && !available(candidates.front())) candidates.pop_front();
+
+	std::vector<const Context*> scopes, founds;
+	size_t tried = 0;
+	BOOST_FOREACH(Entry *e, candidates) {
+		if (!available(e)) continue;
+		if (tried++ == MAX_CANDIDATES) break;
+
+		scopes.clear();
+		founds.clear();
+		bool valid = true;
+		BOOST_FOREACH(const Read &read, e->reads) {
+			const Context *scope = isScoped(read.type) ? ancestor(ctx, read.hops) : NULL;
+			const Context *foundctx = NULL;
+			Value value;
+			switch (read.type) {
+			case VARIABLE:
+			case CONFIG_VARIABLE: {
+				const Context *from = (read.type == VARIABLE) ? scope : ctx;
+				if (!from) { valid = false; break; }
+				const Value *v = from->find_variable(read.name, boost::hash<std::string>()(read.name), foundctx);
+				if (v) value = *v;
+				break;
+			}
+			case MODULE:
+			case FUNCTION:
+				if (!scope) { valid = false; break; }
+				value = resolve(read.type, scope, read.name, foundctx);
+				if ((foundctx ? distance(scope, foundctx) : -1) != read.foundhops) valid = false;
+				break;
+			case LIBRARY:
+				value = Value(str(boost::format("%p") % ModuleCache::instance()->lookup(read.name)));
+				break;
+			case IMPORT:
+				value = Value(file_id(read.name));
+				break;
+			}
+			if (!valid || value != read.value) {
+				valid = false;
+				break;
+			}
+			scopes.push_back(scope);
+			founds.push_back(foundctx);
+		}
+		if (!valid) continue;
+
+		take(e);
+		if (!e->messages.empty()) PRINT(e->messages);
+		if (!this->recordings.empty()) {
+			Recording *parent = this->recordings.back();
+			for (size_t i = 0; i < e->reads.size(); i++) {
+				const Read &read = e->reads[i];
+				note(parent, read.type, read.name, scopes[i], founds[i], read.value);
+			}
+			parent->children.push_back(e);
+		}
+		return e->node;
+	}
+	return NULL;
+}
+
+/*!
+	Moves e with the entries nested in it to the compile in progress.
+*/
+void InstantiationCache::take(Entry *e)
+{
+	for (Entry *p = e->parent; p; p = p->parent) p->valid = false;
+	e->parent = NULL;
+	this->taken.push_back(e);
+
+	std::vector<Entry*> moving(1, e);
+	while (!moving.empty()) {
+		Entry *m = moving.back();
+		moving.pop_back();
+		m->generation = this->generation;
+		this->entries.push_back(m);
+		moving.insert(moving.end(), m->children.begin(), m->children.end());
+	}
+}
+
+/*!
+	Starts recording the evaluation of \a inst in \a ctx, until the next
+	store() which isn't matched by another record().
+*/
+void InstantiationCache::record(const ModuleInstantiation &inst, const Context *ctx)
+{
+	Recording *r = new Recording;
+	r->inst = &inst;
+	r->ctx = ctx;
+	r->serial = Context::nextSerial();
+	r->cacheable = true;
+	this->recordings.push_back(r);
+	print_messages_push();
+}
+
+/*!
+	Ends the recording started last, whose evaluation resulted in \a node.
+	What it read outside the contexts of the recording it's nested in is
+	passed on to that.
+*/
+void InstantiationCache::store(AbstractNode *node)
+{
+	Recording *r = this->recordings.back();
+	this->recordings.pop_back();
+	std::string messages = print_messages_stack.back();
+	print_messages_pop();
+	Recording *parent = this->recordings.empty() ? NULL : this->recordings.back();
+
+	Entry *e = NULL;
+	if (r->cacheable && node) {
+		e = new Entry;
+		e->key = key(*r->inst);
+		e->messages = messages;
+		e->node = node;
+		e->parent = NULL;
+		e->children = r->children;
+		e->generation = this->generation;
+		e->oldest = this->generation;
+		e->valid = true;
+		BOOST_FOREACH(const ReadMap::value_type &item, r->reads) {
+			Read read;
+			read.type = item.first.type;
+			read.name = item.first.name;
+			read.hops = item.first.scope ? distance(r->ctx, item.first.scope) : 0;
+			read.foundhops = -1;
+			if (item.second.found && (read.type == MODULE || read.type == FUNCTION)) {
+				read.foundhops = distance(item.first.scope, item.second.found);
+			}
+			read.value = item.second.value;
+			if (read.hops < 0) {
+				delete e;
+				e = NULL;
+				break;
+			}
+			e->reads.push_back(read);
+		}
+	}
+
+	if (e) {
+		BOOST_FOREACH(Entry *child, e->children) {
+			child->parent = e;
+			e->oldest = std::min(e->oldest, child->oldest);
+		}
+		this->entries.push_back(e);
+	}
+	if (parent) {
+		BOOST_FOREACH(const ReadMap::value_type &item, r->reads) {
+			note(parent, item.first.type, item.first.name, item.first.scope, item.second.found, item.second.value);
+		}
+		if (e) parent->children.push_back(e);
+		else parent->children.insert(parent->children.end(), r->children.begin(), r->children.end());
+	}
+	delete r;
+}
+
+/*!
+	Records a read into r, unless what was read is defined in a context
+	created during r. For lookups, scope is where the lookup started and
+	found where it ended, or NULL if nothing was found.
+*/
+void InstantiationCache::note(Recording *r, ReadType type, const std::string &name,
+															const Context *scope, const Context *found, const Value &value)
+{
+	if (found && found->serial >= r->serial) return;
+	while (scope && scope->serial >= r->serial) scope = scope->parent;
+	if (isScoped(type) && !scope) {
+		r->cacheable = false;
+		return;
+	}
+	r->reads.insert(std::make_pair(ReadKey(type, name, scope), Result(value, found)));
+}
+
+void InstantiationCache::readVariable(const Context *start, const Context *found,
+																			const std::string &name, const Value &value)
+{
+	if (this->recordings.empty()) return;
+	if (name[0] == '$') note(this->recordings.back(), CONFIG_VARIABLE, name, NULL, found, value);
+	else note(this->recordings.back(), VARIABLE, name, start, found, value);
+}
+
+void InstantiationCache::readModule(const Context *start, const std::string &name)
+{
+	if (this->recordings.empty()) return;
+	const Context *found;
+	Value definition = resolve(MODULE, start, name, found);
+	note(this->recordings.back(), MODULE, name, start, found, definition);
+}
+
+void InstantiationCache::readFunction(const Context *start, const std::string &name)
+{
+	if (this->recordings.empty()) return;
+	const Context *found;
+	Value definition = resolve(FUNCTION, start, name, found);
+	note(this->recordings.back(), FUNCTION, name, start, found, definition);
+}
+
+void InstantiationCache::readLibrary(const std::string &filename, const FileModule *module)
+{
+	if (this->recordings.empty()) return;
+	note(this->recordings.back(), LIBRARY, filename, NULL, NULL, Value(str(boost::format("%p") % module)));
+}
+
+void InstantiationCache::readFile(const std::string &filename)
+{
+	if (this->recordings.empty()) return;
+	note(this->recordings.back(), IMPORT, filename, NULL, NULL, Value(file_id(filename)));
+}
+
+/*!
+	child() instantiates the children of the module call whose context is
+	\a modulectx, which belong to the caller. The recordings which started
+	inside that call can't tell which children they got.
+*/
+void InstantiationCache::readChildren(const Context *modulectx)
+{
+	BOOST_FOREACH(Recording *r, this->recordings) {
+		if (modulectx->serial < r->serial) r->cacheable = false;
+	}
+}
+
+/*!
+	Marks all recordings in progress as uncacheable, for reads whose result
+	may differ on every compile.
+*/
+void InstantiationCache::uncacheable()
+{
+	BOOST_FOREACH(Recording *r, this->recordings) r->cacheable = false;
+}
+
+/*!
+	Finds the definition a call of the module or function \a name from
+	\a scope would use, like ModuleContext::instantiate_module() and
+	ModuleContext::evaluate_function() do. Returns a value identifying it:
+	the hash of its dump for user definitions, its address for builtins.
+*/
+Value InstantiationCache::resolve(ReadType type, const Context *scope, const std::string &name, const Context *&found)
+{
+	const void *definition = NULL;
+	found = NULL;
+	for (const Context *c = scope; c && !definition; c = c->parent) {
+		const ModuleContext *mc = dynamic_cast<const ModuleContext*>(c);
+		if (!mc) continue;
+		if (type == MODULE && mc->modules_p) {
+			LocalScope::AbstractModuleContainer::const_iterator it = mc->modules_p->find(name);
+			if (it != mc->modules_p->end()) definition = it->second;
+		}
+		if (type == FUNCTION && mc->functions_p) {
+			LocalScope::FunctionContainer::const_iterator it = mc->functions_p->find(name);
+			if (it != mc->functions_p->end()) definition = it->second;
+		}
+		const FileContext *fc = dynamic_cast<const FileContext*>(c);
+		if (!definition && fc) {
+			BOOST_FOREACH(const FileModule::ModuleContainer::value_type &lib, fc->usedLibraries()) {
+				FileModule *usedmod = ModuleCache::instance()->lookup(lib);
+				if (!usedmod) continue;
+				if (type == MODULE && usedmod->scope.modules.find(name) != usedmod->scope.modules.end()) {
+					definition = usedmod->scope.modules[name];
+					break;
+				}
+				if (type == FUNCTION && usedmod->scope.functions.find(name) != usedmod->scope.functions.end()) {
+					definition = usedmod->scope.functions[name];
+					break;
+				}
+			}
+		}
+		if (definition) found = c;
+	}
+	if (!definition) return Value();
+
+	boost::unordered_map<const void*, Value>::const_iterator it = this->definitions.find(definition);
+	if (it != this->definitions.end()) return it->second;
+	std::string id;
+	if (type == MODULE) {
+		const Module *module = dynamic_cast<const Module*>(static_cast<const AbstractModule*>(definition));
+		id = module ? hash128(module->dump("", name)) : str(boost::format("%p") % definition);
+	}
+	else {
+		const Function *function = dynamic_cast<const Function*>(static_cast<const AbstractFunction*>(definition));
+		id = function ? hash128(function->dump("", name)) : str(boost::format("%p") % definition);
+	}
+	return this->definitions[definition] = Value(id);
+}
+
+/*!
+	Returns the hash identifying \a inst with its modifiers, path and
+	children, which is the same for equal instantiations of different
+	compiles.
+*/
+const std::string &InstantiationCache::key(const ModuleInstantiation &inst)
+{
+	boost::unordered_map<const ModuleInstantiation*, std::string>::const_iterator it = this->keys.find(&inst);
+	if (it != this->keys.end()) return it->second;
+	std::stringstream text;
+	text << inst.isRoot() << inst.isHighlight() << inst.isBackground() << inst.path() << "\n" << inst.dump("");
+	return this->keys[&inst] = hash128(text.str());
+}
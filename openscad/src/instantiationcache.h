@@ -0,0 +1,144 @@
+#ifndef INSTANTIATIONCACHE_H_
+#define INSTANTIATIONCACHE_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <boost/unordered_map.hpp>
+#include "value.h"
+#include "context.h"
+
+class AbstractNode;
+class ModuleInstantiation;
+class FileModule;
+
+/*!
+	Keeps the node subtrees of the last compile together with what each
+	ModuleInstantiation::evaluate() read from outside the contexts it
+	created itself: variables, the module and function definitions it
+	called, used libraries and imported files. On the next compile, an
+	instantiation whose reads all give the same results gets its old
+	subtree back instead of being evaluated again. The reused nodes keep
+	their indices, so the Tree keeps their dump and ID strings too.
+
+	The reads are recorded relative to the context the instantiation was
+	evaluated in: a variable is looked up again from the context the same
+	number of parents up, where the lookup left the contexts created by the
+	instantiation. Instantiations reading something which can't be checked
+	that way (unseeded rands(), the children of a module call they are
+	nested in, parallel for loops) are evaluated on every compile.
+
+	Each MainWindow has one; the batch modes compile only once and don't
+	use it. Since reused nodes still point to the ModuleInstantiations of
+	the compile which created them, the root modules of earlier compiles
+	are retired to the cache rather than deleted, until no node refers to
+	them anymore. Library modules replaced in the ModuleCache are retired
+	to every cache the same way, and released back to the ModuleCache.
+*/
+class InstantiationCache
+{
+public:
+	InstantiationCache();
+	~InstantiationCache();
+
+	// The cache of the compile in progress, if any. Nothing is recorded while
+	// for loop iterations are instantiated on several threads.
+	static InstantiationCache *active() { return Context::threaded ? NULL : current; }
+
+	bool beginCompile();
+	void endCompile(AbstractNode *oldroot, const AbstractNode *root);
+	void retire(FileModule *module);
+	static int retireLibrary(FileModule *module);
+	void invalidate(const AbstractNode &root, const AbstractNode &node);
+	void clear();
+
+	AbstractNode *reuse(const ModuleInstantiation &inst, const Context *ctx);
+	void record(const ModuleInstantiation &inst, const Context *ctx);
+	void store(AbstractNode *node);
+
+	void readVariable(const Context *start, const Context *found, const std::string &name, const Value &value);
+	void readModule(const Context *start, const std::string &name);
+	void readFunction(const Context *start, const std::string &name);
+	void readLibrary(const std::string &filename, const FileModule *module);
+	void readFile(const std::string &filename);
+	void readChildren(const Context *modulectx);
+	void uncacheable();
+
+private:
+	enum ReadType { VARIABLE, CONFIG_VARIABLE, MODULE, FUNCTION, LIBRARY, IMPORT };
+
+	struct Read {
+		ReadType type;
+		std::string name;
+		int hops;      // Parents from the evaluation context to where the lookup starts
+		int foundhops; // Parents from there to the definition of a module or function
+		Value value;
+	};
+
+	struct Entry {
+		std::string key;
+		std::vector<Read> reads;
+		std::string messages;
+		AbstractNode *node;
+		Entry *parent;
+		std::vector<Entry*> children;
+		int generation;  // The compile whose tree holds the node
+		int oldest;      // The oldest compile whose root module the subtree refers to
+		bool valid;
+	};
+
+	struct ReadKey {
+		ReadKey(ReadType type, const std::string &name, const Context *scope)
+			: type(type), name(name), scope(scope) {}
+		bool operator==(const ReadKey &other) const {
+			return type == other.type && scope == other.scope && name == other.name;
+		}
+		ReadType type;
+		std::string name;
+		const Context *scope;
+	};
+	friend size_t hash_value(const ReadKey &key);
+
+	struct Result {
+		Result(const Value &value, const Context *found) : value(value), found(found) {}
+		Value value;
+		const Context *found;
+	};
+
+	typedef boost::unordered_map<ReadKey, Result> ReadMap;
+
+	struct Recording {
+		const ModuleInstantiation *inst;
+		const Context *ctx;
+		unsigned long serial; // Serial of the first context created by the instantiation
+		bool cacheable;
+		ReadMap reads;
+		std::vector<Entry*> children;
+	};
+
+	static bool isScoped(ReadType type) { return type == VARIABLE || type == MODULE || type == FUNCTION; }
+	void note(Recording *r, ReadType type, const std::string &name,
+						const Context *scope, const Context *found, const Value &value);
+	Value resolve(ReadType type, const Context *scope, const std::string &name, const Context *&found);
+	const std::string &key(const ModuleInstantiation &inst);
+	bool available(const Entry *e) const { return e->valid && e->generation != this->generation; }
+	void take(Entry *e);
+
+	static InstantiationCache *current;
+	static std::vector<InstantiationCache*> instances;
+
+	int generation;
+	size_t livenodes;
+	size_t nextindex;  // The node index counter after the last compile
+	std::vector<Entry*> entries;  // Of the tree of the last compile
+	std::vector<Entry*> stale;    // Of the tree being replaced
+	boost::unordered_map<std::string, std::deque<Entry*> > previous;
+	std::vector<Entry*> taken;
+	std::vector<Recording*> recordings;
+	std::vector<std::pair<int, FileModule*> > retired;
+	std::vector<std::pair<int, FileModule*> > libraries;  // Owned by the ModuleCache
+	boost::unordered_map<const ModuleInstantiation*, std::string> keys;
+	boost::unordered_map<const void*, Value> definitions;
+};
+
+#endif
@@ -31,6 +31,7 @@
 #include "printutils.h"
 #include "fileutils.h"
 #include "builtin.h"
+#include "instantiationcache.h"
 #include "PolySetEvaluator.h"
 #include "openscad.h" // get_fragments_from_r()
 #include "mathc99.h" 
@@ -76,6 +77,7 @@ AbstractNode *LinearExtrudeModule::instantiate(const Context *ctx, const ModuleI
 	if (!file.isUndefined() && file.type() == Value::STRING) {
 		PRINT("DEPRECATED: Support for reading files in linear_extrude will be removed in future releases. Use a child import() instead.");
 		node->filename = lookup_file(file.toString(), inst->path(), c.documentPath());
+		if (InstantiationCache *cache = InstantiationCache::active()) cache->readFile(node->filename);
 	}
 
 	// if height not given, and first argument is a number,
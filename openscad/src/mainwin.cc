@@ -25,6 +25,7 @@
  */
 
 #include "PolySetCache.h"
+#include "DiskCache.h"
 #include "ModuleCache.h"
 #include "MainWindow.h"
 #include "openscad.h" // examplesdir
@@ -58,6 +59,7 @@
 #endif
 #include "PlatformUtils.h"
 #include "CsgInfo.h"
+#include "enclosure.h"
 
 
 #include <QMenu>
@@ -80,6 +82,7 @@
 #include <QDesktopServices>
 #include <QSettings>
 #include <QProgressDialog>
+#include <QInputDialog>
 #include <QMutexLocker>
 
 #include <fstream>
@@ -468,6 +471,12 @@ MainWindow::loadDesignSettings()
 	uint cgalCacheSize = Preferences::inst()->getValue("advanced/cgalCacheSize").toUInt();
 	CGALCache::instance()->setMaxSize(cgalCacheSize);
 #endif
+	// --disk-cache on the command line takes precedence
+	if (!DiskCache::instance()->enabled()) {
+		DiskCache::instance()->setMaxSize(Preferences::inst()->getValue("advanced/diskCacheSize").toUInt());
+		QString diskCacheDir = Preferences::inst()->getValue("advanced/diskCacheDir").toString();
+		if (!diskCacheDir.isEmpty()) DiskCache::instance()->setDirectory(diskCacheDir.toLocal8Bit().constData());
+	}
 }
 
 MainWindow::~MainWindow()
@@ -566,7 +575,8 @@ MainWindow::setFileName(const QString &filename)
 		this->top_ctx.setDocumentPath(fileinfo.dir().absolutePath().toLocal8Bit().constData());
 		QDir::setCurrent(fileinfo.dir().absolutePath());
 	}
-
+	// Relative file names may resolve differently now
+	this->instantiations.clear();
 }
 
 void MainWindow::updateRecentFiles()
@@ -739,8 +749,9 @@ void MainWindow::instantiateRoot()
 	delete this->thrownTogetherRenderer;
 	this->thrownTogetherRenderer = NULL;
 
-	// Remove previous CSG tree
-	delete this->absolute_root_node;
+	// Keep the previous CSG tree until the new one has taken the subtrees
+	// it can reuse
+	AbstractNode *oldroot = this->absolute_root_node;
 	this->absolute_root_node = NULL;
 
 	this->root_raw_term.reset();
@@ -758,20 +769,20 @@ void MainWindow::instantiateRoot()
 	this->background_chain = NULL;
 
 	this->root_node = NULL;
-	this->tree.setRoot(NULL);
 
 	if (this->root_module) {
 		// Evaluate CSG tree
 		PRINT("Compiling design (CSG Tree generation)...");
 		if (this->procevents) QApplication::processEvents();
 		
-		AbstractNode::resetIndexCounter();
+		bool incremental = this->instantiations.beginCompile();
 
 		// split these two lines - gcc 4.7 bug
 		ModuleInstantiation mi = ModuleInstantiation( "group" );
 		this->root_inst = mi; 
 
 		this->absolute_root_node = this->root_module->instantiate(&top_ctx, &this->root_inst, NULL);
+		this->instantiations.endCompile(oldroot, this->absolute_root_node);
 		
 		if (this->absolute_root_node) {
 			// Do we have an explicit root node (! modifier)?
@@ -779,12 +790,24 @@ void MainWindow::instantiateRoot()
 				this->root_node = this->absolute_root_node;
 			}
 			// FIXME: Consider giving away ownership of root_node to the Tree, or use reference counted pointers
-			this->tree.setRoot(this->root_node);
-			// Dump the tree (to initialize caches).
-			// FIXME: We shouldn't really need to do this explicitly..
-			this->tree.getString(*this->root_node);
+			if (incremental) this->tree.updateRoot(this->root_node);
+			else this->tree.setRoot(this->root_node);
+		}
+		else {
+			this->tree.setRoot(NULL);
 		}
 	}
+	else {
+		this->instantiations.clear();
+		delete oldroot;
+		this->tree.setRoot(NULL);
+	}
+
+	if (this->root_node) {
+		// Dump the tree (to initialize caches).
+		// FIXME: We shouldn't really need to do this explicitly..
+		this->tree.getString(*this->root_node);
+	}
 
 	if (!this->root_node) {
 		if (parser_error_pos < 0) {
@@ -1164,7 +1187,7 @@ void MainWindow::compileTopLevelDocument()
 		std::string(this->last_compiled_doc.toLocal8Bit().constData()) +
 		"\n" + commandline_commands;
 	
-	delete this->root_module;
+	this->instantiations.retire(this->root_module);
 	this->root_module = NULL;
 	
 	this->root_module = parse(fulltext.c_str(),
@@ -1341,6 +1364,7 @@ void MainWindow::actionRenderCGALDone(CGAL_Nef_polyhedron *root_N)
 #ifdef ENABLE_CGAL
 		CGALCache::instance()->print();
 #endif
+		DiskCache::instance()->print();
 		if (!root_N->isNull()) {
 			if (root_N->dim == 2) {
 				PRINT("   Top level object is a 2D object:");
@@ -1392,11 +1416,7 @@ void MainWindow::actionRenderCGALDone(CGAL_Nef_polyhedron *root_N)
 	delete this->progresswidget;
 	this->progresswidget = NULL;
 	compileEnded();
-    
-    if(crossSectionMode) {
-        crossSectionOutLines();
-        
-    }
+
 }
 
 #endif /* ENABLE_CGAL */
@@ -1572,6 +1592,7 @@ void MainWindow::addCubeAction(){
     transNode->children.push_back(node);
     
     this->root_node->children[0]->children.push_back(transNode); //
+    nodeModified(*this->root_node->children[0]);
     csgRender();
     
     setCurrentOutput();
@@ -1607,6 +1628,7 @@ void MainWindow::addCuttingPlaneAfter(){
     transNode->children.push_back(node);
     
     this->root_node->children[0]->children.push_back(transNode); //
+    nodeModified(*this->root_node->children[0]);
     csgRender();
 
     
@@ -1639,6 +1661,7 @@ void MainWindow::addCuttingPlaneAfterNoRender(){
     transNode->children.push_back(node);
     
     this->root_node->children[0]->children.push_back(transNode); //
+    nodeModified(*this->root_node->children[0]);
     
     
     
@@ -1678,10 +1701,32 @@ void MainWindow::addScrewHole(double xPos, double yPos){
     transNode->children.push_back(node);
     
     this->root_node->children[0]->children.push_back(transNode); //
+    nodeModified(*this->root_node->children[0]);
     
     
     
     
+}
+
+/*!
+	Forgets the dumps and IDs of node and its ancestors after node was
+	modified in place, and keeps the next compile from reusing them.
+*/
+void MainWindow::nodeModified(const AbstractNode &node)
+{
+	this->tree.invalidate(node);
+	if (this->absolute_root_node) this->instantiations.invalidate(*this->absolute_root_node, node);
+}
+
+/*!
+	Cuts the swept target out of the enclosure in the tree just compiled
+	from generated SCAD code (see subtract_inserted_mesh()).
+*/
+void MainWindow::subtractInsertedMesh()
+{
+	if (!this->root_node || !this->insertedMesh) return;
+	AbstractNode *difference = subtract_inserted_mesh(this->root_node, this->insertedMesh);
+	if (difference) nodeModified(*difference);
 }
 
 void MainWindow::setSliderVal(int val)
@@ -1701,6 +1746,7 @@ void MainWindow::setSliderVal(int val)
     
     
     ((TransformNode*)(children[0]))->matrix(2,3)=val/5.0; //- 57;
+    nodeModified(*children[0]);
     
     /*
     setCurrentOutput();
@@ -1765,7 +1811,7 @@ void MainWindow::actionTestSeanCode()
 	//FileModule *root_module;
 	//ModuleInstantiation root_inst("group");
     
-    delete this->root_module;
+    this->instantiations.retire(this->root_module);
 	this->root_module = NULL;
 	
 	this->root_module = parse("difference(){sphere( r=25, $fn = 50); translate([0, 0, 0]) rotate(a=-25, v=[0,1,0]) translate([12, 72, -57]) {sphere( r=25, $fn = 50);}}  ","",false); //cube(); // translate([0, 0, -2]){ sphere($fn = 50);}} //import(\"fileRepaired.stl\", convexity=3)
@@ -2558,130 +2604,43 @@ void MainWindow::insertionButtonAction(){
     PRINTB("zRot %f", zRot);
     clearCurrentOutput();
     
-    std::ofstream *out = new std::ofstream("rotate.mlx");
-    if(!out->good()) {
-        exit(1);
-    }
-    
-    
-    *out << "<!DOCTYPE FilterScript>" << std::endl;
-    *out << "<FilterScript>" << std::endl;
-    
-    *out << "<filter name=\"Transform: Rotate\">" << std::endl;
-    *out << "<Param enum_val0=\"X axis\" enum_val1=\"Y axis\" enum_cardinality=\"4\" enum_val2=\"Z axis\" enum_val3=\"custom axis\" type=\"RichEnum\" value=\"2\" name=\"rotAxis\"/>" << std::endl;
-    *out << "<Param enum_val0=\"origin\" enum_val1=\"barycenter\" enum_cardinality=\"3\" enum_val2=\"custom point\" type=\"RichEnum\" value=\"0\" name=\"rotCenter\"/>" << std::endl;
-    *out << "<Param type=\"RichDynamicFloat\" value=\""<< zRot <<"\" min=\"-360\" name=\"angle\" max=\"360\"/>" << std::endl;
-    *out << "<Param type=\"RichBool\" value=\"false\" name=\"snapFlag\"/>" << std::endl;
-    *out << "<Param x=\"0\" y=\"0\" z=\"0\" type=\"RichPoint3f\" name=\"customAxis\"/>" << std::endl;
-    *out << "<Param x=\"0\" y=\"0\" z=\"0\" type=\"RichPoint3f\" name=\"customCenter\"/>" << std::endl;
-    *out << "<Param type=\"RichFloat\" value=\"30\" name=\"snapAngle\"/>" << std::endl;
-    *out << "<Param type=\"RichBool\" value=\"true\" name=\"Freeze\"/>" << std::endl;
-    *out << "<Param type=\"RichBool\" value=\"false\" name=\"ToAll\"/>" << std::endl;
-    *out << "</filter>" << std::endl;
-    
-    
-    *out << "<filter name=\"Transform: Rotate\">" << std::endl;
-    *out << "<Param enum_val0=\"X axis\" enum_val1=\"Y axis\" enum_cardinality=\"4\" enum_val2=\"Z axis\" enum_val3=\"custom axis\" type=\"RichEnum\" value=\"1\" name=\"rotAxis\"/>" << std::endl;
-    *out << "<Param enum_val0=\"origin\" enum_val1=\"barycenter\" enum_cardinality=\"3\" enum_val2=\"custom point\" type=\"RichEnum\" value=\"0\" name=\"rotCenter\"/>" << std::endl;
-    *out << "<Param type=\"RichDynamicFloat\" value=\""<< yRot <<"\" min=\"-360\" name=\"angle\" max=\"360\"/>" << std::endl;
-    *out << "<Param type=\"RichBool\" value=\"false\" name=\"snapFlag\"/>" << std::endl;
-    *out << "<Param x=\"0\" y=\"0\" z=\"0\" type=\"RichPoint3f\" name=\"customAxis\"/>" << std::endl;
-    *out << "<Param x=\"0\" y=\"0\" z=\"0\" type=\"RichPoint3f\" name=\"customCenter\"/>" << std::endl;
-    *out << "<Param type=\"RichFloat\" value=\"30\" name=\"snapAngle\"/>" << std::endl;
-    *out << "<Param type=\"RichBool\" value=\"true\" name=\"Freeze\"/>" << std::endl;
-    *out << "<Param type=\"RichBool\" value=\"false\" name=\"ToAll\"/>" << std::endl;
-    *out << "</filter>" << std::endl;
-    
-    
-    *out << "<filter name=\"Transform: Rotate\">" << std::endl;
-    *out << "<Param enum_val0=\"X axis\" enum_val1=\"Y axis\" enum_cardinality=\"4\" enum_val2=\"Z axis\" enum_val3=\"custom axis\" type=\"RichEnum\" value=\"0\" name=\"rotAxis\"/>" << std::endl;
-    *out << "<Param enum_val0=\"origin\" enum_val1=\"barycenter\" enum_cardinality=\"3\" enum_val2=\"custom point\" type=\"RichEnum\" value=\"0\" name=\"rotCenter\"/>" << std::endl;
-    *out << "<Param type=\"RichDynamicFloat\" value=\""<< xRot <<"\" min=\"-360\" name=\"angle\" max=\"360\"/>" << std::endl;
-    *out << "<Param type=\"RichBool\" value=\"false\" name=\"snapFlag\"/>" << std::endl;
-    *out << "<Param x=\"0\" y=\"0\" z=\"0\" type=\"RichPoint3f\" name=\"customAxis\"/>" << std::endl;
-    *out << "<Param x=\"0\" y=\"0\" z=\"0\" type=\"RichPoint3f\" name=\"customCenter\"/>" << std::endl;
-    *out << "<Param type=\"RichFloat\" value=\"30\" name=\"snapAngle\"/>" << std::endl;
-    *out << "<Param type=\"RichBool\" value=\"true\" name=\"Freeze\"/>" << std::endl;
-    *out << "<Param type=\"RichBool\" value=\"false\" name=\"ToAll\"/>" << std::endl;
-    *out << "</filter>" << std::endl;
-    
-    
-    *out << "<filter name=\"Transform: Rotate\">" << std::endl;
-    *out << "<Param enum_val0=\"X axis\" enum_val1=\"Y axis\" enum_cardinality=\"4\" enum_val2=\"Z axis\" enum_val3=\"custom axis\" type=\"RichEnum\" value=\"1\" name=\"rotAxis\"/>" << std::endl;
-    *out << "<Param enum_val0=\"origin\" enum_val1=\"barycenter\" enum_cardinality=\"3\" enum_val2=\"custom point\" type=\"RichEnum\" value=\"0\" name=\"rotCenter\"/>" << std::endl;
-    *out << "<Param type=\"RichDynamicFloat\" value=\""<< -90 <<"\" min=\"-360\" name=\"angle\" max=\"360\"/>" << std::endl;
-    *out << "<Param type=\"RichBool\" value=\"false\" name=\"snapFlag\"/>" << std::endl;
-    *out << "<Param x=\"0\" y=\"0\" z=\"0\" type=\"RichPoint3f\" name=\"customAxis\"/>" << std::endl;
-    *out << "<Param x=\"0\" y=\"0\" z=\"0\" type=\"RichPoint3f\" name=\"customCenter\"/>" << std::endl;
-    *out << "<Param type=\"RichFloat\" value=\"30\" name=\"snapAngle\"/>" << std::endl;
-    *out << "<Param type=\"RichBool\" value=\"true\" name=\"Freeze\"/>" << std::endl;
-    *out << "<Param type=\"RichBool\" value=\"false\" name=\"ToAll\"/>" << std::endl;
-    *out << "</filter>" << std::endl;
-        
-    *out << "</FilterScript>" << std::endl;
-    
-    out->close();
-    
-    setCurrentOutput();
-    PRINT("Output rotate.mlx");
-    clearCurrentOutput();
-    
-    QDir dir = QDir::current();
-    QString dirFileName = dir.absolutePath();
-    
-    setCurrentOutput();
-    PRINT(dirFileName.toStdString());
-    clearCurrentOutput();
-    
-    // Runmeshlab script to rotate target mesh
-    std::stringstream command;
-    //command << "/Applications/meshlabPatched.app/Contents/MacOS/meshlabserver -i " << targetFileName.toStdString() <<" -o rotatedMesh.stl -s rotate.mlx";
-    command << dirFileName.toStdString() << "/../libraries/MeshLabMac_v132patched/meshlab.app/Contents/MacOS/meshlabserver -i " << targetFileName.toStdString() <<" -o rotatedMesh.stl -s rotate.mlx";
-    
-    const std::string tmp = command.str();
-    const char* cstr = tmp.c_str();
-    
-    int rv = system(cstr);
-    
-    setCurrentOutput();
-    PRINT(tmp);
-    clearCurrentOutput();
-    
-    // remove previous binvox file
+    // Insertion direction in the frame of the target. The part used to be
+    // rotated by meshlab so that this was +x (Z by zRot, Y by yRot, X by xRot,
+    // then Y by -90); now the grid is swept along the direction instead.
+    Vector3d direction = Eigen::AngleAxisd(-zRot / 180 * M_PI, Vector3d::UnitZ()) *
+        Eigen::AngleAxisd(-yRot / 180 * M_PI, Vector3d::UnitY()) *
+        Eigen::AngleAxisd(-xRot / 180 * M_PI, Vector3d::UnitX()) * Vector3d(0, 0, -1);
 
-    if(std::remove("rotatedMesh.binvox") != 0)
-      std::perror("No previous output to clear");
-    else
-      std::puts("Cleared previous output");
+    // The swept mesh only depends on the target, the view rotation and the
+    // grid resolution, so it's cached under those
+    std::string key = str(boost::format("insertion(file = %s, timestamp = %d, rotation = [%g, %g, %g], resolution = %d)") %
+        targetFileName.toStdString() % QFileInfo(targetFileName).lastModified().toTime_t() %
+        xRot % yRot % zRot % voxelResolution);
 
-    // run binvox on rotated mesh to voxelize
-    
-    std::stringstream binVoxCommand;
-    binVoxCommand<< dirFileName.toStdString() << "/../libraries/binvox/binvox  64 -c rotatedMesh.stl ";
+    setCurrentOutput();
+    if (PolySetCache::instance()->contains(key)) {
+        insertedMesh = PolySetCache::instance()->get(key);
+        PRINT("Using cached insertion mesh");
+    }
+    else {
+        // voxelize, sweep and extract the target in-process (replaces the
+        // external meshlab, binvox and glutMarch steps)
+        QTime t;
+        t.start();
+        shared_ptr<PolySet> targetMesh = import_stl(targetFileName.toStdString());
+        // Don't keep the mesh of an earlier target if this one fails
+        insertedMesh.reset(targetMesh ? sweep_insertion(*targetMesh, direction, voxelResolution) : NULL);
+        if (!insertedMesh) {
+            PRINTB("WARNING: Unable to voxelize %s", targetFileName.toStdString());
+            clearCurrentOutput();
+            return;
+        }
+        PolySetCache::instance()->insert(key, insertedMesh);
+        PRINTB("Swept insertion mesh with %d triangles in %d ms", insertedMesh->polygons.size() % t.elapsed());
+    }
 
-    const std::string tmp2 = binVoxCommand.str();
-    const char* cstr2 = tmp2.c_str();
-    
-    int rv2 = system(cstr2);
-    
-    //parse binvox file for scale and translate values
-    const std::string binFileName = "rotatedMesh.binvox";
-    readBinvoxScaleTranslate(binFileName);
-    
-    // run marchingCubes code to extrude part
-    std::stringstream marchCommand;
-    //marchCommand<< "/Users/follmer/Library/Developer/Xcode/DerivedData/glutMarch-dzjxobmlwtluttgyfdxwuivouinc/Build/Products/Debug/glutMarch rotatedMesh.binvox";
-    marchCommand<< dirFileName.toStdString() << "/../glutMarch/Product/glutMarch rotatedMesh.binvox";
-    
-    const std::string tmp3 = marchCommand.str();
-    const char* cstr3 = tmp3.c_str();
-    
-    int rv3 = system(cstr3);
-    
-    // reload that fhat file
-    
+    clearCurrentOutput();
     
-    //trianglesExp.stl
     loadInsertedFiles();
 
 }
@@ -2708,20 +2667,35 @@ void MainWindow::exportSTLSeanButtonAction(){
 	}
     PRINT("CGAL Geometry exists and is manifold");
     
-    QString suffix =  ".stl";
-	QString stl_filename = "untitledMesh.stl";//QFileDialog::getSaveFileName(this, stl_mode ? "Export STL File" : "Export OFF File", this->fileName.isEmpty() ? "Untitled"+suffix : QFileInfo(this->fileName).baseName()+suffix, stl_mode ? "STL Files (*.stl)" : "OFF Files (*.off)");
+    // Binary formats are much smaller and load faster in slicers; the
+    // last choice is remembered
+    QSettings settings;
+    QStringList formats;
+    formats << "binstl" << "stl" << "off" << "ply";
+    int current = std::max(0, formats.indexOf(settings.value("design/exportFormat", "binstl").toString()));
+    bool ok = false;
+    QString format_name = QInputDialog::getItem(this, "Export Mesh", "Format:", formats, current, false, &ok);
+    if (!ok) {
+		PRINT("No format selected. export aborted.");
+		clearCurrentOutput();
+		return;
+    }
+    settings.setValue("design/exportFormat", format_name);
+    export_format_e format = export_format(format_name.toStdString());
+
+	QString stl_filename = QString("untitledMesh.") + export_format_suffix(format);
 	if (stl_filename.isEmpty()) {
 		PRINT("No filename specified. export aborted.");
 		clearCurrentOutput();
 		return;
 	}
     
-	std::ofstream fstream(stl_filename.toUtf8());
+	std::ofstream fstream(stl_filename.toUtf8(), export_format_is_binary(format) ? std::ios::out|std::ios::binary : std::ios::out);
 	if (!fstream.is_open()) {
 		PRINTB("Can't open file \"%s\" for export", stl_filename.toLocal8Bit().constData());
 	}
 	else {
-		export_stl(this->root_N, fstream);
+		export_mesh(this->root_N, format, fstream);
 		
 		fstream.close();
         
@@ -2762,7 +2736,7 @@ void MainWindow::loadOriginalFiles()
 	//FileModule *root_module;
 	//ModuleInstantiation root_inst("group");
     
-    delete this->root_module;
+    this->instantiations.retire(this->root_module);
 	this->root_module = NULL;
 	
     std::stringstream parseCommand;
@@ -2861,39 +2835,24 @@ void MainWindow::loadInsertedFiles() {
 	//FileModule *root_module;
 	//ModuleInstantiation root_inst("group");
     
-    delete this->root_module;
+    this->instantiations.retire(this->root_module);
 	this->root_module = NULL;
 	
     
     std::stringstream parseCommand;
     parseCommand << "difference(){ {import(\"" ;
     parseCommand << enclosureFileName.toStdString();
-    parseCommand << "\", convexity=2);} { ";
-    
-    parseCommand << "rotate(a=" << -1*zRot <<", v=[0,0,1]) "; //invert insertion direction rotation
-    parseCommand << "rotate(a=" << -1*yRot <<", v=[0,1,0]) ";
-    parseCommand << "rotate(a=" << -1*xRot <<", v=[1,0,0]) ";
-    
-    
-    parseCommand << "rotate(a=90, v=[0,1,0]) ";     //invert -90Y rot for binvox
-    parseCommand << "translate([" << binvoxTransX << ", "<< binvoxTransY << ", "<< binvoxTransZ << "]) ";
-    parseCommand << "scale([" << binvoxScale << ", "<< binvoxScale << ", "<< binvoxScale << "]) ";
-    parseCommand << "rotate(a=90, v=[1,0,0]) rotate(a=90, v=[0,1,0] ) import(\"trianglesExp.stl\", convexity=2);} };"; //rotate to get back to correct position (I think due to a x,y,z read order error when importing binvox volume corrdinates to marching cubes app)
+    parseCommand << "\", convexity=2);} };";
     
     setCurrentOutput();
     PRINT(parseCommand.str());
     clearCurrentOutput();
-    /*
-    std::stringstream parseCommand2;
-    parseCommand2 << "difference(){ {import(\"" ;
-    parseCommand2 << enclosureFileName.toStdString();
-    parseCommand2 << "\", convexity=2);} {import(\"trianglesExp.stl\", convexity=2);} };"; */
     const std::string tmp = parseCommand.str();
     const char* cstr = tmp.c_str();
     
 	this->root_module = parse(cstr,"",false);
     instantiateRoot();
-    
+    subtractInsertedMesh();
         
     PRINT(this->tree.getString(*this->root_node));
     
@@ -2923,39 +2882,24 @@ void MainWindow::loadInsertedFilesNoRender() {
 	//FileModule *root_module;
 	//ModuleInstantiation root_inst("group");
     
-    delete this->root_module;
+    this->instantiations.retire(this->root_module);
 	this->root_module = NULL;
 	
     
     std::stringstream parseCommand;
     parseCommand << "difference(){ {import(\"" ;
     parseCommand << enclosureFileName.toStdString();
-    parseCommand << "\", convexity=2);} { ";
-    
-    parseCommand << "rotate(a=" << -1*zRot <<", v=[0,0,1]) "; //invert insertion direction rotation
-    parseCommand << "rotate(a=" << -1*yRot <<", v=[0,1,0]) ";
-    parseCommand << "rotate(a=" << -1*xRot <<", v=[1,0,0]) ";
-    
-    
-    parseCommand << "rotate(a=90, v=[0,1,0]) ";     //invert -90Y rot for binvox
-    parseCommand << "translate([" << binvoxTransX << ", "<< binvoxTransY << ", "<< binvoxTransZ << "]) ";
-    parseCommand << "scale([" << binvoxScale << ", "<< binvoxScale << ", "<< binvoxScale << "]) ";
-    parseCommand << "rotate(a=90, v=[1,0,0]) rotate(a=90, v=[0,1,0] ) import(\"trianglesExp.stl\", convexity=2);} };"; //rotate to get back to correct position (I think due to a x,y,z read order error when importing binvox volume corrdinates to marching cubes app)
+    parseCommand << "\", convexity=2);} };";
     
     setCurrentOutput();
     PRINT(parseCommand.str());
     clearCurrentOutput();
-    /*
-     std::stringstream parseCommand2;
-     parseCommand2 << "difference(){ {import(\"" ;
-     parseCommand2 << enclosureFileName.toStdString();
-     parseCommand2 << "\", convexity=2);} {import(\"trianglesExp.stl\", convexity=2);} };"; */
     const std::string tmp = parseCommand.str();
     const char* cstr = tmp.c_str();
     
 	this->root_module = parse(cstr,"",false);
     instantiateRoot();
-    
+    subtractInsertedMesh();
     
     PRINT(this->tree.getString(*this->root_node));
     
@@ -2970,74 +2914,6 @@ void MainWindow::loadInsertedFilesNoRender() {
     
     addCuttingPlaneAfterNoRender();
     
-}
-
-void MainWindow::readBinvoxScaleTranslate(std::string filespec){
-    std::ifstream *input = new std::ifstream(filespec.c_str());
-    
-    //
-    // read header
-    //
-    std::string line;
-    *input >> line;  // #binvox
-    if(line.length()==0){
-        //cout << "no first line" <<endl;
-    }
-    if (line.compare("#binvox") != 0) {
-        //cout << "Error: first line reads [" << line << "] instead of [#binvox]" << endl;
-        delete input;
-        return;
-    }
-    int version;
-    *input >> version;
-    //cout << "reading binvox version " << version << endl;
-    
-    int depth, height, width;
-    depth = -1;
-    int done = 0;
-    while(input->good() && !done) {
-        *input >> line;
-        if (line.compare("data") == 0) done = 1;
-        else if (line.compare("dim") == 0) {
-            *input >> depth >> height >> width;
-        }
-        else if (line.compare("translate") == 0) {
-            *input >> binvoxTransX >> binvoxTransY >> binvoxTransZ;
-        }
-        else if (line.compare("scale") == 0) {
-            *input >> binvoxScale;
-        }
-        else {
-            //cout << "  unrecognized keyword [" << line << "], skipping" << endl;
-            char c;
-            do {  // skip until end of line
-                c = input->get();
-            } while(input->good() && (c != '\n'));
-            
-        }
-    }
-    
-    setCurrentOutput();
-    PRINT("Binvox file values");
-    PRINTB("%f",binvoxTransX);
-    PRINTB("%f",binvoxTransY);
-    PRINTB("%f",binvoxTransZ);
-    PRINTB("%f",binvoxScale);
-    
-    clearCurrentOutput();
-    
-    if (!done) {
-        //cout << "  error reading header" << endl;
-        return;
-    }
-    if (depth == -1) {
-        //cout << "  missing dimensions in header" << endl;
-        return;
-    }
-    
-   
-
-    
 }
 
 void MainWindow::computeScrewPositionsAction(){
@@ -3046,704 +2922,98 @@ void MainWindow::computeScrewPositionsAction(){
 
 void MainWindow::crossSection(){
     
-    crossSectionMode = true;
+    Transform3d section = cross_section_transform(cuttingPlaneMatrixRot);
+    transMatrixInverse = section.inverse();
     
-    crossSectionModel(targetFileName.toStdString());
-}
-
-void MainWindow::crossSectionOutLines(){
     setCurrentOutput();
-    PRINT("Done rendering cgal");
-    clearCurrentOutput();   
-    if(crossSectionModelNumber==0){
-        crossSectionTarget = this->root_N;
-        this->root_N =NULL;
-        crossSectionModel(enclosureFileName.toStdString());
-    }
-    if (crossSectionModelNumber==1){
-        crossSectionEnclosure = this->root_N;
-        this->root_N =NULL;
-        
-
-        
-        crossSectionModelBinvox();
+    QTime t;
+    t.start();
+    shared_ptr<PolySet> enclosureMesh = import_stl(enclosureFileName.toStdString());
+    shared_ptr<PolySet> inserted = this->insertedMesh;
+    if (!enclosureMesh || !inserted) {
+        PRINT("WARNING: Load the enclosure and compute the insertion before placing screws");
+        clearCurrentOutput();
+        return;
     }
-    if (crossSectionModelNumber==2){
-        crossSectionTargetInserted= this->root_N;
-        this->root_N =NULL;
     
-        CGAL_Nef_polyhedron crossSectionEncMinInserted = (crossSectionEnclosure->copy());
-        crossSectionEncMinInserted-= (*crossSectionTargetInserted);
-        //(*crossSectionEnclosure)-=  (*crossSectionTarget);
-        
-        //cavityPointsTarget = findCloseCavityPoints(crossSectionTarget, crossSectionEnclosure);
-        cavityPointsInserted = findCloseCavityPoints(crossSectionTargetInserted, &crossSectionEncMinInserted);
-        
-        setCurrentOutput();
-        PRINTB("cavity points target %d", (cavityPointsTarget.size()));
-                clearCurrentOutput();
-        
-        std::stringstream parseCommand;
-        for(int i =0; i < cavityPointsTarget.size(); i++){
-            parseCommand<<cavityPointsTarget[i].first<<", "<<cavityPointsTarget[i].second<<std::endl;
-        }
-        
-        setCurrentOutput();
-        PRINT(parseCommand.str());
+    CGAL_Nef_polyhedron cavity = cross_section(*enclosureMesh, section);
+    CGAL_Nef_polyhedron insertedSection = cross_section(*inserted, section);
+    if (cavity.isNull()) {
+        PRINT("WARNING: The cut plane doesn't intersect the enclosure");
         clearCurrentOutput();
-       
-        setCurrentOutput();
-        PRINTB("cavity points inserted %d", (cavityPointsInserted.size()));
-        clearCurrentOutput();
-        
-        std::stringstream parseCommand2;
-        for(int i =0; i < cavityPointsInserted.size(); i++){
-            parseCommand2<<cavityPointsInserted[i].first<<", "<<cavityPointsInserted[i].second<<std::endl;
-        }
-        
-        setCurrentOutput();
-        PRINT(parseCommand2.str());
-        clearCurrentOutput();
-        
-        //now find screw positions inside crossSectionEncMinInserted
-        
-        DxfData *dd =crossSectionEncMinInserted.convertToDxfData();
-        findScrewPositions(dd);
-        
-        
-        crossSectionMode = false;
+        return;
     }
-    
-    
-    crossSectionModelNumber++;
-}
-
-void MainWindow::crossSectionModel(std::string modelFileName){
-    
-    Transform3d transMatrix2 = cuttingPlaneMatrixRot.inverse();
-    Transform3d transMatrix90Deg = Transform3d::Identity();
-    transMatrix90Deg(1,1)=cos(90*3.14159/180.0);
-    transMatrix90Deg(1,2)=-1*sin(90*3.14159/180.0);
-    transMatrix90Deg(2,1)=sin(90*3.14159/180.0);
-    transMatrix90Deg(2,2)=cos(90*3.14159/180.0);
-    transMatrix2 = transMatrix90Deg * transMatrix2 ;
-    
-    transMatrixInverse = transMatrix2.inverse();
-    
-    delete this->root_module;
-	this->root_module = NULL;
-	
-    
-    std::stringstream parseCommand;
-    parseCommand << "projection(cut = true){ {";
-    
-    parseCommand <<"multmatrix(m = [ [" << transMatrix2(0,0) << " , " << transMatrix2(0,1) << " , " << transMatrix2(0,2) << " , " << transMatrix2(0,3) << " ], ";
-    parseCommand <<"[ " << transMatrix2(1,0) << " , " << transMatrix2(1,1) << " , " << transMatrix2(1,2) << " , " << transMatrix2(1,3) << " ], ";
-    parseCommand <<"[ " << transMatrix2(2,0) << " , " << transMatrix2(2,1) << " , " << transMatrix2(2,2) << " , " << transMatrix2(2,3) << " ], ";
-    parseCommand <<"[ " << transMatrix2(3,0) << " , " << transMatrix2(3,1) << " , " << transMatrix2(3,2) << " , " << transMatrix2(3,3) << " ] ] ) ";
-    parseCommand << "import(\"" ;
-    parseCommand << modelFileName;
-    parseCommand << "\", convexity=2);} } ";
-    
-    
-    setCurrentOutput();
-    PRINT(parseCommand.str());
+    if (!insertedSection.isNull()) cavity -= insertedSection;
+    PRINTB("Cross sections in %d ms", t.elapsed());
     clearCurrentOutput();
     
-    const std::string tmp = parseCommand.str();
-    const char* cstr = tmp.c_str();
-    
-	this->root_module = parse(cstr,"",false);
-    instantiateRoot();
-    
-    
-    PRINT(this->tree.getString(*this->root_node));
-    
-    cgalRender();
-    
-}
-
-QVector<Point2D> MainWindow::findCloseCavityPoints(class CGAL_Nef_polyhedron *target, class CGAL_Nef_polyhedron *enclosure){
-    
-    
-     
-     DxfData *dd =enclosure->convertToDxfData();
-     DxfData *ddTarget =target->convertToDxfData();
-    QVector<Point2D> closePoints;
-    
-     for (size_t i=0; i<dd->paths.size(); i++) {
-         for (size_t j=0; j<dd->paths[i].indices.size(); j++) {
-     
-             const Vector2d &p2 = dd->points[dd->paths[i].indices[j]];
-     
-             double x2 = p2[0];
-             double y2 = p2[1];
-             
-             for (size_t i2=0; i2<ddTarget->paths.size(); i2++) {
-                 for (size_t j2=0; j2<ddTarget->paths[i2].indices.size(); j2++) {
-                     const Vector2d &p3 = ddTarget->points[ddTarget->paths[i2].indices[j2]];
-                     
-                     double x3 = p3[0];
-                     double y3 = p3[1];
-                     
-                     if((x2==x3)&&(y2==y3)){
-                     
-                        /* setCurrentOutput();
-                         PRINT("SAME Point found");
-                         PRINTB("%f x pt", x2);
-                         PRINTB("%f y pt", y2);
-                         clearCurrentOutput();*/
-                         
-                         closePoints.push_back(Point2D(x2,y2));
-                         
-                     }
-                 }
-             }
-         }
-     
-     }
-    return closePoints;
-    
-    
-}
-
-void MainWindow::crossSectionModelBinvox(){
-    
-    Transform3d transMatrix2 = cuttingPlaneMatrixRot.inverse();
-    Transform3d transMatrix90Deg = Transform3d::Identity();
-    transMatrix90Deg(1,1)=cos(90*3.14159/180.0);
-    transMatrix90Deg(1,2)=-1*sin(90*3.14159/180.0);
-    transMatrix90Deg(2,1)=sin(90*3.14159/180.0);
-    transMatrix90Deg(2,2)=cos(90*3.14159/180.0);
-    transMatrix2 = transMatrix90Deg * transMatrix2 ;
-    
-    delete this->root_module;
-	this->root_module = NULL;
-    
-    
-    std::stringstream parseCommand;
-    parseCommand << "projection(cut = true){ {";
-    
-    parseCommand <<"multmatrix(m = [ [" << transMatrix2(0,0) << " , " << transMatrix2(0,1) << " , " << transMatrix2(0,2) << " , " << transMatrix2(0,3) << " ], ";
-    parseCommand <<"[ " << transMatrix2(1,0) << " , " << transMatrix2(1,1) << " , " << transMatrix2(1,2) << " , " << transMatrix2(1,3) << " ], ";
-    parseCommand <<"[ " << transMatrix2(2,0) << " , " << transMatrix2(2,1) << " , " << transMatrix2(2,2) << " , " << transMatrix2(2,3) << " ], ";
-    parseCommand <<"[ " << transMatrix2(3,0) << " , " << transMatrix2(3,1) << " , " << transMatrix2(3,2) << " , " << transMatrix2(3,3) << " ] ] ) ";
-    
-    parseCommand << "rotate(a=" << -1*zRot <<", v=[0,0,1]) "; //invert insertion direction rotation
-    parseCommand << "rotate(a=" << -1*yRot <<", v=[0,1,0]) ";
-    parseCommand << "rotate(a=" << -1*xRot <<", v=[1,0,0]) ";
-    
-    
-    parseCommand << "rotate(a=90, v=[0,1,0]) ";     //invert -90Y rot for binvox
-    parseCommand << "translate([" << binvoxTransX << ", "<< binvoxTransY << ", "<< binvoxTransZ << "]) ";
-    parseCommand << "scale([" << binvoxScale << ", "<< binvoxScale << ", "<< binvoxScale << "]) ";
-    parseCommand << "rotate(a=90, v=[1,0,0]) rotate(a=90, v=[0,1,0] ) import(\"trianglesExp.stl\", convexity=2);}} ";
+    cavityPointsInserted.clear();
+    cavitySegmentsInserted.clear();
+    if (!insertedSection.isNull()) cavityPointsInserted = findCloseCavityPoints(&insertedSection, &cavity, &cavitySegmentsInserted);
     
     setCurrentOutput();
-    PRINT(parseCommand.str());
+    PRINTB("cavity points inserted %d", (cavityPointsInserted.size()));
+    PRINTB("cavity segments inserted %d", (cavitySegmentsInserted.size()));
     clearCurrentOutput();
     
-    const std::string tmp = parseCommand.str();
-    const char* cstr = tmp.c_str();
-    
-	this->root_module = parse(cstr,"",false);
-    instantiateRoot();
-    
-    
-    PRINT(this->tree.getString(*this->root_node));
-    
-    cgalRender();
-
-
-    
-}
-
-void MainWindow::findScrewPositions(DxfData *dd)
-{
-    std::srand(std::time(NULL));
-    
-    if( (dd->paths.size()) ==1){
-     
-        //bounding box
-        double maxX, minX, maxY, minY;
-        
-        setCurrentOutput();
-        PRINTB("size of indices %f", (dd->paths[0].indices.size()));
-        clearCurrentOutput();
-        
-        
-        const Vector2d &p1 = dd->points[dd->paths[0].indices[0]];
-        
-        maxX = p1[0];
-        minX = p1[0];
-        maxY = p1[1];
-        minY = p1[1];
-        
-        
-        
-        for (size_t j=0; j<dd->paths[0].indices.size(); j++) {
-            const Vector2d &p2 = dd->points[dd->paths[0].indices[j]];
-            
-            double x2 = p2[0];
-            double y2 = p2[1];
-            
-            if(x2>maxX) maxX = x2;
-            else if (x2<minX) minX = x2;
-            
-            if (y2>maxY) maxY = y2;
-            else if (y2<minY) minY = y2;
-            
-        } 
-        
-        // now have max and min
-        
-       
-        
-        int x0 = minX;
-        int xDist = int(maxX-minX) + 1;
-        int y0 = minY;
-        int yDist = int(maxY-minY) + 1;
-        int gridSpacing = 5;
-        
-        
-        setCurrentOutput();
-        PRINTB("MinX %d", minX);
-        PRINTB("MinY %d", minY);
-        PRINTB("dist x %d ", xDist);
-        PRINTB("dist y %d", yDist);
-        clearCurrentOutput();
-        
-        
-        gridCell *grid = new gridCell[gridSpacing*xDist*gridSpacing*yDist];
-        Vector2d screw1Pos; //= picRandomPointInPolygon(dd, minX,  minY,  yDist,  xDist);
-        Vector2d screw2Pos; //= picRandomPointInPolygon(dd, minX,  minY,  yDist,  xDist);
-        Vector2d screw3Pos; //= picRandomPointInPolygon(dd, minX,  minY,  yDist,  xDist);
-        
-        
-        int countInside=0;
-        int countEdgeCells=0;
-        double currentEnergySum =0;
-        for(int i=0; i < (gridSpacing*xDist); i++){
-            for(int j=0; j < (gridSpacing*yDist); j++){
-                
-                
-                grid[(i*(gridSpacing*xDist)+j)].xLoc = double(i) / double(gridSpacing*xDist) * double(xDist) + double(minX);
-                grid[(i*(gridSpacing*xDist)+j)].yLoc = double(j) / double(gridSpacing*yDist) * double(yDist) + double(minY);
-                if (pnpoly( dd, grid[(i*(gridSpacing*xDist)+j)].xLoc, grid[(i*(gridSpacing*xDist)+j)].yLoc)==1) {
-                    grid[(i*(gridSpacing*xDist)+j)].insidePoly = true;
-                    countInside++;
-                    // find out if near edge
-                    if (testIfCloseToPolygonEdge(dd, grid[(i*(gridSpacing*xDist)+j)].xLoc, grid[(i*(gridSpacing*xDist)+j)].yLoc, 5 )){ // dist in mm
-                        grid[(i*(gridSpacing*xDist)+j)].nearEdge = true;
-                        countEdgeCells++;
-                    }
-                    //
-                    /*double tempEnergy = distanceToPoint(grid[(i*(gridSpacing*xDist)+j)].xLoc, grid[(i*(gridSpacing*xDist)+j)].yLoc, screw1Pos[0], screw1Pos[1] );
-                    tempEnergy += distanceToPoint(grid[(i*(gridSpacing*xDist)+j)].xLoc, grid[(i*(gridSpacing*xDist)+j)].yLoc, screw2Pos[0], screw2Pos[1] );
-                    tempEnergy += distanceToPoint(grid[(i*(gridSpacing*xDist)+j)].xLoc, grid[(i*(gridSpacing*xDist)+j)].yLoc, screw3Pos[0], screw3Pos[1] );
-                    grid[(i*(gridSpacing*xDist)+j)].currentEnergy = tempEnergy;
-                    currentEnergySum+= tempEnergy;*/
-                }
-                else{
-                    grid[(i*(gridSpacing*xDist)+j)].insidePoly = false;
-                }
-            }
-        }
-        
-        //pic random positions in grid that are good
-        int screwIndex1;
-        int screwIndex2;
-        int screwIndex3;
-        int tempCount = 0;
-        screwIndex1 = pickRandomGoodGridCell(grid, gridSpacing*xDist*gridSpacing*yDist);
-        screw1Pos = Vector2d(grid[screwIndex1].xLoc, grid[screwIndex1].yLoc);
-
-        
-        /*
-        while (tempCount<1000) {
-            screwIndex1 = pickRandomGoodGridCell(grid, gridSpacing*xDist*gridSpacing*yDist);
-            screw1Pos = Vector2d(grid[screwIndex1].xLoc, grid[screwIndex1].yLoc);
-            if( (screw1Pos[1] < (minY+ (yDist/3.0)))) break;
-        }
-        while (tempCount<1000) {
-            screwIndex2 = pickRandomGoodGridCell(grid, gridSpacing*xDist*gridSpacing*yDist);
-            screw2Pos = Vector2d(grid[screwIndex2].xLoc, grid[screwIndex2].yLoc);
-
-            if( (screw2Pos[1] > (minY+ (yDist/3.0))) && (screw2Pos[1] < (minY+ (yDist/3.0)*2))) break;
-        }
-        while (tempCount<1000) {
-            screwIndex3 = pickRandomGoodGridCell(grid, gridSpacing*xDist*gridSpacing*yDist);
-            screw3Pos = Vector2d(grid[screwIndex3].xLoc, grid[screwIndex3].yLoc);
-                     
-            if( (screw3Pos[1] > (minY+ (yDist/3.0)*2) )) break;
-        } */
-        
-        while (tempCount<1000) {
-            tempCount++;
-            screwIndex2 = pickRandomGoodGridCell(grid, gridSpacing*xDist*gridSpacing*yDist);
-            screw2Pos = Vector2d(grid[screwIndex2].xLoc, grid[screwIndex2].yLoc);
-            screwIndex3 = pickRandomGoodGridCell(grid, gridSpacing*xDist*gridSpacing*yDist);
-            screw3Pos = Vector2d(grid[screwIndex3].xLoc, grid[screwIndex3].yLoc);
-            
-            if( (distanceToPoint(screw1Pos[0], screw1Pos[1], screw2Pos[0], screw2Pos[1] ) > 30 ) && (distanceToPoint(screw1Pos[0], screw1Pos[1], screw3Pos[0], screw3Pos[1] ) > 30 ) && (distanceToPoint(screw2Pos[0], screw2Pos[1], screw3Pos[0], screw3Pos[1] ) > 30 )) {
-                setCurrentOutput();
-                PRINT("Found one good start");
-                break;
-            }
-        }
-        
-        
-        
-        setCurrentOutput();
-        PRINTB("random in poly x %f", screw1Pos[0]);
-        PRINTB("random in poly y %f", screw1Pos[1]);
-        PRINTB("random in poly x 2 %f", screw2Pos[0]);
-        PRINTB("random in poly y 2 %f", screw2Pos[1]);
-        PRINTB("random in poly x 3 %f", screw3Pos[0]);
-        PRINTB("random in poly y 3 %f", screw3Pos[1]);
-        
-        clearCurrentOutput();
-        
-        
-        // calculate current energy
-        currentEnergySum =0;
-        
-        
-        for(int i =0; i < ( gridSpacing*xDist*gridSpacing*yDist); i ++) {
-            
-            if( (grid[i].insidePoly ) && ! (grid[i].nearEdge ) ){
-                 double tempEnergy = distanceToPoint(grid[i].xLoc, grid[i].yLoc, screw1Pos[0], screw1Pos[1] );
-                 tempEnergy += distanceToPoint(grid[i].xLoc, grid[i].yLoc, screw2Pos[0], screw2Pos[1] );
-                 tempEnergy += distanceToPoint(grid[i].xLoc, grid[i].yLoc, screw3Pos[0], screw3Pos[1] );
-                 grid[i].currentEnergy = tempEnergy;
-                
-                 currentEnergySum+= tempEnergy;
-            }
-            
-        }
-        
-        int numPossibleMoves = 12;
-        double possilbeEnergies [numPossibleMoves];
-        for (int i = 0; i < numPossibleMoves; i++) possilbeEnergies[i]=0;
-        Vector2d * possiblePositions = new Vector2d [numPossibleMoves];
-        double possiblePositionsX [numPossibleMoves];
-        double possiblePositionsY [numPossibleMoves];
-        int possiblePositionIndicies [numPossibleMoves];
-        bool isOkMove [numPossibleMoves];
-        
-        for (int k = 0; k < 1000; k++) {
-            
-            for (int i = 0; i < numPossibleMoves; i++){
-                possilbeEnergies[i]=0;
-                isOkMove[i]=true;
-            }
-            currentEnergySum=0;
-            
-            
-            int stepSize = 1;
-            // find positions of next points
-            //screw 1
-            possiblePositionIndicies[0] = screwIndex1-stepSize;
-            possiblePositionIndicies[1] = screwIndex1+stepSize;
-            possiblePositionIndicies[2] = screwIndex1- (gridSpacing*xDist*stepSize);
-            possiblePositionIndicies[3] = screwIndex1+ (gridSpacing*xDist*stepSize);
-            // screw 2
-            possiblePositionIndicies[4] = screwIndex2-stepSize;
-            possiblePositionIndicies[5] = screwIndex2+stepSize;
-            possiblePositionIndicies[6] = screwIndex2- (gridSpacing*xDist* stepSize);
-            possiblePositionIndicies[7] = screwIndex2+ (gridSpacing*xDist*stepSize);
-            //screw 3
-            possiblePositionIndicies[8] = screwIndex3-stepSize;
-            possiblePositionIndicies[9] = screwIndex3+stepSize;
-            possiblePositionIndicies[10] = screwIndex3- (gridSpacing*xDist*stepSize);
-            possiblePositionIndicies[11] = screwIndex3+ (gridSpacing*xDist*stepSize);
-            
-            
-            for(int h=0; h < numPossibleMoves; h++){
-                possiblePositions[h]=Vector2d(grid[possiblePositionIndicies[h]].xLoc, grid[possiblePositionIndicies[h]].yLoc);
-                possiblePositionsX[h] = grid[possiblePositionIndicies[h]].xLoc;
-                possiblePositionsY[h] = grid[possiblePositionIndicies[h]].yLoc;
-                
-                if((grid[possiblePositionIndicies[h]].insidePoly ) && !(grid[possiblePositionIndicies[h]].nearEdge)){
-                    isOkMove[h] = true;
-                }
-                else{
-                    isOkMove[h] = false;
-                    
-                }
-            }
-            
-            // calculate energy
-            for(int i =0; i < ( gridSpacing*xDist*gridSpacing*yDist); i ++) {
-                
-                if( (grid[i].insidePoly )  ){
-                    double tempEnergy = distanceToPoint(grid[i].xLoc, grid[i].yLoc, screw1Pos[0], screw1Pos[1] );
-                    tempEnergy += distanceToPoint(grid[i].xLoc, grid[i].yLoc, screw2Pos[0], screw2Pos[1] );
-                    tempEnergy += distanceToPoint(grid[i].xLoc, grid[i].yLoc, screw3Pos[0], screw3Pos[1] );
-                    grid[i].currentEnergy = tempEnergy;
-                    
-                    currentEnergySum+= tempEnergy;
-                    
-                    
-                    for(int h=0; h < 4; h++){
-                        if(isOkMove[h]) {
-                        
-                            grid[i].possibleEnergy[h] = distanceToPoint(grid[i].xLoc, grid[i].yLoc, possiblePositionsX[h], possiblePositionsY[h] );
-                            grid[i].possibleEnergy[h] += distanceToPoint(grid[i].xLoc, grid[i].yLoc, screw2Pos[0], screw2Pos[1] );
-                            grid[i].possibleEnergy[h] += distanceToPoint(grid[i].xLoc, grid[i].yLoc, screw3Pos[0], screw3Pos[1] );
-                        
-                            possilbeEnergies[h]+= grid[i].possibleEnergy[h];
-                        }
-                    }
-                    for(int h=4; h < 8; h++){
-                        
-                        if(isOkMove[h]) {
-                            grid[i].possibleEnergy[h] = distanceToPoint(grid[i].xLoc, grid[i].yLoc, screw1Pos[0], screw1Pos[1] );
-                            grid[i].possibleEnergy[h] += distanceToPoint(grid[i].xLoc, grid[i].yLoc, possiblePositionsX[h], possiblePositionsY[h] );
-                            grid[i].possibleEnergy[h] += distanceToPoint(grid[i].xLoc, grid[i].yLoc, screw3Pos[0], screw3Pos[1] );
-                        
-                            possilbeEnergies[h]+= grid[i].possibleEnergy[h];
-                        }
-                    }
-                    for(int h=8; h < 12; h++){
-                        
-                        if(isOkMove[h]) {
-                            grid[i].possibleEnergy[h] = distanceToPoint(grid[i].xLoc, grid[i].yLoc, screw1Pos[0], screw1Pos[1] );
-                            grid[i].possibleEnergy[h] += distanceToPoint(grid[i].xLoc, grid[i].yLoc, screw2Pos[0], screw2Pos[1] );
-                            grid[i].possibleEnergy[h] += distanceToPoint(grid[i].xLoc, grid[i].yLoc, possiblePositionsX[h], possiblePositionsY[h]);
-                        
-                            possilbeEnergies[h]+= grid[i].possibleEnergy[h];
-                        }
-                    }
-                    
-                }
-                
-                
-                
-            }
-            
-            setCurrentOutput();
-            PRINTB("current energies %f", currentEnergySum);
-            
-            for(int h=0; h < numPossibleMoves; h++) PRINTB("possible energies %f", possilbeEnergies[h]);
-            clearCurrentOutput();
-            // move based on least energy
-            
-            int currentSmallestIndex = -1;
-            double currentSmallestEnergy = currentEnergySum;
-            for(int h=0; h < numPossibleMoves; h++){
-                if(isOkMove[h]) {
-                    if(possilbeEnergies[h]<currentSmallestEnergy){
-                        currentSmallestEnergy= possilbeEnergies[h];
-                        currentSmallestIndex =h;
-                    }
-                }
-                
-            }
-            
-            if (currentSmallestIndex != -1){
-                if(currentSmallestIndex<4){
-                    screw1Pos[0] = possiblePositionsX[currentSmallestIndex];
-                    screw1Pos[1] = possiblePositionsY[currentSmallestIndex];
-                    screwIndex1 = possiblePositionIndicies[currentSmallestIndex];
-                }else if (currentSmallestIndex<8){
-                    screw2Pos[0] = possiblePositionsX[currentSmallestIndex];
-                    screw2Pos[1] = possiblePositionsY[currentSmallestIndex];
-                    screwIndex3 = possiblePositionIndicies[currentSmallestIndex];
-                } else if (currentSmallestIndex<12 ) {
-                    screw3Pos[0] = possiblePositionsX[currentSmallestIndex];
-                    screw3Pos[1] = possiblePositionsY[currentSmallestIndex];
-                    screwIndex3 = possiblePositionIndicies[currentSmallestIndex];
-                }
-                
-                
-            }
-            
-            setCurrentOutput();
-            PRINTB("current smallest index %d", currentSmallestIndex);
-            PRINTB("screw1 x %f", screw1Pos[0]);
-            PRINTB("screw1 y %f", screw1Pos[1]);
-            PRINTB("screw x 2 %f", screw2Pos[0]);
-            PRINTB("screw y 2 %f", screw2Pos[1]);
-            PRINTB("screw x 3 %f", screw3Pos[0]);
-            PRINTB("screw y 3 %f", screw3Pos[1]);
-            
-            clearCurrentOutput();
-            
-            
-            
-            
-        }
-        
-        
-        //calculate energy of 12 possible moves
-        
-        
-        
-        
-        
-        
-        
-        
-        
-        
-        setCurrentOutput();
-        PRINTB("num pixels inside poly %d", countInside);
-        PRINTB("num edge cells %d", countEdgeCells);
-        PRINTB("num pixels %d", (gridSpacing*xDist*gridSpacing*yDist) );
-        PRINTB("current energy %f",currentEnergySum);
-        clearCurrentOutput();
-        
-        /*loadInsertedFilesNoRender();
-        addScrewHole(screw1Pos[0], screw1Pos[1]);
-        addScrewHole(screw2Pos[0], screw2Pos[1]);
-        addScrewHole(screw3Pos[0], screw3Pos[1]);
-        csgRender();*/
-        //testDrawScrewPos(screw1Pos[0], screw1Pos[1]);
-        
-        
-        screw1X = screw1Pos[0];
-        screw1Y = screw1Pos[1];
-        screw2X = screw2Pos[0];
-        screw2Y = screw2Pos[1];
-        screw3X = screw3Pos[0];
-        screw3Y =  screw3Pos[1];
-        testDrawScrewPosAssembly();
+    std::stringstream parseCommand2;
+    for(int i =0; i < cavityPointsInserted.size(); i++){
+        parseCommand2<<cavityPointsInserted[i].first<<", "<<cavityPointsInserted[i].second<<std::endl;
     }
     
-    
-}
-
-Vector2d MainWindow::picRandomPointInPolygon(DxfData *dd, int minX, int minY, int yDist, int xDist){
-    
-    int aRand = std::rand();
-    double dRand= aRand / 2147483647.0;
     setCurrentOutput();
-    PRINTB("random num %d", aRand);
-    PRINTB("random num float %f", dRand);
-    clearCurrentOutput(); 
-    
-    
-    
+    PRINT(parseCommand2.str());
+    clearCurrentOutput();
     
-    double xRand = double(std::rand()/2147483647.0) * double(xDist) + double(minX);
-    double yRand = double(std::rand()/2147483647.0) * double(yDist) + double(minY);
+    //now find screw positions inside the cavity section
     
-    while (true) {
-        if ( pnpoly(dd, xRand, yRand) == 1) 
-            break;
-        
-        else {
-            xRand = double(std::rand()/2147483647.0) * double(xDist) + double(minX);
-            yRand = double(std::rand()/2147483647.0) * double(yDist) + double(minY);
-        }
-    }
-    Vector2d  vec = Vector2d(xRand, yRand);
-    return vec;
+    DxfData *dd = cavity.convertToDxfData();
+    findScrewPositions(dd);
+    delete dd;
 }
 
-int MainWindow::pnpoly( DxfData *dd, double testx, double testy)
-{
-    
-    int i, j, c = 0;
-    if( (dd->paths.size()) ==1){
-        for (i = 0, j = (dd->paths[0].indices.size())-1; i < (dd->paths[0].indices.size()); j = i++) {
-            const Vector2d &p1 = dd->points[dd->paths[0].indices[i]];
-            
-            double x1 = p1[0];
-            double y1 = p1[1];
-            
-            const Vector2d &p2 = dd->points[dd->paths[0].indices[j]];
-            
-            double x2 = p2[0];
-            double y2 = p2[1];
-            
-            
-            if ( ((y1>testy) != (y2>testy)) &&
-                (testx < (x2-x1) * (testy-y1) / (y2-y1) + x1) )
-                    c = !c;
-        }
-    }
-    return c;
+QVector<Point2D> MainWindow::findCloseCavityPoints(class CGAL_Nef_polyhedron *target, class CGAL_Nef_polyhedron *enclosure, QVector<QPair<Point2D, Point2D> > *segments){
     
-}
-
-double MainWindow::distanceToPoint(double x1, double y1, double x2, double y2 ){
+    DxfData *dd = enclosure->convertToDxfData();
+    DxfData *ddTarget = target->convertToDxfData();
     
-    return sqrt((x2-x1)*(x2-x1)+(y2-y1)*(y2-y1));
+    std::vector<int> contactPoints;
+    std::vector<std::pair<int,int> > contactSegments;
+    find_cavity_contacts(*dd, *ddTarget, GRID_FINE, contactPoints, contactSegments);
     
-}
-
-
-
-double MainWindow::distToLineSegment(double x1, double y1, double x2, double y2, double x3, double y3){ //x3,y3 is the point
-    double px = x2-x1;
-    double py = y2-y1;
- 
-    double something = px*px + py*py;
- 
-    double u =  ((x3 - x1) * px + (y3 - y1) * py) / (something);
- 
-    if (u > 1) u = 1;
-    else if( u < 0) u = 0;
- 
-    double x = x1 + u * px;
-    double y = y1 + u * py;
- 
-    double dx = x - x3;
-    double dy = y - y3;
- 
- /*# Note: If the actual distance does not matter,
- # if you only want to compare what this function
- # returns to other results of this function, you
- # can just return the squared distance instead
- # (i.e. remove the sqrt) to gain a little performance*/
- 
-    double dist = sqrt(dx*dx + dy*dy);
- 
-    return dist;
-
-}
-
-bool MainWindow::testIfCloseToPolygonEdge(DxfData *dd, double testx, double testy, double minDist){
-    bool isTooClose = false;
-    if( (dd->paths.size()) ==1){
-        int i, j =0;
-        for ( i = 0,  j = (dd->paths[0].indices.size())-1; i < (dd->paths[0].indices.size()); j = i++) {
-            const Vector2d &p1 = dd->points[dd->paths[0].indices[i]];
-            
-            double x1 = p1[0];
-            double y1 = p1[1];
-            
-            const Vector2d &p2 = dd->points[dd->paths[0].indices[j]];
-            
-            double x2 = p2[0];
-            double y2 = p2[1];
-
-            double dist = distToLineSegment(x1,  y1,  x2,  y2,  testx, testy );
-            if( dist < minDist) {
-                // too close
-                isTooClose = true;
-                return isTooClose;
-            }
-            
+    QVector<Point2D> closePoints;
+    BOOST_FOREACH(int i, contactPoints) {
+        closePoints.push_back(Point2D(dd->points[i][0], dd->points[i][1]));
+    }
+    if (segments) {
+        segments->clear();
+        for (size_t i = 0; i < contactSegments.size(); i++) {
+            const Vector2d &p = dd->points[contactSegments[i].first], &q = dd->points[contactSegments[i].second];
+            segments->push_back(qMakePair(Point2D(p[0], p[1]), Point2D(q[0], q[1])));
         }
     }
     
-    return isTooClose;
+    delete dd;
+    delete ddTarget;
+    return closePoints;
 }
 
-int MainWindow::pickRandomGoodGridCell(gridCell* grid, int gridSize){
-    while(true){
-        int randomPosition = int (double(std::rand()/2147483647.0) * gridSize);
-    
-        if(grid[randomPosition].insidePoly && !grid[randomPosition].nearEdge){
-            return randomPosition;
-        }
-        
+void MainWindow::findScrewPositions(DxfData *dd)
+{
+    Vector2d screws[3];
+    setCurrentOutput();
+    screw_placement_e placement = find_screw_positions(*dd, screws);
+    if (placement != SCREWS_PLACED) PRINTB("WARNING: %s", screw_placement_error(placement));
+    clearCurrentOutput();
+    if (placement == SCREWS_PLACED) {
+        screw1X = screws[0][0];
+        screw1Y = screws[0][1];
+        screw2X = screws[1][0];
+        screw2Y = screws[1][1];
+        screw3X = screws[2][0];
+        screw3Y = screws[2][1];
+        testDrawScrewPosAssembly();
     }
-    return -1;
-    
 }
 
 void MainWindow::testDrawScrewPos(double xPos, double yPos){
@@ -3754,7 +3024,7 @@ void MainWindow::testDrawScrewPos(double xPos, double yPos){
     transMatrix2 = transPos * transMatrix2;
     
     
-    delete this->root_module;
+    this->instantiations.retire(this->root_module);
 	this->root_module = NULL;
 	
     
@@ -3787,76 +3057,20 @@ void MainWindow::testDrawScrewPos(double xPos, double yPos){
 
 void MainWindow::testDrawScrewPosAssembly(){
     
-    Transform3d transMatrix1 = transMatrixInverse;
-    Transform3d transPos1 = Transform3d::Identity();
-    transPos1(0,3) = screw1X;
-    transPos1(1,3) = screw1Y;
-    transMatrix1 = transPos1 * transMatrix1;
+    Vector2d screws[3] = { Vector2d(screw1X, screw1Y), Vector2d(screw2X, screw2Y), Vector2d(screw3X, screw3Y) };
     
-    Transform3d transMatrix2 = transMatrixInverse;
-    Transform3d transPos2 = Transform3d::Identity();
-    transPos2(0,3) = screw2X;
-    transPos2(1,3) = screw2Y;
-    transMatrix2 = transPos2 * transMatrix2;
-    
-    Transform3d transMatrix3 = transMatrixInverse;
-    Transform3d transPos3 = Transform3d::Identity();
-    transPos3(0,3) = screw3X;
-    transPos3(1,3) = screw3Y;
-    transMatrix3 = transPos3 * transMatrix3;
-    
-    
-    delete this->root_module;
+    this->instantiations.retire(this->root_module);
 	this->root_module = NULL;
 	
-    
-    std::stringstream parseCommand;
-    parseCommand << "module nutAssembly(){ cylinder(r= 6.5/2, h=100, $fn = 6, center=[0,0]); translate([0, 0, 1]) rotate(a=-180, v=[0,1,0]) cylinder(r= 3.8/2, h=100, $fn = 100, center=[0,0]); translate([0, 0, -5]) rotate(a=-180, v=[0,1,0]) cylinder(r= 3.5, h=100, $fn = 100, center=[0,0]);} ";
-    
-    parseCommand << "difference(){ {import(\"" ;
-    parseCommand << enclosureFileName.toStdString();
-    parseCommand << "\", convexity=2);} { ";
-    
-    parseCommand << "rotate(a=" << -1*zRot <<", v=[0,0,1]) "; //invert insertion direction rotation
-    parseCommand << "rotate(a=" << -1*yRot <<", v=[0,1,0]) ";
-    parseCommand << "rotate(a=" << -1*xRot <<", v=[1,0,0]) ";
-    
-    
-    parseCommand << "rotate(a=90, v=[0,1,0]) ";     //invert -90Y rot for binvox
-    parseCommand << "translate([" << binvoxTransX << ", "<< binvoxTransY << ", "<< binvoxTransZ << "]) ";
-    parseCommand << "scale([" << binvoxScale << ", "<< binvoxScale << ", "<< binvoxScale << "]) ";
-    parseCommand << "rotate(a=90, v=[1,0,0]) rotate(a=90, v=[0,1,0] ) import(\"trianglesExp.stl\", convexity=2);} "; //rotate to get back to correct position (I think due to a x,y,z read order error when importing binvox volume corrdinates to marching cubes app)
-
-    parseCommand <<"multmatrix(m = [ [" << transMatrix1(0,0) << " , " << transMatrix1(0,1) << " , " << transMatrix1(0,2) << " , " << transMatrix1(0,3) << " ], ";
-    parseCommand <<"[ " << transMatrix1(1,0) << " , " << transMatrix1(1,1) << " , " << transMatrix1(1,2) << " , " << transMatrix1(1,3) << " ], ";
-    parseCommand <<"[ " << transMatrix1(2,0) << " , " << transMatrix1(2,1) << " , " << transMatrix1(2,2) << " , " << transMatrix1(2,3) << " ], ";
-    parseCommand <<"[ " << transMatrix1(3,0) << " , " << transMatrix1(3,1) << " , " << transMatrix1(3,2) << " , " << transMatrix1(3,3) << " ] ] ) ";
-    parseCommand << "nutAssembly();";
-    
-    parseCommand <<"multmatrix(m = [ [" << transMatrix2(0,0) << " , " << transMatrix2(0,1) << " , " << transMatrix2(0,2) << " , " << transMatrix2(0,3) << " ], ";
-    parseCommand <<"[ " << transMatrix2(1,0) << " , " << transMatrix2(1,1) << " , " << transMatrix2(1,2) << " , " << transMatrix2(1,3) << " ], ";
-    parseCommand <<"[ " << transMatrix2(2,0) << " , " << transMatrix2(2,1) << " , " << transMatrix2(2,2) << " , " << transMatrix2(2,3) << " ], ";
-    parseCommand <<"[ " << transMatrix2(3,0) << " , " << transMatrix2(3,1) << " , " << transMatrix2(3,2) << " , " << transMatrix2(3,3) << " ] ] ) ";
-    parseCommand << "nutAssembly();";
-    
-    
-    parseCommand <<"multmatrix(m = [ [" << transMatrix3(0,0) << " , " << transMatrix3(0,1) << " , " << transMatrix3(0,2) << " , " << transMatrix3(0,3) << " ], ";
-    parseCommand <<"[ " << transMatrix3(1,0) << " , " << transMatrix3(1,1) << " , " << transMatrix3(1,2) << " , " << transMatrix3(1,3) << " ], ";
-    parseCommand <<"[ " << transMatrix3(2,0) << " , " << transMatrix3(2,1) << " , " << transMatrix3(2,2) << " , " << transMatrix3(2,3) << " ], ";
-    parseCommand <<"[ " << transMatrix3(3,0) << " , " << transMatrix3(3,1) << " , " << transMatrix3(3,2) << " , " << transMatrix3(3,3) << " ] ] ) ";
-    parseCommand << "nutAssembly();} ";
-    
+    std::string parseCommand = screw_assembly_scad(enclosureFileName.toStdString(), transMatrixInverse, screws);
     
     setCurrentOutput();
-    PRINT(parseCommand.str());
+    PRINT(parseCommand);
     clearCurrentOutput();
     
-    const std::string tmp = parseCommand.str();
-    const char* cstr = tmp.c_str();
-    
-	this->root_module = parse(cstr,"",false);
+	this->root_module = parse(parseCommand.c_str(),"",false);
     instantiateRoot();
-    
+    subtractInsertedMesh();
     
     PRINT(this->tree.getString(*this->root_node));
     
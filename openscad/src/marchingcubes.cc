@@ -0,0 +1,681 @@
+#include "marchingcubes.h"
+#include "indexedmesh.h"
+#include "voxelizer.h"
+#include "polyset.h"
+
+#include <algorithm>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
+/*!
+	Extracts the boundary surface of a VoxelGrid as a PolySet.
+
+	This is the marching cubes stage of the old glutMarch tool (which in turn
+	is based on Cory Bloyd's public domain example), minus the GLUT window and
+	the OBJ export. Voxel values are sampled at the voxel centers, so the
+	resulting vertices are in the same coordinate system as the mesh the grid
+	was created from.
+
+	Only the surface is visited: the cells are grouped into bricks of
+	BRICK_SIZE^3 and the bricks into blocks of BLOCK_SIZE^3 bricks. A min/max
+	pyramid over these tells which bricks have both empty and occupied
+	corners; all other bricks can't produce any triangles and are skipped.
+	Within a brick, the corner occupancy is read once, a row at a time,
+	and every triangle vertex is identified by the grid edge it lies on.
+
+	The grid is split into slabs of blocks along z, which are extracted by
+	separate threads. Each slab numbers its vertices through a hash map
+	from edge keys to indices (EdgeMap). Neighbouring slabs only share the
+	edges on the plane between them, so welding looks up just those keys in
+	the map of the slab below. Neither the vertex nor the triangle order
+	depends on the number of threads.
+*/
+
+// Position of each cube corner relative to corner 0
+static const int vertexOffset[8][3] =
+{
+	{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0},
+	{0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1}
+};
+
+// The two corners of each of the 12 cube edges
+static const int edgeConnection[12][2] =
+{
+	{0, 1}, {1, 2}, {2, 3}, {3, 0},
+	{4, 5}, {5, 6}, {6, 7}, {7, 4},
+	{0, 4}, {1, 5}, {2, 6}, {3, 7}
+};
+
+// Direction of each edge (corner 1 - corner 0)
+static const int edgeDirection[12][3] =
+{
+	{1, 0, 0}, {0, 1, 0}, {-1, 0, 0}, {0, -1, 0},
+	{1, 0, 0}, {0, 1, 0}, {-1, 0, 0}, {0, -1, 0},
+	{0, 0, 1}, {0, 0, 1}, {0, 0, 1}, {0, 0, 1}
+};
+
+/*!
+	For each of the 256 corner configurations, the edges intersected by
+	the surface. Bit n is set if edge n is intersected.
+*/
+static const int cubeEdgeFlags[256] =
+{
+	0x000, 0x109, 0x203, 0x30a, 0x406, 0x50f, 0x605, 0x70c, 0x80c, 0x905, 0xa0f, 0xb06, 0xc0a, 0xd03, 0xe09, 0xf00,
+	0x190, 0x099, 0x393, 0x29a, 0x596, 0x49f, 0x795, 0x69c, 0x99c, 0x895, 0xb9f, 0xa96, 0xd9a, 0xc93, 0xf99, 0xe90,
+	0x230, 0x339, 0x033, 0x13a, 0x636, 0x73f, 0x435, 0x53c, 0xa3c, 0xb35, 0x83f, 0x936, 0xe3a, 0xf33, 0xc39, 0xd30,
+	0x3a0, 0x2a9, 0x1a3, 0x0aa, 0x7a6, 0x6af, 0x5a5, 0x4ac, 0xbac, 0xaa5, 0x9af, 0x8a6, 0xfaa, 0xea3, 0xda9, 0xca0,
+	0x460, 0x569, 0x663, 0x76a, 0x066, 0x16f, 0x265, 0x36c, 0xc6c, 0xd65, 0xe6f, 0xf66, 0x86a, 0x963, 0xa69, 0xb60,
+	0x5f0, 0x4f9, 0x7f3, 0x6fa, 0x1f6, 0x0ff, 0x3f5, 0x2fc, 0xdfc, 0xcf5, 0xfff, 0xef6, 0x9fa, 0x8f3, 0xbf9, 0xaf0,
+	0x650, 0x759, 0x453, 0x55a, 0x256, 0x35f, 0x055, 0x15c, 0xe5c, 0xf55, 0xc5f, 0xd56, 0xa5a, 0xb53, 0x859, 0x950,
+	0x7c0, 0x6c9, 0x5c3, 0x4ca, 0x3c6, 0x2cf, 0x1c5, 0x0cc, 0xfcc, 0xec5, 0xdcf, 0xcc6, 0xbca, 0xac3, 0x9c9, 0x8c0,
+	0x8c0, 0x9c9, 0xac3, 0xbca, 0xcc6, 0xdcf, 0xec5, 0xfcc, 0x0cc, 0x1c5, 0x2cf, 0x3c6, 0x4ca, 0x5c3, 0x6c9, 0x7c0,
+	0x950, 0x859, 0xb53, 0xa5a, 0xd56, 0xc5f, 0xf55, 0xe5c, 0x15c, 0x055, 0x35f, 0x256, 0x55a, 0x453, 0x759, 0x650,
+	0xaf0, 0xbf9, 0x8f3, 0x9fa, 0xef6, 0xfff, 0xcf5, 0xdfc, 0x2fc, 0x3f5, 0x0ff, 0x1f6, 0x6fa, 0x7f3, 0x4f9, 0x5f0,
+	0xb60, 0xa69, 0x963, 0x86a, 0xf66, 0xe6f, 0xd65, 0xc6c, 0x36c, 0x265, 0x16f, 0x066, 0x76a, 0x663, 0x569, 0x460,
+	0xca0, 0xda9, 0xea3, 0xfaa, 0x8a6, 0x9af, 0xaa5, 0xbac, 0x4ac, 0x5a5, 0x6af, 0x7a6, 0x0aa, 0x1a3, 0x2a9, 0x3a0,
+	0xd30, 0xc39, 0xf33, 0xe3a, 0x936, 0x83f, 0xb35, 0xa3c, 0x53c, 0x435, 0x73f, 0x636, 0x13a, 0x033, 0x339, 0x230,
+	0xe90, 0xf99, 0xc93, 0xd9a, 0xa96, 0xb9f, 0x895, 0x99c, 0x69c, 0x795, 0x49f, 0x596, 0x29a, 0x393, 0x099, 0x190,
+	0xf00, 0xe09, 0xd03, 0xc0a, 0xb06, 0xa0f, 0x905, 0x80c, 0x70c, 0x605, 0x50f, 0x406, 0x30a, 0x203, 0x109, 0x000
+};
+
+/*!
+	The triangulation of the edge intersections for each corner
+	configuration, as edge triples terminated by -1.
+*/
+static const int triangleConnectionTable[256][16] =
+{
+	{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{0, 1, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{1, 8, 3, 9, 8, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{1, 2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{0, 8, 3, 1, 2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{9, 2, 10, 0, 2, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{2, 8, 3, 2, 10, 8, 10, 9, 8, -1, -1, -1, -1, -1, -1, -1},
+	{3, 11, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{0, 11, 2, 8, 11, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{1, 9, 0, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{1, 11, 2, 1, 9, 11, 9, 8, 11, -1, -1, -1, -1, -1, -1, -1},
+	{3, 10, 1, 11, 10, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{0, 10, 1, 0, 8, 10, 8, 11, 10, -1, -1, -1, -1, -1, -1, -1},
+	{3, 9, 0, 3, 11, 9, 11, 10, 9, -1, -1, -1, -1, -1, -1, -1},
+	{9, 8, 10, 10, 8, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{4, 3, 0, 7, 3, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{0, 1, 9, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{4, 1, 9, 4, 7, 1, 7, 3, 1, -1, -1, -1, -1, -1, -1, -1},
+	{1, 2, 10, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{3, 4, 7, 3, 0, 4, 1, 2, 10, -1, -1, -1, -1, -1, -1, -1},
+	{9, 2, 10, 9, 0, 2, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1},
+	{2, 10, 9, 2, 9, 7, 2, 7, 3, 7, 9, 4, -1, -1, -1, -1},
+	{8, 4, 7, 3, 11, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{11, 4, 7, 11, 2, 4, 2, 0, 4, -1, -1, -1, -1, -1, -1, -1},
+	{9, 0, 1, 8, 4, 7, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1},
+	{4, 7, 11, 9, 4, 11, 9, 11, 2, 9, 2, 1, -1, -1, -1, -1},
+	{3, 10, 1, 3, 11, 10, 7, 8, 4, -1, -1, -1, -1, -1, -1, -1},
+	{1, 11, 10, 1, 4, 11, 1, 0, 4, 7, 11, 4, -1, -1, -1, -1},
+	{4, 7, 8, 9, 0, 11, 9, 11, 10, 11, 0, 3, -1, -1, -1, -1},
+	{4, 7, 11, 4, 11, 9, 9, 11, 10, -1, -1, -1, -1, -1, -1, -1},
+	{9, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{9, 5, 4, 0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{0, 5, 4, 1, 5, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{8, 5, 4, 8, 3, 5, 3, 1, 5, -1, -1, -1, -1, -1, -1, -1},
+	{1, 2, 10, 9, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{3, 0, 8, 1, 2, 10, 4, 9, 5, -1, -1, -1, -1, -1, -1, -1},
+	{5, 2, 10, 5, 4, 2, 4, 0, 2, -1, -1, -1, -1, -1, -1, -1},
+	{2, 10, 5, 3, 2, 5, 3, 5, 4, 3, 4, 8, -1, -1, -1, -1},
+	{9, 5, 4, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{0, 11, 2, 0, 8, 11, 4, 9, 5, -1, -1, -1, -1, -1, -1, -1},
+	{0, 5, 4, 0, 1, 5, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1},
+	{2, 1, 5, 2, 5, 8, 2, 8, 11, 4, 8, 5, -1, -1, -1, -1},
+	{10, 3, 11, 10, 1, 3, 9, 5, 4, -1, -1, -1, -1, -1, -1, -1},
+	{4, 9, 5, 0, 8, 1, 8, 10, 1, 8, 11, 10, -1, -1, -1, -1},
+	{5, 4, 0, 5, 0, 11, 5, 11, 10, 11, 0, 3, -1, -1, -1, -1},
+	{5, 4, 8, 5, 8, 10, 10, 8, 11, -1, -1, -1, -1, -1, -1, -1},
+	{9, 7, 8, 5, 7, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{9, 3, 0, 9, 5, 3, 5, 7, 3, -1, -1, -1, -1, -1, -1, -1},
+	{0, 7, 8, 0, 1, 7, 1, 5, 7, -1, -1, -1, -1, -1, -1, -1},
+	{1, 5, 3, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{9, 7, 8, 9, 5, 7, 10, 1, 2, -1, -1, -1, -1, -1, -1, -1},
+	{10, 1, 2, 9, 5, 0, 5, 3, 0, 5, 7, 3, -1, -1, -1, -1},
+	{8, 0, 2, 8, 2, 5, 8, 5, 7, 10, 5, 2, -1, -1, -1, -1},
+	{2, 10, 5, 2, 5, 3, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1},
+	{7, 9, 5, 7, 8, 9, 3, 11, 2, -1, -1, -1, -1, -1, -1, -1},
+	{9, 5, 7, 9, 7, 2, 9, 2, 0, 2, 7, 11, -1, -1, -1, -1},
+	{2, 3, 11, 0, 1, 8, 1, 7, 8, 1, 5, 7, -1, -1, -1, -1},
+	{11, 2, 1, 11, 1, 7, 7, 1, 5, -1, -1, -1, -1, -1, -1, -1},
+	{9, 5, 8, 8, 5, 7, 10, 1, 3, 10, 3, 11, -1, -1, -1, -1},
+	{5, 7, 0, 5, 0, 9, 7, 11, 0, 1, 0, 10, 11, 10, 0, -1},
+	{11, 10, 0, 11, 0, 3, 10, 5, 0, 8, 0, 7, 5, 7, 0, -1},
+	{11, 10, 5, 7, 11, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{10, 6, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{0, 8, 3, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{9, 0, 1, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{1, 8, 3, 1, 9, 8, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1},
+	{1, 6, 5, 2, 6, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{1, 6, 5, 1, 2, 6, 3, 0, 8, -1, -1, -1, -1, -1, -1, -1},
+	{9, 6, 5, 9, 0, 6, 0, 2, 6, -1, -1, -1, -1, -1, -1, -1},
+	{5, 9, 8, 5, 8, 2, 5, 2, 6, 3, 2, 8, -1, -1, -1, -1},
+	{2, 3, 11, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{11, 0, 8, 11, 2, 0, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1},
+	{0, 1, 9, 2, 3, 11, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1},
+	{5, 10, 6, 1, 9, 2, 9, 11, 2, 9, 8, 11, -1, -1, -1, -1},
+	{6, 3, 11, 6, 5, 3, 5, 1, 3, -1, -1, -1, -1, -1, -1, -1},
+	{0, 8, 11, 0, 11, 5, 0, 5, 1, 5, 11, 6, -1, -1, -1, -1},
+	{3, 11, 6, 0, 3, 6, 0, 6, 5, 0, 5, 9, -1, -1, -1, -1},
+	{6, 5, 9, 6, 9, 11, 11, 9, 8, -1, -1, -1, -1, -1, -1, -1},
+	{5, 10, 6, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{4, 3, 0, 4, 7, 3, 6, 5, 10, -1, -1, -1, -1, -1, -1, -1},
+	{1, 9, 0, 5, 10, 6, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1},
+	{10, 6, 5, 1, 9, 7, 1, 7, 3, 7, 9, 4, -1, -1, -1, -1},
+	{6, 1, 2, 6, 5, 1, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1},
+	{1, 2, 5, 5, 2, 6, 3, 0, 4, 3, 4, 7, -1, -1, -1, -1},
+	{8, 4, 7, 9, 0, 5, 0, 6, 5, 0, 2, 6, -1, -1, -1, -1},
+	{7, 3, 9, 7, 9, 4, 3, 2, 9, 5, 9, 6, 2, 6, 9, -1},
+	{3, 11, 2, 7, 8, 4, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1},
+	{5, 10, 6, 4, 7, 2, 4, 2, 0, 2, 7, 11, -1, -1, -1, -1},
+	{0, 1, 9, 4, 7, 8, 2, 3, 11, 5, 10, 6, -1, -1, -1, -1},
+	{9, 2, 1, 9, 11, 2, 9, 4, 11, 7, 11, 4, 5, 10, 6, -1},
+	{8, 4, 7, 3, 11, 5, 3, 5, 1, 5, 11, 6, -1, -1, -1, -1},
+	{5, 1, 11, 5, 11, 6, 1, 0, 11, 7, 11, 4, 0, 4, 11, -1},
+	{0, 5, 9, 0, 6, 5, 0, 3, 6, 11, 6, 3, 8, 4, 7, -1},
+	{6, 5, 9, 6, 9, 11, 4, 7, 9, 7, 11, 9, -1, -1, -1, -1},
+	{10, 4, 9, 6, 4, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{4, 10, 6, 4, 9, 10, 0, 8, 3, -1, -1, -1, -1, -1, -1, -1},
+	{10, 0, 1, 10, 6, 0, 6, 4, 0, -1, -1, -1, -1, -1, -1, -1},
+	{8, 3, 1, 8, 1, 6, 8, 6, 4, 6, 1, 10, -1, -1, -1, -1},
+	{1, 4, 9, 1, 2, 4, 2, 6, 4, -1, -1, -1, -1, -1, -1, -1},
+	{3, 0, 8, 1, 2, 9, 2, 4, 9, 2, 6, 4, -1, -1, -1, -1},
+	{0, 2, 4, 4, 2, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{8, 3, 2, 8, 2, 4, 4, 2, 6, -1, -1, -1, -1, -1, -1, -1},
+	{10, 4, 9, 10, 6, 4, 11, 2, 3, -1, -1, -1, -1, -1, -1, -1},
+	{0, 8, 2, 2, 8, 11, 4, 9, 10, 4, 10, 6, -1, -1, -1, -1},
+	{3, 11, 2, 0, 1, 6, 0, 6, 4, 6, 1, 10, -1, -1, -1, -1},
+	{6, 4, 1, 6, 1, 10, 4, 8, 1, 2, 1, 11, 8, 11, 1, -1},
+	{9, 6, 4, 9, 3, 6, 9, 1, 3, 11, 6, 3, -1, -1, -1, -1},
+	{8, 11, 1, 8, 1, 0, 11, 6, 1, 9, 1, 4, 6, 4, 1, -1},
+	{3, 11, 6, 3, 6, 0, 0, 6, 4, -1, -1, -1, -1, -1, -1, -1},
+	{6, 4, 8, 11, 6, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{7, 10, 6, 7, 8, 10, 8, 9, 10, -1, -1, -1, -1, -1, -1, -1},
+	{0, 7, 3, 0, 10, 7, 0, 9, 10, 6, 7, 10, -1, -1, -1, -1},
+	{10, 6, 7, 1, 10, 7, 1, 7, 8, 1, 8, 0, -1, -1, -1, -1},
+	{10, 6, 7, 10, 7, 1, 1, 7, 3, -1, -1, -1, -1, -1, -1, -1},
+	{1, 2, 6, 1, 6, 8, 1, 8, 9, 8, 6, 7, -1, -1, -1, -1},
+	{2, 6, 9, 2, 9, 1, 6, 7, 9, 0, 9, 3, 7, 3, 9, -1},
+	{7, 8, 0, 7, 0, 6, 6, 0, 2, -1, -1, -1, -1, -1, -1, -1},
+	{7, 3, 2, 6, 7, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{2, 3, 11, 10, 6, 8, 10, 8, 9, 8, 6, 7, -1, -1, -1, -1},
+	{2, 0, 7, 2, 7, 11, 0, 9, 7, 6, 7, 10, 9, 10, 7, -1},
+	{1, 8, 0, 1, 7, 8, 1, 10, 7, 6, 7, 10, 2, 3, 11, -1},
+	{11, 2, 1, 11, 1, 7, 10, 6, 1, 6, 7, 1, -1, -1, -1, -1},
+	{8, 9, 6, 8, 6, 7, 9, 1, 6, 11, 6, 3, 1, 3, 6, -1},
+	{0, 9, 1, 11, 6, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{7, 8, 0, 7, 0, 6, 3, 11, 0, 11, 6, 0, -1, -1, -1, -1},
+	{7, 11, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{7, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{3, 0, 8, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{0, 1, 9, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{8, 1, 9, 8, 3, 1, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1},
+	{10, 1, 2, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{1, 2, 10, 3, 0, 8, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1},
+	{2, 9, 0, 2, 10, 9, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1},
+	{6, 11, 7, 2, 10, 3, 10, 8, 3, 10, 9, 8, -1, -1, -1, -1},
+	{7, 2, 3, 6, 2, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{7, 0, 8, 7, 6, 0, 6, 2, 0, -1, -1, -1, -1, -1, -1, -1},
+	{2, 7, 6, 2, 3, 7, 0, 1, 9, -1, -1, -1, -1, -1, -1, -1},
+	{1, 6, 2, 1, 8, 6, 1, 9, 8, 8, 7, 6, -1, -1, -1, -1},
+	{10, 7, 6, 10, 1, 7, 1, 3, 7, -1, -1, -1, -1, -1, -1, -1},
+	{10, 7, 6, 1, 7, 10, 1, 8, 7, 1, 0, 8, -1, -1, -1, -1},
+	{0, 3, 7, 0, 7, 10, 0, 10, 9, 6, 10, 7, -1, -1, -1, -1},
+	{7, 6, 10, 7, 10, 8, 8, 10, 9, -1, -1, -1, -1, -1, -1, -1},
+	{6, 8, 4, 11, 8, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{3, 6, 11, 3, 0, 6, 0, 4, 6, -1, -1, -1, -1, -1, -1, -1},
+	{8, 6, 11, 8, 4, 6, 9, 0, 1, -1, -1, -1, -1, -1, -1, -1},
+	{9, 4, 6, 9, 6, 3, 9, 3, 1, 11, 3, 6, -1, -1, -1, -1},
+	{6, 8, 4, 6, 11, 8, 2, 10, 1, -1, -1, -1, -1, -1, -1, -1},
+	{1, 2, 10, 3, 0, 11, 0, 6, 11, 0, 4, 6, -1, -1, -1, -1},
+	{4, 11, 8, 4, 6, 11, 0, 2, 9, 2, 10, 9, -1, -1, -1, -1},
+	{10, 9, 3, 10, 3, 2, 9, 4, 3, 11, 3, 6, 4, 6, 3, -1},
+	{8, 2, 3, 8, 4, 2, 4, 6, 2, -1, -1, -1, -1, -1, -1, -1},
+	{0, 4, 2, 4, 6, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{1, 9, 0, 2, 3, 4, 2, 4, 6, 4, 3, 8, -1, -1, -1, -1},
+	{1, 9, 4, 1, 4, 2, 2, 4, 6, -1, -1, -1, -1, -1, -1, -1},
+	{8, 1, 3, 8, 6, 1, 8, 4, 6, 6, 10, 1, -1, -1, -1, -1},
+	{10, 1, 0, 10, 0, 6, 6, 0, 4, -1, -1, -1, -1, -1, -1, -1},
+	{4, 6, 3, 4, 3, 8, 6, 10, 3, 0, 3, 9, 10, 9, 3, -1},
+	{10, 9, 4, 6, 10, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{4, 9, 5, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{0, 8, 3, 4, 9, 5, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1},
+	{5, 0, 1, 5, 4, 0, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1},
+	{11, 7, 6, 8, 3, 4, 3, 5, 4, 3, 1, 5, -1, -1, -1, -1},
+	{9, 5, 4, 10, 1, 2, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1},
+	{6, 11, 7, 1, 2, 10, 0, 8, 3, 4, 9, 5, -1, -1, -1, -1},
+	{7, 6, 11, 5, 4, 10, 4, 2, 10, 4, 0, 2, -1, -1, -1, -1},
+	{3, 4, 8, 3, 5, 4, 3, 2, 5, 10, 5, 2, 11, 7, 6, -1},
+	{7, 2, 3, 7, 6, 2, 5, 4, 9, -1, -1, -1, -1, -1, -1, -1},
+	{9, 5, 4, 0, 8, 6, 0, 6, 2, 6, 8, 7, -1, -1, -1, -1},
+	{3, 6, 2, 3, 7, 6, 1, 5, 0, 5, 4, 0, -1, -1, -1, -1},
+	{6, 2, 8, 6, 8, 7, 2, 1, 8, 4, 8, 5, 1, 5, 8, -1},
+	{9, 5, 4, 10, 1, 6, 1, 7, 6, 1, 3, 7, -1, -1, -1, -1},
+	{1, 6, 10, 1, 7, 6, 1, 0, 7, 8, 7, 0, 9, 5, 4, -1},
+	{4, 0, 10, 4, 10, 5, 0, 3, 10, 6, 10, 7, 3, 7, 10, -1},
+	{7, 6, 10, 7, 10, 8, 5, 4, 10, 4, 8, 10, -1, -1, -1, -1},
+	{6, 9, 5, 6, 11, 9, 11, 8, 9, -1, -1, -1, -1, -1, -1, -1},
+	{3, 6, 11, 0, 6, 3, 0, 5, 6, 0, 9, 5, -1, -1, -1, -1},
+	{0, 11, 8, 0, 5, 11, 0, 1, 5, 5, 6, 11, -1, -1, -1, -1},
+	{6, 11, 3, 6, 3, 5, 5, 3, 1, -1, -1, -1, -1, -1, -1, -1},
+	{1, 2, 10, 9, 5, 11, 9, 11, 8, 11, 5, 6, -1, -1, -1, -1},
+	{0, 11, 3, 0, 6, 11, 0, 9, 6, 5, 6, 9, 1, 2, 10, -1},
+	{11, 8, 5, 11, 5, 6, 8, 0, 5, 10, 5, 2, 0, 2, 5, -1},
+	{6, 11, 3, 6, 3, 5, 2, 10, 3, 10, 5, 3, -1, -1, -1, -1},
+	{5, 8, 9, 5, 2, 8, 5, 6, 2, 3, 8, 2, -1, -1, -1, -1},
+	{9, 5, 6, 9, 6, 0, 0, 6, 2, -1, -1, -1, -1, -1, -1, -1},
+	{1, 5, 8, 1, 8, 0, 5, 6, 8, 3, 8, 2, 6, 2, 8, -1},
+	{1, 5, 6, 2, 1, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{1, 3, 6, 1, 6, 10, 3, 8, 6, 5, 6, 9, 8, 9, 6, -1},
+	{10, 1, 0, 10, 0, 6, 9, 5, 0, 5, 6, 0, -1, -1, -1, -1},
+	{0, 3, 8, 5, 6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{10, 5, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{11, 5, 10, 7, 5, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{11, 5, 10, 11, 7, 5, 8, 3, 0, -1, -1, -1, -1, -1, -1, -1},
+	{5, 11, 7, 5, 10, 11, 1, 9, 0, -1, -1, -1, -1, -1, -1, -1},
+	{10, 7, 5, 10, 11, 7, 9, 8, 1, 8, 3, 1, -1, -1, -1, -1},
+	{11, 1, 2, 11, 7, 1, 7, 5, 1, -1, -1, -1, -1, -1, -1, -1},
+	{0, 8, 3, 1, 2, 7, 1, 7, 5, 7, 2, 11, -1, -1, -1, -1},
+	{9, 7, 5, 9, 2, 7, 9, 0, 2, 2, 11, 7, -1, -1, -1, -1},
+	{7, 5, 2, 7, 2, 11, 5, 9, 2, 3, 2, 8, 9, 8, 2, -1},
+	{2, 5, 10, 2, 3, 5, 3, 7, 5, -1, -1, -1, -1, -1, -1, -1},
+	{8, 2, 0, 8, 5, 2, 8, 7, 5, 10, 2, 5, -1, -1, -1, -1},
+	{9, 0, 1, 5, 10, 3, 5, 3, 7, 3, 10, 2, -1, -1, -1, -1},
+	{9, 8, 2, 9, 2, 1, 8, 7, 2, 10, 2, 5, 7, 5, 2, -1},
+	{1, 3, 5, 3, 7, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{0, 8, 7, 0, 7, 1, 1, 7, 5, -1, -1, -1, -1, -1, -1, -1},
+	{9, 0, 3, 9, 3, 5, 5, 3, 7, -1, -1, -1, -1, -1, -1, -1},
+	{9, 8, 7, 5, 9, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{5, 8, 4, 5, 10, 8, 10, 11, 8, -1, -1, -1, -1, -1, -1, -1},
+	{5, 0, 4, 5, 11, 0, 5, 10, 11, 11, 3, 0, -1, -1, -1, -1},
+	{0, 1, 9, 8, 4, 10, 8, 10, 11, 10, 4, 5, -1, -1, -1, -1},
+	{10, 11, 4, 10, 4, 5, 11, 3, 4, 9, 4, 1, 3, 1, 4, -1},
+	{2, 5, 1, 2, 8, 5, 2, 11, 8, 4, 5, 8, -1, -1, -1, -1},
+	{0, 4, 11, 0, 11, 3, 4, 5, 11, 2, 11, 1, 5, 1, 11, -1},
+	{0, 2, 5, 0, 5, 9, 2, 11, 5, 4, 5, 8, 11, 8, 5, -1},
+	{9, 4, 5, 2, 11, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{2, 5, 10, 3, 5, 2, 3, 4, 5, 3, 8, 4, -1, -1, -1, -1},
+	{5, 10, 2, 5, 2, 4, 4, 2, 0, -1, -1, -1, -1, -1, -1, -1},
+	{3, 10, 2, 3, 5, 10, 3, 8, 5, 4, 5, 8, 0, 1, 9, -1},
+	{5, 10, 2, 5, 2, 4, 1, 9, 2, 9, 4, 2, -1, -1, -1, -1},
+	{8, 4, 5, 8, 5, 3, 3, 5, 1, -1, -1, -1, -1, -1, -1, -1},
+	{0, 4, 5, 1, 0, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{8, 4, 5, 8, 5, 3, 9, 0, 5, 0, 3, 5, -1, -1, -1, -1},
+	{9, 4, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{4, 11, 7, 4, 9, 11, 9, 10, 11, -1, -1, -1, -1, -1, -1, -1},
+	{0, 8, 3, 4, 9, 7, 9, 11, 7, 9, 10, 11, -1, -1, -1, -1},
+	{1, 10, 11, 1, 11, 4, 1, 4, 0, 7, 4, 11, -1, -1, -1, -1},
+	{3, 1, 4, 3, 4, 8, 1, 10, 4, 7, 4, 11, 10, 11, 4, -1},
+	{4, 11, 7, 9, 11, 4, 9, 2, 11, 9, 1, 2, -1, -1, -1, -1},
+	{9, 7, 4, 9, 11, 7, 9, 1, 11, 2, 11, 1, 0, 8, 3, -1},
+	{11, 7, 4, 11, 4, 2, 2, 4, 0, -1, -1, -1, -1, -1, -1, -1},
+	{11, 7, 4, 11, 4, 2, 8, 3, 4, 3, 2, 4, -1, -1, -1, -1},
+	{2, 9, 10, 2, 7, 9, 2, 3, 7, 7, 4, 9, -1, -1, -1, -1},
+	{9, 10, 7, 9, 7, 4, 10, 2, 7, 8, 7, 0, 2, 0, 7, -1},
+	{3, 7, 10, 3, 10, 2, 7, 4, 10, 1, 10, 0, 4, 0, 10, -1},
+	{1, 10, 2, 8, 7, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{4, 9, 1, 4, 1, 7, 7, 1, 3, -1, -1, -1, -1, -1, -1, -1},
+	{4, 9, 1, 4, 1, 7, 0, 8, 1, 8, 7, 1, -1, -1, -1, -1},
+	{4, 0, 3, 7, 4, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{4, 8, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{9, 10, 8, 10, 11, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{3, 0, 9, 3, 9, 11, 11, 9, 10, -1, -1, -1, -1, -1, -1, -1},
+	{0, 1, 10, 0, 10, 8, 8, 10, 11, -1, -1, -1, -1, -1, -1, -1},
+	{3, 1, 10, 11, 3, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{1, 2, 11, 1, 11, 9, 9, 11, 8, -1, -1, -1, -1, -1, -1, -1},
+	{3, 0, 9, 3, 9, 11, 1, 2, 9, 2, 11, 9, -1, -1, -1, -1},
+	{0, 2, 11, 8, 0, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{3, 2, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{2, 3, 8, 2, 8, 10, 10, 8, 9, -1, -1, -1, -1, -1, -1, -1},
+	{9, 10, 2, 0, 9, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{2, 3, 8, 2, 8, 10, 0, 1, 8, 1, 10, 8, -1, -1, -1, -1},
+	{1, 10, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{1, 3, 8, 9, 1, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{0, 9, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{0, 3, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1}
+};
+
+// glutMarch sampled -50 inside and 50 outside, with the surface at 1. With
+// binary samples, every edge vertex is thus 0.51 away from its inside corner.
+static const double insideValue = -50.0;
+static const double outsideValue = 50.0;
+static const double targetValue = 1.0;
+static const double insideOffset = (targetValue - insideValue) / (outsideValue - insideValue);
+
+namespace {
+	const int BRICK_SIZE = 8; // cells per brick side
+	const int BLOCK_SIZE = 4; // bricks per block side
+
+	enum { HAS_EMPTY = 1, HAS_OCCUPIED = 2, MIXED = HAS_EMPTY | HAS_OCCUPIED };
+
+	/*!
+		Cell (x,y,z) is the cube with corner 0 at voxel (x-1,y-1,z-1), so the
+		cells cover the grid plus one voxel of empty space on each side.
+		Edges are keyed by their lower corner and their axis.
+	*/
+	class Extractor
+	{
+	public:
+		Extractor(const VoxelGrid &grid) : grid(grid) {
+			this->cells[0] = grid.width + 1;
+			this->cells[1] = grid.height + 1;
+			this->cells[2] = grid.depth + 1;
+			for (int i = 0; i < 3; i++) {
+				this->bricks[i] = (this->cells[i] + BRICK_SIZE - 1) / BRICK_SIZE;
+				this->blocks[i] = (this->bricks[i] + BLOCK_SIZE - 1) / BLOCK_SIZE;
+			}
+			for (int e = 0; e < 12; e++) {
+				int c0 = edgeConnection[e][0], c1 = edgeConnection[e][1];
+				bool forward = edgeDirection[e][0] + edgeDirection[e][1] + edgeDirection[e][2] > 0;
+				int lower = forward ? c0 : c1;
+				for (int k = 0; k < 3; k++) {
+					this->edgeLower[e][k] = vertexOffset[lower][k];
+					if (edgeDirection[e][k] != 0) this->edgeAxis[e] = k;
+				}
+			}
+		}
+
+		void initPyramid();
+		void buildPyramid(int bz0, int bz1);
+		void extractBlock(int bx, int by, int bz, std::vector<uint64_t> &triangles) const;
+		Vector3d vertex(uint64_t key) const;
+
+		int blockCount(int axis) const { return this->blocks[axis]; }
+		// The edge keys with their lower corner on the first cell plane of the given block
+		uint64_t planeKey(int bz) const { return edgeKey(0, 0, bz * BLOCK_SIZE * BRICK_SIZE, 0); }
+		uint64_t planeKeys() const { return edgeKey(0, 0, 1, 0); }
+		bool blockMixed(int bx, int by, int bz) const {
+			return this->blockFlags[(size_t(bz) * this->blocks[1] + by) * this->blocks[0] + bx] == MIXED;
+		}
+
+	private:
+		int loadBrick(int bx, int by, int bz, uint16_t corners[BRICK_SIZE + 1][BRICK_SIZE + 1]) const;
+		void extractBrick(int bx, int by, int bz, std::vector<uint64_t> &triangles) const;
+		uint64_t edgeKey(int x, int y, int z, int axis) const {
+			return ((uint64_t(z) * (this->cells[1] + 1) + y) * (this->cells[0] + 1) + x) * 3 + axis;
+		}
+
+		const VoxelGrid &grid;
+		int cells[3], bricks[3], blocks[3];
+		int edgeLower[12][3], edgeAxis[12];
+		std::vector<unsigned char> brickFlags, blockFlags;
+	};
+
+	/*!
+		Reads the (BRICK_SIZE+1)^3 corners of the given brick into rows of
+		bits and returns its HAS_EMPTY/HAS_OCCUPIED flags.
+	*/
+	int Extractor::loadBrick(int bx, int by, int bz, uint16_t corners[BRICK_SIZE + 1][BRICK_SIZE + 1]) const
+	{
+		const uint16_t full = (1 << (BRICK_SIZE + 1)) - 1;
+		int x0 = bx * BRICK_SIZE - 1, y0 = by * BRICK_SIZE - 1, z0 = bz * BRICK_SIZE - 1;
+		int flags = 0;
+		for (int z = 0; z <= BRICK_SIZE; z++) {
+			for (int y = 0; y <= BRICK_SIZE; y++) {
+				uint16_t row = this->grid.getRun(x0, y0 + y, z0 + z, BRICK_SIZE + 1);
+				corners[z][y] = row;
+				if (row != 0) flags |= HAS_OCCUPIED;
+				if (row != full) flags |= HAS_EMPTY;
+			}
+		}
+		return flags;
+	}
+
+	void Extractor::initPyramid()
+	{
+		this->brickFlags.resize(size_t(this->bricks[0]) * this->bricks[1] * this->bricks[2]);
+		this->blockFlags.assign(size_t(this->blocks[0]) * this->blocks[1] * this->blocks[2], 0);
+	}
+
+	/*!
+		Fills in the pyramid for the blocks bz0..bz1-1 along z.
+	*/
+	void Extractor::buildPyramid(int bz0, int bz1)
+	{
+		uint16_t corners[BRICK_SIZE + 1][BRICK_SIZE + 1];
+		int z1 = std::min(bz1 * BLOCK_SIZE, this->bricks[2]);
+		for (int z = bz0 * BLOCK_SIZE; z < z1; z++) {
+			size_t i = size_t(z) * this->bricks[1] * this->bricks[0];
+			for (int y = 0; y < this->bricks[1]; y++) {
+				for (int x = 0; x < this->bricks[0]; x++, i++) {
+					this->brickFlags[i] = loadBrick(x, y, z, corners);
+					size_t block = (size_t(z / BLOCK_SIZE) * this->blocks[1] + y / BLOCK_SIZE) * this->blocks[0] + x / BLOCK_SIZE;
+					this->blockFlags[block] |= this->brickFlags[i];
+				}
+			}
+		}
+	}
+
+	void Extractor::extractBlock(int bx, int by, int bz, std::vector<uint64_t> &triangles) const
+	{
+		int x1 = std::min((bx + 1) * BLOCK_SIZE, this->bricks[0]);
+		int y1 = std::min((by + 1) * BLOCK_SIZE, this->bricks[1]);
+		int z1 = std::min((bz + 1) * BLOCK_SIZE, this->bricks[2]);
+		for (int z = bz * BLOCK_SIZE; z < z1; z++) {
+			for (int y = by * BLOCK_SIZE; y < y1; y++) {
+				for (int x = bx * BLOCK_SIZE; x < x1; x++) {
+					if (this->brickFlags[(size_t(z) * this->bricks[1] + y) * this->bricks[0] + x] == MIXED) {
+						extractBrick(x, y, z, triangles);
+					}
+				}
+			}
+		}
+	}
+
+	/*!
+		Appends three edge keys per triangle.
+	*/
+	void Extractor::extractBrick(int bx, int by, int bz, std::vector<uint64_t> &triangles) const
+	{
+		uint16_t corners[BRICK_SIZE + 1][BRICK_SIZE + 1];
+		loadBrick(bx, by, bz, corners);
+		for (int z = 0; z < BRICK_SIZE; z++) {
+			for (int y = 0; y < BRICK_SIZE; y++) {
+				uint16_t r00 = corners[z][y], r10 = corners[z][y + 1];
+				uint16_t r01 = corners[z + 1][y], r11 = corners[z + 1][y + 1];
+				// Rows where all four corner rows agree have no surface
+				if ((r00 == r10 && r00 == r01 && r00 == r11) && (r00 == 0 || r00 == (1 << (BRICK_SIZE + 1)) - 1)) continue;
+				for (int x = 0; x < BRICK_SIZE; x++) {
+					int flagIndex =
+						((r00 >> x) & 1) | ((r00 >> x) & 2) | (((r10 >> x) & 2) << 1) | (((r10 >> x) & 1) << 3) |
+						(((r01 >> x) & 1) << 4) | (((r01 >> x) & 2) << 4) | (((r11 >> x) & 2) << 5) | (((r11 >> x) & 1) << 7);
+					if (cubeEdgeFlags[flagIndex] == 0) continue;
+					int cx = bx * BRICK_SIZE + x, cy = by * BRICK_SIZE + y, cz = bz * BRICK_SIZE + z;
+					const int *tri = triangleConnectionTable[flagIndex];
+					for (int t = 0; t < 15 && tri[t] >= 0; t += 3) {
+						// The table winds triangles inwards
+						for (int c = 2; c >= 0; c--) {
+							int e = tri[t + c];
+							triangles.push_back(edgeKey(cx + this->edgeLower[e][0], cy + this->edgeLower[e][1],
+																					cz + this->edgeLower[e][2], this->edgeAxis[e]));
+						}
+					}
+				}
+			}
+		}
+	}
+
+	/*!
+		Returns the position of the vertex on the given edge.
+	*/
+	Vector3d Extractor::vertex(uint64_t key) const
+	{
+		int axis = key % 3;
+		key /= 3;
+		int p[3];
+		p[0] = key % (this->cells[0] + 1) - 1;
+		key /= this->cells[0] + 1;
+		p[1] = key % (this->cells[1] + 1) - 1;
+		p[2] = key / (this->cells[1] + 1) - 1;
+		bool lowerInside = this->grid.inside(p[0], p[1], p[2]) && this->grid.get(p[0], p[1], p[2]);
+		double s = this->grid.voxelSize();
+		Vector3d v;
+		for (int k = 0; k < 3; k++) {
+			double offset = k != axis ? 0 : lowerInside ? insideOffset : 1 - insideOffset;
+			v[k] = this->grid.translate[k] + s * (p[k] + 0.5 + offset);
+		}
+		return v;
+	}
+}
+
+namespace {
+	const uint64_t EMPTY_KEY = ~uint64_t(0);
+
+	/*!
+		Open addressing hash map from edge keys to vertex indices.
+	*/
+	class EdgeMap
+	{
+	public:
+		EdgeMap() : mask(0) { }
+		void reserve(size_t n) {
+			size_t capacity = 16;
+			while (capacity < 2 * n) capacity <<= 1;
+			this->keys.assign(capacity, EMPTY_KEY);
+			this->ids.resize(capacity);
+			this->mask = capacity - 1;
+		}
+		// Returns the index of key, inserting it with the given index if it's new
+		int insert(uint64_t key, int id) {
+			size_t i = slot(key);
+			while (this->keys[i] != EMPTY_KEY) {
+				if (this->keys[i] == key) return this->ids[i];
+				i = (i + 1) & this->mask;
+			}
+			this->keys[i] = key;
+			this->ids[i] = id;
+			return id;
+		}
+		int find(uint64_t key) const {
+			for (size_t i = slot(key); this->keys[i] != EMPTY_KEY; i = (i + 1) & this->mask) {
+				if (this->keys[i] == key) return this->ids[i];
+			}
+			return -1;
+		}
+	private:
+		size_t slot(uint64_t key) const { return (key * 0x9E3779B97F4A7C15ULL >> 20) & this->mask; }
+		std::vector<uint64_t> keys;
+		std::vector<int> ids;
+		size_t mask;
+	};
+
+	/*!
+		Vertices are numbered in order of first use, first within the slab
+		and then globally. Since the slabs are in traversal order, this
+		doesn't depend on how the grid was split.
+	*/
+	struct Slab {
+		int z0, z1; // block range along z
+		std::vector<int> triangles; // slab vertex indices
+		std::vector<uint64_t> vertexKeys; // edge key of each slab vertex
+		std::vector<int> globalIds; // mesh vertex index of each slab vertex
+		EdgeMap map;
+	};
+
+	void extract_slab(Extractor *extractor, Slab *slab)
+	{
+		extractor->buildPyramid(slab->z0, slab->z1);
+		std::vector<uint64_t> keys;
+		for (int z = slab->z0; z < slab->z1; z++) {
+			for (int y = 0; y < extractor->blockCount(1); y++) {
+				for (int x = 0; x < extractor->blockCount(0); x++) {
+					if (extractor->blockMixed(x, y, z)) extractor->extractBlock(x, y, z, keys);
+				}
+			}
+		}
+		// Every vertex is shared by about six triangles
+		slab->map.reserve(keys.size() / 4);
+		slab->triangles.resize(keys.size());
+		for (size_t i = 0; i < keys.size(); i++) {
+			int id = slab->map.insert(keys[i], slab->vertexKeys.size());
+			if (id == int(slab->vertexKeys.size())) slab->vertexKeys.push_back(keys[i]);
+			slab->triangles[i] = id;
+		}
+	}
+
+	void output_slab(const Extractor *extractor, const Slab *slab, IndexedMesh *mesh, size_t offset, int firstNew)
+	{
+		for (size_t i = 0; i < slab->triangles.size(); i++) {
+			mesh->triangles[offset + i] = slab->globalIds[slab->triangles[i]];
+		}
+		for (size_t i = 0; i < slab->vertexKeys.size(); i++) {
+			int id = slab->globalIds[i];
+			if (id >= firstNew) mesh->vertices[id] = extractor->vertex(slab->vertexKeys[i]);
+		}
+	}
+}
+
+/*!
+	Extracts the closed, outward facing surface of the occupied voxels into
+	mesh. Voxels touching the grid boundary are closed off as well.
+	If threads is 0, one thread per hardware core is used. The result is
+	the same for any number of threads.
+*/
+void marching_cubes(const VoxelGrid &grid, IndexedMesh &mesh, int threads)
+{
+	Extractor extractor(grid);
+	extractor.initPyramid();
+
+	if (threads <= 0) threads = boost::thread::hardware_concurrency();
+	int blocks = extractor.blockCount(2);
+	threads = std::max(1, std::min(threads, blocks));
+
+	// The pyramid is built per slab too, as the slabs don't share any blocks
+	std::vector<Slab> slabs(threads);
+	boost::thread_group extract;
+	for (int i = 0; i < threads; i++) {
+		slabs[i].z0 = blocks * i / threads;
+		slabs[i].z1 = blocks * (i + 1) / threads;
+		extract.create_thread(boost::bind(&extract_slab, &extractor, &slabs[i]));
+	}
+	extract.join_all();
+
+	// Weld the slabs. Neighbouring slabs only share the x and y edges on the
+	// plane between them, which the lower slab has seen first.
+	std::vector<int> firstNew(threads);
+	int numVertices = 0;
+	size_t numTriangleIds = 0;
+	for (int i = 0; i < threads; i++) {
+		Slab &slab = slabs[i];
+		firstNew[i] = numVertices;
+		uint64_t shared0 = extractor.planeKey(slab.z0), shared1 = extractor.planeKey(slab.z0) + extractor.planeKeys();
+		slab.globalIds.resize(slab.vertexKeys.size());
+		for (size_t v = 0; v < slab.vertexKeys.size(); v++) {
+			uint64_t key = slab.vertexKeys[v];
+			int id = -1;
+			if (i > 0 && key >= shared0 && key < shared1) {
+				id = slabs[i - 1].map.find(key);
+				if (id >= 0) id = slabs[i - 1].globalIds[id];
+			}
+			slab.globalIds[v] = id >= 0 ? id : numVertices++;
+		}
+		numTriangleIds += slab.triangles.size();
+	}
+
+	mesh.vertices.resize(numVertices);
+	mesh.triangles.resize(numTriangleIds);
+	boost::thread_group output;
+	size_t offset = 0;
+	for (int i = 0; i < threads; i++) {
+		output.create_thread(boost::bind(&output_slab, &extractor, &slabs[i], &mesh, offset, firstNew[i]));
+		offset += slabs[i].triangles.size();
+	}
+	output.join_all();
+}
+
+/*!
+	Returns the surface of the occupied voxels as a new PolySet.
+*/
+PolySet *marching_cubes(const VoxelGrid &grid, int threads)
+{
+	IndexedMesh mesh;
+	marching_cubes(grid, mesh, threads);
+	return mesh.toPolySet();
+}
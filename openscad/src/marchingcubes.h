@@ -0,0 +1,7 @@
+#ifndef MARCHINGCUBES_H_
+#define MARCHINGCUBES_H_
+
+class PolySet *marching_cubes(const class VoxelGrid &grid, int threads = 0);
+void marching_cubes(const VoxelGrid &grid, class IndexedMesh &mesh, int threads = 0);
+
+#endif
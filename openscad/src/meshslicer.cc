@@ -0,0 +1,211 @@
+#include "meshslicer.h"
+#include "polyset.h"
+#include "dxfdata.h"
+#include "printutils.h"
+
+#include <algorithm>
+#include <boost/foreach.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
+
+namespace {
+	/*!
+		A mesh edge, keyed by its end points in lexicographic order so both
+		polygons sharing the edge find the same entry.
+	*/
+	struct SliceEdge
+	{
+		double a[3], b[3];
+
+		SliceEdge(const Vector3d &p, const Vector3d &q) {
+			for (int i = 0; i < 3; i++) {
+				this->a[i] = p[i];
+				this->b[i] = q[i];
+			}
+		}
+		bool operator==(const SliceEdge &other) const {
+			return std::equal(this->a, this->a + 3, other.a) && std::equal(this->b, this->b + 3, other.b);
+		}
+	};
+
+	size_t hash_value(const SliceEdge &e)
+	{
+		size_t seed = 0;
+		boost::hash_range(seed, e.a, e.a + 3);
+		boost::hash_range(seed, e.b, e.b + 3);
+		return seed;
+	}
+
+	bool lexicographic_less(const Vector3d &p, const Vector3d &q)
+	{
+		return std::lexicographical_compare(p.data(), p.data() + 3, q.data(), q.data() + 3);
+	}
+
+	class MeshSlicer
+	{
+	public:
+		MeshSlicer(const Transform3d &section, DxfData &dd) : section(section), dd(dd), broken(0) {}
+
+		double height(const Vector3d &p) const {
+			return this->section(2, 0) * p[0] + this->section(2, 1) * p[1] + this->section(2, 2) * p[2] + this->section(2, 3);
+		}
+
+		/*!
+			Returns the index of the point where the edge p-q crosses the plane,
+			adding it on the first call for the edge. The point is computed from
+			the ordered end points, so it's identical for both polygons.
+		*/
+		int edgePoint(Vector3d p, Vector3d q, double hp, double hq) {
+			if (lexicographic_less(q, p)) {
+				std::swap(p, q);
+				std::swap(hp, hq);
+			}
+			SliceEdge key(p, q);
+			boost::unordered_map<SliceEdge, int>::iterator it = this->points.find(key);
+			if (it != this->points.end()) return it->second;
+
+			Vector3d v = p + (q - p) * (hp / (hp - hq));
+			Vector3d s = this->section * v;
+			int index = this->dd.addPoint(s[0], s[1]);
+			this->points[key] = index;
+			this->next.push_back(-1);
+			this->hasPrev.push_back(false);
+			return index;
+		}
+
+		void link(int from, int to) {
+			if (this->next[from] >= 0 || this->hasPrev[to]) this->broken++;
+			this->next[from] = to;
+			this->hasPrev[to] = true;
+		}
+
+		void addPolygon(const PolySet::Polygon &poly);
+		int chain();
+
+	private:
+		const Transform3d &section;
+		DxfData &dd;
+		boost::unordered_map<SliceEdge, int> points;
+		std::vector<int> next;
+		std::vector<bool> hasPrev;
+		std::vector<double> heights;
+		std::vector<std::pair<int, bool> > crossings;
+
+	public:
+		int broken;
+	};
+}
+
+/*!
+	Adds the segments where a planar, convex polygon crosses the plane.
+	Vertices on the plane count as below it, which is a consistent
+	perturbation of the plane and keeps every crossing a proper one.
+
+	Polygons are counter-clockwise seen from the outside, so walking the
+	polygon the segment runs from the edge which goes down through the
+	plane to the edge which goes back up. Both polygons sharing an edge
+	then agree on the direction through its point.
+*/
+void MeshSlicer::addPolygon(const PolySet::Polygon &poly)
+{
+	size_t n = poly.size();
+	if (n < 3) return;
+	this->heights.resize(n);
+	bool above = false, below = false;
+	for (size_t i = 0; i < n; i++) {
+		this->heights[i] = height(poly[i]);
+		if (this->heights[i] > 0) above = true;
+		else below = true;
+	}
+	if (!above || !below) return;
+
+	this->crossings.clear();
+	for (size_t i = 0; i < n; i++) {
+		size_t j = (i + 1) % n;
+		bool down = this->heights[i] > 0;
+		if (down == (this->heights[j] > 0)) continue;
+		this->crossings.push_back(std::make_pair(edgePoint(poly[i], poly[j], this->heights[i], this->heights[j]), down));
+	}
+
+	size_t first = 0;
+	while (!this->crossings[first].second) first++;
+	int from = -1;
+	for (size_t k = 0; k < this->crossings.size(); k++) {
+		const std::pair<int, bool> &c = this->crossings[(first + k) % this->crossings.size()];
+		if (c.second) from = c.first;
+		else if (from >= 0) {
+			link(from, c.first);
+			from = -1;
+		}
+	}
+}
+
+/*!
+	Follows the segments into closed outlines. Returns the number of
+	chains which don't close, which only open or non-manifold meshes leave.
+*/
+int MeshSlicer::chain()
+{
+	int open = 0;
+	size_t n = this->next.size();
+	std::vector<bool> visited(n, false);
+	for (size_t i = 0; i < n; i++) {
+		if (this->hasPrev[i] || visited[i]) continue;
+		open++;
+		for (int k = i; k >= 0 && !visited[k]; k = this->next[k]) visited[k] = true;
+	}
+
+	std::vector<int> indices;
+	for (size_t i = 0; i < n; i++) {
+		if (visited[i]) continue;
+		indices.clear();
+		int k = i;
+		do {
+			visited[k] = true;
+			// Vertices on the plane produce the same point for several edges
+			if (indices.empty() || this->dd.points[k] != this->dd.points[indices.back()]) indices.push_back(k);
+			k = this->next[k];
+		} while (k >= 0 && !visited[k]);
+		if (k != int(i)) {
+			open++;
+			continue;
+		}
+		while (indices.size() > 1 && this->dd.points[indices.back()] == this->dd.points[indices.front()]) indices.pop_back();
+		if (indices.size() < 3) continue;
+
+		this->dd.paths.push_back(DxfData::Path());
+		DxfData::Path &path = this->dd.paths.back();
+		path.indices = indices;
+		path.indices.push_back(indices.front());
+		path.is_closed = true;
+	}
+	return open;
+}
+
+/*!
+	Returns the closed outlines where ps, moved by section, crosses the
+	plane z=0, in the same form as CGAL_Nef_polyhedron::convertToDxfData():
+	the points are the x,y coordinates after section, and each path repeats
+	its first point at the end.
+
+	This replaces projection(cut = true) of an imported mesh, without
+	building Nef polyhedra: only polygons crossing the plane are visited
+	beyond the height of their vertices, and segments are joined through
+	a hash of the mesh edges they start and end on. The polygons of ps must
+	be convex, and vertices shared between polygons must have identical
+	coordinates, as for imported STL files.
+*/
+DxfData *slice_mesh(const PolySet &ps, const Transform3d &section)
+{
+	DxfData *dd = new DxfData();
+	MeshSlicer slicer(section, *dd);
+	BOOST_FOREACH(const PolySet::Polygon &poly, ps.polygons) {
+		slicer.addPolygon(poly);
+	}
+	int open = slicer.chain();
+	if (open > 0 || slicer.broken > 0) {
+		PRINTB("WARNING: Mesh section has %d open outlines and %d non-manifold crossings, the mesh isn't closed", open % slicer.broken);
+	}
+	dd->fixup_path_direction();
+	return dd;
+}
@@ -0,0 +1,11 @@
+#ifndef MESHSLICER_H_
+#define MESHSLICER_H_
+
+#include "linalg.h"
+
+class PolySet;
+class DxfData;
+
+DxfData *slice_mesh(const PolySet &ps, const Transform3d &section);
+
+#endif
@@ -5,6 +5,7 @@
 #include "printutils.h"
 #include "builtin.h"
 #include "ModuleCache.h"
+#include "instantiationcache.h"
 
 #include <boost/foreach.hpp>
 
@@ -177,6 +178,7 @@ Value FileContext::evaluate_function(const std::string &name, const EvalContext
 		FileModule *usedmod = ModuleCache::instance()->lookup(m);
 		if (usedmod && 
 				usedmod->scope.functions.find(name) != usedmod->scope.functions.end()) {
+			if (InstantiationCache *cache = InstantiationCache::active()) cache->readLibrary(m, usedmod);
 			FileContext ctx(*usedmod, this->parent);
 			ctx.initializeModule(*usedmod);
 			// FIXME: Set document path
@@ -201,6 +203,7 @@ AbstractNode *FileContext::instantiate_module(const ModuleInstantiation &inst, c
 		// usedmod is NULL if the library wasn't be compiled (error or file-not-found)
 		if (usedmod && 
 				usedmod->scope.modules.find(inst.name()) != usedmod->scope.modules.end()) {
+			if (InstantiationCache *cache = InstantiationCache::active()) cache->readLibrary(m, usedmod);
 			FileContext ctx(*usedmod, this->parent);
 			ctx.initializeModule(*usedmod);
 			// FIXME: Set document path
@@ -49,6 +49,7 @@ public:
 	virtual Value evaluate_function(const std::string &name, const EvalContext *evalctx) const;
 	virtual AbstractNode *instantiate_module(const ModuleInstantiation &inst, 
 																					 const EvalContext *evalctx) const;
+	const FileModule::ModuleContainer &usedLibraries() const { return this->usedlibs; }
 
 private:
 	const FileModule::ModuleContainer &usedlibs;
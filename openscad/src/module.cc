@@ -33,6 +33,7 @@
 #include "function.h"
 #include "printutils.h"
 #include "parsersettings.h"
+#include "instantiationcache.h"
 
 #include <boost/filesystem.hpp>
 namespace fs = boost::filesystem;
@@ -133,13 +134,22 @@ std::string IfElseModuleInstantiation::dump(const std::string &indent) const
 
 AbstractNode *ModuleInstantiation::evaluate(const Context *ctx) const
 {
+	InstantiationCache *cache = InstantiationCache::active();
+	if (cache) {
+		AbstractNode *node = cache->reuse(*this, ctx);
+		if (node) return node;
+		cache->record(*this, ctx);
+	}
+
 	EvalContext c(ctx, this->arguments, &this->scope);
 
 #if 0 && DEBUG
 	PRINT("New eval ctx:");
 	c.dump(NULL, this);
 #endif
+	if (cache) cache->readModule(ctx, this->modname);
 	AbstractNode *node = ctx->instantiate_module(*this, &c); // Passes c as evalctx
+	if (cache) cache->store(node);
 	return node;
 }
 
@@ -160,15 +170,15 @@ Module::~Module()
 class ModRecursionGuard
 {
 public:
-	ModRecursionGuard(const ModuleInstantiation &inst) : inst(inst) { 
-		inst.recursioncount++; 
+	ModRecursionGuard(const ModuleInstantiation &inst) : count(inst.recursioncount.get()) { 
+		count++; 
 	}
 	~ModRecursionGuard() { 
-		inst.recursioncount--; 
+		count--; 
 	}
-	bool recursion_detected() const { return (inst.recursioncount > 1000); }
+	bool recursion_detected() const { return (count > 1000); }
 private:
-	const ModuleInstantiation &inst;
+	int &count;
 };
 
 AbstractNode *Module::instantiate(const Context *ctx, const ModuleInstantiation *inst, const EvalContext *evalctx) const
@@ -217,15 +227,27 @@ std::string Module::dump(const std::string &indent, const std::string &name) con
 }
 
 void FileModule::registerInclude(const std::string &localpath,
-																 const std::string &fullpath)
+																 const std::string &fullpath,
+																 const std::string &sourcepath)
 {
 	struct stat st;
 	memset(&st, 0, sizeof(struct stat));
 	bool valid = stat(fullpath.c_str(), &st) == 0;
-	IncludeFile inc = {fullpath, valid, st.st_mtime};
+	IncludeFile inc = {fullpath, valid, st.st_mtime, sourcepath};
 	this->includes[localpath] = inc;
 }
 
+FileModule::IncludePaths FileModule::includePaths() const
+{
+	IncludePaths paths;
+	BOOST_FOREACH(const FileModule::IncludeContainer::value_type &item, this->includes) {
+		IncludePath &inc = paths[item.first];
+		inc.sourcepath = item.second.sourcepath;
+		inc.fullpath = item.second.filename;
+	}
+	return paths;
+}
+
 bool FileModule::includesChanged() const
 {
 	BOOST_FOREACH(const FileModule::IncludeContainer::value_type &item, this->includes) {
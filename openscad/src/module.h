@@ -12,12 +12,13 @@
 #include "value.h"
 #include "typedefs.h"
 #include "localscope.h"
+#include "recursioncount.h"
 
 class ModuleInstantiation
 {
 public:
 	ModuleInstantiation(const std::string &name = "")
-		: tag_root(false), tag_highlight(false), tag_background(false), recursioncount(0), modname(name) { }
+		: tag_root(false), tag_highlight(false), tag_background(false), modname(name) { }
 	virtual ~ModuleInstantiation();
 
 	virtual std::string dump(const std::string &indent) const;
@@ -39,7 +40,7 @@ public:
 	bool tag_root;
 	bool tag_highlight;
 	bool tag_background;
-	mutable int recursioncount;
+	RecursionCount recursioncount;
 protected:
 	std::string modname;
 	std::string modpath;
@@ -65,6 +66,11 @@ public:
 	virtual std::string dump(const std::string &indent, const std::string &name) const;
 };
 
+// Number of threads on which the iterations of large for loops are
+// instantiated, or 0 for one per core. The default of 1 instantiates
+// them in sequence.
+extern int instantiation_threads;
+
 class Module : public AbstractModule
 {
 public:
@@ -89,13 +95,21 @@ public:
 
 	void setModulePath(const std::string &path) { this->path = path; }
 	const std::string &modulePath() const { return this->path; }
-	void registerInclude(const std::string &localpath, const std::string &fullpath);
+	void registerInclude(const std::string &localpath, const std::string &fullpath, const std::string &sourcepath);
 	bool includesChanged() const;
 	bool handleDependencies();
 	virtual AbstractNode *instantiate(const Context *ctx, const ModuleInstantiation *inst, const EvalContext *evalctx = NULL) const;
 	bool hasIncludes() const { return !this->includes.empty(); }
 	bool usesLibraries() const { return !this->usedlibs.empty(); }
 	bool isHandlingDependencies() const { return this->is_handling_dependencies; }
+	// An included file: the directory it was searched from and the full path it was found at
+	struct IncludePath {
+		std::string sourcepath;
+		std::string fullpath;
+	};
+	// The included files by local path
+	typedef boost::unordered_map<std::string, IncludePath> IncludePaths;
+	IncludePaths includePaths() const;
 
 	typedef boost::unordered_set<std::string> ModuleContainer;
 	ModuleContainer usedlibs;
@@ -104,6 +118,7 @@ private:
 		std::string filename;
 		bool valid;
 		time_t mtime;
+		std::string sourcepath;
 	};
 
 	bool include_modified(const IncludeFile &inc) const;
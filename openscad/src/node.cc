@@ -26,6 +26,7 @@
 
 #include "node.h"
 #include "module.h"
+#include "context.h"
 #include "progress.h"
 #include "visitor.h"
 #include "stl-utils.h"
@@ -39,7 +40,19 @@ size_t AbstractNode::idx_counter;
 AbstractNode::AbstractNode(const ModuleInstantiation *mi)
 {
 	modinst = mi;
-	idx = idx_counter++;
+	idx = Context::threaded ? 0 : idx_counter++;
+}
+
+/*!
+	Numbers the given subtree in preorder, continuing from the counter.
+	Nodes instantiated on several threads, like the iterations of a
+	parallel for loop, are numbered by this once the threads are done, so
+	the numbering doesn't depend on how the threads ran.
+*/
+void AbstractNode::renumber(AbstractNode *node)
+{
+	node->idx = idx_counter++;
+	BOOST_FOREACH(AbstractNode *child, node->children) renumber(child);
 }
 
 AbstractNode::~AbstractNode()
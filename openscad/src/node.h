@@ -15,8 +15,9 @@ void progress_report_fin();
 /*!  
 
 	The node tree is the result of evaluation of a module instantiation
-	tree.  Both the module tree and the node tree are regenerated from
-	scratch for each compile.
+	tree.  The module tree is regenerated from scratch for each compile;
+	the GUI reuses the subtrees of the node tree whose inputs didn't
+	change (see InstantiationCache).
 
  */
 class AbstractNode
@@ -46,6 +47,8 @@ public:
 	size_t index() const { return this->idx; }
 
 	static void resetIndexCounter() { idx_counter = 1; }
+	static size_t indexCounter() { return idx_counter; }
+	static void renumber(AbstractNode *node);
 
 	// FIXME: Make protected
 	std::vector<AbstractNode*> children;
@@ -57,7 +60,7 @@ public:
 	void progress_prepare();
 	void progress_report() const;
 
-	int idx; // Node index (unique per tree)
+	int idx; // Node index (unique per tree, and kept by reused subtrees)
 };
 
 class AbstractIntersectionNode : public AbstractNode
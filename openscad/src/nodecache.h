@@ -8,7 +8,8 @@
 /*!
 	Caches string values per node based on the node.index().
 	The node index guaranteed to be unique per node tree since the index is reset
-	every time a new tree is generated.
+	every time a new tree is generated, or keeps counting when the GUI reuses
+	subtrees of the last one.
 */
 class NodeCache
 {
@@ -44,6 +45,14 @@ public:
 		this->cache.clear();
 	}
 
+	/*! Removes the strings of all nodes whose index isn't set in keep */
+	void retain(const std::vector<bool> &keep) {
+		if (this->cache.size() > keep.size()) this->cache.resize(keep.size());
+		for (size_t i = 0; i < this->cache.size(); i++) {
+			if (!keep[i]) this->cache[i] = std::string();
+		}
+	}
+
 private:
   std::vector<std::string> cache;
 	std::string nullvalue;
@@ -64,7 +64,21 @@ std::string NodeDumper::dumpChildren(const AbstractNode &node)
 */
 Response NodeDumper::visit(State &state, const AbstractNode &node)
 {
-	if (isCached(node)) return PruneTraversal;
+	if (isCached(node)) {
+		// A subtree reused at another depth has to be dumped again
+		if (state.isPrefix()) {
+			const std::string &dump = this->cache[node];
+			if (dump.compare(0, this->currindent.size(), this->currindent) == 0 &&
+					(dump.size() == this->currindent.size() || dump[this->currindent.size()] != '\t')) {
+				return PruneTraversal;
+			}
+			this->cache.remove(node);
+		}
+		else {
+			handleVisitedChildren(state, node);
+			return PruneTraversal;
+		}
+	}
 
 	handleIndent(state);
 	if (state.isPostfix()) {
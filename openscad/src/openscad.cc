@@ -37,6 +37,7 @@
 #include "handle_dep.h"
 #include "parsersettings.h"
 #include "rendersettings.h"
+#include "DiskCache.h"
 
 #include <string>
 #include <vector>
@@ -46,6 +47,7 @@
 #include "CGAL_Nef_polyhedron.h"
 #include "CGALEvaluator.h"
 #include "PolySetCGALEvaluator.h"
+#include "enclosure.h"
 #endif
 
 #include <QApplication>
@@ -66,6 +68,7 @@
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
+#include <boost/thread.hpp>
 #include "boosty.h"
 
 #ifdef _MSC_VER
@@ -83,8 +86,13 @@ static void help(const char *progname)
 	        "%*s[ --camera=translatex,y,z,rotx,y,z,dist | \\\n"
 	        "%*s  --camera=eyex,y,z,centerx,y,z ] \\\n"
 	        "%*s[ --imgsize=width,height ] [ --projection=(o)rtho|(p)ersp] \\\n"
-	        "%*sfilename\n",
-					progname, tab, "", tab, "", tab, "", tab, "", tab, "");
+	        "%*s[ --disk-cache=dir [ --disk-cache-size=MB ] ] [ --instantiation-threads=n ] \\\n"
+	        "%*s[ --cgal-threads=n ] \\\n"
+	        "%*s[ --export-format=stl|binstl|off|ply ] \\\n"
+	        "%*sfilename\n"
+	        "       %s --enclosure target.stl enclosure.stl --insert-dir=x,y,z \\\n"
+	        "%*s--cut-plane=nx,ny,nz,offset [ --voxel-resolution=n ] [ --export-format=... ] -o output.stl\n",
+					progname, tab, "", tab, "", tab, "", tab, "", tab, "", tab, "", tab, "", tab, "", progname, tab, "");
 	exit(1);
 }
 
@@ -155,6 +163,45 @@ Camera get_camera( po::variables_map vm )
 	return camera;
 }
 
+static vector<double> get_numbers(po::variables_map vm, const char *option, size_t count)
+{
+	vector<string> strs;
+	vector<double> numbers;
+	split(strs, vm[option].as<string>(), is_any_of(","));
+	if (strs.size() != count) {
+		fprintf(stderr, "--%s requires %d numbers\n", option, int(count));
+		exit(1);
+	}
+	BOOST_FOREACH(string &s, strs) numbers.push_back(lexical_cast<double>(s));
+	return numbers;
+}
+
+#ifdef ENABLE_CGAL
+/*!
+	Runs the enclosure pipeline from the command line, without the GUI.
+*/
+static int run_enclosure(po::variables_map vm, const char *output_file)
+{
+	vector<string> files = vm["enclosure"].as<vector<string> >();
+	if (files.size() != 2 || !output_file || !vm.count("insert-dir") || !vm.count("cut-plane")) {
+		fprintf(stderr, "--enclosure requires a target and an enclosure file, --insert-dir, --cut-plane and -o\n");
+		exit(1);
+	}
+	vector<double> dir = get_numbers(vm, "insert-dir", 3);
+	vector<double> plane = get_numbers(vm, "cut-plane", 4);
+	int resolution = vm.count("voxel-resolution") ? vm["voxel-resolution"].as<int>() : 256;
+	export_format_e format = export_format(vm.count("export-format") ? vm["export-format"].as<string>() :
+																				 QFileInfo(output_file).suffix().toLower().toStdString());
+	if (format == EXPORT_UNKNOWN) {
+		fprintf(stderr, "Unknown export format for output file %s\n", output_file);
+		exit(1);
+	}
+
+	return enclosure_batch(files[0], files[1], Vector3d(dir[0], dir[1], dir[2]),
+												 Vector3d(plane[0], plane[1], plane[2]), plane[3], output_file, format, resolution);
+}
+#endif
+
 int main(int argc, char **argv)
 {
 	int rc = 0;
@@ -200,6 +247,15 @@ int main(int argc, char **argv)
 		("camera", po::value<string>(), "parameters for camera when exporting png")
 	        ("imgsize", po::value<string>(), "=width,height for exporting png")
 		("projection", po::value<string>(), "(o)rtho or (p)erspective when exporting png")
+		("enclosure", po::value<vector<string> >()->multitoken(), "target and enclosure STL files for the enclosure pipeline")
+		("insert-dir", po::value<string>(), "=x,y,z direction in which the target is inserted")
+		("cut-plane", po::value<string>(), "=nx,ny,nz,offset plane along which the enclosure is split")
+		("voxel-resolution", po::value<int>(), "grid resolution of the insertion sweep")
+		("disk-cache", po::value<string>(), "directory in which evaluated geometry and parsed libraries are cached across sessions")
+		("disk-cache-size", po::value<int>(), "size limit of the disk cache in MB")
+		("instantiation-threads", po::value<int>(), "threads on which the iterations of large for loops are instantiated, 0 for one per core")
+		("cgal-threads", po::value<int>(), "threads on which independent CGAL operations are evaluated, 0 for one per core")
+		("export-format", po::value<string>(), "=stl|binstl|off|ply format of exported meshes, instead of the one implied by the suffix")
 		("o,o", po::value<string>(), "out-file")
 		("s,s", po::value<string>(), "stl-file")
 		("x,x", po::value<string>(), "dxf-file")
@@ -297,6 +353,33 @@ int main(int argc, char **argv)
 
 	parser_init(QApplication::instance()->applicationDirPath().toLocal8Bit().constData());
 
+	if (vm.count("disk-cache-size")) {
+		DiskCache::instance()->setMaxSize(size_t(vm["disk-cache-size"].as<int>()) * 1024 * 1024);
+	}
+	if (vm.count("disk-cache")) {
+		DiskCache::instance()->setDirectory(vm["disk-cache"].as<string>());
+	}
+	if (vm.count("instantiation-threads")) {
+		instantiation_threads = vm["instantiation-threads"].as<int>();
+	}
+#ifdef ENABLE_CGAL
+	if (vm.count("cgal-threads")) {
+		cgal_threads = vm["cgal-threads"].as<int>();
+	}
+#endif
+
+	if (vm.count("enclosure")) {
+#ifdef ENABLE_CGAL
+		rc = run_enclosure(vm, output_file);
+		DiskCache::instance()->flush();
+		Builtins::instance(true);
+		return rc;
+#else
+		fprintf(stderr, "OpenSCAD has been compiled without CGAL support!\n");
+		exit(1);
+#endif
+	}
+
 	// Initialize global visitors
 	NodeCache nodecache;
 	NodeDumper dumper(nodecache);
@@ -308,15 +391,14 @@ int main(int argc, char **argv)
 
 	if (output_file)
 	{
-		const char *stl_output_file = NULL;
-		const char *off_output_file = NULL;
+		const char *mesh_output_file = NULL;
 		const char *dxf_output_file = NULL;
 		const char *csg_output_file = NULL;
 		const char *png_output_file = NULL;
 
 		QString suffix = QFileInfo(output_file).suffix().toLower();
-		if (suffix == "stl") stl_output_file = output_file;
-		else if (suffix == "off") off_output_file = output_file;
+		export_format_e mesh_format = export_format(suffix.toStdString());
+		if (mesh_format != EXPORT_UNKNOWN) mesh_output_file = output_file;
 		else if (suffix == "dxf") dxf_output_file = output_file;
 		else if (suffix == "csg") csg_output_file = output_file;
 		else if (suffix == "png") png_output_file = output_file;
@@ -325,6 +407,14 @@ int main(int argc, char **argv)
 			exit(1);
 		}
 
+		if (vm.count("export-format")) {
+			mesh_format = export_format(vm["export-format"].as<string>());
+			if (mesh_format == EXPORT_UNKNOWN || !mesh_output_file) {
+				fprintf(stderr, "--export-format requires stl, binstl, off or ply and a mesh output file\n");
+				exit(1);
+			}
+		}
+
 		if (!filename) help(argv[0]);
 
 		// Top context - this context only holds builtins
@@ -394,8 +484,7 @@ int main(int argc, char **argv)
 			if (deps_output_file) {
 				std::string deps_out( deps_output_file );
 				std::string geom_out;
-				if ( stl_output_file ) geom_out = std::string(stl_output_file);
-				else if ( off_output_file ) geom_out = std::string(off_output_file);
+				if ( mesh_output_file ) geom_out = std::string(mesh_output_file);
 				else if ( dxf_output_file ) geom_out = std::string(dxf_output_file);
 				else if ( png_output_file ) geom_out = std::string(png_output_file);
 				else {
@@ -410,26 +499,7 @@ int main(int argc, char **argv)
 				}
 			}
 
-			if (stl_output_file) {
-				if (root_N.dim != 3) {
-					fprintf(stderr, "Current top level object is not a 3D object.\n");
-					exit(1);
-				}
-				if (!root_N.p3->is_simple()) {
-					fprintf(stderr, "Object isn't a valid 2-manifold! Modify your design.\n");
-					exit(1);
-				}
-				std::ofstream fstream(stl_output_file);
-				if (!fstream.is_open()) {
-					PRINTB("Can't open file \"%s\" for export", stl_output_file);
-				}
-				else {
-					export_stl(&root_N, fstream);
-					fstream.close();
-				}
-			}
-			
-			if (off_output_file) {
+			if (mesh_output_file) {
 				if (root_N.dim != 3) {
 					fprintf(stderr, "Current top level object is not a 3D object.\n");
 					exit(1);
@@ -438,12 +508,12 @@ int main(int argc, char **argv)
 					fprintf(stderr, "Object isn't a valid 2-manifold! Modify your design.\n");
 					exit(1);
 				}
-				std::ofstream fstream(off_output_file);
+				std::ofstream fstream(mesh_output_file, export_format_is_binary(mesh_format) ? std::ios::out|std::ios::binary : std::ios::out);
 				if (!fstream.is_open()) {
-					PRINTB("Can't open file \"%s\" for export", off_output_file);
+					PRINTB("Can't open file \"%s\" for export", mesh_output_file);
 				}
 				else {
-					export_off(&root_N, fstream);
+					export_mesh(&root_N, mesh_format, fstream);
 					fstream.close();
 				}
 			}
@@ -528,6 +598,7 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
+	DiskCache::instance()->flush();
 	Builtins::instance(true);
 
 	return rc;
@@ -262,14 +262,11 @@ TOK_UNDEF {
   $$ = new Expression(Value::undefined);
 } |
 TOK_ID {
-  $$ = new Expression();
-  $$->type = "L";
-  $$->var_name = $1;
+  $$ = new Expression(Expression::LOOKUP, $1);
   free($1);
 } |
 expr '.' TOK_ID {
-  $$ = new Expression("N", $1);
-  $$->var_name = $3;
+  $$ = new Expression(Expression::MEMBER, $3, $1);
   free($3);
 } |
 TOK_STRING {
@@ -281,15 +278,13 @@ TOK_NUMBER {
 } |
 '[' expr ':' expr ']' {
   Expression *e_one = new Expression(Value(1.0));
-  $$ = new Expression();
-  $$->type = "R";
+  $$ = new Expression(Expression::RANGE);
   $$->children.push_back($2);
   $$->children.push_back(e_one);
   $$->children.push_back($4);
 } |
 '[' expr ':' expr ':' expr ']' {
-  $$ = new Expression();
-  $$->type = "R";
+  $$ = new Expression(Expression::RANGE);
   $$->children.push_back($2);
   $$->children.push_back($4);
   $$->children.push_back($6);
@@ -301,69 +296,67 @@ TOK_NUMBER {
   $$ = $2;
 } |
 expr '*' expr {
-  $$ = new Expression("*", $1, $3);
+  $$ = new Expression(Expression::MULTIPLY, $1, $3);
 } |
 expr '/' expr {
-  $$ = new Expression("/", $1, $3);
+  $$ = new Expression(Expression::DIVIDE, $1, $3);
 } |
 expr '%' expr {
-  $$ = new Expression("%", $1, $3);
+  $$ = new Expression(Expression::MODULO, $1, $3);
 } |
 expr '+' expr {
-  $$ = new Expression("+", $1, $3);
+  $$ = new Expression(Expression::PLUS, $1, $3);
 } |
 expr '-' expr {
-  $$ = new Expression("-", $1, $3);
+  $$ = new Expression(Expression::MINUS, $1, $3);
 } |
 expr '<' expr {
-  $$ = new Expression("<", $1, $3);
+  $$ = new Expression(Expression::LESS, $1, $3);
 } |
 expr LE expr {
-  $$ = new Expression("<=", $1, $3);
+  $$ = new Expression(Expression::LESS_EQUAL, $1, $3);
 } |
 expr EQ expr {
-  $$ = new Expression("==", $1, $3);
+  $$ = new Expression(Expression::EQUAL, $1, $3);
 } |
 expr NE expr {
-  $$ = new Expression("!=", $1, $3);
+  $$ = new Expression(Expression::NOT_EQUAL, $1, $3);
 } |
 expr GE expr {
-  $$ = new Expression(">=", $1, $3);
+  $$ = new Expression(Expression::GREATER_EQUAL, $1, $3);
 } |
 expr '>' expr {
-  $$ = new Expression(">", $1, $3);
+  $$ = new Expression(Expression::GREATER, $1, $3);
 } |
 expr AND expr {
-  $$ = new Expression("&&", $1, $3);
+  $$ = new Expression(Expression::AND, $1, $3);
 } |
 expr OR expr {
-  $$ = new Expression("||", $1, $3);
+  $$ = new Expression(Expression::OR, $1, $3);
 } |
 '+' expr {
   $$ = $2;
 } |
 '-' expr {
-  $$ = new Expression("I", $2);
+  $$ = new Expression(Expression::INVERT, $2);
 } |
 '!' expr {
-  $$ = new Expression("!", $2);
+  $$ = new Expression(Expression::NOT, $2);
 } |
 '(' expr ')' {
   $$ = $2;
 } |
 expr '?' expr ':' expr {
-  $$ = new Expression();
-  $$->type = "?:";
+  $$ = new Expression(Expression::CONDITION);
   $$->children.push_back($1);
   $$->children.push_back($3);
   $$->children.push_back($5);
 } |
 expr '[' expr ']' {
-  $$ = new Expression("[]", $1, $3);
+  $$ = new Expression(Expression::INDEX, $1, $3);
 } |
 TOK_ID '(' arguments_call ')' {
-  $$ = new Expression();
-  $$->type = "F";
+  $$ = new Expression(Expression::CALL);
   $$->call_funcname = $1;
   $$->call_arguments = *$3;
   free($1);
@@ -375,7 +368,7 @@ optional_commas:
 
 vector_expr:
 expr {
-  $$ = new Expression("V", $1);
+  $$ = new Expression(Expression::VECTOR, $1);
 } |
 vector_expr ',' optional_commas expr {
   $$ = $1;
@@ -2,9 +2,11 @@
 #define PARSERSETTINGS_H_
 
 #include <string>
+#include <vector>
 #include "boosty.h"
 
 extern int parser_error_pos;
+extern std::vector<std::string> librarypath;
 
 void parser_init(const std::string &applicationpath);
 void add_librarydir(const std::string &libdir);
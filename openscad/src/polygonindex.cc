@@ -0,0 +1,226 @@
+#include "polygonindex.h"
+#include "dxfdata.h"
+
+#include <algorithm>
+#include <limits>
+#include <math.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+
+/*!
+	Indexes the edges of all paths of dd. Every path is treated as closed,
+	as in pnpoly().
+*/
+PolygonIndex::PolygonIndex(const DxfData &dd)
+	: minx(0), miny(0), maxx(0), maxy(0), bandHeight(1), cellSize(1), cols(0), rows(0)
+{
+	BOOST_FOREACH(const DxfData::Path &path, dd.paths) {
+		const std::vector<int> &indices = path.indices;
+		if (indices.empty()) continue;
+		for (size_t i = 0, j = indices.size() - 1; i < indices.size(); j = i++) {
+			const Vector2d &p1 = dd.points[indices[i]];
+			const Vector2d &p2 = dd.points[indices[j]];
+			Edge e = { p1[0], p1[1], p2[0], p2[1] };
+			this->edges.push_back(e);
+		}
+	}
+	if (this->edges.empty()) return;
+
+	this->minx = this->maxx = this->edges[0].x1;
+	this->miny = this->maxy = this->edges[0].y1;
+	BOOST_FOREACH(const Edge &e, this->edges) {
+		this->minx = std::min(this->minx, e.x1);
+		this->maxx = std::max(this->maxx, e.x1);
+		this->miny = std::min(this->miny, e.y1);
+		this->maxy = std::max(this->maxy, e.y1);
+	}
+	double w = this->maxx - this->minx, h = this->maxy - this->miny;
+	int n = int(this->edges.size());
+
+	// About one band per edge, so most bands hold a handful of edges
+	int bands = std::min(n, 1 << 16);
+	if (h > 0) this->bandHeight = h / bands;
+	this->bandStart.assign(bands + 1, 0);
+	BOOST_FOREACH(const Edge &e, this->edges) {
+		for (int b = band(std::min(e.y1, e.y2)); b <= band(std::max(e.y1, e.y2)); b++) this->bandStart[b + 1]++;
+	}
+	for (int b = 0; b < bands; b++) this->bandStart[b + 1] += this->bandStart[b];
+	this->bandEdges.resize(this->bandStart[bands]);
+	{
+		std::vector<size_t> next(this->bandStart.begin(), this->bandStart.end() - 1);
+		for (int i = 0; i < n; i++) {
+			const Edge &e = this->edges[i];
+			for (int b = band(std::min(e.y1, e.y2)); b <= band(std::max(e.y1, e.y2)); b++) this->bandEdges[next[b]++] = i;
+		}
+	}
+
+	// About one cell per edge
+	double extent = std::max(w, h);
+	if (extent > 0) this->cellSize = extent / ceil(sqrt(double(n)));
+	this->cols = int(w / this->cellSize) + 1;
+	this->rows = int(h / this->cellSize) + 1;
+	this->cellStart.assign(size_t(this->cols) * this->rows + 1, 0);
+	for (int pass = 0; pass < 2; pass++) {
+		std::vector<size_t> next;
+		if (pass == 1) {
+			for (size_t c = 1; c < this->cellStart.size(); c++) this->cellStart[c] += this->cellStart[c - 1];
+			this->cellEdges.resize(this->cellStart.back());
+			next.assign(this->cellStart.begin(), this->cellStart.end() - 1);
+		}
+		for (int i = 0; i < n; i++) {
+			const Edge &e = this->edges[i];
+			int cx0 = std::min(this->cols - 1, int((std::min(e.x1, e.x2) - this->minx) / this->cellSize));
+			int cx1 = std::min(this->cols - 1, int((std::max(e.x1, e.x2) - this->minx) / this->cellSize));
+			int cy0 = std::min(this->rows - 1, int((std::min(e.y1, e.y2) - this->miny) / this->cellSize));
+			int cy1 = std::min(this->rows - 1, int((std::max(e.y1, e.y2) - this->miny) / this->cellSize));
+			for (int cy = cy0; cy <= cy1; cy++) {
+				for (int cx = cx0; cx <= cx1; cx++) {
+					size_t c = size_t(cy) * this->cols + cx;
+					if (pass == 0) this->cellStart[c + 1]++;
+					else this->cellEdges[next[c]++] = i;
+				}
+			}
+		}
+	}
+}
+
+int PolygonIndex::band(double y) const
+{
+	int bands = int(this->bandStart.size()) - 1;
+	return std::max(0, std::min(bands - 1, int(floor((y - this->miny) / this->bandHeight))));
+}
+
+/*!
+	Appends the x coordinates where the horizontal line at y crosses the
+	outlines to xs, in ascending order. An edge is crossed if its end
+	points lie on different sides of the line, with the same half-open
+	rule as pnpoly().
+*/
+void PolygonIndex::crossings(double y, std::vector<double> &xs) const
+{
+	xs.clear();
+	if (this->edges.empty() || y < this->miny || y > this->maxy) return;
+	int b = band(y);
+	for (size_t k = this->bandStart[b]; k < this->bandStart[b + 1]; k++) {
+		const Edge &e = this->edges[this->bandEdges[k]];
+		if ((e.y1 > y) != (e.y2 > y)) {
+			xs.push_back((e.x2 - e.x1) * (y - e.y1) / (e.y2 - e.y1) + e.x1);
+		}
+	}
+	std::sort(xs.begin(), xs.end());
+}
+
+/*!
+	Returns true if (x,y) lies inside the outlines by the even-odd rule.
+*/
+bool PolygonIndex::inside(double x, double y) const
+{
+	std::vector<double> xs;
+	crossings(y, xs);
+	size_t right = xs.end() - std::upper_bound(xs.begin(), xs.end(), x);
+	return right % 2 == 1;
+}
+
+/*!
+	Classifies the n points (x0 + i * dx, y), for dx > 0, in one pass over
+	the crossings of the row.
+*/
+void PolygonIndex::classifyRow(double y, double x0, double dx, int n, std::vector<bool> &inside) const
+{
+	std::vector<double> xs;
+	crossings(y, xs);
+	inside.assign(n, false);
+	size_t k = 0;
+	for (int i = 0; i < n; i++) {
+		double x = x0 + i * dx;
+		while (k < xs.size() && xs[k] <= x) k++;
+		inside[i] = (xs.size() - k) % 2 == 1;
+	}
+}
+
+double PolygonIndex::edgeDistance(const Edge &e, double x, double y) const
+{
+	double px = e.x2 - e.x1;
+	double py = e.y2 - e.y1;
+	double len2 = px * px + py * py;
+	double u = len2 > 0 ? ((x - e.x1) * px + (y - e.y1) * py) / len2 : 0;
+	if (u > 1) u = 1;
+	else if (u < 0) u = 0;
+	double dx = e.x1 + u * px - x;
+	double dy = e.y1 + u * py - y;
+	return sqrt(dx * dx + dy * dy);
+}
+
+/*!
+	Returns the distance from (x,y) to the nearest edge. With a limit >= 0,
+	only edges closer than limit are searched for, and limit is returned
+	if there are none.
+*/
+double PolygonIndex::distance(double x, double y, double limit) const
+{
+	double best = limit >= 0 ? limit : std::numeric_limits<double>::infinity();
+	if (this->edges.empty()) return best;
+
+	int cx = std::max(0, std::min(this->cols - 1, int(floor((x - this->minx) / this->cellSize))));
+	int cy = std::max(0, std::min(this->rows - 1, int(floor((y - this->miny) / this->cellSize))));
+	int maxr = std::max(std::max(cx, this->cols - 1 - cx), std::max(cy, this->rows - 1 - cy));
+	for (int r = 0; r <= maxr; r++) {
+		// Cells on ring r are at least r - 1 cells away from the point
+		if ((r - 1) * this->cellSize >= best) break;
+		for (int j = std::max(0, cy - r); j <= std::min(this->rows - 1, cy + r); j++) {
+			int step = (j == cy - r || j == cy + r) ? 1 : 2 * r;
+			for (int i = cx - r; i <= cx + r; i += step) {
+				if (i < 0 || i >= this->cols) continue;
+				size_t c = size_t(j) * this->cols + i;
+				for (size_t k = this->cellStart[c]; k < this->cellStart[c + 1]; k++) {
+					best = std::min(best, edgeDistance(this->edges[this->cellEdges[k]], x, y));
+				}
+			}
+		}
+	}
+	return best;
+}
+
+/*!
+	Returns the distance to the outlines, negative inside.
+*/
+double PolygonIndex::signedDistance(double x, double y, double limit) const
+{
+	double d = distance(x, y, limit);
+	return inside(x, y) ? -d : d;
+}
+
+void PolygonIndex::fillRows(DistanceField *field, double limit, int y0, int y1) const
+{
+	std::vector<bool> inside;
+	for (int y = y0; y < y1; y++) {
+		double py = field->y0 + y * field->spacing;
+		classifyRow(py, field->x0, field->spacing, field->width, inside);
+		double *row = &field->values[size_t(y) * field->width];
+		for (int x = 0; x < field->width; x++) {
+			double d = distance(field->x0 + x * field->spacing, py, limit);
+			row[x] = inside[x] ? -d : d;
+		}
+	}
+}
+
+/*!
+	Rasterizes the signed distance to the outlines on a width x height grid
+	of samples, negative inside. With a limit >= 0, distances are clamped
+	to limit, which makes the rasterization much faster. The rows are
+	split between up to threads threads.
+*/
+DistanceField *PolygonIndex::signedDistanceField(double x0, double y0, double spacing, int width, int height,
+																								 double limit, int threads) const
+{
+	DistanceField *field = new DistanceField(x0, y0, spacing, width, height);
+	threads = std::max(1, std::min(threads, height));
+	boost::thread_group group;
+	for (int i = 0; i < threads; i++) {
+		group.create_thread(boost::bind(&PolygonIndex::fillRows, this, field, limit,
+																		height * i / threads, height * (i + 1) / threads));
+	}
+	group.join_all();
+	return field;
+}
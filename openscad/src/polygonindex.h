@@ -0,0 +1,83 @@
+#ifndef POLYGONINDEX_H_
+#define POLYGONINDEX_H_
+
+#include "linalg.h"
+#include <vector>
+
+class DxfData;
+
+/*!
+	Samples on a regular 2D grid, stored row by row along x. Sample (x,y)
+	lies at (x0 + x * spacing, y0 + y * spacing).
+*/
+class DistanceField
+{
+public:
+	DistanceField(double x0, double y0, double spacing, int width, int height)
+		: x0(x0), y0(y0), spacing(spacing), width(width), height(height), values(size_t(width) * height) {}
+
+	double x0, y0, spacing;
+	int width, height;
+	std::vector<double> values;
+
+	double get(int x, int y) const { return this->values[size_t(y) * this->width + x]; }
+	Vector2d position(int x, int y) const { return Vector2d(this->x0 + x * this->spacing, this->y0 + y * this->spacing); }
+};
+
+/*!
+	Spatial index over the outlines of a DxfData, answering the point
+	queries of screw placement without visiting every edge.
+
+	Inside/outside classification uses the even-odd rule over all paths,
+	exactly like a pnpoly() loop. Whole rows of samples are classified
+	from the sorted crossings of the row with the outlines; the edges
+	crossing a row are found through a table of horizontal bands.
+
+	Distances to the outlines are answered by searching a uniform grid of
+	edge buckets ring by ring around the query point.
+*/
+class PolygonIndex
+{
+public:
+	PolygonIndex(const DxfData &dd);
+
+	bool isEmpty() const { return this->edges.empty(); }
+	double minX() const { return this->minx; }
+	double minY() const { return this->miny; }
+	double maxX() const { return this->maxx; }
+	double maxY() const { return this->maxy; }
+
+	bool inside(double x, double y) const;
+	void classifyRow(double y, double x0, double dx, int n, std::vector<bool> &inside) const;
+	double distance(double x, double y, double limit = -1) const;
+	double signedDistance(double x, double y, double limit = -1) const;
+	DistanceField *signedDistanceField(double x0, double y0, double spacing, int width, int height,
+																		 double limit = -1, int threads = 1) const;
+
+private:
+	struct Edge {
+		double x1, y1, x2, y2;
+	};
+
+	int band(double y) const;
+	void crossings(double y, std::vector<double> &xs) const;
+	double edgeDistance(const Edge &e, double x, double y) const;
+	void fillRows(DistanceField *field, double limit, int y0, int y1) const;
+
+	std::vector<Edge> edges;
+	double minx, miny, maxx, maxy;
+
+	// Horizontal bands, listing the edges whose y range overlaps them
+	double bandHeight;
+	std::vector<size_t> bandStart;
+	std::vector<int> bandEdges;
+
+	// Uniform grid of square cells, listing the edges whose bounding box
+	// overlaps them
+	double cellSize;
+	int cols, rows;
+	std::vector<size_t> cellStart;
+	std::vector<int> cellEdges;
+};
+
+#endif
@@ -1,11 +1,19 @@
 #include "printutils.h"
 #include <sstream>
 #include <stdio.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
 
 std::list<std::string> print_messages_stack;
 OutputHandlerFunc *outputhandler = NULL;
 void *outputhandler_data = NULL;
 
+// Geometry may be evaluated on several threads at once
+static boost::mutex print_mutex;
+
+// Messages printed on the calling thread since print_capture_begin()
+static boost::thread_specific_ptr<std::vector<std::string> > print_capture;
+
 void set_output_handler(OutputHandlerFunc *newhandler, void *userdata)
 {
 	outputhandler = newhandler;
@@ -29,14 +37,40 @@ void print_messages_pop()
 	}
 }
 
+/*!
+	Collects the messages printed on the calling thread until
+	print_capture_end() instead of outputting them. Threads instantiating
+	for loop iterations use this, so the messages can be printed in the
+	order of the iterations.
+*/
+void print_capture_begin()
+{
+	print_capture.reset(new std::vector<std::string>);
+}
+
+std::vector<std::string> print_capture_end()
+{
+	std::vector<std::string> messages;
+	if (print_capture.get()) messages.swap(*print_capture);
+	print_capture.reset();
+	return messages;
+}
+
 void PRINT(const std::string &msg)
 {
 	if (msg.empty()) return;
-	if (print_messages_stack.size() > 0) {
-		if (!print_messages_stack.back().empty()) {
-			print_messages_stack.back() += "\n";
+	if (print_capture.get()) {
+		print_capture->push_back(msg);
+		return;
+	}
+	{
+		boost::mutex::scoped_lock lock(print_mutex);
+		if (print_messages_stack.size() > 0) {
+			if (!print_messages_stack.back().empty()) {
+				print_messages_stack.back() += "\n";
+			}
+			print_messages_stack.back() += msg;
 		}
-		print_messages_stack.back() += msg;
 	}
 	PRINT_NOCACHE(msg);
 }
@@ -44,6 +78,7 @@ void PRINT(const std::string &msg)
 void PRINT_NOCACHE(const std::string &msg)
 {
 	if (msg.empty()) return;
+	boost::mutex::scoped_lock lock(print_mutex);
 	if (!outputhandler) {
 		fprintf(stderr, "%s\n", msg.c_str());
 	} else {
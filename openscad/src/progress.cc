@@ -1,5 +1,6 @@
 #include "progress.h"
 #include "node.h"
+#include <boost/thread/mutex.hpp>
 
 int progress_report_count;
 void (*progress_report_f)(const class AbstractNode*, void*, int);
@@ -20,8 +21,12 @@ void progress_report_fin()
 	progress_report_userdata = NULL;
 }
 
+// Subtrees may be evaluated concurrently, but the callbacks don't expect that
+static boost::mutex progress_mutex;
+
 void progress_update(const AbstractNode *node, int mark)
 {
+	boost::mutex::scoped_lock lock(progress_mutex);
 	if (progress_report_f)
 		progress_report_f(node, progress_report_userdata, mark);
 }
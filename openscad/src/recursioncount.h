@@ -0,0 +1,37 @@
+#ifndef RECURSIONCOUNT_H_
+#define RECURSIONCOUNT_H_
+
+#include "context.h"
+#include <boost/thread/tss.hpp>
+#include <boost/unordered_map.hpp>
+
+/*!
+	Nesting depth of the calls through a function call or module
+	instantiation, used for recursion detection.
+
+	While Context::threaded is set, the threads instantiating for loop
+	iterations share the module tree, so each counts in a map of its own.
+*/
+class RecursionCount
+{
+public:
+	RecursionCount() : count(0) {}
+
+	int &get() const {
+		if (!Context::threaded) return this->count;
+		Counts *counts = threadCounts().get();
+		if (!counts) threadCounts().reset(counts = new Counts);
+		return (*counts)[this];
+	}
+
+private:
+	typedef boost::unordered_map<const RecursionCount*, int> Counts;
+	static boost::thread_specific_ptr<Counts> &threadCounts() {
+		static boost::thread_specific_ptr<Counts> counts;
+		return counts;
+	}
+
+	mutable int count;
+};
+
+#endif
@@ -30,6 +30,7 @@
 #include "printutils.h"
 #include "fileutils.h"
 #include "builtin.h"
+#include "instantiationcache.h"
 #include "polyset.h"
 #include "visitor.h"
 #include "PolySetEvaluator.h"
@@ -71,6 +72,7 @@ AbstractNode *RotateExtrudeModule::instantiate(const Context *ctx, const ModuleI
 	if (!file.isUndefined()) {
 		PRINT("DEPRECATED: Support for reading files in rotate_extrude will be removed in future releases. Use a child import() instead.");
 		node->filename = lookup_file(file.toString(), inst->path(), c.documentPath());
+		if (InstantiationCache *cache = InstantiationCache::active()) cache->readFile(node->filename);
 	}
 
 	node->layername = layer.isUndefined() ? "" : layer.toString();
@@ -0,0 +1,254 @@
+#include "screwplacer.h"
+#include "polygonindex.h"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <math.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int.hpp>
+
+// Size of the level 0 blocks in samples, and the distance in blocks of
+// the same level beyond which blocks are expanded instead of refined
+static const int BLOCK = 8;
+static const int NEAR_BLOCKS = 3;
+
+/*!
+	Samples with a negative distance are inside; those at a distance of at
+	least clearance inside may hold screws.
+*/
+ScrewPlacer::ScrewPlacer(const DistanceField &field, double clearance)
+	: iterations(1000), separation(30), startAttempts(1000),
+		width(field.width), height(field.height), x0(field.x0), y0(field.y0), spacing(field.spacing),
+		allowed(field.values.size(), false), inside(0)
+{
+	Level level0;
+	level0.cols = std::max(1, (this->width + BLOCK - 1) / BLOCK);
+	level0.rows = std::max(1, (this->height + BLOCK - 1) / BLOCK);
+	int blocks = level0.cols * level0.rows;
+
+	this->blockStart.assign(blocks + 1, 0);
+	for (int y = 0; y < this->height; y++) {
+		for (int x = 0; x < this->width; x++) {
+			double dist = field.values[size_t(y) * this->width + x];
+			if (dist >= 0) continue;
+			this->blockStart[(y / BLOCK) * level0.cols + x / BLOCK + 1]++;
+			if (-dist >= clearance) {
+				this->allowed[y * this->width + x] = true;
+				this->candidates.push_back(y * this->width + x);
+			}
+		}
+	}
+	for (int b = 0; b < blocks; b++) this->blockStart[b + 1] += this->blockStart[b];
+	this->inside = this->blockStart[blocks];
+
+	this->xs.resize(this->inside);
+	this->ys.resize(this->inside);
+	{
+		std::vector<size_t> next(this->blockStart.begin(), this->blockStart.end() - 1);
+		for (int y = 0; y < this->height; y++) {
+			for (int x = 0; x < this->width; x++) {
+				if (field.values[size_t(y) * this->width + x] >= 0) continue;
+				size_t k = next[(y / BLOCK) * level0.cols + x / BLOCK]++;
+				this->xs[k] = this->x0 + x * this->spacing;
+				this->ys[k] = this->y0 + y * this->spacing;
+			}
+		}
+	}
+
+	level0.count.setZero(blocks);
+	level0.cx.setZero(blocks);
+	level0.cy.setZero(blocks);
+	level0.sxx.setZero(blocks);
+	level0.sxy.setZero(blocks);
+	level0.syy.setZero(blocks);
+	for (int b = 0; b < blocks; b++) {
+		size_t s0 = this->blockStart[b], n = this->blockStart[b + 1] - s0;
+		if (n == 0) continue;
+		Eigen::ArrayXd bx = this->xs.segment(s0, n), by = this->ys.segment(s0, n);
+		level0.count[b] = n;
+		level0.cx[b] = bx.mean();
+		level0.cy[b] = by.mean();
+		bx -= level0.cx[b];
+		by -= level0.cy[b];
+		level0.sxx[b] = bx.square().sum();
+		level0.sxy[b] = (bx * by).sum();
+		level0.syy[b] = by.square().sum();
+	}
+	this->levels.push_back(level0);
+
+	// Merge 2 x 2 blocks, moving the moments to the new centroid, until the
+	// top level is small
+	while (this->levels.back().cols * this->levels.back().rows > 16) {
+		const Level &below = this->levels.back();
+		Level level;
+		level.cols = (below.cols + 1) / 2;
+		level.rows = (below.rows + 1) / 2;
+		int n = level.cols * level.rows;
+		level.count.setZero(n);
+		level.cx.setZero(n);
+		level.cy.setZero(n);
+		level.sxx.setZero(n);
+		level.sxy.setZero(n);
+		level.syy.setZero(n);
+		for (int j = 0; j < below.rows; j++) {
+			for (int i = 0; i < below.cols; i++) {
+				int c = j * below.cols + i, b = (j / 2) * level.cols + i / 2;
+				level.count[b] += below.count[c];
+				level.cx[b] += below.count[c] * below.cx[c];
+				level.cy[b] += below.count[c] * below.cy[c];
+			}
+		}
+		for (int b = 0; b < n; b++) {
+			if (level.count[b] == 0) continue;
+			level.cx[b] /= level.count[b];
+			level.cy[b] /= level.count[b];
+		}
+		for (int j = 0; j < below.rows; j++) {
+			for (int i = 0; i < below.cols; i++) {
+				int c = j * below.cols + i, b = (j / 2) * level.cols + i / 2;
+				double dx = below.cx[c] - level.cx[b], dy = below.cy[c] - level.cy[b];
+				level.sxx[b] += below.sxx[c] + below.count[c] * dx * dx;
+				level.sxy[b] += below.sxy[c] + below.count[c] * dx * dy;
+				level.syy[b] += below.syy[c] + below.count[c] * dy * dy;
+			}
+		}
+		this->levels.push_back(level);
+	}
+}
+
+Vector2d ScrewPlacer::position(int sample) const
+{
+	return Vector2d(this->x0 + (sample % this->width) * this->spacing, this->y0 + (sample / this->width) * this->spacing);
+}
+
+/*!
+	Returns the summed distance from all inside samples to the given one.
+*/
+double ScrewPlacer::sampleEnergy(int sample) const
+{
+	Vector2d p = position(sample);
+	int px = (sample % this->width) / BLOCK, py = (sample / this->width) / BLOCK;
+	double energy = 0;
+
+	std::vector<int> blocks, refined;
+	const Level &top = this->levels.back();
+	for (int b = 0; b < top.cols * top.rows; b++) blocks.push_back(b);
+	for (int l = this->levels.size() - 1; l >= 0; l--) {
+		const Level &level = this->levels[l];
+		refined.clear();
+		BOOST_FOREACH(int b, blocks) {
+			if (level.count[b] == 0) continue;
+			int i = b % level.cols, j = b / level.cols;
+			if (std::max(abs(i - (px >> l)), abs(j - (py >> l))) > NEAR_BLOCKS) {
+				// |R + d| ~ |R| + (|d|^2 - (R.d)^2 / |R|^2) / 2|R|, summed over the
+				// offsets d from the centroid, whose first moments vanish
+				double dx = level.cx[b] - p[0], dy = level.cy[b] - p[1];
+				double r2 = dx * dx + dy * dy, r = sqrt(r2);
+				energy += level.count[b] * r + (level.sxx[b] + level.syy[b]) / (2 * r) -
+					(level.sxx[b] * dx * dx + 2 * level.sxy[b] * dx * dy + level.syy[b] * dy * dy) / (2 * r2 * r);
+			}
+			else if (l > 0) {
+				const Level &below = this->levels[l - 1];
+				for (int cj = 2 * j; cj < std::min(2 * j + 2, below.rows); cj++) {
+					for (int ci = 2 * i; ci < std::min(2 * i + 2, below.cols); ci++) refined.push_back(cj * below.cols + ci);
+				}
+			}
+			else {
+				size_t s0 = this->blockStart[b], n = this->blockStart[b + 1] - s0;
+				energy += ((this->xs.segment(s0, n) - p[0]).square() + (this->ys.segment(s0, n) - p[1]).square()).sqrt().sum();
+			}
+		}
+		blocks.swap(refined);
+	}
+	return energy;
+}
+
+void ScrewPlacer::run(int count, unsigned int seed, std::vector<int> &samples, double &energy) const
+{
+	boost::mt19937 rng(seed);
+	boost::uniform_int<size_t> pick(0, this->candidates.size() - 1);
+	samples.resize(count);
+	for (int attempt = 0; attempt < std::max(1, this->startAttempts); attempt++) {
+		bool separated = true;
+		for (int s = 0; s < count; s++) {
+			samples[s] = this->candidates[pick(rng)];
+			for (int t = 0; t < s && separated; t++) {
+				separated = (position(samples[s]) - position(samples[t])).norm() > this->separation;
+			}
+		}
+		if (separated) break;
+	}
+
+	boost::unordered_map<int, double> cache;
+	std::vector<double> current(count);
+	for (int s = 0; s < count; s++) {
+		boost::unordered_map<int, double>::iterator it = cache.find(samples[s]);
+		current[s] = it != cache.end() ? it->second : (cache[samples[s]] = sampleEnergy(samples[s]));
+	}
+
+	for (int k = 0; k < this->iterations; k++) {
+		int bestScrew = -1, bestSample = -1;
+		double bestDelta = 0;
+		for (int s = 0; s < count; s++) {
+			int x = samples[s] % this->width, y = samples[s] / this->width;
+			int moves[4][2] = { { x - 1, y }, { x + 1, y }, { x, y - 1 }, { x, y + 1 } };
+			for (int m = 0; m < 4; m++) {
+				if (moves[m][0] < 0 || moves[m][0] >= this->width || moves[m][1] < 0 || moves[m][1] >= this->height) continue;
+				int sample = moves[m][1] * this->width + moves[m][0];
+				if (!this->allowed[sample]) continue;
+				boost::unordered_map<int, double>::iterator it = cache.find(sample);
+				double e = it != cache.end() ? it->second : (cache[sample] = sampleEnergy(sample));
+				if (e - current[s] < bestDelta) {
+					bestDelta = e - current[s];
+					bestScrew = s;
+					bestSample = sample;
+				}
+			}
+		}
+		if (bestScrew < 0) break;
+		samples[bestScrew] = bestSample;
+		current[bestScrew] += bestDelta;
+	}
+
+	energy = 0;
+	for (int s = 0; s < count; s++) energy += current[s];
+}
+
+void ScrewPlacer::runAll(int count, unsigned int seed, int first, int step,
+												 std::vector<std::vector<int> > &samples, std::vector<double> &energies) const
+{
+	for (size_t i = first; i < samples.size(); i += step) {
+		run(count, seed + i, samples[i], energies[i]);
+	}
+}
+
+/*!
+	Places count screws, making starts runs on up to threads threads.
+	Returns false if there is no sample which may hold a screw.
+*/
+bool ScrewPlacer::place(int count, std::vector<Vector2d> &screws, double &energy,
+												int starts, int threads, unsigned int seed) const
+{
+	if (count <= 0 || this->candidates.empty()) return false;
+	starts = std::max(1, starts);
+	threads = std::max(1, std::min(threads, starts));
+
+	std::vector<std::vector<int> > samples(starts);
+	std::vector<double> energies(starts);
+	boost::thread_group group;
+	for (int i = 0; i < threads; i++) {
+		group.create_thread(boost::bind(&ScrewPlacer::runAll, this, count, seed, i, threads,
+																		boost::ref(samples), boost::ref(energies)));
+	}
+	group.join_all();
+
+	int best = std::min_element(energies.begin(), energies.end()) - energies.begin();
+	screws.clear();
+	for (int s = 0; s < count; s++) screws.push_back(position(samples[best][s]));
+	energy = energies[best];
+	return true;
+}
@@ -0,0 +1,77 @@
+#ifndef SCREWPLACER_H_
+#define SCREWPLACER_H_
+
+#include "linalg.h"
+#include <vector>
+
+class DistanceField;
+
+/*!
+	Places screws on the samples of a cross section, given as a signed
+	distance field, minimizing the summed distance between the inside
+	samples and the screws.
+
+	Screws may only be placed on samples at least clearance inside the
+	outline. Each run starts from random samples which are at least
+	separation apart, if such samples are found, and then repeatedly moves
+	the screw whose move to a neighbouring sample lowers the energy the
+	most, until no move does or the iteration limit is reached. Several
+	runs can be made on separate threads; the one with the lowest energy
+	wins.
+
+	The energy is the sum over the screws of the summed distances from the
+	inside samples to that screw, so a move only changes the term of the
+	moved screw. Terms are cached per sample within a run.
+
+	A term is evaluated over a pyramid of blocks of samples, from the
+	coarsest level down: blocks which are far enough from the screw are
+	expanded to second order around their centroid, using their sample
+	count and central second moments, and nearer blocks are refined. The
+	samples of the blocks next to the screw are summed exactly with
+	vectorized Eigen array kernels over a structure-of-arrays copy of the
+	samples. This makes a term cost a few thousand operations instead of
+	one distance per inside sample.
+*/
+class ScrewPlacer
+{
+public:
+	ScrewPlacer(const DistanceField &field, double clearance);
+
+	int iterations;
+	double separation;
+	int startAttempts;
+
+	size_t insideCount() const { return this->inside; }
+	size_t allowedCount() const { return this->candidates.size(); }
+
+	bool place(int count, std::vector<Vector2d> &screws, double &energy,
+						 int starts = 1, int threads = 1, unsigned int seed = 0) const;
+	double sampleEnergy(int sample) const;
+
+private:
+	void run(int count, unsigned int seed, std::vector<int> &samples, double &energy) const;
+	void runAll(int count, unsigned int seed, int first, int step,
+							std::vector<std::vector<int> > &samples, std::vector<double> &energies) const;
+	Vector2d position(int sample) const;
+
+	int width, height;
+	double x0, y0, spacing;
+	std::vector<char> allowed;
+	std::vector<int> candidates;
+	size_t inside;
+
+	// The inside samples, grouped by level 0 block
+	Eigen::ArrayXd xs, ys;
+	std::vector<size_t> blockStart;
+
+	// Level 0 blocks are BLOCK x BLOCK samples, and each level merges 2 x 2
+	// blocks of the one below. Per block: sample count, centroid and
+	// central second moments
+	struct Level {
+		int cols, rows;
+		Eigen::ArrayXd count, cx, cy, sxx, sxy, syy;
+	};
+	std::vector<Level> levels;
+};
+
+#endif
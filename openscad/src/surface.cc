@@ -33,6 +33,7 @@
 #include "fileutils.h"
 #include "handle_dep.h" // handle_dep()
 #include "visitor.h"
+#include "instantiationcache.h"
 
 #include <sstream>
 #include <fstream>
@@ -84,6 +85,7 @@ AbstractNode *SurfaceModule::instantiate(const Context *ctx, const ModuleInstant
 
 	Value fileval = c.lookup_variable("file");
 	node->filename = lookup_file(fileval.isUndefined() ? "" : fileval.toString(), inst->path(), c.documentPath());
+	if (InstantiationCache *cache = InstantiationCache::active()) cache->readFile(node->filename);
 
 	Value center = c.lookup_variable("center", true);
 	if (center.type() == Value::BOOL) {
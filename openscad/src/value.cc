@@ -30,6 +30,7 @@
 #include <math.h>
 #include <assert.h>
 #include <sstream>
+#include <algorithm>
 #include <boost/foreach.hpp>
 #include <boost/variant/apply_visitor.hpp>
 #include <boost/variant/static_visitor.hpp>
@@ -92,22 +93,22 @@ Value::Value(double v) : value(v)
   //  std::cout << "creating double " << v << "\n";
 }
 
-Value::Value(const std::string &v) : value(v)
+Value::Value(const std::string &v) : value(SharedString(v))
 {
   //  std::cout << "creating string\n";
 }
 
-Value::Value(const char *v) : value(std::string(v))
+Value::Value(const char *v) : value(SharedString(v))
 {
   //  std::cout << "creating string from char *\n";
 }
 
-Value::Value(char v) : value(std::string(1, v))
+Value::Value(char v) : value(SharedString(std::string(1, v)))
 {
   //  std::cout << "creating string from char\n";
 }
 
-Value::Value(const VectorType &v) : value(v)
+Value::Value(const VectorType &v) : value(SharedVector(v))
 {
   //  std::cout << "creating vector\n";
 }
@@ -142,10 +143,10 @@ bool Value::toBool() const
     return boost::get<double>(this->value)!= 0;
     break;
   case STRING:
-    return boost::get<std::string>(this->value).size() > 0;
+    return boost::get<SharedString>(this->value)->size() > 0;
     break;
   case VECTOR:
-    return boost::get<VectorType >(this->value).size() > 0;
+    return boost::get<SharedVector>(this->value)->size() > 0;
     break;
   case RANGE:
     return true;
@@ -222,12 +223,16 @@ public:
     return v ? "true" : "false";
   }
 
-  std::string operator()(const Value::VectorType &v) const {
+  std::string operator()(const Value::SharedString &s) const {
+    return *s;
+  }
+
+  std::string operator()(const Value::SharedVector &v) const {
     std::stringstream stream;
     stream << '[';
-    for (size_t i = 0; i < v.size(); i++) {
+    for (size_t i = 0; i < v->size(); i++) {
       if (i > 0) stream << ", ";
-      stream << v[i];
+      stream << (*v)[i];
     }
     stream << ']';
     return stream.str();
@@ -247,8 +252,8 @@ const Value::VectorType &Value::toVector() const
 {
   static VectorType empty;
   
-  const VectorType *v = boost::get<VectorType>(&this->value);
-  if (v) return *v;
+  const SharedVector *v = boost::get<SharedVector>(&this->value);
+  if (v) return **v;
   else return empty;
 }
 
@@ -345,8 +350,8 @@ public:
     return op1 < op2;
   }
 
-  bool operator()(const std::string &op1, const std::string &op2) const {
-    return op1 < op2;
+  bool operator()(const Value::SharedString &op1, const Value::SharedString &op2) const {
+    return *op1 < *op2;
   }
 };
 
@@ -361,8 +366,8 @@ public:
     return op1 > op2;
   }
 
-  bool operator()(const std::string &op1, const std::string &op2) const {
-    return op1 > op2;
+  bool operator()(const Value::SharedString &op1, const Value::SharedString &op2) const {
+    return *op1 > *op2;
   }
 };
 
@@ -397,10 +402,14 @@ public:
     return Value(op1 + op2);
   }
 
-  Value operator()(const Value::VectorType &op1, const Value::VectorType &op2) const {
+  Value operator()(const Value::SharedVector &op1, const Value::SharedVector &op2) const {
+    size_t n = std::min(op1->size(), op2->size());
     Value::VectorType sum;
-    for (size_t i = 0; i < op1.size() && i < op2.size(); i++) {
-      sum.push_back(op1[i] + op2[i]);
+    sum.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+      double a, b;
+      if ((*op1)[i].getDouble(a) && (*op2)[i].getDouble(b)) sum.push_back(Value(a + b));
+      else sum.push_back((*op1)[i] + (*op2)[i]);
     }
     return Value(sum);
   }
@@ -422,10 +431,14 @@ public:
     return Value(op1 - op2);
   }
 
-  Value operator()(const Value::VectorType &op1, const Value::VectorType &op2) const {
+  Value operator()(const Value::SharedVector &op1, const Value::SharedVector &op2) const {
+    size_t n = std::min(op1->size(), op2->size());
     Value::VectorType sum;
-    for (size_t i = 0; i < op1.size() && i < op2.size(); i++) {
-      sum.push_back(op1[i] - op2[i]);
+    sum.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+      double a, b;
+      if ((*op1)[i].getDouble(a) && (*op2)[i].getDouble(b)) sum.push_back(Value(a - b));
+      else sum.push_back((*op1)[i] - (*op2)[i]);
     }
     return Value(sum);
   }
@@ -436,12 +449,57 @@ Value Value::operator-(const Value &v) const
   return boost::apply_visitor(minus_visitor(), this->value, v.value);
 }
 
+/*!
+  Copies the first n elements of vec to out, if they are all numbers.
+*/
+static bool get_numbers(const Value::VectorType &vec, size_t n, double *out)
+{
+  if (vec.size() < n) return false;
+  for (size_t i = 0; i < n; i++) {
+    if (!vec[i].getDouble(out[i])) return false;
+  }
+  return true;
+}
+
+/*!
+  Copies the first cols elements of each row of a matrix to a contiguous
+  row-major array, if they are all numbers.
+*/
+static bool get_matrix(const Value::VectorType &rows, size_t cols, std::vector<double> &m)
+{
+  m.resize(rows.size() * cols);
+  for (size_t j = 0; j < rows.size(); j++) {
+    if (rows[j].type() != Value::VECTOR || !get_numbers(rows[j].toVector(), cols, &m[j * cols])) return false;
+  }
+  return true;
+}
+
+/*!
+  Multiplies the row vector v by the rows x cols matrix m, both contiguous.
+*/
+static Value mult_vec_mat(const double *v, const double *m, size_t rows, size_t cols)
+{
+  Value::VectorType dstv;
+  dstv.reserve(cols);
+  for (size_t i = 0; i < cols; i++) {
+    double r_e = 0.0;
+    for (size_t j = 0; j < rows; j++) r_e += v[j] * m[j * cols + i];
+    dstv.push_back(Value(r_e));
+  }
+  return Value(dstv);
+}
+
 Value Value::multvecnum(const Value &vecval, const Value &numval)
 {
   // Vector * Number
+  const VectorType &vec = vecval.toVector();
+  double num = numval.toDouble();
   VectorType dstv;
-  BOOST_FOREACH(const Value &val, vecval.toVector()) {
-    dstv.push_back(val * numval);
+  dstv.reserve(vec.size());
+  BOOST_FOREACH(const Value &val, vec) {
+    double d;
+    if (val.getDouble(d)) dstv.push_back(Value(d * num));
+    else dstv.push_back(val * numval);
   }
   return Value(dstv);
 }
@@ -450,21 +508,21 @@ Value Value::multmatvec(const Value &matrixval, const Value &vectorval)
 {
   const VectorType &matrixvec = matrixval.toVector();
   const VectorType &vectorvec = vectorval.toVector();
+  size_t n = vectorvec.size();
 
   // Matrix * Vector
+  std::vector<double> v(n), row(n);
+  if (!get_numbers(vectorvec, n, &v[0])) return Value();
   VectorType dstv;
+  dstv.reserve(matrixvec.size());
   for (size_t i=0;i<matrixvec.size();i++) {
     if (matrixvec[i].type() != VECTOR || 
-        matrixvec[i].toVector().size() != vectorvec.size()) {
+        matrixvec[i].toVector().size() != n ||
+        !get_numbers(matrixvec[i].toVector(), n, &row[0])) {
       return Value();
     }
     double r_e = 0.0;
-    for (size_t j=0;j<matrixvec[i].toVector().size();j++) {
-      if (matrixvec[i].toVector()[j].type() != NUMBER || vectorvec[j].type() != NUMBER) {
-        return Value();
-      }
-      r_e += matrixvec[i].toVector()[j].toDouble() * vectorvec[j].toDouble();
-    }
+    for (size_t j=0;j<n;j++) r_e += row[j] * v[j];
     dstv.push_back(Value(r_e));
   }
   return Value(dstv);
@@ -474,22 +532,13 @@ Value Value::multvecmat(const Value &vectorval, const Value &matrixval)
 {
   const VectorType &vectorvec = vectorval.toVector();
   const VectorType &matrixvec = matrixval.toVector();
-  assert(vectorvec.size() == matrixvec.size());
+  if (vectorvec.size() != matrixvec.size()) return Value::undefined;
   // Vector * Matrix
-  VectorType dstv;
-  for (size_t i=0;i<matrixvec[0].toVector().size();i++) {
-    double r_e = 0.0;
-    for (size_t j=0;j<vectorvec.size();j++) {
-      if (matrixvec[j].type() != VECTOR ||
-          matrixvec[j].toVector()[i].type() != NUMBER || 
-          vectorvec[j].type() != NUMBER) {
-        return Value::undefined;
-      }
-      r_e += vectorvec[j].toDouble() * matrixvec[j].toVector()[i].toDouble();
-    }
-    dstv.push_back(Value(r_e));
-  }
-  return Value(dstv);
+  size_t rows = matrixvec.size(), cols = matrixvec[0].toVector().size();
+  if (cols == 0) return Value(VectorType());
+  std::vector<double> v(rows), m;
+  if (!get_numbers(vectorvec, rows, &v[0]) || !get_matrix(matrixvec, cols, m)) return Value::undefined;
+  return mult_vec_mat(&v[0], &m[0], rows, cols);
 }
 
 Value Value::operator*(const Value &v) const
@@ -511,10 +560,11 @@ Value Value::operator*(const Value &v) const
         // Vector dot product.
         double r = 0.0;
         for (size_t i=0;i<vec1.size();i++) {
-          if (vec1[i].type() != NUMBER || vec2[i].type() != NUMBER) {
+          double a, b;
+          if (!vec1[i].getDouble(a) || !vec2[i].getDouble(b)) {
             return Value::undefined;
           }
-          r += (vec1[i].toDouble() * vec2[i].toDouble());
+          r += a * b;
         }
         return Value(r);
     } else if (vec1[0].type() == VECTOR && vec2[0].type() == NUMBER &&
@@ -525,10 +575,17 @@ Value Value::operator*(const Value &v) const
       return multvecmat(vec1, vec2);
     } else if (vec1[0].type() == VECTOR && vec2[0].type() == VECTOR &&
                vec1[0].toVector().size() == vec2.size()) {
-      // Matrix * Matrix
+      // Matrix * Matrix, with the right hand side flattened once for all rows
+      size_t rows = vec2.size(), cols = vec2[0].toVector().size();
+      std::vector<double> m, row(rows);
+      bool numeric = get_matrix(vec2, cols, m);
       VectorType dstv;
+      dstv.reserve(vec1.size());
       BOOST_FOREACH(const Value &srcrow, vec1) {
-        dstv.push_back(multvecmat(srcrow, vec2));
+        if (cols == 0 && srcrow.toVector().size() == rows) dstv.push_back(Value(VectorType()));
+        else if (numeric && srcrow.toVector().size() == rows && get_numbers(srcrow.toVector(), rows, &row[0]))
+          dstv.push_back(mult_vec_mat(&row[0], &m[0], rows, cols));
+        else dstv.push_back(Value::undefined);
       }
       return Value(dstv);
     }
@@ -543,17 +600,25 @@ Value Value::operator/(const Value &v) const
   }
   else if (this->type() == VECTOR && v.type() == NUMBER) {
     const VectorType &vec = this->toVector();
+    double num = v.toDouble();
     VectorType dstv;
+    dstv.reserve(vec.size());
     BOOST_FOREACH(const Value &vecval, vec) {
-      dstv.push_back(vecval / v);
+      double d;
+      if (vecval.getDouble(d)) dstv.push_back(Value(d / num));
+      else dstv.push_back(vecval / v);
     }
     return Value(dstv);
   }
   else if (this->type() == NUMBER && v.type() == VECTOR) {
     const VectorType &vec = v.toVector();
+    double num = this->toDouble();
     VectorType dstv;
+    dstv.reserve(vec.size());
     BOOST_FOREACH(const Value &vecval, vec) {
-      dstv.push_back(*this / vecval);
+      double d;
+      if (vecval.getDouble(d)) dstv.push_back(Value(num / d));
+      else dstv.push_back(*this / vecval);
     }
     return Value(dstv);
   }
@@ -576,8 +641,11 @@ Value Value::operator-() const
   else if (this->type() == VECTOR) {
     const VectorType &vec = this->toVector();
     VectorType dstv;
+    dstv.reserve(vec.size());
     BOOST_FOREACH(const Value &vecval, vec) {
-      dstv.push_back(-vecval);
+      double d;
+      if (vecval.getDouble(d)) dstv.push_back(Value(-d));
+      else dstv.push_back(-vecval);
     }
     return Value(dstv);
   }
@@ -599,19 +667,19 @@ Value Value::operator-() const
 class bracket_visitor : public boost::static_visitor<Value>
 {
 public:
-  Value operator()(const std::string &str, const double &idx) const {
+  Value operator()(const Value::SharedString &str, const double &idx) const {
     int i = int(idx);
     Value v;
-    if (i >= 0 && i < str.size()) {
-      v = Value(str[int(idx)]);
+    if (i >= 0 && i < str->size()) {
+      v = Value((*str)[int(idx)]);
       //      std::cout << "bracket_visitor: " <<  v << "\n";
     }
     return v;
   }
 
-  Value operator()(const Value::VectorType &vec, const double &idx) const {
+  Value operator()(const Value::SharedVector &vec, const double &idx) const {
     int i = int(idx);
-    if (i >= 0 && i < vec.size()) return vec[int(idx)];
+    if (i >= 0 && i < vec->size()) return (*vec)[int(idx)];
     return Value::undefined;
   }
 
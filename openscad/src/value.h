@@ -8,6 +8,8 @@
 #ifndef Q_MOC_RUN
 #include <boost/variant.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
 #endif
 
 class QuotedString : public std::string
@@ -46,6 +48,26 @@ public:
 
   typedef std::vector<Value> VectorType;
 
+  /*!
+    Immutable payload shared between the copies of a Value, so copying a
+    string or a vector, like a long list of points, only updates a
+    reference count.
+  */
+  template <typename T> class Shared
+  {
+  public:
+    explicit Shared(const T &v) : ptr(boost::make_shared<T>(v)) {}
+    const T &operator*() const { return *this->ptr; }
+    const T *operator->() const { return this->ptr.get(); }
+    bool operator==(const Shared &other) const {
+      return this->ptr == other.ptr || *this->ptr == *other.ptr;
+    }
+  private:
+    boost::shared_ptr<const T> ptr;
+  };
+  typedef Shared<std::string> SharedString;
+  typedef Shared<VectorType> SharedVector;
+
   enum ValueType {
     UNDEFINED,
     BOOL,
@@ -114,7 +136,7 @@ public:
     return stream;
   }
 
-  typedef boost::variant< boost::blank, bool, double, std::string, VectorType, RangeType > Variant;
+  typedef boost::variant< boost::blank, bool, double, SharedString, SharedVector, RangeType > Variant;
 
 private:
   static Value multvecnum(const Value &vecval, const Value &numval);
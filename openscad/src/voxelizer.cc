@@ -0,0 +1,430 @@
+#include "voxelizer.h"
+#include "polyset.h"
+
+#include <algorithm>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+
+/*!
+	Converts a closed triangle mesh into a solid VoxelGrid.
+
+	This replaces the external binvox tool. It runs in two passes, both split
+	into z slabs which are processed by separate threads. Each thread only ever
+	touches the rows of its own slab, so no locking is needed and the result
+	does not depend on the number of threads.
+
+	1) Surface: every voxel whose box overlaps a triangle is set, using the
+	   separating axis triangle/box test by Tomas Akenine-Moeller.
+	2) Interior: a ray is cast along +x through the center of every (y,z) row.
+	   The crossings with the mesh are sorted and the voxels between each pair
+	   of crossings are filled (even-odd rule).
+*/
+
+namespace {
+	struct Triangle {
+		Vector3d p[3];
+	};
+
+	inline bool axisSeparates(const Vector3d &axis, const Vector3d v[3], const Vector3d &h)
+	{
+		double p0 = axis.dot(v[0]), p1 = axis.dot(v[1]), p2 = axis.dot(v[2]);
+		double r = h[0] * fabs(axis[0]) + h[1] * fabs(axis[1]) + h[2] * fabs(axis[2]);
+		return std::min(p0, std::min(p1, p2)) > r || std::max(p0, std::max(p1, p2)) < -r;
+	}
+
+	/*!
+		Returns true if the triangle overlaps the axis aligned box with the given
+		center and half size.
+	*/
+	bool triBoxOverlap(const Vector3d &center, const Vector3d &h, const Triangle &t)
+	{
+		const Vector3d v[3] = { t.p[0] - center, t.p[1] - center, t.p[2] - center };
+
+		// The box normals
+		for (int i = 0; i < 3; i++) {
+			if (std::min(v[0][i], std::min(v[1][i], v[2][i])) > h[i] ||
+					std::max(v[0][i], std::max(v[1][i], v[2][i])) < -h[i]) return false;
+		}
+
+		// The triangle normal
+		const Vector3d e[3] = { v[1] - v[0], v[2] - v[1], v[0] - v[2] };
+		Vector3d n = e[0].cross(e[1]);
+		double r = h[0] * fabs(n[0]) + h[1] * fabs(n[1]) + h[2] * fabs(n[2]);
+		if (fabs(n.dot(v[0])) > r) return false;
+
+		// The nine edge/box-axis cross products
+		for (int i = 0; i < 3; i++) {
+			if (axisSeparates(Vector3d(0, -e[i][2], e[i][1]), v, h)) return false;
+			if (axisSeparates(Vector3d(e[i][2], 0, -e[i][0]), v, h)) return false;
+			if (axisSeparates(Vector3d(-e[i][1], e[i][0], 0), v, h)) return false;
+		}
+		return true;
+	}
+
+	inline int clampIndex(double v, int size)
+	{
+		if (v < 0) return 0;
+		if (v > size - 1) return size - 1;
+		return int(v);
+	}
+
+	void rasterizeSurface(const std::vector<Triangle> &tris, VoxelGrid &grid, int z0, int z1)
+	{
+		double s = grid.voxelSize();
+		Vector3d h(s / 2, s / 2, s / 2);
+		BOOST_FOREACH(const Triangle &t, tris) {
+			Vector3d lo, hi;
+			for (int i = 0; i < 3; i++) {
+				lo[i] = std::min(t.p[0][i], std::min(t.p[1][i], t.p[2][i]));
+				hi[i] = std::max(t.p[0][i], std::max(t.p[1][i], t.p[2][i]));
+			}
+			int kz0 = std::max(z0, clampIndex(floor((lo[2] - grid.translate[2]) / s), grid.depth));
+			int kz1 = std::min(z1 - 1, clampIndex(floor((hi[2] - grid.translate[2]) / s), grid.depth));
+			if (kz0 > kz1) continue;
+			int ky0 = clampIndex(floor((lo[1] - grid.translate[1]) / s), grid.height);
+			int ky1 = clampIndex(floor((hi[1] - grid.translate[1]) / s), grid.height);
+			int kx0 = clampIndex(floor((lo[0] - grid.translate[0]) / s), grid.width);
+			int kx1 = clampIndex(floor((hi[0] - grid.translate[0]) / s), grid.width);
+			for (int z = kz0; z <= kz1; z++) {
+				for (int y = ky0; y <= ky1; y++) {
+					for (int x = kx0; x <= kx1; x++) {
+						if (grid.get(x, y, z)) continue;
+						if (triBoxOverlap(grid.voxelMin(x, y, z) + h, h, t)) grid.set(x, y, z);
+					}
+				}
+			}
+		}
+	}
+
+	/*!
+		2D edge function of the (y,z) projection. The endpoints are put in a
+		canonical order first, so the two triangles sharing an edge get exactly
+		negated values and a ray hitting the edge is counted exactly once.
+	*/
+	inline double edgeFunction(const Vector2d &p, const Vector2d &q, const Vector2d &r, bool &topleft)
+	{
+		bool swapped = q[0] < p[0] || (q[0] == p[0] && q[1] < p[1]);
+		const Vector2d &a = swapped ? q : p;
+		const Vector2d &b = swapped ? p : q;
+		double w = (b[0] - a[0]) * (r[1] - a[1]) - (b[1] - a[1]) * (r[0] - a[0]);
+		Vector2d d = q - p;
+		topleft = d[1] < 0 || (d[1] == 0 && d[0] < 0);
+		return swapped ? -w : w;
+	}
+
+	inline bool covers(double w, bool topleft)
+	{
+		return w > 0 || (w == 0 && topleft);
+	}
+
+	void fillInterior(const std::vector<Triangle> &tris, VoxelGrid &grid, int z0, int z1)
+	{
+		double s = grid.voxelSize();
+		const Vector3d &t0 = grid.translate;
+		std::vector<std::vector<double> > crossings(size_t(z1 - z0) * grid.height);
+
+		BOOST_FOREACH(const Triangle &t, tris) {
+			Vector2d a(t.p[0][1], t.p[0][2]), b(t.p[1][1], t.p[1][2]), c(t.p[2][1], t.p[2][2]);
+			double xa = t.p[0][0], xb = t.p[1][0], xc = t.p[2][0];
+			double area = (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+			if (area == 0) continue;
+			if (area < 0) {
+				std::swap(b, c);
+				std::swap(xb, xc);
+				area = -area;
+			}
+			// Rows whose center lies within the projected bounding box
+			int ky0 = std::max(0, int(ceil((std::min(a[0], std::min(b[0], c[0])) - t0[1]) / s - 0.5)));
+			int ky1 = std::min(grid.height - 1, int(floor((std::max(a[0], std::max(b[0], c[0])) - t0[1]) / s - 0.5)));
+			int kz0 = std::max(z0, int(ceil((std::min(a[1], std::min(b[1], c[1])) - t0[2]) / s - 0.5)));
+			int kz1 = std::min(z1 - 1, int(floor((std::max(a[1], std::max(b[1], c[1])) - t0[2]) / s - 0.5)));
+			for (int z = kz0; z <= kz1; z++) {
+				for (int y = ky0; y <= ky1; y++) {
+					Vector2d p(t0[1] + (y + 0.5) * s, t0[2] + (z + 0.5) * s);
+					bool tl0, tl1, tl2;
+					double w0 = edgeFunction(b, c, p, tl0);
+					double w1 = edgeFunction(c, a, p, tl1);
+					double w2 = edgeFunction(a, b, p, tl2);
+					if (covers(w0, tl0) && covers(w1, tl1) && covers(w2, tl2)) {
+						crossings[size_t(z - z0) * grid.height + y].push_back((w0 * xa + w1 * xb + w2 * xc) / area);
+					}
+				}
+			}
+		}
+
+		for (int z = z0; z < z1; z++) {
+			for (int y = 0; y < grid.height; y++) {
+				std::vector<double> &row = crossings[size_t(z - z0) * grid.height + y];
+				std::sort(row.begin(), row.end());
+				// An odd number of crossings means the mesh isn't closed; ignore the last one
+				for (size_t i = 0; i + 1 < row.size(); i += 2) {
+					int x0 = std::max(0, int(ceil((row[i] - t0[0]) / s - 0.5)));
+					int x1 = std::min(grid.width - 1, int(floor((row[i + 1] - t0[0]) / s - 0.5)));
+					if (x0 <= x1) grid.fillRow(y, z, x0, x1);
+				}
+			}
+		}
+	}
+
+	inline int popcount64(uint64_t w)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_popcountll(w);
+#else
+		int n = 0;
+		for (; w; w &= w - 1) n++;
+		return n;
+#endif
+	}
+}
+
+VoxelGrid::VoxelGrid(int width, int height, int depth)
+	: width(width), height(height), depth(depth), scale(1.0), translate(0, 0, 0)
+{
+	this->words.resize(size_t(depth) * height * wordsPerRow(), 0);
+}
+
+/*!
+	Sets the voxels x0..x1 (inclusive) of the given row.
+*/
+void VoxelGrid::fillRow(int y, int z, int x0, int x1)
+{
+	uint64_t *row = &this->words[rowIndex(y, z)];
+	int w0 = x0 >> 6, w1 = x1 >> 6;
+	uint64_t first = ~uint64_t(0) << (x0 & 63);
+	uint64_t last = ~uint64_t(0) >> (63 - (x1 & 63));
+	if (w0 == w1) {
+		row[w0] |= first & last;
+		return;
+	}
+	row[w0] |= first;
+	for (int w = w0 + 1; w < w1; w++) row[w] = ~uint64_t(0);
+	row[w1] |= last;
+}
+
+/*!
+	Returns the n (<= 64) voxels starting at x in the given row as bits,
+	with voxel x in bit 0. Voxels outside the grid read as empty.
+*/
+uint64_t VoxelGrid::getRun(int x, int y, int z, int n) const
+{
+	if (y < 0 || z < 0 || y >= this->height || z >= this->depth || x >= this->width) return 0;
+	int shift = 0;
+	if (x < 0) {
+		shift = -x;
+		n -= shift;
+		x = 0;
+		if (n <= 0) return 0;
+	}
+	const uint64_t *row = &this->words[rowIndex(y, z)];
+	int w = x >> 6, o = x & 63;
+	uint64_t bits = row[w] >> o;
+	if (o > 0 && o + n > 64 && w + 1 < wordsPerRow()) bits |= row[w + 1] << (64 - o);
+	if (n < 64) bits &= (uint64_t(1) << n) - 1;
+	return bits << shift;
+}
+
+size_t VoxelGrid::count() const
+{
+	size_t n = 0;
+	BOOST_FOREACH(uint64_t w, this->words) n += popcount64(w);
+	return n;
+}
+
+/*!
+	Voxelizes the given PolySet into a resolution^3 grid fitted to its bounding
+	box. If threads is 0, one thread per hardware core is used.
+	Returns NULL if the PolySet is empty or 2D.
+*/
+VoxelGrid *voxelize(const PolySet &ps, int resolution, int threads)
+{
+	if (ps.empty() || ps.is2d || resolution < 1) return NULL;
+
+	std::vector<Triangle> tris;
+	tris.reserve(ps.polygons.size());
+	BOOST_FOREACH(const PolySet::Polygon &poly, ps.polygons) {
+		for (size_t i = 2; i < poly.size(); i++) {
+			Triangle t;
+			t.p[0] = poly[0];
+			t.p[1] = poly[i - 1];
+			t.p[2] = poly[i];
+			tris.push_back(t);
+		}
+	}
+
+	BoundingBox bbox = ps.getBoundingBox();
+	VoxelGrid *grid = new VoxelGrid(resolution, resolution, resolution);
+	grid->translate = bbox.min();
+	grid->scale = bbox.sizes().maxCoeff();
+	if (grid->scale <= 0) return grid;
+
+	if (threads <= 0) threads = boost::thread::hardware_concurrency();
+	threads = std::max(1, std::min(threads, resolution));
+
+	for (int pass = 0; pass < 2; pass++) {
+		boost::thread_group group;
+		for (int i = 0; i < threads; i++) {
+			int z0 = resolution * i / threads;
+			int z1 = resolution * (i + 1) / threads;
+			if (pass == 0) {
+				group.create_thread(boost::bind(&rasterizeSurface, boost::cref(tris), boost::ref(*grid), z0, z1));
+			}
+			else {
+				group.create_thread(boost::bind(&fillInterior, boost::cref(tris), boost::ref(*grid), z0, z1));
+			}
+		}
+		group.join_all();
+	}
+
+	return grid;
+}
+
+namespace {
+	/*!
+		Transposes a 64x64 bit matrix in place, so that bit j of a[i] ends up
+		as bit i of a[j] (Hacker's Delight, 7-3).
+	*/
+	void transpose64(uint64_t a[64])
+	{
+		uint64_t m = 0x00000000FFFFFFFFULL;
+		for (int j = 32; j != 0; j >>= 1, m ^= m << j) {
+			for (int k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+				uint64_t t = ((a[k] >> j) ^ a[k | j]) & m;
+				a[k] ^= t << j;
+				a[k | j] ^= t;
+			}
+		}
+	}
+
+	/*!
+		Swaps the x (axis 0) or y (axis 1) axis of the grid with z.
+		Swapping y only moves whole rows, swapping x transposes 64x64 blocks.
+	*/
+	void swap_axes(VoxelGrid &grid, int axis)
+	{
+		VoxelGrid result(axis == 0 ? grid.depth : grid.width,
+										 axis == 1 ? grid.depth : grid.height,
+										 axis == 0 ? grid.width : grid.height);
+		if (axis == 1) {
+			int words = grid.wordsPerRow();
+			for (int z = 0; z < result.depth; z++) {
+				for (int y = 0; y < result.height; y++) {
+					std::copy(&grid.words[grid.rowIndex(z, y)], &grid.words[grid.rowIndex(z, y)] + words,
+										&result.words[result.rowIndex(y, z)]);
+				}
+			}
+		}
+		else {
+			uint64_t block[64];
+			for (int y = 0; y < grid.height; y++) {
+				for (int z0 = 0; z0 < grid.depth; z0 += 64) {
+					for (int w = 0; w < grid.wordsPerRow(); w++) {
+						for (int i = 0; i < 64; i++) block[i] = z0 + i < grid.depth ? grid.words[grid.rowIndex(y, z0 + i) + w] : 0;
+						transpose64(block);
+						for (int j = 0; j < 64 && 64 * w + j < grid.width; j++) {
+							result.words[result.rowIndex(y, 64 * w + j) + z0 / 64] = block[j];
+						}
+					}
+				}
+			}
+		}
+		grid.width = result.width;
+		grid.height = result.height;
+		grid.depth = result.depth;
+		grid.words.swap(result.words);
+	}
+
+	/*!
+		dst = src shifted by one voxel towards +x (shift 1) or -x (shift -1).
+	*/
+	void shift_row(const uint64_t *src, uint64_t *dst, int words, int shift)
+	{
+		if (shift > 0) {
+			for (int w = words - 1; w > 0; w--) dst[w] = (src[w] << 1) | (src[w - 1] >> 63);
+			dst[0] = src[0] << 1;
+		}
+		else if (shift < 0) {
+			for (int w = 0; w < words - 1; w++) dst[w] = (src[w] >> 1) | (src[w + 1] << 63);
+			dst[words - 1] = src[words - 1] >> 1;
+		}
+		else {
+			std::copy(src, src + words, dst);
+		}
+	}
+
+	/*!
+		The sweep proper, for a direction that is mostly along z. Each z plane
+		is visited once, in the direction of the sweep, and a carry plane holds
+		the running OR of all planes so far. Before it's ORed into the next
+		plane, the carry is moved by the rounded shear of the direction, which
+		is at most one voxel along x and y. All of this works on whole 64-bit
+		words.
+	*/
+	void sweep_planes(VoxelGrid &grid, const Vector3d &d)
+	{
+		int words = grid.wordsPerRow();
+		uint64_t lastMask = ~uint64_t(0) >> (63 - ((grid.width - 1) & 63));
+		double sx = d[0] / fabs(d[2]), sy = d[1] / fabs(d[2]);
+		int step = d[2] > 0 ? 1 : -1;
+		// Only the part of the sweep before the center plane is used
+		double limit = d.dot(Vector3d(grid.width, grid.height, grid.depth) / 2);
+
+		std::vector<uint64_t> carry(size_t(grid.height) * words), prev(carry.size());
+		for (int i = 0; i < grid.depth; i++) {
+			int z = step > 0 ? i : grid.depth - 1 - i;
+			int dx = i == 0 ? 0 : int(floor(i * sx + 0.5)) - int(floor((i - 1) * sx + 0.5));
+			int dy = i == 0 ? 0 : int(floor(i * sy + 0.5)) - int(floor((i - 1) * sy + 0.5));
+			prev.swap(carry);
+			for (int y = 0; y < grid.height; y++) {
+				uint64_t *c = &carry[size_t(y) * words];
+				uint64_t *row = &grid.words[grid.rowIndex(y, z)];
+				if (i > 0 && y - dy >= 0 && y - dy < grid.height) {
+					shift_row(&prev[size_t(y - dy) * words], c, words, dx);
+					c[words - 1] &= lastMask;
+				}
+				else {
+					std::fill(c, c + words, 0);
+				}
+				for (int w = 0; w < words; w++) c[w] |= row[w];
+
+				// Voxel centers with d.p < limit
+				double r = limit - d[1] * (y + 0.5) - d[2] * (z + 0.5);
+				int x0 = 0, x1 = grid.width - 1;
+				if (d[0] > 0) x1 = int(std::min(double(x1), ceil(r / d[0] - 0.5) - 1));
+				else if (d[0] < 0) x0 = int(std::max(double(x0), floor(r / d[0] - 0.5) + 1));
+				else if (r <= 0) continue;
+				for (int w = std::max(0, x0 >> 6); x0 <= x1 && w <= x1 >> 6; w++) {
+					uint64_t mask = ~uint64_t(0);
+					if (w == x0 >> 6) mask &= ~uint64_t(0) << (x0 & 63);
+					if (w == x1 >> 6) mask &= ~uint64_t(0) >> (63 - (x1 & 63));
+					row[w] |= c[w] & mask;
+				}
+			}
+		}
+	}
+}
+
+/*!
+	Extends every occupied voxel along the given direction (in grid axes),
+	i.e. the volume swept by the part when it's inserted along that
+	direction. As in the original glutMarch sweep, only voxels in front of
+	the plane through the grid center, normal to direction, are added.
+
+	Directions which aren't mostly along z are handled by temporarily
+	swapping the dominant axis with z.
+*/
+void sweep_voxels(VoxelGrid &grid, const Vector3d &direction)
+{
+	if (grid.words.empty() || direction.norm() == 0) return;
+	Vector3d d = direction.normalized();
+	int axis = 2;
+	if (fabs(d[0]) > fabs(d[axis])) axis = 0;
+	if (fabs(d[1]) > fabs(d[axis])) axis = 1;
+	if (axis != 2) {
+		swap_axes(grid, axis);
+		std::swap(d[axis], d[2]);
+	}
+	sweep_planes(grid, d);
+	if (axis != 2) swap_axes(grid, axis);
+}
@@ -0,0 +1,59 @@
+#ifndef VOXELIZER_H_
+#define VOXELIZER_H_
+
+#include "linalg.h"
+#include <vector>
+#include <algorithm>
+#ifdef WIN32
+typedef unsigned __int64 uint64_t;
+#else
+#include <stdint.h>
+#endif
+
+class PolySet;
+
+/*!
+	Dense occupancy grid with one bit per voxel.
+
+	Rows along x are packed into 64-bit words, so a (y,z) row occupies
+	wordsPerRow() consecutive words and a z plane occupies height*wordsPerRow()
+	words. The grid covers the cube [translate, translate + scale] in world
+	space, split into width x height x depth voxels. This is the same
+	translate/scale convention as the .binvox format.
+*/
+class VoxelGrid
+{
+public:
+	VoxelGrid(int width = 0, int height = 0, int depth = 0);
+
+	int width, height, depth;
+	double scale;
+	Vector3d translate;
+	std::vector<uint64_t> words;
+
+	int wordsPerRow() const { return (this->width + 63) / 64; }
+	size_t rowIndex(int y, int z) const { return (size_t(z) * this->height + y) * wordsPerRow(); }
+
+	bool get(int x, int y, int z) const {
+		return (this->words[rowIndex(y, z) + (x >> 6)] >> (x & 63)) & 1;
+	}
+	void set(int x, int y, int z) {
+		this->words[rowIndex(y, z) + (x >> 6)] |= uint64_t(1) << (x & 63);
+	}
+	void fillRow(int y, int z, int x0, int x1);
+	uint64_t getRun(int x, int y, int z, int n) const;
+
+	bool inside(int x, int y, int z) const {
+		return x >= 0 && y >= 0 && z >= 0 && x < this->width && y < this->height && z < this->depth;
+	}
+	double voxelSize() const { return this->scale / std::max(this->width, std::max(this->height, this->depth)); }
+	Vector3d voxelMin(int x, int y, int z) const { return this->translate + voxelSize() * Vector3d(x, y, z); }
+
+	size_t count() const;
+	size_t memsize() const { return this->words.size() * sizeof(uint64_t); }
+};
+
+VoxelGrid *voxelize(const PolySet &ps, int resolution, int threads = 0);
+void sweep_voxels(VoxelGrid &grid, const Vector3d &direction);
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ *  OpenSCAD (www.openscad.org)
+ *  Copyright (C) 2009-2011 Clifford Wolf <clifford@clifford.at> and
+ *                          Marius Kintel <marius@kintel.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  As a special exception, you have permission to link this program
+ *  with the CGAL library and distribute executables, as long as you
+ *  follow the requirements of the GNU GPL in regard to all of the
+ *  software in the executable aside from CGAL.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+	Evaluates each top level object of a file with CGAL and writes its
+	exact bounding box, for operations whose result can be checked by
+	hand that way, like sweep().
+*/
+
+#include "tests-common.h"
+#include "openscad.h"
+#include "parsersettings.h"
+#include "node.h"
+#include "module.h"
+#include "modcontext.h"
+#include "value.h"
+#include "builtin.h"
+#include "Tree.h"
+#include "CGAL_Nef_polyhedron.h"
+#include "CGALEvaluator.h"
+#include "PolySetCGALEvaluator.h"
+#include "cgalutils.h"
+
+#include <iostream>
+#include <fstream>
+#include <boost/foreach.hpp>
+
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+#include "boosty.h"
+
+std::string commandline_commands;
+std::string currentdir;
+
+using std::string;
+
+int main(int argc, char **argv)
+{
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s <file.scad> <output.txt>\n", argv[0]);
+		exit(1);
+	}
+
+	const char *filename = argv[1];
+	const char *outfilename = argv[2];
+
+	Builtins::instance()->initialize();
+
+	fs::path original_path = fs::current_path();
+
+	currentdir = boosty::stringy( fs::current_path() );
+
+	parser_init(boosty::stringy(fs::path(argv[0]).branch_path()));
+	add_librarydir(boosty::stringy(fs::path(argv[0]).branch_path() / "../libraries"));
+
+	ModuleContext top_ctx;
+	top_ctx.registerBuiltin();
+
+	FileModule *root_module;
+	ModuleInstantiation root_inst("group");
+
+	root_module = parsefile(filename);
+	if (!root_module) {
+		exit(1);
+	}
+
+	if (fs::path(filename).has_parent_path()) {
+		fs::current_path(fs::path(filename).parent_path());
+	}
+
+	AbstractNode::resetIndexCounter();
+	AbstractNode *root_node = root_module->instantiate(&top_ctx, &root_inst);
+
+	Tree tree(root_node);
+
+	CGALEvaluator cgalevaluator(tree);
+	PolySetCGALEvaluator psevaluator(cgalevaluator);
+
+	std::ofstream outfile;
+	outfile.open(outfilename);
+	int count = 0;
+	BOOST_FOREACH(const AbstractNode *child, root_node->getChildren()) {
+		CGAL_Nef_polyhedron N = cgalevaluator.evaluateCGALMesh(*child);
+		outfile << ++count << " " << child->name() << ": ";
+		if (N.isNull() || N.isEmpty()) {
+			outfile << "empty\n";
+		}
+		else if (N.dim != 3) {
+			outfile << "not a 3D object\n";
+		}
+		else {
+			CGAL_Iso_cuboid_3 box = bounding_box(*N.p3);
+			outfile << "[" << CGAL::to_double(box.xmin()) << ", " << CGAL::to_double(box.ymin()) << ", " <<
+				CGAL::to_double(box.zmin()) << "] - [" << CGAL::to_double(box.xmax()) << ", " <<
+				CGAL::to_double(box.ymax()) << ", " << CGAL::to_double(box.zmax()) << "]";
+			if (!N.p3->is_simple()) outfile << ", not a valid 2-manifold";
+			outfile << "\n";
+		}
+	}
+	outfile.close();
+	current_path(original_path);
+
+	delete root_node;
+	Builtins::instance(true);
+
+	return 0;
+}
@@ -0,0 +1,287 @@
+/*
+ *  OpenSCAD (www.openscad.org)
+ *  Copyright (C) 2009-2011 Clifford Wolf <clifford@clifford.at> and
+ *                          Marius Kintel <marius@kintel.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  As a special exception, you have permission to link this program
+ *  with the CGAL library and distribute executables, as long as you
+ *  follow the requirements of the GNU GPL in regard to all of the
+ *  software in the executable aside from CGAL.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+	Evaluates a file with CGAL, exports it as binary STL, OFF and PLY and
+	reads each file back. The meshes are written with their vertices
+	sorted and each face starting at its lowest vertex, so the result
+	doesn't depend on the order CGAL enumerates them in. The binary STL is
+	read with import_stl_mesh(); since its triangles depend on how facets
+	are split, only their number, the volume and the area are written.
+*/
+
+#include "tests-common.h"
+#include "openscad.h"
+#include "parsersettings.h"
+#include "node.h"
+#include "module.h"
+#include "modcontext.h"
+#include "value.h"
+#include "builtin.h"
+#include "Tree.h"
+#include "CGAL_Nef_polyhedron.h"
+#include "CGALEvaluator.h"
+#include "PolySetCGALEvaluator.h"
+#include "export.h"
+#include "importnode.h"
+#include "indexedmesh.h"
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <string.h>
+#include <boost/cstdint.hpp>
+#include <boost/foreach.hpp>
+
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+#include "boosty.h"
+
+std::string commandline_commands;
+std::string currentdir;
+
+using std::string;
+
+typedef std::vector<int> Face;
+
+struct VertexLess
+{
+	VertexLess(const std::vector<Vector3d> &vertices) : vertices(vertices) {}
+	bool operator()(int a, int b) const {
+		const Vector3d &u = this->vertices[a], &v = this->vertices[b];
+		return u[0] != v[0] ? u[0] < v[0] : u[1] != v[1] ? u[1] < v[1] : u[2] < v[2];
+	}
+	const std::vector<Vector3d> &vertices;
+};
+
+/*!
+	Writes the vertices in sorted order, and returns the new index of each.
+*/
+static std::vector<int> write_vertices(std::ostream &out, const std::vector<Vector3d> &vertices)
+{
+	std::vector<int> order(vertices.size());
+	for (size_t i = 0; i < order.size(); i++) order[i] = i;
+	std::sort(order.begin(), order.end(), VertexLess(vertices));
+	std::vector<int> index(vertices.size());
+	out << "vertices: " << vertices.size() << "\n";
+	for (size_t i = 0; i < order.size(); i++) {
+		const Vector3d &v = vertices[order[i]];
+		out << "  " << i << ": [" << v[0] << ", " << v[1] << ", " << v[2] << "]\n";
+		index[order[i]] = i;
+	}
+	return index;
+}
+
+static void write_mesh(std::ostream &out, const std::vector<Vector3d> &vertices, const std::vector<Face> &faces)
+{
+	std::vector<int> index = write_vertices(out, vertices);
+	std::vector<Face> sorted;
+	BOOST_FOREACH(const Face &face, faces) {
+		Face f;
+		BOOST_FOREACH(int v, face) f.push_back(index[v]);
+		std::rotate(f.begin(), std::min_element(f.begin(), f.end()), f.end());
+		sorted.push_back(f);
+	}
+	std::sort(sorted.begin(), sorted.end());
+	out << "faces: " << sorted.size() << "\n";
+	BOOST_FOREACH(const Face &f, sorted) {
+		out << " ";
+		BOOST_FOREACH(int v, f) out << " " << v;
+		out << "\n";
+	}
+}
+
+static void write_binstl(std::ostream &out, CGAL_Nef_polyhedron &N, const string &filename)
+{
+	std::ofstream file(filename.c_str(), std::ios::out | std::ios::binary);
+	export_mesh(&N, EXPORT_STL_BINARY, file);
+	file.close();
+	IndexedMesh *mesh = import_stl_mesh(filename, 1);
+	fs::remove(filename);
+	if (!mesh) {
+		out << "No mesh\n";
+		return;
+	}
+	write_vertices(out, mesh->vertices);
+	double volume = 0, area = 0;
+	for (size_t i = 0; i < mesh->numTriangles(); i++) {
+		const int *t = &mesh->triangles[3 * i];
+		const Vector3d &a = mesh->vertices[t[0]], &b = mesh->vertices[t[1]], &c = mesh->vertices[t[2]];
+		volume += a.dot(b.cross(c)) / 6;
+		area += (b - a).cross(c - a).norm() / 2;
+	}
+	out << "triangles: " << mesh->numTriangles() << "\n";
+	out << "volume: " << volume << "\n";
+	out << "area: " << area << "\n";
+	delete mesh;
+}
+
+static void write_off(std::ostream &out, CGAL_Nef_polyhedron &N)
+{
+	std::stringstream file;
+	export_mesh(&N, EXPORT_OFF, file);
+	string magic;
+	size_t nvertices, nfaces, nedges;
+	file >> magic >> nvertices >> nfaces >> nedges;
+	if (magic != "OFF") {
+		out << "Not an OFF file\n";
+		return;
+	}
+	std::vector<Vector3d> vertices(nvertices);
+	for (size_t i = 0; i < nvertices; i++) file >> vertices[i][0] >> vertices[i][1] >> vertices[i][2];
+	std::vector<Face> faces(nfaces);
+	for (size_t i = 0; i < nfaces; i++) {
+		size_t degree;
+		file >> degree;
+		faces[i].resize(degree);
+		for (size_t j = 0; j < degree; j++) file >> faces[i][j];
+	}
+	if (!file) {
+		out << "Truncated OFF file\n";
+		return;
+	}
+	write_mesh(out, vertices, faces);
+}
+
+static uint32_t read_uint32(std::istream &file)
+{
+	unsigned char bytes[4];
+	file.read((char *)bytes, 4);
+	return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (uint32_t(bytes[3]) << 24);
+}
+
+static void write_ply(std::ostream &out, CGAL_Nef_polyhedron &N)
+{
+	std::stringstream file(std::ios::in | std::ios::out | std::ios::binary);
+	export_mesh(&N, EXPORT_PLY, file);
+	size_t nvertices = 0, nfaces = 0;
+	string line;
+	while (std::getline(file, line) && line != "end_header") {
+		std::stringstream words(line);
+		string keyword, element;
+		words >> keyword >> element;
+		if (keyword == "format" && element != "binary_little_endian") {
+			out << "Not binary little endian PLY\n";
+			return;
+		}
+		if (keyword == "element" && element == "vertex") words >> nvertices;
+		if (keyword == "element" && element == "face") words >> nfaces;
+	}
+	std::vector<Vector3d> vertices(nvertices);
+	for (size_t i = 0; i < nvertices; i++) {
+		for (int j = 0; j < 3; j++) {
+			uint32_t u = read_uint32(file);
+			float x;
+			memcpy(&x, &u, 4);
+			vertices[i][j] = x;
+		}
+	}
+	std::vector<Face> faces(nfaces);
+	for (size_t i = 0; i < nfaces; i++) {
+		faces[i].resize((unsigned char)file.get());
+		for (size_t j = 0; j < faces[i].size(); j++) faces[i][j] = read_uint32(file);
+	}
+	if (!file) {
+		out << "Truncated PLY file\n";
+		return;
+	}
+	write_mesh(out, vertices, faces);
+}
+
+int main(int argc, char **argv)
+{
+#ifdef _MSC_VER
+  _set_output_format(_TWO_DIGIT_EXPONENT);
+#endif
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s <file.scad> <output.txt>\n", argv[0]);
+		exit(1);
+	}
+
+	const char *filename = argv[1];
+	const char *outfilename = argv[2];
+
+	Builtins::instance()->initialize();
+
+	fs::path original_path = fs::current_path();
+
+	currentdir = boosty::stringy( fs::current_path() );
+
+	parser_init(boosty::stringy(fs::path(argv[0]).branch_path()));
+	add_librarydir(boosty::stringy(fs::path(argv[0]).branch_path() / "../libraries"));
+
+	ModuleContext top_ctx;
+	top_ctx.registerBuiltin();
+
+	FileModule *root_module;
+	ModuleInstantiation root_inst("group");
+
+	root_module = parsefile(filename);
+	if (!root_module) {
+		exit(1);
+	}
+
+	if (fs::path(filename).has_parent_path()) {
+		fs::current_path(fs::path(filename).parent_path());
+	}
+
+	AbstractNode::resetIndexCounter();
+	AbstractNode *root_node = root_module->instantiate(&top_ctx, &root_inst);
+
+	Tree tree(root_node);
+
+	CGALEvaluator cgalevaluator(tree);
+	PolySetCGALEvaluator psevaluator(cgalevaluator);
+
+	CGAL_Nef_polyhedron N = cgalevaluator.evaluateCGALMesh(*root_node);
+
+	current_path(original_path);
+	std::ofstream outfile;
+	outfile.open(outfilename);
+	if (!outfile.is_open()) {
+		fprintf(stderr, "Error: Unable to open output file %s\n", outfilename);
+		exit(1);
+	}
+	if (N.isNull() || N.isEmpty() || N.dim != 3) {
+		outfile << "Not a 3D object\n";
+	}
+	else {
+		outfile << "binstl\n";
+		write_binstl(outfile, N, string(outfilename) + ".stl");
+		outfile << "off\n";
+		write_off(outfile, N);
+		outfile << "ply\n";
+		write_ply(outfile, N);
+	}
+	outfile.close();
+
+	delete root_node;
+	delete root_module;
+	Builtins::instance(true);
+
+	return 0;
+}
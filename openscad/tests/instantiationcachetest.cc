@@ -0,0 +1,187 @@
+/*
+ *  OpenSCAD (www.openscad.org)
+ *  Copyright (C) 2009-2011 Clifford Wolf <clifford@clifford.at> and
+ *                          Marius Kintel <marius@kintel.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  As a special exception, you have permission to link this program
+ *  with the CGAL library and distribute executables, as long as you
+ *  follow the requirements of the GNU GPL in regard to all of the
+ *  software in the executable aside from CGAL.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+	Compiles a file several times the way the GUI does, with an
+	InstantiationCache and a Tree kept across the compiles, and reports
+	which top level nodes were reused. Between the compiles it changes the
+	variable step, the contents of instantiationcache.dat next to the
+	output file (keeping its size and modification time), and a node of the
+	tree in place. Every tree is compared with one compiled from scratch.
+*/
+
+#include "tests-common.h"
+#include "openscad.h"
+#include "parsersettings.h"
+#include "node.h"
+#include "module.h"
+#include "modcontext.h"
+#include "value.h"
+#include "builtin.h"
+#include "instantiationcache.h"
+#include "Tree.h"
+
+#include <assert.h>
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <set>
+
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+#include "boosty.h"
+
+std::string commandline_commands;
+std::string currentdir;
+
+using std::string;
+
+static void writefile(const fs::path &path, const string &text, time_t mtime)
+{
+	std::ofstream ofs(boosty::stringy(path).c_str(), std::ios::out | std::ios::binary);
+	ofs << text;
+	ofs.close();
+	fs::last_write_time(path, mtime);
+}
+
+static string yesno(bool b)
+{
+	return b ? "yes" : "no";
+}
+
+int main(int argc, char **argv)
+{
+#ifdef _MSC_VER
+  _set_output_format(_TWO_DIGIT_EXPONENT);
+#endif
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s <file.scad> <output.txt>\n", argv[0]);
+		exit(1);
+	}
+
+	const char *filename = argv[1];
+	const char *outfilename = argv[2];
+
+	Builtins::instance()->initialize();
+
+	currentdir = boosty::stringy(fs::current_path());
+
+	parser_init(boosty::stringy(fs::path(argv[0]).branch_path()));
+	add_librarydir(boosty::stringy(fs::path(argv[0]).branch_path() / "../libraries"));
+
+	// Relative file names in the test file refer to the output directory
+	fs::path outdir = boosty::absolute(fs::path(outfilename)).parent_path();
+	fs::path datafile = outdir / "instantiationcache.dat";
+	time_t mtime = time(NULL);
+	writefile(datafile, "1 2\n3 4\n", mtime);
+
+	// Enough threads to evaluate long for loops in parallel
+	instantiation_threads = 2;
+
+	ModuleContext top_ctx;
+	top_ctx.registerBuiltin();
+	top_ctx.setDocumentPath(boosty::stringy(outdir));
+	ModuleInstantiation root_inst("group");
+
+	InstantiationCache cache;
+	Tree tree;
+	FileModule *root_module = NULL;
+	AbstractNode *root_node = NULL;
+
+	std::stringstream out;
+	const char *steps[] = {
+		"first compile",
+		"unchanged",
+		"step changed",
+		"instantiationcache.dat changed",
+		"node 0 modified in place"
+	};
+	for (int i = 0; i < 5; i++) {
+		if (i == 2) top_ctx.set_variable("step", Value(1.0));
+		else if (i == 0) top_ctx.set_variable("step", Value(0.0));
+		if (i == 3) writefile(datafile, "5 6\n7 8\n", mtime);
+		if (i == 4) {
+			AbstractNode *node = root_node->children[0];
+			node->children.push_back(new AbstractNode(&root_inst));
+			tree.invalidate(*node);
+			cache.invalidate(*root_node, *node);
+			Tree fresh(root_node);
+			out << "modified tree matches fresh tree: " <<
+				yesno(tree.getString(*root_node) == fresh.getString(*root_node) &&
+							tree.getIdString(*root_node) == fresh.getIdString(*root_node)) << "\n";
+		}
+
+		cache.retire(root_module);
+		root_module = parsefile(filename, boosty::stringy(outdir).c_str());
+		if (!root_module) {
+			fprintf(stderr, "Error: Unable to parse input file\n");
+			exit(1);
+		}
+
+		std::set<const AbstractNode *> oldchildren;
+		if (root_node) oldchildren.insert(root_node->children.begin(), root_node->children.end());
+
+		bool incremental = cache.beginCompile();
+		AbstractNode *oldroot = root_node;
+		root_node = root_module->instantiate(&top_ctx, &root_inst);
+		cache.endCompile(oldroot, root_node);
+		if (incremental) tree.updateRoot(root_node);
+		else tree.setRoot(root_node);
+
+		out << "compile " << i << ": " << steps[i] << "\n";
+		for (size_t j = 0; j < root_node->children.size(); j++) {
+			const AbstractNode *node = root_node->children[j];
+			out << "  " << j << " " << node->name() << ": " <<
+				(oldchildren.find(node) != oldchildren.end() ? "reused" : "evaluated") << "\n";
+		}
+
+		FileModule *fresh_module = parsefile(filename, boosty::stringy(outdir).c_str());
+		AbstractNode *fresh_node = fresh_module->instantiate(&top_ctx, &root_inst);
+		Tree fresh(fresh_node);
+		out << "  matches fresh compile: " <<
+			yesno(tree.getString(*root_node) == fresh.getString(*fresh_node) &&
+						tree.getIdString(*root_node) == fresh.getIdString(*fresh_node)) << "\n";
+		delete fresh_node;
+		delete fresh_module;
+	}
+
+	delete root_node;
+	cache.retire(root_module);
+	fs::remove(datafile);
+
+	std::ofstream outfile;
+	outfile.open(outfilename);
+	if (!outfile.is_open()) {
+		fprintf(stderr, "Error: Unable to open output file %s\n", outfilename);
+		exit(1);
+	}
+	outfile << out.str();
+	outfile.close();
+
+	Builtins::instance(true);
+
+	return 0;
+}
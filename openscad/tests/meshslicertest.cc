@@ -0,0 +1,99 @@
+/*
+ *  OpenSCAD (www.openscad.org)
+ *  Copyright (C) 2009-2011 Clifford Wolf <clifford@clifford.at> and
+ *                          Marius Kintel <marius@kintel.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  As a special exception, you have permission to link this program
+ *  with the CGAL library and distribute executables, as long as you
+ *  follow the requirements of the GNU GPL in regard to all of the
+ *  software in the executable aside from CGAL.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+	Slices an STL file with slice_mesh() at z=0 and writes the outlines
+	and the warnings.
+*/
+
+#include "tests-common.h"
+#include "importnode.h"
+#include "indexedmesh.h"
+#include "meshslicer.h"
+#include "polyset.h"
+#include "dxfdata.h"
+#include "printutils.h"
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+
+std::string commandline_commands;
+std::string currentdir;
+
+static void outfile_handler(const std::string &msg, void *userdata) {
+	std::ostream *str = static_cast<std::ostream*>(userdata);
+	*str << msg << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+#ifdef _MSC_VER
+  _set_output_format(_TWO_DIGIT_EXPONENT);
+#endif
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s <file.stl> <output.txt>\n", argv[0]);
+		exit(1);
+	}
+
+	const char *filename = argv[1];
+	const char *outfilename = argv[2];
+
+	IndexedMesh *mesh = import_stl_mesh(filename, 1);
+	if (!mesh) {
+		fprintf(stderr, "Error: Unable to read %s\n", filename);
+		exit(1);
+	}
+	PolySet *ps = mesh->toPolySet();
+	delete mesh;
+
+	std::ofstream outfile;
+	outfile.open(outfilename);
+	if (!outfile.is_open()) {
+		fprintf(stderr, "Error: Unable to open output file %s\n", outfilename);
+		exit(1);
+	}
+
+	set_output_handler(&outfile_handler, &outfile);
+	DxfData *dd = slice_mesh(*ps, Transform3d::Identity());
+	set_output_handler(NULL, NULL);
+
+	outfile << "paths: " << dd->paths.size() << "\n";
+	for (size_t i = 0; i < dd->paths.size(); i++) {
+		const DxfData::Path &path = dd->paths[i];
+		outfile << "  " << (path.is_closed ? "closed" : "open") << ":";
+		for (size_t j = 0; j < path.indices.size(); j++) {
+			const Vector2d &p = dd->points[path.indices[j]];
+			outfile << " [" << p[0] << ", " << p[1] << "]";
+		}
+		outfile << "\n";
+	}
+	outfile.close();
+
+	delete dd;
+	delete ps;
+	return 0;
+}
@@ -0,0 +1,144 @@
+/*
+ *  OpenSCAD (www.openscad.org)
+ *  Copyright (C) 2009-2011 Clifford Wolf <clifford@clifford.at> and
+ *                          Marius Kintel <marius@kintel.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  As a special exception, you have permission to link this program
+ *  with the CGAL library and distribute executables, as long as you
+ *  follow the requirements of the GNU GPL in regard to all of the
+ *  software in the executable aside from CGAL.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+	Parses a file twice with the disk cache enabled, like
+	openscad --disk-cache would, clearing the module cache in between.
+	Writes the dumps of the libraries it uses, which are parsed the first
+	time and loaded from the disk cache the second, and whether both
+	dumps are the same.
+*/
+
+#include "tests-common.h"
+#include "openscad.h"
+#include "parsersettings.h"
+#include "module.h"
+#include "ModuleCache.h"
+#include "DiskCache.h"
+#include "builtin.h"
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <map>
+#include <boost/foreach.hpp>
+
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+#include "boosty.h"
+
+std::string commandline_commands;
+std::string currentdir;
+
+using std::string;
+
+/*!
+	Collects the dumps of the libraries used by module and by those
+	libraries, by file name.
+*/
+static void dump_libraries(const FileModule &module, std::map<string, string> &dumps)
+{
+	BOOST_FOREACH(const string &lib, module.usedlibs) {
+		string filename = boosty::stringy(find_valid_path(module.modulePath(), lib));
+		FileModule *libmod = ModuleCache::instance()->lookup(filename);
+		string leaf = boosty::stringy(fs::path(filename).filename());
+		if (!libmod || dumps.find(leaf) != dumps.end()) continue;
+		dumps[leaf] = libmod->dump("", "");
+		dump_libraries(*libmod, dumps);
+	}
+}
+
+static string parse_and_dump(const char *filename)
+{
+	FileModule *root_module = parsefile(filename);
+	if (!root_module) return "Unable to parse input file\n";
+
+	std::map<string, string> dumps;
+	dump_libraries(*root_module, dumps);
+	delete root_module;
+
+	std::stringstream out;
+	typedef std::map<string, string>::value_type Dump;
+	BOOST_FOREACH(const Dump &dump, dumps) {
+		out << "// " << dump.first << "\n" << dump.second << "\n";
+	}
+	return out.str();
+}
+
+int main(int argc, char **argv)
+{
+#ifdef _MSC_VER
+  _set_output_format(_TWO_DIGIT_EXPONENT);
+#endif
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s <file.scad> <output.txt>\n", argv[0]);
+		exit(1);
+	}
+
+	const char *filename = argv[1];
+	const char *outfilename = argv[2];
+
+	Builtins::instance()->initialize();
+
+	currentdir = boosty::stringy(fs::current_path());
+
+	parser_init(boosty::stringy(fs::path(argv[0]).branch_path()));
+	add_librarydir(boosty::stringy(fs::path(argv[0]).branch_path() / "../libraries"));
+
+	// Start from an empty disk cache next to the output
+	fs::path cachedir = fs::path(string(outfilename) + "-diskcache");
+	fs::remove_all(cachedir);
+	if (!DiskCache::instance()->setDirectory(boosty::stringy(cachedir))) {
+		fprintf(stderr, "Error: Unable to use disk cache directory %s\n", boosty::stringy(cachedir).c_str());
+		exit(1);
+	}
+
+	string parsed = parse_and_dump(filename);
+	DiskCache::instance()->flush();
+	int files = 0;
+	for (fs::directory_iterator it(cachedir); it != fs::directory_iterator(); ++it) files++;
+
+	ModuleCache::instance()->clear();
+	string loaded = parse_and_dump(filename);
+
+	std::ofstream outfile;
+	outfile.open(outfilename);
+	if (!outfile.is_open()) {
+		fprintf(stderr, "Error: Unable to open output file %s\n", outfilename);
+		exit(1);
+	}
+	outfile << parsed;
+	outfile << "libraries in the disk cache: " << files << "\n";
+	outfile << "same after loading from the disk cache: " << (loaded == parsed ? "yes" : "no") << "\n";
+	outfile.close();
+
+	DiskCache::instance()->setDirectory("");
+	fs::remove_all(cachedir);
+
+	Builtins::instance(true);
+
+	return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ *  OpenSCAD (www.openscad.org)
+ *  Copyright (C) 2009-2011 Clifford Wolf <clifford@clifford.at> and
+ *                          Marius Kintel <marius@kintel.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  As a special exception, you have permission to link this program
+ *  with the CGAL library and distribute executables, as long as you
+ *  follow the requirements of the GNU GPL in regard to all of the
+ *  software in the executable aside from CGAL.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+	Builds the signed distance field of the outlines of a DXF file and
+	checks ScrewPlacer on it: sampleEnergy() against the exact sum of the
+	distances from the inside samples, and place() with a fixed seed on
+	one thread, which must give the same screws every time.
+*/
+
+#include "tests-common.h"
+#include "screwplacer.h"
+#include "polygonindex.h"
+#include "dxfdata.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <math.h>
+
+std::string commandline_commands;
+std::string currentdir;
+
+// Samples across the larger side of the outlines
+static const int RESOLUTION = 96;
+
+int main(int argc, char **argv)
+{
+#ifdef _MSC_VER
+  _set_output_format(_TWO_DIGIT_EXPONENT);
+#endif
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s <file.dxf> <output.txt>\n", argv[0]);
+		exit(1);
+	}
+
+	const char *filename = argv[1];
+	const char *outfilename = argv[2];
+
+	std::ofstream outfile;
+	outfile.open(outfilename);
+	if (!outfile.is_open()) {
+		fprintf(stderr, "Error: Unable to open output file %s\n", outfilename);
+		exit(1);
+	}
+
+	DxfData dd(0, 2, 12, filename);
+	PolygonIndex index(dd);
+	if (index.isEmpty()) {
+		outfile << "No outlines\n";
+		return 0;
+	}
+	double spacing = std::max(index.maxX() - index.minX(), index.maxY() - index.minY()) / RESOLUTION;
+	int width = int((index.maxX() - index.minX()) / spacing) + 1;
+	int height = int((index.maxY() - index.minY()) / spacing) + 1;
+	double clearance = 4 * spacing;
+	DistanceField *field = index.signedDistanceField(index.minX(), index.minY(), spacing, width, height, clearance);
+	ScrewPlacer placer(*field, clearance);
+	outfile << "samples: " << width << " x " << height << "\n";
+	outfile << "inside: " << placer.insideCount() << "\n";
+	outfile << "allowed: " << placer.allowedCount() << "\n";
+
+	std::vector<Vector2d> inside;
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			if (field->get(x, y) < 0) inside.push_back(field->position(x, y));
+		}
+	}
+	double maxError = 0;
+	int checked = 0;
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			if (field->get(x, y) >= 0) continue;
+			Vector2d p = field->position(x, y);
+			double exact = 0;
+			for (size_t i = 0; i < inside.size(); i++) exact += (inside[i] - p).norm();
+			double error = fabs(placer.sampleEnergy(y * width + x) - exact) / exact;
+			maxError = std::max(maxError, error);
+			checked++;
+		}
+	}
+	outfile << "sampleEnergy of " << checked << " samples within 1e-4 of the exact sum: " <<
+		(maxError < 1e-4 ? "yes" : "no") << "\n";
+
+	std::vector<Vector2d> screws, again;
+	double energy = 0, energyAgain = 0;
+	if (!placer.place(3, screws, energy, 1, 1, 42)) {
+		outfile << "No room for screws\n";
+	}
+	else {
+		placer.place(3, again, energyAgain, 1, 1, 42);
+		for (size_t i = 0; i < screws.size(); i++) {
+			outfile << "screw " << i << ": [" << screws[i][0] << ", " << screws[i][1] << "]\n";
+		}
+		outfile << "energy: " << energy << "\n";
+		outfile << "same on second run: " << (screws == again && energy == energyAgain ? "yes" : "no") << "\n";
+	}
+	outfile.close();
+
+	delete field;
+	return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ *  OpenSCAD (www.openscad.org)
+ *  Copyright (C) 2009-2011 Clifford Wolf <clifford@clifford.at> and
+ *                          Marius Kintel <marius@kintel.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  As a special exception, you have permission to link this program
+ *  with the CGAL library and distribute executables, as long as you
+ *  follow the requirements of the GNU GPL in regard to all of the
+ *  software in the executable aside from CGAL.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+	Imports an STL file with import_stl_mesh() and writes the welded
+	vertices, the triangles and the warnings. The import is repeated on
+	several threads, which must give the same result.
+*/
+
+#include "tests-common.h"
+#include "importnode.h"
+#include "indexedmesh.h"
+#include "printutils.h"
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+#include "boosty.h"
+
+std::string commandline_commands;
+std::string currentdir;
+
+using std::string;
+
+static void outfile_handler(const std::string &msg, void *userdata) {
+	std::ostream *str = static_cast<std::ostream*>(userdata);
+	*str << msg << std::endl;
+}
+
+static string import_mesh(const string &filename, int threads)
+{
+	std::stringstream out;
+	set_output_handler(&outfile_handler, &out);
+	IndexedMesh *mesh = import_stl_mesh(filename, threads);
+	set_output_handler(NULL, NULL);
+	if (!mesh) {
+		out << "No mesh\n";
+		return out.str();
+	}
+
+	out << "vertices: " << mesh->vertices.size() << "\n";
+	for (size_t i = 0; i < mesh->vertices.size(); i++) {
+		const Vector3d &v = mesh->vertices[i];
+		out << "  " << i << ": [" << v[0] << ", " << v[1] << ", " << v[2] << "]\n";
+	}
+	out << "triangles: " << mesh->numTriangles() << "\n";
+	for (size_t i = 0; i < mesh->numTriangles(); i++) {
+		const int *t = &mesh->triangles[3 * i];
+		out << "  " << t[0] << " " << t[1] << " " << t[2] << "\n";
+	}
+	delete mesh;
+	return out.str();
+}
+
+int main(int argc, char **argv)
+{
+#ifdef _MSC_VER
+  _set_output_format(_TWO_DIGIT_EXPONENT);
+#endif
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s <file.stl> <output.txt>\n", argv[0]);
+		exit(1);
+	}
+
+	const char *filename = argv[1];
+	const char *outfilename = argv[2];
+
+	std::ofstream outfile;
+	outfile.open(outfilename);
+	if (!outfile.is_open()) {
+		fprintf(stderr, "Error: Unable to open output file %s\n", outfilename);
+		exit(1);
+	}
+
+	// Warnings name the file, so import it from its own directory
+	fs::path path = boosty::absolute(fs::path(filename));
+	fs::current_path(path.parent_path());
+	string leaf = boosty::stringy(path.filename());
+
+	string single = import_mesh(leaf, 1);
+	outfile << single;
+	int threads[] = { 2, 4 };
+	for (int i = 0; i < 2; i++) {
+		outfile << "same on " << threads[i] << " threads: " <<
+			(import_mesh(leaf, threads[i]) == single ? "yes" : "no") << "\n";
+	}
+	outfile.close();
+
+	return 0;
+}